@@ -17,6 +17,7 @@ using Nuclex.Game.States;
 using Nuclex.Input;
 using log4net;
 
+using AngryTanks.Common;
 using AngryTanks.Common.Protocol;
 
 namespace AngryTanks.Client
@@ -121,7 +122,7 @@ namespace AngryTanks.Client
             // Create a new SpriteBatch, which can be used to draw textures.
             spriteBatch = new SpriteBatch(GraphicsDevice);            
 
-            //world.LoadMap(new StreamReader("Content/maps/ducati_style_random.bzw"));
+            //world.LoadMap(WorldMap.Compile("Content/maps/ducati_style_random.bzw", "WorldCache"));
 
             base.LoadContent();
         }
@@ -338,7 +339,8 @@ namespace AngryTanks.Client
             Console.WriteLine("Disconnecting from server.");
             serverLink.Disconnect(reason);
 
-            world.LoadMap(new StreamReader("Content/maps/ducati_style_random.bzw"));
+            // show the bundled map while we're not connected, compiled once and cached after that
+            world.LoadMap(WorldMap.Compile("Content/maps/ducati_style_random.bzw", "WorldCache"));
         }
     }
 }
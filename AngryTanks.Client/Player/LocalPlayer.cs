@@ -37,17 +37,28 @@ namespace AngryTanks.Client
         public LocalPlayer(World world, PlayerInformation playerInfo)
             : base(world, playerInfo)
         {
-            // set our update frequency
-            this.msgUpdateFrequency = new TimeSpan(0, 0, 0, 0, (int)(1000 / (UInt16)World.VarDB["updatesPerSecond"].Value));
-
-            // TODO support if these variables change
-            this.maxVelocity = (Single)World.VarDB["tankSpeed"].Value;
-            this.maxAngularVelocity = (Single)World.VarDB["tankAngVel"].Value;
+            ReadVariables();
 
             inputService = (IInputService)World.IService.GetService(typeof(IInputService));
             inputService.GetKeyboard().KeyPressed += KeyPressed;
         }
 
+        private void ReadVariables()
+        {
+            // set our update frequency
+            this.msgUpdateFrequency = GetUpdateFrequency();
+
+            this.maxVelocity = World.VarDB.TankSpeed.Value;
+            this.maxAngularVelocity = World.VarDB.TankAngVel.Value;
+        }
+
+        protected override void HandleVariableChanged(object sender, VariableChangedEvent e)
+        {
+            ReadVariables();
+
+            base.HandleVariableChanged(sender, e);
+        }
+
         protected override void Dispose(bool disposing)
         {
             if (disposing)
@@ -91,7 +102,7 @@ namespace AngryTanks.Client
                         Byte numActiveShots = (Byte)ActiveShots.Count;
 
                         // is there shot slots left for the player to fire?
-                        Byte maxShots = (Byte)World.VarDB["shotSlots"].Value;
+                        Byte maxShots = World.VarDB.ShotSlots.Value;
 
                         if (numActiveShots >= maxShots)
                             return;
@@ -213,7 +224,7 @@ namespace AngryTanks.Client
                 playerClientUpdateMessage.Write((Byte)playerClientUpdatePacket.MsgType);
                 playerClientUpdatePacket.Write(playerClientUpdateMessage);
 
-                World.ServerLink.SendMessage(playerClientUpdateMessage, NetDeliveryMethod.UnreliableSequenced, 0);
+                World.ServerLink.SendMessage(playerClientUpdateMessage, playerClientUpdatePacket.MsgType);
             }
         }
 
@@ -233,7 +244,7 @@ namespace AngryTanks.Client
                 // we shall die
                 Die(shot.Player);
 
-                // now end that shot
+                // now end that shot, hitting a tank is the one thing nobody else can work out from its path
                 shot.End(false, true);
             }
         }
@@ -262,7 +273,7 @@ namespace AngryTanks.Client
             deathMessage.Write((Byte)deathPacket.MsgType);
             deathPacket.Write(deathMessage);
 
-            World.ServerLink.SendMessage(deathMessage, NetDeliveryMethod.ReliableOrdered, 0);
+            World.ServerLink.SendMessage(deathMessage, deathPacket.MsgType);
 
             // write to console that you were killed
             ConsoleMessageLine consoleMessage;
@@ -284,19 +295,19 @@ namespace AngryTanks.Client
             base.Die(killer);
         }
 
-        protected override void Shoot(Byte shotSlot, Vector2 initialPosition, Single rotation, Vector2 initialVelocity, bool local)
+        protected override void Shoot(Byte shotSlot, Vector2 initialPosition, Single rotation, UInt32 startTick, bool local)
         {
-            // send out the shot begin packet right away
+            // send out the shot begin packet right away, it is the only message the shot needs unless it hits a tank
             NetOutgoingMessage shotBeginMessage = World.ServerLink.CreateMessage();
 
-            MsgBeginShotPacket shotBeginPacket = new MsgBeginShotPacket(shotSlot, initialPosition, rotation, initialVelocity);
+            MsgBeginShotPacket shotBeginPacket = new MsgBeginShotPacket(shotSlot, initialPosition, rotation, startTick);
 
             shotBeginMessage.Write((Byte)shotBeginPacket.MsgType);
             shotBeginPacket.Write(shotBeginMessage);
 
-            World.ServerLink.SendMessage(shotBeginMessage, NetDeliveryMethod.ReliableUnordered, 0);
+            World.ServerLink.SendMessage(shotBeginMessage, shotBeginPacket.MsgType);
 
-            base.Shoot(shotSlot, initialPosition, rotation, initialVelocity, local);
+            base.Shoot(shotSlot, initialPosition, rotation, startTick, local);
         }
     }
 }
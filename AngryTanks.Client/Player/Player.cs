@@ -99,6 +99,7 @@ namespace AngryTanks.Client
             explosion.Running = false;
 
             World.ServerLink.MessageReceivedEvent += HandleReceivedMessage;
+            World.VarDB.VariableChanged += HandleVariableChanged;
         }
 
         ~Player()
@@ -118,6 +119,7 @@ namespace AngryTanks.Client
                 return;
 
             World.ServerLink.MessageReceivedEvent -= HandleReceivedMessage;
+            World.VarDB.VariableChanged -= HandleVariableChanged;
         }
 
         protected static Texture2D GetTexture(World world, PlayerInformation playerInfo)
@@ -136,8 +138,24 @@ namespace AngryTanks.Client
 
         protected static Vector2 GetTankSize(World world, PlayerInformation playerInfo)
         {
-            return new Vector2((Single)world.VarDB["tankWidth"].Value,
-                               (Single)world.VarDB["tankLength"].Value);
+            return new Vector2(world.VarDB.TankWidth.Value, world.VarDB.TankLength.Value);
+        }
+
+        /// <summary>
+        /// Gets the time between position updates from the variables.
+        /// </summary>
+        protected TimeSpan GetUpdateFrequency()
+        {
+            return new TimeSpan(0, 0, 0, 0, (int)(1000 / World.VarDB.UpdatesPerSecond.Value));
+        }
+
+        /// <summary>
+        /// Picks up changes to the variables the server sends mid-game.
+        /// </summary>
+        protected virtual void HandleVariableChanged(object sender, VariableChangedEvent e)
+        {
+            if (e.Variable == World.VarDB.TankWidth || e.Variable == World.VarDB.TankLength)
+                Size = GetTankSize(World, PlayerInfo);
         }
 
         public override void Update(GameTime gameTime)
@@ -266,17 +284,26 @@ namespace AngryTanks.Client
         protected virtual void Shoot(Byte shotSlot, bool local)
         {
             // get starting position
-            Single tankLength = (Single)World.VarDB["tankLength"].Value;
+            Single tankLength = World.VarDB.TankLength.Value;
             Vector2 initialPosition = Position + new Vector2((tankLength / 2) * (Single)Math.Cos(Rotation - Math.PI / 2),
                                                              (tankLength / 2) * (Single)Math.Sin(Rotation - Math.PI / 2));
 
-            Shoot(shotSlot, initialPosition, Rotation, Velocity, local);
+            Shoot(shotSlot, initialPosition, Rotation, ShotPath.ToTick(World.ServerLink.ServerTime), local);
+        }
+
+        protected virtual void Shoot(Byte shotSlot, Vector2 initialPosition, Single rotation, UInt32 startTick, bool local)
+        {
+            // create the shot, its whole flight is known from here on
+            Shots[shotSlot] = new Shot(World, this, shotSlot, local, World.CreateShotPath(initialPosition, rotation, startTick));
         }
 
-        protected virtual void Shoot(Byte shotSlot, Vector2 initialPosition, Single rotation, Vector2 initialVelocity, bool local)
+        /// <summary>
+        /// Works out our shots again against the loaded map, from where and when they were fired.
+        /// </summary>
+        public void RebuildShotPaths()
         {
-            // create the shot
-            Shots[shotSlot] = new Shot(World, this, shotSlot, local, initialPosition, Rotation, Velocity);
+            foreach (Shot shot in Shots.Values)
+                shot.Rebuild(World.CreateShotPath(shot.Path.Origin, shot.Path.Rotation, shot.Path.StartTick));
         }
 
         /// <summary>
@@ -43,6 +43,16 @@ namespace AngryTanks.Client
             }
         }
 
+        private Leaderboard<Byte> leaderboard = new Leaderboard<Byte>();
+
+        /// <summary>
+        /// Gets every player's score by slot, in rank order.
+        /// </summary>
+        public Leaderboard<Byte> Leaderboard
+        {
+            get { return leaderboard; }
+        }
+
         public List<Shot> AllActiveShots
         {
             get
@@ -98,6 +108,7 @@ namespace AngryTanks.Client
                 remotePlayer.Dispose();
 
             remotePlayers.Clear();
+            leaderboard.Clear();
 
             if (localPlayer != null)
             {
@@ -124,6 +135,18 @@ namespace AngryTanks.Client
                 remotePlayer.Draw(gameTime, spriteBatch);
         }
 
+        /// <summary>
+        /// Works out every shot in the air again against the map that was just loaded.
+        /// </summary>
+        public void RebuildShotPaths()
+        {
+            if (localPlayer != null)
+                localPlayer.RebuildShotPaths();
+
+            foreach (RemotePlayer remotePlayer in remotePlayers.Values)
+                remotePlayer.RebuildShotPaths();
+        }
+
         private void HandleReceivedMessage(object sender, ServerLinkMessageEvent message)
         {
             switch (message.MessageType)
@@ -142,7 +165,39 @@ namespace AngryTanks.Client
                         if (!packet.AddMyself)
                             AddPlayer(packet.Player);
                         else
-                            localPlayer = new LocalPlayer(world, packet.Player);
+                            AddLocalPlayer(packet.Player);
+
+                        break;
+                    }
+
+                case MessageType.MsgJoinSnapshot:
+                    {
+                        MsgJoinSnapshotPacket packet = (MsgJoinSnapshotPacket)message.MessageData;
+
+                        foreach (JoinSnapshotEntry entry in packet.Players)
+                        {
+                            Player player;
+
+                            if (entry.Player.Slot == packet.Slot)
+                            {
+                                player = AddLocalPlayer(entry.Player);
+                            }
+                            else
+                            {
+                                world.Console.WriteLine(String.Format("{0} is on the {1}",
+                                                        entry.Player.Callsign, entry.Player.Team));
+
+                                AddPlayer(entry.Player);
+                                player = remotePlayers[entry.Player.Slot];
+                            }
+
+                            player.Score = entry.Score;
+                            leaderboard.Set(player.Slot, entry.Score);
+
+                            // put anyone already in play where they are
+                            if (entry.State == PlayerState.Alive)
+                                player.Spawn(entry.Position, entry.Rotation);
+                        }
 
                         break;
                     }
@@ -158,6 +213,15 @@ namespace AngryTanks.Client
                         break;
                     }
 
+                case MessageType.MsgScore:
+                    {
+                        MsgScorePacket packet = (MsgScorePacket)message.MessageData;
+
+                        leaderboard.Set(packet.Slot, packet.Score);
+
+                        break;
+                    }
+
                 default:
                     break;
             }            
@@ -171,6 +235,15 @@ namespace AngryTanks.Client
         {
             // add player to our list
             remotePlayers[playerInfo.Slot] = new RemotePlayer(world, playerInfo);
+            leaderboard.Set(playerInfo.Slot, remotePlayers[playerInfo.Slot].Score);
+        }
+
+        private LocalPlayer AddLocalPlayer(PlayerInformation playerInfo)
+        {
+            localPlayer = new LocalPlayer(world, playerInfo);
+            leaderboard.Set(playerInfo.Slot, localPlayer.Score);
+
+            return localPlayer;
         }
 
         /// <summary>
@@ -183,6 +256,7 @@ namespace AngryTanks.Client
 
             // nuke player from the dictionary
             remotePlayers.Remove(slot);
+            leaderboard.Remove(slot);
 
             // dispose of remote player
             remotePlayer.Dispose();
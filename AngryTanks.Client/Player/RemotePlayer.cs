@@ -32,7 +32,7 @@ namespace AngryTanks.Client
             this.lastMsgUpdate = new TimeSpan();
 
             // set our update frequency
-            this.msgUpdateFrequency = new TimeSpan(0, 0, 0, 0, (int)(1000 / (UInt16)World.VarDB["updatesPerSecond"].Value));
+            this.msgUpdateFrequency = GetUpdateFrequency();
         }
 
         public override void Update(GameTime gameTime)
@@ -52,6 +52,14 @@ namespace AngryTanks.Client
             base.Update(gameTime);
         }
 
+        protected override void HandleVariableChanged(object sender, VariableChangedEvent e)
+        {
+            if (e.Variable == World.VarDB.UpdatesPerSecond)
+                this.msgUpdateFrequency = GetUpdateFrequency();
+
+            base.HandleVariableChanged(sender, e);
+        }
+
         protected override void HandleReceivedMessage(object sender, ServerLinkMessageEvent message)
         {
             switch (message.MessageType)
@@ -86,7 +94,7 @@ namespace AngryTanks.Client
                         // only interested if it's a shot that this player began
                         if (packet.Slot == this.Slot)
                         {
-                            Shoot(packet.ShotSlot, packet.Position, packet.Rotation, packet.Velocity, false);
+                            Shoot(packet.ShotSlot, packet.Position, packet.Rotation, packet.StartTick, false);
                         }
 
                         break;
@@ -22,10 +22,34 @@ namespace AngryTanks.Client
     {
         private static readonly ILog Log = LogManager.GetLogger(System.Reflection.MethodBase.GetCurrentMethod().DeclaringType);
 
-        private Score myScore;
+        // most rows the scoreboard shows, the local player gets a row of their own below if they're further down
+        private static readonly int MaxRows = 20;
+
+        /// <summary>
+        /// A line of the scoreboard, formatted and measured once and drawn until the standings change.
+        /// </summary>
+        private struct Row
+        {
+            public readonly String  Text;
+            public readonly Color   Color;
+            public readonly Vector2 Position;
+
+            public Row(String text, Color color, Vector2 position)
+            {
+                this.Text     = text;
+                this.Color    = color;
+                this.Position = position;
+            }
+        }
 
         private PlayerManager playerManager;
-        private List<Player> players;
+
+        private String myScoreText;
+        private List<Row> rows = new List<Row>(MaxRows + 2);
+
+        // leaderboard versions the cached text was built from
+        private UInt32? myScoreVersion, rowsVersion;
+        private Byte myScoreSlot;
 
         public bool isActive = false;
         public bool isOpen = false;
@@ -38,9 +62,6 @@ namespace AngryTanks.Client
         public ScoreHUD(PlayerManager playerManager)
         {
             this.playerManager = playerManager;
-
-            myScore = new Score();
-            players = new List<Player>(ProtocolInformation.DummySlot);
         }
 
         public void LoadContent(ContentManager Content)
@@ -55,8 +76,18 @@ namespace AngryTanks.Client
             if (!isActive)
                 return;
 
-            // first update the local player's score
-            myScore = playerManager.LocalPlayer.Score;            
+            Leaderboard<Byte> leaderboard = playerManager.Leaderboard;
+
+            // first update the local player's score, which is only reformatted when something changed
+            if (myScoreVersion != leaderboard.Version || myScoreSlot != playerManager.LocalPlayer.Slot)
+            {
+                LeaderboardEntry<Byte> myEntry;
+                leaderboard.TryGetEntry(playerManager.LocalPlayer.Slot, out myEntry);
+
+                myScoreText = playerManager.LocalPlayer.Callsign + ": " + myEntry.Overall.ToString();
+                myScoreVersion = leaderboard.Version;
+                myScoreSlot = playerManager.LocalPlayer.Slot;
+            }
 
             ks = Keyboard.GetState();
             if (ks.IsKeyDown(Keys.Tab) && oldKs.IsKeyUp(Keys.Tab))
@@ -65,23 +96,60 @@ namespace AngryTanks.Client
             }
             oldKs = ks;
 
-            // only load and sort data if we must
-            if (isOpen)
+            // the leaderboard keeps the players ranked, we only rebuild our rows when it moves
+            if (isOpen && rowsVersion != leaderboard.Version)
             {
-                // step 1: get the players from player manager
-                players.Clear(); // first clear it out
+                BuildRows(leaderboard);
+                rowsVersion = leaderboard.Version;
+            }
+        }
+
+        private void BuildRows(Leaderboard<Byte> leaderboard)
+        {
+            rows.Clear();
 
-                // add all remote players
-                players.AddRange(playerManager.RemotePlayers.Cast<Player>());
+            String header = String.Format("{0,-6} ({1,-6} - {2,6}) {3}",
+                                          "Score", "Wins", "Losses", "Player");
 
-                // add local player, if we can
-                if (playerManager.LocalPlayer != null)
-                    players.Add(playerManager.LocalPlayer);
+            rows.Add(new Row(header, Color.White, new Vector2(5, 100)));
 
-                // step 2: sort players in descending order
-                // first by wins, then by overall score
-                players = players.OrderByDescending(p => p.Score.Wins).ThenByDescending(p => p.Score.Overall).ToList();
+            Single y = 120;
+            bool listedMyself = false;
+
+            foreach (LeaderboardEntry<Byte> entry in leaderboard.GetTop(MaxRows))
+            {
+                listedMyself |= entry.Key == playerManager.LocalPlayer.Slot;
+                y = AddRow(entry, y);
             }
+
+            // always show where we stand
+            if (!listedMyself && leaderboard.Contains(playerManager.LocalPlayer.Slot))
+            {
+                LeaderboardEntry<Byte> entry;
+                leaderboard.TryGetEntry(playerManager.LocalPlayer.Slot, out entry);
+                AddRow(entry, y);
+            }
+        }
+
+        private Single AddRow(LeaderboardEntry<Byte> entry, Single y)
+        {
+            Player p = playerManager.GetPlayerBySlot(entry.Key);
+
+            // draw an individual scoreboard entry
+            String scoreboardEntry;
+
+            // this player has no tag
+            if (p.Tag.Length == 0)
+                scoreboardEntry = String.Format("{0,-6} ({1,-6} - {2,6}) {3}",
+                                                entry.Overall, entry.Wins, entry.Losses, p.Callsign);
+            else
+                scoreboardEntry = String.Format("{0,-6} ({1,-6} - {2,6}) {3} ({4})",
+                                                entry.Overall, entry.Wins, entry.Losses, p.Callsign, p.Tag);
+
+            // TODO draw with the same color as the player's team
+            rows.Add(new Row(scoreboardEntry, ProtocolHelpers.TeamTypeToColor(p.Team), new Vector2(5, (int)y)));
+
+            return y + scoreboardFont.MeasureString(scoreboardEntry).Y;
         }
 
         public void Draw(SpriteBatch spriteBatch)
@@ -91,7 +159,7 @@ namespace AngryTanks.Client
 
             // draw the local player's overall score always
             spriteBatch.DrawString(scoreFont,
-                                   playerManager.LocalPlayer.Callsign + ": " + myScore.Overall.ToString(),
+                                   myScoreText,
                                    new Vector2(5, 5),
                                    Color.White,
                                    0.0f,
@@ -104,45 +172,17 @@ namespace AngryTanks.Client
             // if we're open, then we draw the whole scoreboard too
             if (isOpen)
             {
-                String header = String.Format("{0,-6} ({1,-6} - {2,6}) {3}",
-                                              "Score", "Wins", "Losses", "Player");
-
-                spriteBatch.DrawString(scoreboardFont,
-                                   header,
-                                   new Vector2(5, 100),
-                                   Color.White,
-                                   0.0f,
-                                   Vector2.Zero,
-                                   1.0f,
-                                   SpriteEffects.None,
-                                   0.0f);
-
-                int i = 0;
-                foreach (Player p in players)
+                foreach (Row row in rows)
                 {
-                    // draw an individual scoreboard entry
-                    String scoreboardEntry;
-
-                    // this player has no tag
-                    if (p.Tag.Length == 0)
-                        scoreboardEntry = String.Format("{0,-6} ({1,-6} - {2,6}) {3}",
-                                                        p.Score.Overall, p.Score.Wins, p.Score.Losses, p.Callsign);
-                    else
-                        scoreboardEntry = String.Format("{0,-6} ({1,-6} - {2,6}) {3} ({4})",
-                                                        p.Score.Overall, p.Score.Wins, p.Score.Losses, p.Callsign, p.Tag);
-
-                    // TODO draw with the same color as the player's team
                     spriteBatch.DrawString(scoreboardFont,
-                                           scoreboardEntry,
-                                           new Vector2(5, 120 + (int)(i * scoreboardFont.MeasureString(scoreboardEntry).Y)),
-                                           ProtocolHelpers.TeamTypeToColor(p.Team),
+                                           row.Text,
+                                           row.Position,
+                                           row.Color,
                                            0.0f,
                                            Vector2.Zero,
                                            1.0f,
                                            SpriteEffects.None,
                                            0.0f);
-
-                    ++i;
                 }
             }
         }
@@ -5,7 +5,6 @@ using System.IO;
 using System.Text;
 using Microsoft.Xna.Framework;
 
-using log4net;
 using Lidgren.Network;
 
 using AngryTanks.Common;
@@ -82,9 +81,19 @@ namespace AngryTanks.Client
         }
     }
 
+    public class ServerLinkWorldEvent : EventArgs
+    {
+        public readonly WorldMap Map;
+
+        public ServerLinkWorldEvent(WorldMap map)
+        {
+            this.Map = map;
+        }
+    }
+
     public class ServerLink
     {
-        private static readonly ILog Log = LogManager.GetLogger(System.Reflection.MethodBase.GetCurrentMethod().DeclaringType);
+        private static readonly FastLog Log = FastLog.GetLogger(System.Reflection.MethodBase.GetCurrentMethod().DeclaringType);
 
         /// <summary>
         /// Event hook to receive messages
@@ -96,6 +105,16 @@ namespace AngryTanks.Client
         /// </summary>
         public event EventHandler<ServerLinkStateChangedEvent> ServerLinkStateChanged;
 
+        /// <summary>
+        /// Event hook to receive the world once it has been loaded from the cache or downloaded
+        /// </summary>
+        public event EventHandler<ServerLinkWorldEvent> WorldLoadedEvent;
+
+        /// <summary>
+        /// Directory downloaded worlds are kept in, named by their hash
+        /// </summary>
+        public static readonly String WorldCacheDirectory = "WorldCache";
+
         /// <summary>
         /// Configuration for <see cref="NetClient"/>
         /// </summary>
@@ -111,6 +130,17 @@ namespace AngryTanks.Client
         /// </summary>
         private NetServerLinkStatus serverLinkStatus = NetServerLinkStatus.None;
 
+        // the world being downloaded, if any
+        private MsgWorldInfoPacket worldInfo;
+        private Byte[] compressedWorld;
+        private int compressedWorldReceived;
+
+        // we're only connected once we have both the world and the join snapshot
+        private bool haveWorld, haveSnapshot;
+
+        // shots are cast against the map, so any we hear about before it loads wait for it
+        private List<ServerLinkMessageEvent> heldShotEvents = new List<ServerLinkMessageEvent>();
+
         /// <summary>
         /// Get the status of <see cref="ServerLink"/>
         /// </summary>
@@ -133,6 +163,22 @@ namespace AngryTanks.Client
             }
         }
 
+        /// <summary>
+        /// Gets the server's clock in seconds, which is what shots are timed by
+        /// </summary>
+        public Double ServerTime
+        {
+            get
+            {
+                NetConnection serverConnection = Client.ServerConnection;
+
+                if (serverConnection == null)
+                    return NetTime.Now;
+
+                return serverConnection.GetRemoteTime(NetTime.Now);
+            }
+        }
+
         public ServerLink()
         {
             Client = new NetClient(SetupConfig());
@@ -160,6 +206,12 @@ namespace AngryTanks.Client
             hailMessage.Write(callsign);
             hailMessage.Write((tag != null ? tag : ""));
 
+            // forget anything from a previous connection
+            worldInfo = null;
+            compressedWorld = null;
+            haveWorld = haveSnapshot = false;
+            heldShotEvents.Clear();
+
             // we are now initiating the connect, so change status
             ServerLinkStatus = NetServerLinkStatus.Connecting;
 
@@ -180,14 +232,16 @@ namespace AngryTanks.Client
                 ServerLinkStatus = NetServerLinkStatus.Disconnecting;
         }
 
-        public NetSendResult SendMessage(NetOutgoingMessage msg, NetDeliveryMethod method)
-        {
-            return Client.SendMessage(msg, method);
-        }
-
-        public NetSendResult SendMessage(NetOutgoingMessage msg, NetDeliveryMethod method, int sequenceChannel)
+        /// <summary>
+        /// Sends a message the way its <see cref="TrafficClass"/> travels.
+        /// </summary>
+        /// <param name="msg"></param>
+        /// <param name="messageType">Type of the message, which picks its delivery method and channel.</param>
+        /// <returns></returns>
+        public NetSendResult SendMessage(NetOutgoingMessage msg, MessageType messageType)
         {
-            return Client.SendMessage(msg, method, sequenceChannel);
+            TrafficRoute route = TrafficClasses.GetRoute(messageType);
+            return Client.SendMessage(msg, route.Method, route.Channel);
         }
 
         public NetOutgoingMessage CreateMessage()
@@ -262,7 +316,7 @@ namespace AngryTanks.Client
 
                 msgReady.Write((Byte)MessageType.MsgState);
 
-                Client.SendMessage(msgReady, NetDeliveryMethod.ReliableOrdered, 0);
+                SendMessage(msgReady, MessageType.MsgState);
 
                 // we now move to getting initial state
                 ServerLinkStatus = NetServerLinkStatus.GettingState;
@@ -285,6 +339,19 @@ namespace AngryTanks.Client
                         break;
                     }
 
+                case MessageType.MsgJoinSnapshot:
+                    {
+                        Log.DebugFormat("Got MsgJoinSnapshot ({0} bytes)", msg.LengthBytes);
+                        MsgJoinSnapshotPacket packet = MsgJoinSnapshotPacket.Read(msg);
+                        FireMessageEvent(gameTime, packet);
+
+                        // the snapshot is the last piece of initial state, unless the world is still coming
+                        haveSnapshot = true;
+                        CheckInitialState();
+
+                        break;
+                    }
+
                 case MessageType.MsgAddPlayer:
                     {
                         Log.DebugFormat("Got MsgAddPlayer ({0} bytes)", msg.LengthBytes);
@@ -325,20 +392,47 @@ namespace AngryTanks.Client
                         break;
                     }
 
-                case MessageType.MsgWorld:
+                case MessageType.MsgWorldInfo:
                     {
-                        Log.DebugFormat("Got MsgWorld ({0} bytes)", msg.LengthBytes);
+                        Log.DebugFormat("Got MsgWorldInfo ({0} bytes)", msg.LengthBytes);
 
-                        UInt16 mapLength = msg.ReadUInt16();
-                        Byte[] rawWorld = new Byte[mapLength];
-                        msg.ReadBytes(mapLength, out rawWorld);
-
-                        MemoryStream ms = new MemoryStream(rawWorld);
-                        StreamReader sr = new StreamReader(ms);
+                        try
+                        {
+                            MsgWorldInfoPacket packet = MsgWorldInfoPacket.Read(msg);
+                            FireMessageEvent(gameTime, packet);
+                            HandleWorldInfo(packet);
+                        }
+                        catch (InvalidDataException e)
+                        {
+                            Log.Error(e.Message);
+                            Disconnect("could not load world");
+                        }
+                        catch (IOException e)
+                        {
+                            Log.Error(e.Message);
+                            Disconnect("could not load world");
+                        }
 
-                        MsgWorldPacket msgWorldEventData = new MsgWorldPacket(mapLength, sr);
+                        break;
+                    }
 
-                        FireMessageEvent(gameTime, msgWorldEventData);
+                case MessageType.MsgWorld:
+                    {
+                        try
+                        {
+                            HandleWorldChunk(MsgWorldPacket.Read(msg));
+                        }
+                        catch (InvalidDataException e)
+                        {
+                            Log.Error(e.Message);
+                            Disconnect("could not load world");
+                        }
+                        catch (IOException e)
+                        {
+                            // a truncated world reads past its end
+                            Log.Error(e.Message);
+                            Disconnect("could not load world");
+                        }
 
                         break;
                     }
@@ -364,6 +458,18 @@ namespace AngryTanks.Client
                         break;
                     }
 
+                case MessageType.MsgEventBundle:
+                    {
+                        Log.DebugFormat("Got MsgEventBundle ({0} bytes)", msg.LengthBytes);
+                        MsgEventBundlePacket packet = MsgEventBundlePacket.Read(msg);
+
+                        // unpack into the same events we would get if they were sent one by one
+                        foreach (MsgBasePacket bundledPacket in packet.Events)
+                            FireMessageEvent(gameTime, bundledPacket);
+
+                        break;
+                    }
+
                 default:
                     // if we get anything else we should fail
                     // protocol version should protect us from unknowns
@@ -372,8 +478,113 @@ namespace AngryTanks.Client
             }
         }
 
+        /// <summary>
+        /// Loads the world from our cache if we have it, otherwise asks the server to stream it to us.
+        /// </summary>
+        /// <param name="packet"></param>
+        private void HandleWorldInfo(MsgWorldInfoPacket packet)
+        {
+            WorldMap cached = WorldMap.LoadCached(WorldCacheDirectory, packet.Hash, packet.Digest);
+
+            if (cached != null)
+            {
+                Log.DebugFormat("World {0} is cached, skipping download", cached.HashString);
+                LoadWorld(cached);
+                return;
+            }
+
+            worldInfo = packet;
+            compressedWorld = new Byte[packet.CompressedLength];
+            compressedWorldReceived = 0;
+
+            NetOutgoingMessage msgRequest = Client.CreateMessage();
+            MsgWorldRequestPacket requestPacket = new MsgWorldRequestPacket(packet.Hash);
+
+            msgRequest.Write((Byte)requestPacket.MsgType);
+            requestPacket.Write(msgRequest);
+
+            SendMessage(msgRequest, requestPacket.MsgType);
+        }
+
+        /// <summary>
+        /// Adds a chunk to the world being downloaded, and loads it once it's complete.
+        /// </summary>
+        /// <param name="packet"></param>
+        /// <exception cref="InvalidDataException">The chunk doesn't fit or the world is corrupt.</exception>
+        private void HandleWorldChunk(MsgWorldPacket packet)
+        {
+            // chunks come in order on their channel, so anything else is a broken stream
+            if (compressedWorld == null
+                || packet.Offset != compressedWorldReceived
+                || packet.Count > compressedWorld.Length - compressedWorldReceived)
+                throw new InvalidDataException(String.Format("unexpected world chunk at {0}", packet.Offset));
+
+            Buffer.BlockCopy(packet.Data, packet.Start, compressedWorld, compressedWorldReceived, packet.Count);
+            compressedWorldReceived += packet.Count;
+
+            if (compressedWorldReceived < compressedWorld.Length)
+                return;
+
+            // loading it recomputes the digest from the bytes we got
+            WorldMap map = WorldMap.FromBytes(Lzma.Decompress(compressedWorld, (int)worldInfo.Length));
+
+            if (map.HashString != WorldMap.HashToString(worldInfo.Hash)
+                || WorldMap.HashToString(map.Digest) != WorldMap.HashToString(worldInfo.Digest))
+                throw new InvalidDataException("downloaded world is not the one we asked for");
+
+            Log.DebugFormat("Downloaded world {0} ({1} bytes)", map.HashString, compressedWorld.Length);
+
+            worldInfo = null;
+            compressedWorld = null;
+
+            // so we don't have to download it again next time
+            map.SaveToCache(WorldCacheDirectory);
+
+            LoadWorld(map);
+        }
+
+        private void LoadWorld(WorldMap map)
+        {
+            EventHandler<ServerLinkWorldEvent> handler = WorldLoadedEvent;
+
+            // prevent race condition
+            if (handler != null)
+                handler(this, new ServerLinkWorldEvent(map));
+
+            haveWorld = true;
+
+            // now the shots held back for the map can be worked out against it, in the order they came
+            EventHandler<ServerLinkMessageEvent> messageHandler = MessageReceivedEvent;
+
+            if (messageHandler != null)
+            {
+                foreach (ServerLinkMessageEvent e in heldShotEvents)
+                    messageHandler(this, e);
+            }
+
+            heldShotEvents.Clear();
+
+            CheckInitialState();
+        }
+
+        /// <summary>
+        /// Moves us to <see cref="NetServerLinkStatus.Connected"/> once all initial state is in.
+        /// </summary>
+        private void CheckInitialState()
+        {
+            if (haveWorld && haveSnapshot && ServerLinkStatus == NetServerLinkStatus.GettingState)
+                ServerLinkStatus = NetServerLinkStatus.Connected;
+        }
+
         private void FireMessageEvent(GameTime gameTime, MsgBasePacket msgData)
         {
+            // a shot needs the map to find its path, so hold it and whatever ends it until the map is in
+            if (!haveWorld && (msgData.MsgType == MessageType.MsgBeginShot || msgData.MsgType == MessageType.MsgEndShot))
+            {
+                heldShotEvents.Add(new ServerLinkMessageEvent(msgData.MsgType, msgData, ServerLinkStatus, gameTime));
+                return;
+            }
+
             EventHandler<ServerLinkMessageEvent> handler = MessageReceivedEvent;
 
             // prevent race condition
@@ -1,4 +1,4 @@
-using System;
+﻿using System;
 using System.Collections.Generic;
 using System.Linq;
 using Microsoft.Xna.Framework;
@@ -85,29 +85,22 @@ namespace AngryTanks.Client
             get { return player; }
         }
 
-        private Vector2 initialPosition;
+        private ShotPath path;
 
         /// <summary>
-        /// Stores the position the shot originated from.
+        /// The flight of the shot, which everyone works out the same way.
         /// </summary>
-        public Vector2 InitialPosition
+        public ShotPath Path
         {
-            get { return initialPosition; }
+            get { return path; }
         }
 
         /// <summary>
-        /// Maximum distance the shot will travel.
-        /// </summary>
-        private Single maxShotRange;
-
-        private TimeSpan initialTime = TimeSpan.Zero;
-
-        /// <summary>
-        /// Time the shot was created.
+        /// Stores the position the shot originated from.
         /// </summary>
-        public TimeSpan InitialTime
+        public Vector2 InitialPosition
         {
-            get { return initialTime; }
+            get { return path.Origin; }
         }
 
         private TimeSpan maxTTL;
@@ -122,28 +115,17 @@ namespace AngryTanks.Client
 
         private AnimatedSprite explosion;
 
-        public Shot(World world, Player player, Byte slot, bool local, Vector2 initialPosition, Single rotation, Vector2 initialVelocity)
-            : base(world, GetTexture(world, player), initialPosition, new Vector2(2, 2), rotation)
+        public Shot(World world, Player player, Byte slot, bool local, ShotPath path)
+            : base(world, GetTexture(world, player), path.Origin, new Vector2(2, 2), path.Rotation)
         {
-            Single shotSpeed = (Single)World.VarDB["shotSpeed"].Value;
-
-            // get the unit vector in the forward direction
-            Velocity = new Vector2((Single)Math.Cos(Rotation - Math.PI / 2),
-                                   (Single)Math.Sin(Rotation - Math.PI / 2));
-
-            // get our shot velocity by multiplying by the magnitude
-            Velocity *= shotSpeed;
-
-            // add the velocity from the tank to the shot
-            //Velocity += initialVelocity;
-
             // store info...
             this.slot = slot;
             this.local = local;
             this.player = player;
-            this.initialPosition = initialPosition;
-            this.maxShotRange = (Single)World.VarDB["shotRange"].Value;
-            this.maxTTL = new TimeSpan(0, 0, 0, 0, (int)((Single)World.VarDB["reloadTime"].Value * 1000));
+            this.path = path;
+            this.maxTTL = new TimeSpan(0, 0, 0, 0, (int)(World.VarDB.ReloadTime.Value * 1000));
+
+            Velocity = path.Direction * path.Speed;
 
             // start the shot
             state = ShotState.Starting;
@@ -203,7 +185,7 @@ namespace AngryTanks.Client
                                            Rotation,
                                            new Point(8, 8), new Point(64, 64), SpriteSheetDirection.RightToLeft, false);
 
-            // we only broadcast the end shot if it's a local one we're keeping track of
+            // only hits on tanks are broadcast, everyone ends shots on walls, range and time by themselves
             if (sendEndShot)
             {
                 NetOutgoingMessage endShotMessage = World.ServerLink.CreateMessage();
@@ -213,15 +195,25 @@ namespace AngryTanks.Client
                 endShotMessage.Write((Byte)endShotPacket.MsgType);
                 endShotPacket.Write(endShotMessage);
 
-                World.ServerLink.SendMessage(endShotMessage, NetDeliveryMethod.ReliableUnordered, 0);
+                World.ServerLink.SendMessage(endShotMessage, endShotPacket.MsgType);
             }
         }
 
+        /// <summary>
+        /// Swaps in a path worked out against a newer map, a shot that has already ended stays ended.
+        /// </summary>
+        public void Rebuild(ShotPath path)
+        {
+            this.path = path;
+
+            if (State == ShotState.Starting || State == ShotState.Active)
+                Velocity = path.Direction * path.Speed;
+        }
+
         public override void Update(GameTime gameTime)
         {
-            // see if we need to setup initial time
-            if (InitialTime == TimeSpan.Zero)
-                initialTime = gameTime.TotalRealTime;
+            // shots run off the server's clock, so a shot we heard about late is already on its way
+            Double elapsed = path.GetElapsed(World.ServerLink.ServerTime);
 
             // if we're starting, move straight to active
             if (State == ShotState.Starting)
@@ -236,45 +228,19 @@ namespace AngryTanks.Client
                     state = ShotState.Ended;
             }
 
-            // can the shot explode based on time yet?
-            if (InitialTime + MaxTTL <= gameTime.TotalRealTime)
-            {
-                if (State == ShotState.Ended)
-                    state = ShotState.None;
-                else if (State != ShotState.Ending)
-                    End(true, false);
-            }
+            // the slot frees up once the shot has reloaded
+            if (State == ShotState.Ended && elapsed >= MaxTTL.TotalSeconds)
+                state = ShotState.None;
 
             // see if we can bail out now
             if (State == ShotState.Ending || State == ShotState.Ended || State == ShotState.None)
                 return;
 
-            // the following is expensive, so we only do it if it's a local shot
-            // we trust everyone else will end their shots for us
-            if (Local)
-            {
-                // see if we collide with any world objects
-                Single overlap;
-                Vector2 collisionProjection;
+            Position = path.GetPosition(elapsed);
 
-                if (FindNearestCollision(World.MapGrid.PotentialIntersects(this), out overlap, out collisionProjection))
-                {
-                    // move our position back
-                    Position += overlap * collisionProjection;
-
-                    // end shot
-                    End(true, true);
-                }
-            }
-
-            Position += Velocity * (Single)gameTime.ElapsedGameTime.TotalSeconds;
-
-            // the shot has travelled its maximum distance
-            if (Math.Abs(Vector2.Distance(initialPosition, Position)) >= maxShotRange)
-            {
-                // end shot
+            // the shot has hit a wall or gone as far as it can, everyone else ends it at the same point
+            if (elapsed >= path.Duration)
                 End(true, false);
-            }
 
             base.Update(gameTime);
         }
@@ -107,6 +107,16 @@ namespace AngryTanks.Client
             get { return mapGrid; }
         }
 
+        private WorldMap map;
+
+        /// <summary>
+        /// Gets the compiled map being played, shots are worked out against its objects.
+        /// </summary>
+        public WorldMap Map
+        {
+            get { return map; }
+        }
+
         private PlayerManager playerManager;
 
         public PlayerManager PlayerManager
@@ -153,13 +163,15 @@ namespace AngryTanks.Client
             // TODO need to get variables from server and stick them in this structure
             this.varDB = new VariableDatabase();
 
+            // we hook up before the player manager so variables from the server are set before players are created
+            ServerLink.MessageReceivedEvent += HandleReceivedMessage;
+            ServerLink.WorldLoadedEvent += HandleWorldLoaded;
+
             // initialize player manager
             this.playerManager = new PlayerManager(this); 
            
             // initialize score HUD
             this.scoreHUD = new ScoreHUD(this.playerManager);
-
-            ServerLink.MessageReceivedEvent += HandleReceivedMessage;
         }
 
         public override void Dispose()
@@ -176,6 +188,7 @@ namespace AngryTanks.Client
 
             GraphicsDevice.DeviceReset -= GraphicsDeviceReset;
             ServerLink.MessageReceivedEvent -= HandleReceivedMessage;
+            ServerLink.WorldLoadedEvent -= HandleWorldLoaded;
 
             if(scoreHUD != null)
                 scoreHUD.isActive = false; //Deactivate scoreHUD to prevent NullReferenceException
@@ -406,15 +419,20 @@ namespace AngryTanks.Client
         {
             switch (message.MessageType)
             {
-                case MessageType.MsgWorld:
+                case MessageType.MsgWorldInfo:
                     Console.WriteLine("Loading map...");
+                    break;
 
-                    MsgWorldPacket worldPacket = (MsgWorldPacket)message.MessageData;
+                case MessageType.MsgJoinSnapshot:
+                    MsgJoinSnapshotPacket snapshotPacket = (MsgJoinSnapshotPacket)message.MessageData;
 
-                    LoadMap(worldPacket.Map);
+                    foreach (MsgSetVariablePacket variable in snapshotPacket.Variables)
+                        SetVariable(variable);
 
-                    Console.WriteLine(String.Format("Map \"{0}\" loaded.", WorldName));
+                    break;
 
+                case MessageType.MsgSetVariable:
+                    SetVariable((MsgSetVariablePacket)message.MessageData);
                     break;
 
                 case MessageType.MsgDeath:
@@ -453,156 +471,92 @@ namespace AngryTanks.Client
             }
         }
 
-        public void LoadMap(StreamReader sr)
+        private void SetVariable(MsgSetVariablePacket variable)
         {
-            // construct the StaticSprites from the stream
-            mapObjects = ParseMapFile(sr);
-
-            // add the boundaries
-            AddMapBoundaries();
-
-            // now we can make our grid, make it 10% larger than actual size to get any objects near the world edge
-            mapGrid = new Grid(new Vector2(WorldSize, WorldSize) * 1.1f, MapObjects);
+            try
+            {
+                VarDB[variable.Name].BoxedValue = variable.Value;
+            }
+            catch (KeyNotFoundException e)
+            {
+                Log.Warn(e.Message);
+                Log.Warn(e.StackTrace);
+            }
         }
 
-        private void AddMapBoundaries()
+        private void HandleWorldLoaded(object sender, ServerLinkWorldEvent e)
         {
-            List<Sprite> tiled = mapObjects["tiled"];
+            LoadMap(e.Map);
 
-            tiled.Add(new Box(this, boxTexture, new Vector2((-WorldSize / 2) - 5, 0), new Vector2(10, WorldSize + 20), 0));
-            tiled.Add(new Box(this, boxTexture, new Vector2(( WorldSize / 2) + 5, 0), new Vector2(10, WorldSize + 20), 0));
-            tiled.Add(new Box(this, boxTexture, new Vector2(0, (-WorldSize / 2) - 5), new Vector2(WorldSize + 20, 10), 0));
-            tiled.Add(new Box(this, boxTexture, new Vector2(0, ( WorldSize / 2) + 5), new Vector2(WorldSize + 20, 10), 0));
+            // shots already in the air were worked out against the old map, or none at all
+            if (playerManager != null)
+                playerManager.RebuildShotPaths();
+
+            Console.WriteLine(String.Format("Map \"{0}\" loaded.", WorldName));
         }
 
-        /// <summary>
-        /// <para>
-        ///     Takes in a StreamReader <paramref name="sr"/> and returns a Dictionary mapping
-        ///     the draw type of the world object to a List of <see cref="Sprite"/>s.
-        /// </para>
-        /// <para>
-        ///     If there is no world data, this method will set the world name and size to
-        ///     the default values of "No Name" and 800 world units, respectively.
-        /// </para>
-        /// </summary>
-        /// <param name="sr"></param>
-        /// <returns></returns>
-        private Dictionary<String, List<Sprite>> ParseMapFile(StreamReader sr)
+        public void LoadMap(WorldMap map)
         {
-            Dictionary<String, List<Sprite>> mapObjects = new Dictionary<String, List<Sprite>>();
-            List<Sprite> stretched = new List<Sprite>();
-            List<Sprite> tiled = new List<Sprite>();
-            
-            Vector2? position = null;
-            Vector2? size = null;
-            Single rotation = 0;
-            String currentType = ""; // internal identifier to indicate which texture to construct
-            int badObjects = 0; // counts object blocks that failed to load
+            this.map = map;
 
-            // control flags
-            bool inWorldBlock = false;
-            bool inBlock = false;
+            worldName = map.Name;
+            worldSize = map.Size;
 
-            // default values for world data will be overidden if found in the file
-            worldName = "No Name";
-            worldSize = 800;
-
-            String line = "";
+            List<Sprite> tiled = new List<Sprite>(map.Objects.Count);
+            List<Sprite> stretched = new List<Sprite>();
 
-            while ((line = sr.ReadLine()) != null)
+            // construct the StaticSprites straight from the compiled objects
+            foreach (MapObject mapObject in map.Objects)
             {
-                line = line.Trim();
-
-                if (line.StartsWith("world", StringComparison.InvariantCultureIgnoreCase))
+                switch (mapObject.Type)
                 {
-                    inWorldBlock = true;
-                    inBlock = false;
-                }
-
-                if (line.StartsWith("box", StringComparison.InvariantCultureIgnoreCase)
-                    || line.StartsWith("pyramid", StringComparison.InvariantCultureIgnoreCase))
-                {
-                    inWorldBlock = false;
-                    inBlock = true;
-                    currentType = line.Split(' ')[0];
-                }
+                    case MapObjectType.Box:
+                        tiled.Add(new Box(this, boxTexture, mapObject.Position, mapObject.Size, mapObject.Rotation));
+                        break;
 
-                if (inWorldBlock)
-                {
-                    if (line.StartsWith("name", StringComparison.InvariantCultureIgnoreCase))
-                    {
-                        worldName = line.Trim().Substring(4).Trim();
-                    }
-                    if (line.StartsWith("size", StringComparison.InvariantCultureIgnoreCase))
-                    {
-                        worldSize = (Single)Convert.ToSingle(line.Trim().Substring(4).Trim());
-                    }
+                    case MapObjectType.Pyramid:
+                        stretched.Add(new Pyramid(this, pyramidTexture, mapObject.Position, mapObject.Size, mapObject.Rotation));
+                        break;
                 }
+            }
 
-                if (inBlock)
-                {
-                    if (line.StartsWith("position", StringComparison.InvariantCultureIgnoreCase)
-                        || line.StartsWith("pos", StringComparison.InvariantCultureIgnoreCase))
-                    {
-                        List<String> rawArgs = line.Trim().Substring(9).Split(' ').ToList();
-                        List<Single> coords = new List<Single>();
+            mapObjects = new Dictionary<String, List<Sprite>>();
+            mapObjects.Add("tiled", tiled);
+            mapObjects.Add("stretched", stretched);
 
-                        rawArgs.ForEach(v => coords.Add((Single)Convert.ToSingle(v)));
+            // add the boundaries
+            AddMapBoundaries();
 
-                        // only load objects with at least x, y and a zero z-position
-                        if (coords.Count == 2 || ((coords.Count == 3) && (Math.Abs(coords[2]) <= Single.Epsilon)))
-                        {
-                            position = new Vector2(coords[0], coords[1]);
-                        }
-                    }
-                    else if (line.StartsWith("size", StringComparison.InvariantCultureIgnoreCase))
-                    {
-                        List<String> rawArgs = line.Trim().Substring(5).Split(' ').ToList();
-                        List<Single> coords = new List<Single>();
+            // collide against as few objects as the map can be boiled down to, they're still drawn as they were built
+            List<IWorldObject> colliders = ColliderSimplifier.Simplify(MapObjects);
 
-                        rawArgs.ForEach(v => coords.Add((Single)Convert.ToSingle(v)));
+            Log.InfoFormat("Simplified {0} colliders to {1}", tiled.Count + stretched.Count, colliders.Count);
 
-                        // only load objects with at least x and y size
-                        if (coords.Count >= 2)
-                        {
-                            size = new Vector2(coords[0], coords[1]);
-                        }
-                    }
-                    else if (line.StartsWith("rotation", StringComparison.InvariantCultureIgnoreCase)
-                             || line.StartsWith("rot", StringComparison.InvariantCultureIgnoreCase))
-                    {
-                        String[] coords = line.Trim().Substring(9).Split(' ');
-                        rotation = Convert.ToSingle(coords[0].Trim());
-                    }
-                }
+            // now we can make our grid, sized for what it gets asked about most: our tank, turned any which way.
+            // the boundaries beyond the edge of the world are kept in the edge cells
+            Single tankReach = new Vector2(VarDB.TankWidth.Value, VarDB.TankLength.Value).Length();
 
-                if (line.Equals("end"))
-                {
-                    if (position.HasValue && size.HasValue)
-                    {
-                        if (currentType.Equals("box"))
-                            tiled.Add(new Box(this, boxTexture, position.Value, size.Value * 2, MathHelper.ToRadians(rotation)));
-                        if (currentType.Equals("pyramid"))
-                            stretched.Add(new Pyramid(this, pyramidTexture, position.Value, size.Value * 2, MathHelper.ToRadians(rotation)));
-                    }
-                    else
-                    {
-                        badObjects++;
-                    }
+            mapGrid = new Grid(new Vector2(WorldSize, WorldSize), colliders, new Vector2(tankReach, tankReach));
 
-                    // when finished with one block clear all variables
-                    inBlock = false;
-                    position = null;
-                    size = null;
-                    rotation = 0;
-                }
+            Log.InfoFormat("Map grid has {0}x{1} cells", mapGrid.GridSize.X, mapGrid.GridSize.Y);
+        }
 
-            }
+        /// <summary>
+        /// Works out the path of a shot against the loaded map, the same way the server and every other client does.
+        /// </summary>
+        public ShotPath CreateShotPath(Vector2 origin, Single rotation, UInt32 startTick)
+        {
+            return new ShotPath(Map, VarDB, origin, rotation, startTick);
+        }
 
-            mapObjects.Add("tiled", tiled);
-            mapObjects.Add("stretched", stretched);
+        private void AddMapBoundaries()
+        {
+            List<Sprite> tiled = mapObjects["tiled"];
 
-            return mapObjects;
+            tiled.Add(new Box(this, boxTexture, new Vector2((-WorldSize / 2) - 5, 0), new Vector2(10, WorldSize + 20), 0));
+            tiled.Add(new Box(this, boxTexture, new Vector2(( WorldSize / 2) + 5, 0), new Vector2(10, WorldSize + 20), 0));
+            tiled.Add(new Box(this, boxTexture, new Vector2(0, (-WorldSize / 2) - 5), new Vector2(WorldSize + 20, 10), 0));
+            tiled.Add(new Box(this, boxTexture, new Vector2(0, ( WorldSize / 2) + 5), new Vector2(WorldSize + 20, 10), 0));
         }
 
         public static Vector2 WorldUnitsToPixels(Vector2 vector)
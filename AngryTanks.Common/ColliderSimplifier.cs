@@ -0,0 +1,255 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+using Microsoft.Xna.Framework;
+
+namespace AngryTanks.Common
+{
+    /// <summary>
+    /// Merges map objects that together make up a larger rectangle into one collider, without changing what they cover.
+    /// </summary>
+    /// <remarks>
+    /// Maps are often built from rows of touching boxes, and otherwise the broad and narrow phases handle each box
+    /// on its own. Two rectangles with the same rotation merge when they span the same extent across one axis and
+    /// touch or overlap along the other. Merging alternates between the two axes until nothing more merges, so
+    /// a wall of boxes becomes one collider and so does a solid block of them. Rectangles that overlap in any other
+    /// way are left alone, since their union is not a rectangle. Only collision uses the result; the map is still
+    /// drawn from its original objects. The result depends only on the objects and their order, so every peer
+    /// simplifies a map the same way.
+    /// </remarks>
+    public static class ColliderSimplifier
+    {
+        // how far apart two edges can be and still count as lined up, in world units
+        private const Single Tolerance = 1e-3f;
+
+        // rotations closer than this, in radians, count as the same
+        private const Double RotationTolerance = 1e-4;
+
+        /// <summary>
+        /// An object as an axis-aligned rectangle in the frame of its rotation group.
+        /// </summary>
+        private class Span
+        {
+            public Single MinX, MinY, MaxX, MaxY;
+
+            // the object it started as, and whether anything has been merged into it since
+            public int Source;
+            public bool Merged;
+        }
+
+        /// <summary>
+        /// Simplifies the colliders of <paramref name="objects"/>. Objects that merge with nothing are returned as they are.
+        /// </summary>
+        public static List<IWorldObject> Simplify(IList<IWorldObject> objects)
+        {
+            return Simplify(objects, o => o.Position, o => o.Size, o => o.Rotation,
+                            (o, position, size, rotation) => (IWorldObject)new WorldObject(position, size, rotation));
+        }
+
+        /// <summary>
+        /// Simplifies the colliders of <paramref name="objects"/>. A merged object takes the type of the first object in it.
+        /// </summary>
+        public static List<MapObject> Simplify(IList<MapObject> objects)
+        {
+            return Simplify(objects, o => o.Position, o => o.Size, o => o.Rotation,
+                            (o, position, size, rotation) => new MapObject(o.Type, position, size, rotation));
+        }
+
+        private static List<T> Simplify<T>(IList<T> objects,
+                                           Func<T, Vector2> getPosition, Func<T, Vector2> getSize, Func<T, Single> getRotation,
+                                           Func<T, Vector2, Vector2, Single, T> create)
+        {
+            // everything turned a quarter turn or more is the same as a rectangle turned less with its sides swapped,
+            // so group by rotation within a quarter turn
+            Dictionary<Int64, List<Span>> groups = new Dictionary<Int64, List<Span>>();
+            Dictionary<Int64, Double> groupRotations = new Dictionary<Int64, Double>();
+
+            for (int i = 0; i < objects.Count; i++)
+            {
+                Vector2 size = getSize(objects[i]);
+                Double rotation = NormalizeRotation(getRotation(objects[i]), ref size);
+                Int64 key = (Int64)Math.Round(rotation / RotationTolerance);
+
+                List<Span> group;
+
+                if (!groups.TryGetValue(key, out group))
+                {
+                    group = new List<Span>();
+                    groups.Add(key, group);
+                    groupRotations.Add(key, rotation);
+                }
+
+                Vector2 center = ToLocal(getPosition(objects[i]), groupRotations[key]);
+
+                Span span = new Span();
+                span.MinX = center.X - size.X / 2;
+                span.MinY = center.Y - size.Y / 2;
+                span.MaxX = center.X + size.X / 2;
+                span.MaxY = center.Y + size.Y / 2;
+                span.Source = i;
+
+                group.Add(span);
+            }
+
+            List<T> colliders = new List<T>(objects.Count);
+
+            foreach (KeyValuePair<Int64, List<Span>> group in groups)
+            {
+                List<Span> spans = group.Value;
+                Double rotation = groupRotations[group.Key];
+
+                bool merging = true;
+
+                while (merging)
+                    merging = MergeAlongX(ref spans) | MergeAlongY(ref spans);
+
+                foreach (Span span in spans)
+                {
+                    T source = objects[span.Source];
+
+                    if (!span.Merged)
+                    {
+                        colliders.Add(source);
+                        continue;
+                    }
+
+                    Vector2 center = ToWorld(new Vector2((span.MinX + span.MaxX) / 2, (span.MinY + span.MaxY) / 2), rotation);
+                    Vector2 size = new Vector2(span.MaxX - span.MinX, span.MaxY - span.MinY);
+
+                    colliders.Add(create(source, center, size, (Single)rotation));
+                }
+            }
+
+            return colliders;
+        }
+
+        #region Merging
+
+        /// <summary>
+        /// Merges rectangles spanning the same Y extent that touch or overlap along X.
+        /// </summary>
+        private static bool MergeAlongX(ref List<Span> spans)
+        {
+            spans.Sort((a, b) =>
+            {
+                int order = a.MinY.CompareTo(b.MinY);
+                if (order == 0)
+                    order = a.MaxY.CompareTo(b.MaxY);
+                if (order == 0)
+                    order = a.MinX.CompareTo(b.MinX);
+                if (order == 0)
+                    order = a.Source.CompareTo(b.Source);
+                return order;
+            });
+
+            List<Span> merged = new List<Span>(spans.Count);
+            Span current = null;
+
+            foreach (Span span in spans)
+            {
+                if (current != null &&
+                    Math.Abs(span.MinY - current.MinY) <= Tolerance && Math.Abs(span.MaxY - current.MaxY) <= Tolerance &&
+                    span.MinX <= current.MaxX + Tolerance)
+                {
+                    current.MaxX = Math.Max(current.MaxX, span.MaxX);
+                    current.Merged = true;
+                    continue;
+                }
+
+                current = span;
+                merged.Add(current);
+            }
+
+            bool changed = merged.Count != spans.Count;
+            spans = merged;
+            return changed;
+        }
+
+        /// <summary>
+        /// Merges rectangles spanning the same X extent that touch or overlap along Y.
+        /// </summary>
+        private static bool MergeAlongY(ref List<Span> spans)
+        {
+            spans.Sort((a, b) =>
+            {
+                int order = a.MinX.CompareTo(b.MinX);
+                if (order == 0)
+                    order = a.MaxX.CompareTo(b.MaxX);
+                if (order == 0)
+                    order = a.MinY.CompareTo(b.MinY);
+                if (order == 0)
+                    order = a.Source.CompareTo(b.Source);
+                return order;
+            });
+
+            List<Span> merged = new List<Span>(spans.Count);
+            Span current = null;
+
+            foreach (Span span in spans)
+            {
+                if (current != null &&
+                    Math.Abs(span.MinX - current.MinX) <= Tolerance && Math.Abs(span.MaxX - current.MaxX) <= Tolerance &&
+                    span.MinY <= current.MaxY + Tolerance)
+                {
+                    current.MaxY = Math.Max(current.MaxY, span.MaxY);
+                    current.Merged = true;
+                    continue;
+                }
+
+                current = span;
+                merged.Add(current);
+            }
+
+            bool changed = merged.Count != spans.Count;
+            spans = merged;
+            return changed;
+        }
+
+        #endregion
+
+        #region Helpers
+
+        /// <summary>
+        /// Brings <paramref name="rotation"/> within a quarter turn, swapping the sides of <paramref name="size"/> if that turns it an odd number of quarters.
+        /// </summary>
+        private static Double NormalizeRotation(Single rotation, ref Vector2 size)
+        {
+            const Double quarter = Math.PI / 2;
+
+            Double turns = Math.Floor(rotation / quarter);
+            Double normalized = rotation - turns * quarter;
+
+            // just shy of a quarter turn is as good as the next one
+            if (quarter - normalized < RotationTolerance)
+            {
+                normalized = 0;
+                turns += 1;
+            }
+
+            if (((Int64)turns & 1) != 0)
+                size = new Vector2(size.Y, size.X);
+
+            return normalized;
+        }
+
+        // the same local frame shots are tested in
+        private static Vector2 ToLocal(Vector2 position, Double rotation)
+        {
+            Single cos = (Single)Math.Cos(rotation);
+            Single sin = (Single)Math.Sin(rotation);
+
+            return new Vector2(position.X * cos + position.Y * sin, -position.X * sin + position.Y * cos);
+        }
+
+        private static Vector2 ToWorld(Vector2 position, Double rotation)
+        {
+            Single cos = (Single)Math.Cos(rotation);
+            Single sin = (Single)Math.Sin(rotation);
+
+            return new Vector2(position.X * cos - position.Y * sin, position.X * sin + position.Y * cos);
+        }
+
+        #endregion
+    }
+}
@@ -0,0 +1,901 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.Linq;
+using System.Linq.Expressions;
+using System.Text;
+using System.Threading;
+
+using log4net;
+using log4net.Core;
+
+namespace AngryTanks.Common
+{
+    /// <summary>
+    /// A logger for hot paths that never formats messages or does I/O on the calling thread.
+    /// </summary>
+    /// <remarks>
+    /// Level checks are a cached field, so a disabled call costs a branch. Enabled calls copy their arguments
+    /// into a preallocated ring of events without boxing primitives or enums, and a background thread
+    /// formats them and hands them to log4net. Objects other than strings are the exception, they are turned into
+    /// text by the call since they may have changed before the writer gets to them, so prefer logging their fields.
+    /// When the ring is full events are dropped rather than waited on.
+    /// Call <see cref="RefreshLevels"/> after changing log4net levels in code.
+    /// </remarks>
+    public sealed class FastLog
+    {
+        private static readonly ILog Log = LogManager.GetLogger(System.Reflection.MethodBase.GetCurrentMethod().DeclaringType);
+
+        #region Event Ring
+
+        // must be a power of two
+        private const int Capacity = 4096;
+        private const int MaxArguments = 4;
+
+        /// <summary>
+        /// A log call waiting for the writer thread, reused once it has been written.
+        /// </summary>
+        private sealed class LogEvent
+        {
+            // Vyukov-style sequence: equals the ring position when free, position + 1 once published
+            public int Sequence;
+
+            public FastLog Logger;
+            public Level Level;
+            public String Format;
+            public int ArgumentCount;
+            public DateTime Time;
+            public Thread Thread;
+
+            // each argument is either a reference, or a value type packed into 64 bits along with its type
+            public readonly Type[] Types = new Type[MaxArguments];
+            public readonly Int64[] Bits = new Int64[MaxArguments];
+            public readonly Object[] References = new Object[MaxArguments];
+
+            public void Store<T>(T argument, int index)
+            {
+                if (ArgumentPacker<T>.Pack == null)
+                {
+                    Types[index] = null;
+                    References[index] = Snapshot(argument);
+                }
+                else
+                {
+                    Types[index] = typeof(T);
+                    Bits[index] = ArgumentPacker<T>.Pack(argument);
+                }
+            }
+
+            /// <summary>
+            /// Turns an object into its text now, since by the time the writer thread formats it the caller may have
+            /// changed it or be in the middle of doing so. Strings and boxed values are copies already.
+            /// </summary>
+            private static Object Snapshot(Object argument)
+            {
+                if (argument == null || argument is String || argument.GetType().IsValueType)
+                    return argument;
+
+                try
+                {
+                    IFormattable formattable = argument as IFormattable;
+
+                    if (formattable != null)
+                        return formattable.ToString(null, CultureInfo.InvariantCulture);
+
+                    return argument.ToString();
+                }
+                catch (Exception e)
+                {
+                    return String.Format("<{0}.ToString() threw {1}>", argument.GetType().Name, e.GetType().Name);
+                }
+            }
+
+            public Object GetArgument(int index)
+            {
+                Type type = Types[index];
+
+                if (type == null)
+                    return References[index];
+
+                return ArgumentPacker.Unpack(type, Bits[index]);
+            }
+
+            public void Clear()
+            {
+                Logger = null;
+                Format = null;
+                Thread = null;
+
+                for (int i = 0; i < MaxArguments; i++)
+                    References[i] = null;
+            }
+        }
+
+        private static readonly LogEvent[] ring = new LogEvent[Capacity];
+
+        // next position to be claimed by a caller, and next position to be written out
+        private static int tail, head;
+
+        private static int dropped;
+
+        // only touched by whoever holds drainLock
+        private static int failed;
+        private static Exception lastFailure;
+
+        private static readonly Object drainLock = new Object();
+
+        private static readonly List<FastLog> loggers = new List<FastLog>();
+
+        static FastLog()
+        {
+            for (int i = 0; i < Capacity; i++)
+            {
+                ring[i] = new LogEvent();
+                ring[i].Sequence = i;
+            }
+
+            LogManager.GetRepository().ConfigurationChanged += delegate { RefreshLevels(); };
+            AppDomain.CurrentDomain.ProcessExit += delegate { Flush(); };
+
+            Thread writer = new Thread(RunWriter);
+            writer.Name = "Log Writer";
+            writer.IsBackground = true;
+            writer.Priority = ThreadPriority.BelowNormal;
+            writer.Start();
+        }
+
+        private LogEvent Claim(Level level, String format, int argumentCount)
+        {
+            int position = Thread.VolatileRead(ref tail);
+
+            while (true)
+            {
+                LogEvent logEvent = ring[position & (Capacity - 1)];
+                int difference = Thread.VolatileRead(ref logEvent.Sequence) - position;
+
+                if (difference == 0)
+                {
+                    int claimed = Interlocked.CompareExchange(ref tail, position + 1, position);
+
+                    if (claimed == position)
+                    {
+                        logEvent.Logger = this;
+                        logEvent.Level = level;
+                        logEvent.Format = format;
+                        logEvent.ArgumentCount = argumentCount;
+                        logEvent.Time = DateTime.UtcNow;
+                        logEvent.Thread = Thread.CurrentThread;
+
+                        return logEvent;
+                    }
+
+                    position = claimed;
+                }
+                else if (difference < 0)
+                {
+                    // the writer hasn't got to this one yet, so we're full
+                    Interlocked.Increment(ref dropped);
+                    return null;
+                }
+                else
+                {
+                    // someone else got there first
+                    position = Thread.VolatileRead(ref tail);
+                }
+            }
+        }
+
+        private static void Publish(LogEvent logEvent)
+        {
+            Thread.VolatileWrite(ref logEvent.Sequence, logEvent.Sequence + 1);
+        }
+
+        private static void RunWriter()
+        {
+            while (true)
+            {
+                if (Drain() == 0)
+                    Thread.Sleep(10);
+            }
+        }
+
+        /// <summary>
+        /// Writes out everything logged so far on the calling thread.
+        /// </summary>
+        public static void Flush()
+        {
+            Drain();
+        }
+
+        private static int Drain()
+        {
+            int written = 0;
+
+            lock (drainLock)
+            {
+                while (true)
+                {
+                    LogEvent logEvent = ring[head & (Capacity - 1)];
+
+                    if (Thread.VolatileRead(ref logEvent.Sequence) != head + 1)
+                        break;
+
+                    try
+                    {
+                        Write(logEvent);
+                    }
+                    catch (Exception e)
+                    {
+                        // one bad event mustn't stop the writer thread, or everything queued behind it
+                        failed++;
+                        lastFailure = e;
+                    }
+
+                    logEvent.Clear();
+
+                    // free for the caller that comes around to it next
+                    Thread.VolatileWrite(ref logEvent.Sequence, head + Capacity);
+                    head++;
+                    written++;
+                }
+
+                int lost = Interlocked.Exchange(ref dropped, 0);
+
+                try
+                {
+                    if (lost > 0)
+                        Log.WarnFormat("Dropped {0} log events, the log writer could not keep up", lost);
+
+                    if (failed > 0)
+                        Log.Error(String.Format("Could not write {0} log events", failed), lastFailure);
+                }
+                catch (Exception)
+                {
+                    // log4net itself is failing, there is nowhere left to report it
+                }
+
+                failed = 0;
+                lastFailure = null;
+            }
+
+            return written;
+        }
+
+        private static void Write(LogEvent logEvent)
+        {
+            String message = logEvent.Format;
+
+            if (logEvent.ArgumentCount > 0)
+            {
+                Object[] arguments = new Object[logEvent.ArgumentCount];
+
+                for (int i = 0; i < arguments.Length; i++)
+                    arguments[i] = logEvent.GetArgument(i);
+
+                try
+                {
+                    // log4net formats with the invariant culture too
+                    message = String.Format(CultureInfo.InvariantCulture, logEvent.Format, arguments);
+                }
+                catch (FormatException e)
+                {
+                    message = String.Format("<log format error: {0}> {1}", e.Message, logEvent.Format);
+                }
+            }
+
+            LoggingEventData data = new LoggingEventData();
+
+            data.LoggerName = logEvent.Logger.log.Logger.Name;
+            data.Level      = logEvent.Level;
+            data.Message    = message;
+            data.TimeStamp  = logEvent.Time.ToLocalTime();
+            data.ThreadName = logEvent.Thread.Name ?? logEvent.Thread.ManagedThreadId.ToString();
+            data.Domain     = AppDomain.CurrentDomain.FriendlyName;
+
+            logEvent.Logger.log.Logger.Log(new LoggingEvent(data));
+        }
+
+        #endregion
+
+        #region Argument Packing
+
+        /// <summary>
+        /// Packs value types into 64 bits so logging them doesn't box on the calling thread.
+        /// </summary>
+        private static class ArgumentPacker
+        {
+            public static Object Unpack(Type type, Int64 bits)
+            {
+                if (type.IsEnum)
+                    return Enum.ToObject(type, bits);
+
+                switch (Type.GetTypeCode(type))
+                {
+                    case TypeCode.Boolean: return bits != 0;
+                    case TypeCode.Char:    return (Char)bits;
+                    case TypeCode.SByte:   return (SByte)bits;
+                    case TypeCode.Byte:    return (Byte)bits;
+                    case TypeCode.Int16:   return (Int16)bits;
+                    case TypeCode.UInt16:  return (UInt16)bits;
+                    case TypeCode.Int32:   return (Int32)bits;
+                    case TypeCode.UInt32:  return (UInt32)bits;
+                    case TypeCode.Int64:   return bits;
+                    case TypeCode.UInt64:  return unchecked((UInt64)bits);
+                    case TypeCode.Single:  return (Single)BitConverter.Int64BitsToDouble(bits);
+                    case TypeCode.Double:  return BitConverter.Int64BitsToDouble(bits);
+                    case TypeCode.DateTime: return DateTime.FromBinary(bits);
+                }
+
+                if (type == typeof(TimeSpan))
+                    return new TimeSpan(bits);
+
+                throw new NotSupportedException(type.FullName);
+            }
+        }
+
+        /// <summary>
+        /// Holds the packing function for <typeparamref name="T"/>, or null if it is kept as a reference.
+        /// </summary>
+        private static class ArgumentPacker<T>
+        {
+            public static readonly Func<T, Int64> Pack = CreatePacker();
+
+            private static Func<T, Int64> CreatePacker()
+            {
+                Type type = typeof(T);
+                ParameterExpression value = Expression.Parameter(type, "value");
+                Expression body;
+
+                if (!type.IsValueType)
+                    return null;
+
+                if (type.IsEnum)
+                {
+                    body = Expression.Convert(Expression.Convert(value, Enum.GetUnderlyingType(type)), typeof(Int64));
+                }
+                else
+                {
+                    switch (Type.GetTypeCode(type))
+                    {
+                        case TypeCode.Boolean:
+                            body = Expression.Condition(value, Expression.Constant(1L), Expression.Constant(0L));
+                            break;
+
+                        case TypeCode.Char:
+                        case TypeCode.SByte:
+                        case TypeCode.Byte:
+                        case TypeCode.Int16:
+                        case TypeCode.UInt16:
+                        case TypeCode.Int32:
+                        case TypeCode.UInt32:
+                        case TypeCode.Int64:
+                        case TypeCode.UInt64:
+                            body = Expression.Convert(value, typeof(Int64));
+                            break;
+
+                        case TypeCode.Single:
+                        case TypeCode.Double:
+                            body = Expression.Call(typeof(BitConverter).GetMethod("DoubleToInt64Bits"),
+                                                   Expression.Convert(value, typeof(Double)));
+                            break;
+
+                        case TypeCode.DateTime:
+                            body = Expression.Call(value, typeof(DateTime).GetMethod("ToBinary"));
+                            break;
+
+                        default:
+                            if (type != typeof(TimeSpan))
+                                return null;
+
+                            body = Expression.Property(value, "Ticks");
+                            break;
+                    }
+                }
+
+                return Expression.Lambda<Func<T, Int64>>(body, value).Compile();
+            }
+        }
+
+        #endregion
+
+        /// <summary>
+        /// Gets the <see cref="FastLog"/> for a type, backed by its log4net logger.
+        /// </summary>
+        /// <param name="type"></param>
+        /// <returns></returns>
+        public static FastLog GetLogger(Type type)
+        {
+            FastLog logger = new FastLog(LogManager.GetLogger(type));
+
+            lock (loggers)
+                loggers.Add(logger);
+
+            return logger;
+        }
+
+        /// <summary>
+        /// Picks up changes to log4net's levels. Configuration reloads are picked up automatically.
+        /// </summary>
+        public static void RefreshLevels()
+        {
+            lock (loggers)
+            {
+                foreach (FastLog logger in loggers)
+                    logger.Refresh();
+            }
+        }
+
+        private readonly ILog log;
+
+        private bool isDebugEnabled, isInfoEnabled, isWarnEnabled, isErrorEnabled, isFatalEnabled;
+
+        private FastLog(ILog log)
+        {
+            this.log = log;
+
+            Refresh();
+        }
+
+        private void Refresh()
+        {
+            isDebugEnabled = log.IsDebugEnabled;
+            isInfoEnabled = log.IsInfoEnabled;
+            isWarnEnabled = log.IsWarnEnabled;
+            isErrorEnabled = log.IsErrorEnabled;
+            isFatalEnabled = log.IsFatalEnabled;
+        }
+
+        #region Level Checks
+
+        public bool IsDebugEnabled
+        {
+            get { return isDebugEnabled; }
+        }
+
+        public bool IsInfoEnabled
+        {
+            get { return isInfoEnabled; }
+        }
+
+        public bool IsWarnEnabled
+        {
+            get { return isWarnEnabled; }
+        }
+
+        public bool IsErrorEnabled
+        {
+            get { return isErrorEnabled; }
+        }
+
+        public bool IsFatalEnabled
+        {
+            get { return isFatalEnabled; }
+        }
+
+        #endregion
+
+        #region Logging
+
+        /// <summary>
+        /// Logs a message at the debug level.
+        /// </summary>
+        /// <param name="message"></param>
+        public void Debug(String message)
+        {
+            if (!isDebugEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Debug, message, 0);
+
+            if (logEvent != null)
+                Publish(logEvent);
+        }
+
+        /// <summary>
+        /// Logs a formatted message at the debug level, the arguments are only formatted on the writer thread.
+        /// </summary>
+        public void DebugFormat<T0>(String format, T0 arg0)
+        {
+            if (!isDebugEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Debug, format, 1);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+
+            Publish(logEvent);
+        }
+
+        public void DebugFormat<T0, T1>(String format, T0 arg0, T1 arg1)
+        {
+            if (!isDebugEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Debug, format, 2);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+
+            Publish(logEvent);
+        }
+
+        public void DebugFormat<T0, T1, T2>(String format, T0 arg0, T1 arg1, T2 arg2)
+        {
+            if (!isDebugEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Debug, format, 3);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+            logEvent.Store(arg2, 2);
+
+            Publish(logEvent);
+        }
+
+        public void DebugFormat<T0, T1, T2, T3>(String format, T0 arg0, T1 arg1, T2 arg2, T3 arg3)
+        {
+            if (!isDebugEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Debug, format, 4);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+            logEvent.Store(arg2, 2);
+            logEvent.Store(arg3, 3);
+
+            Publish(logEvent);
+        }
+
+        /// <summary>
+        /// Logs a message at the info level.
+        /// </summary>
+        /// <param name="message"></param>
+        public void Info(String message)
+        {
+            if (!isInfoEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Info, message, 0);
+
+            if (logEvent != null)
+                Publish(logEvent);
+        }
+
+        /// <summary>
+        /// Logs a formatted message at the info level, the arguments are only formatted on the writer thread.
+        /// </summary>
+        public void InfoFormat<T0>(String format, T0 arg0)
+        {
+            if (!isInfoEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Info, format, 1);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+
+            Publish(logEvent);
+        }
+
+        public void InfoFormat<T0, T1>(String format, T0 arg0, T1 arg1)
+        {
+            if (!isInfoEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Info, format, 2);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+
+            Publish(logEvent);
+        }
+
+        public void InfoFormat<T0, T1, T2>(String format, T0 arg0, T1 arg1, T2 arg2)
+        {
+            if (!isInfoEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Info, format, 3);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+            logEvent.Store(arg2, 2);
+
+            Publish(logEvent);
+        }
+
+        public void InfoFormat<T0, T1, T2, T3>(String format, T0 arg0, T1 arg1, T2 arg2, T3 arg3)
+        {
+            if (!isInfoEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Info, format, 4);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+            logEvent.Store(arg2, 2);
+            logEvent.Store(arg3, 3);
+
+            Publish(logEvent);
+        }
+
+        /// <summary>
+        /// Logs a message at the warn level.
+        /// </summary>
+        /// <param name="message"></param>
+        public void Warn(String message)
+        {
+            if (!isWarnEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Warn, message, 0);
+
+            if (logEvent != null)
+                Publish(logEvent);
+        }
+
+        /// <summary>
+        /// Logs a formatted message at the warn level, the arguments are only formatted on the writer thread.
+        /// </summary>
+        public void WarnFormat<T0>(String format, T0 arg0)
+        {
+            if (!isWarnEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Warn, format, 1);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+
+            Publish(logEvent);
+        }
+
+        public void WarnFormat<T0, T1>(String format, T0 arg0, T1 arg1)
+        {
+            if (!isWarnEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Warn, format, 2);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+
+            Publish(logEvent);
+        }
+
+        public void WarnFormat<T0, T1, T2>(String format, T0 arg0, T1 arg1, T2 arg2)
+        {
+            if (!isWarnEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Warn, format, 3);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+            logEvent.Store(arg2, 2);
+
+            Publish(logEvent);
+        }
+
+        public void WarnFormat<T0, T1, T2, T3>(String format, T0 arg0, T1 arg1, T2 arg2, T3 arg3)
+        {
+            if (!isWarnEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Warn, format, 4);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+            logEvent.Store(arg2, 2);
+            logEvent.Store(arg3, 3);
+
+            Publish(logEvent);
+        }
+
+        /// <summary>
+        /// Logs a message at the error level.
+        /// </summary>
+        /// <param name="message"></param>
+        public void Error(String message)
+        {
+            if (!isErrorEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Error, message, 0);
+
+            if (logEvent != null)
+                Publish(logEvent);
+        }
+
+        /// <summary>
+        /// Logs a formatted message at the error level, the arguments are only formatted on the writer thread.
+        /// </summary>
+        public void ErrorFormat<T0>(String format, T0 arg0)
+        {
+            if (!isErrorEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Error, format, 1);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+
+            Publish(logEvent);
+        }
+
+        public void ErrorFormat<T0, T1>(String format, T0 arg0, T1 arg1)
+        {
+            if (!isErrorEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Error, format, 2);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+
+            Publish(logEvent);
+        }
+
+        public void ErrorFormat<T0, T1, T2>(String format, T0 arg0, T1 arg1, T2 arg2)
+        {
+            if (!isErrorEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Error, format, 3);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+            logEvent.Store(arg2, 2);
+
+            Publish(logEvent);
+        }
+
+        public void ErrorFormat<T0, T1, T2, T3>(String format, T0 arg0, T1 arg1, T2 arg2, T3 arg3)
+        {
+            if (!isErrorEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Error, format, 4);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+            logEvent.Store(arg2, 2);
+            logEvent.Store(arg3, 3);
+
+            Publish(logEvent);
+        }
+
+        /// <summary>
+        /// Logs a message at the fatal level.
+        /// </summary>
+        /// <param name="message"></param>
+        public void Fatal(String message)
+        {
+            if (!isFatalEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Fatal, message, 0);
+
+            if (logEvent != null)
+                Publish(logEvent);
+        }
+
+        /// <summary>
+        /// Logs a formatted message at the fatal level, the arguments are only formatted on the writer thread.
+        /// </summary>
+        public void FatalFormat<T0>(String format, T0 arg0)
+        {
+            if (!isFatalEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Fatal, format, 1);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+
+            Publish(logEvent);
+        }
+
+        public void FatalFormat<T0, T1>(String format, T0 arg0, T1 arg1)
+        {
+            if (!isFatalEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Fatal, format, 2);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+
+            Publish(logEvent);
+        }
+
+        public void FatalFormat<T0, T1, T2>(String format, T0 arg0, T1 arg1, T2 arg2)
+        {
+            if (!isFatalEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Fatal, format, 3);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+            logEvent.Store(arg2, 2);
+
+            Publish(logEvent);
+        }
+
+        public void FatalFormat<T0, T1, T2, T3>(String format, T0 arg0, T1 arg1, T2 arg2, T3 arg3)
+        {
+            if (!isFatalEnabled)
+                return;
+
+            LogEvent logEvent = Claim(Level.Fatal, format, 4);
+
+            if (logEvent == null)
+                return;
+
+            logEvent.Store(arg0, 0);
+            logEvent.Store(arg1, 1);
+            logEvent.Store(arg2, 2);
+            logEvent.Store(arg3, 3);
+
+            Publish(logEvent);
+        }
+
+        #endregion
+    }
+}
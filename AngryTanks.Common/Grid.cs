@@ -7,14 +7,13 @@ using Microsoft.Xna.Framework;
 namespace AngryTanks.Common
 {
     /// <summary>
-    /// Structure that represents one grid block whose position coordinates
-    /// are measured from the center of the world (in world units).
+    /// Structure that represents one grid block, numbered from the upper left corner of the world.
     /// </summary>
     public struct GridLocation
     {
         #region Properties
 
-        // world unit coords of grid cell
+        // column and row of grid cell
         public readonly Int16 X, Y;
 
         // bounds of the grid cell
@@ -22,12 +21,12 @@ namespace AngryTanks.Common
 
         #endregion
 
-        public GridLocation(Int16 X, Int16 Y, Vector2 worldCellSize)
+        public GridLocation(Int16 X, Int16 Y, Vector2 worldOrigin, Vector2 worldCellSize)
         {
             this.X = X;
             this.Y = Y;
-            this.Bounds = new RotatedRectangle(X * worldCellSize.X,
-                                               Y * worldCellSize.Y,
+            this.Bounds = new RotatedRectangle(worldOrigin.X + X * worldCellSize.X,
+                                               worldOrigin.Y + Y * worldCellSize.Y,
                                                    worldCellSize.X,
                                                    worldCellSize.Y, 0);
         }
@@ -64,8 +63,38 @@ namespace AngryTanks.Common
         }
     }
 
+    /// <summary>
+    /// Buckets static <see cref="IWorldObject"/>s into a grid of cells covering the world, so finding what an object
+    /// could be touching only looks at the objects near it.
+    /// </summary>
+    /// <remarks>
+    /// Unless told otherwise the grid picks its own resolution with <see cref="ChooseGridSize"/>, from how many objects
+    /// there are, how big they are and how big the things asked about are. Columns and rows are chosen separately, so
+    /// cells need not be square. Cells are found from positions in floating point, so a position maps to exactly the
+    /// cell it is in. Anything beyond the edge of the world is kept in the cells along the edge.
+    /// </remarks>
     public class Grid
     {
+        #region Cost Model
+
+        // relative cost of the work a query does, fitted to the "grid" benchmark's sweep of the maps in Content/maps;
+        // a visited cell that's empty is next to free, it's the candidates and their exact tests that cost
+        private const Double CellCost      = 1;   // visiting a cell
+        private const Double EntryCost     = 20;  // looking at an object listed in a visited cell
+        private const Double CandidateCost = 250; // returning a candidate, which the caller then tests exactly
+
+        // most cells along either side
+        private const int MaxCellsPerSide = 256;
+
+        /// <summary>
+        /// Size of the things asked about when not given, a tank's bounds at its widest.
+        /// </summary>
+        public static readonly Vector2 DefaultQuerySize = new Vector2(8, 8);
+
+        #endregion
+
+        #region Properties
+
         private List<IWorldObject> allObjects = new List<IWorldObject>();
 
         public List<IWorldObject> AllObjects
@@ -73,21 +102,56 @@ namespace AngryTanks.Common
             get { return allObjects; }
         }
 
-        private Dictionary<GridLocation, List<IWorldObject>> grid = new Dictionary<GridLocation, List<IWorldObject>>();
+        private Point gridSize;
+
+        /// <summary>
+        /// Gets the number of columns and rows.
+        /// </summary>
+        public Point GridSize
+        {
+            get { return gridSize; }
+        }
 
-        // grid characteristics
-        private Vector2 cellSize; // world dimensions of each grid cell        
-        private Point gridSize;   // X-by-Y dimensions of grid
-        private Point minGrid;    // upper left most coord of Grid
-        private Point maxGrid;    // lower right most coord of Grid
+        private Vector2 cellSize;
 
         /// <summary>
-        /// Constructs a default 16x16 <see cref="Grid"/>.
+        /// Gets the world dimensions of each cell.
+        /// </summary>
+        public Vector2 CellSize
+        {
+            get { return cellSize; }
+        }
+
+        #endregion
+
+        // indices into allObjects by cell, row after row
+        private Int32[][] cells;
+
+        // upper left corner of the world, and the reciprocal of the cell size so mapping a position is a multiply
+        private Vector2 origin;
+        private Vector2 cellsPerUnit;
+
+        // the query each object was last returned by, so every object is returned once per query
+        private Int32[] lastSeen;
+        private Int32 query = 0;
+
+        /// <summary>
+        /// Constructs a <see cref="Grid"/> with a resolution suited to its objects and tank sized queries.
         /// </summary>
         /// <param name="worldSize"></param>
         /// <param name="allObjects"></param>
         public Grid(Vector2 worldSize, List<IWorldObject> allObjects)
-            : this(worldSize, new Point(16, 16), allObjects)
+            : this(worldSize, allObjects, DefaultQuerySize)
+        { }
+
+        /// <summary>
+        /// Constructs a <see cref="Grid"/> with a resolution suited to its objects and queries of <paramref name="querySize"/>.
+        /// </summary>
+        /// <param name="worldSize"></param>
+        /// <param name="allObjects"></param>
+        /// <param name="querySize">Typical size of the bounds of objects that will be asked about.</param>
+        public Grid(Vector2 worldSize, List<IWorldObject> allObjects, Vector2 querySize)
+            : this(worldSize, ChooseGridSize(worldSize, allObjects, querySize), allObjects)
         { }
 
         /// <summary>
@@ -98,17 +162,17 @@ namespace AngryTanks.Common
         /// <param name="allObjects"></param>
         public Grid(Vector2 worldSize, Point gridSize, List<IWorldObject> allObjects)
         {
-            this.allObjects = allObjects;
-
-            this.cellSize.X = worldSize.X / gridSize.X;
-            this.cellSize.Y = worldSize.Y / gridSize.Y;
+            if (gridSize.X < 1 || gridSize.Y < 1 || gridSize.X > Int16.MaxValue || gridSize.Y > Int16.MaxValue)
+                throw new ArgumentOutOfRangeException("gridSize", gridSize, "Grid must have at least one cell a side");
 
+            this.allObjects = allObjects;
             this.gridSize = gridSize;
 
-            this.minGrid.X = -gridSize.X / 2;
-            this.minGrid.Y = -gridSize.Y / 2;
-            this.maxGrid.X = (gridSize.X / 2) - 1; // you must substract 1 to get the upper left
-            this.maxGrid.Y = (gridSize.X / 2) - 1; // corner of the lower right-most grid cell
+            this.cellSize = new Vector2(worldSize.X / gridSize.X, worldSize.Y / gridSize.Y);
+            this.cellsPerUnit = new Vector2(gridSize.X / worldSize.X, gridSize.Y / worldSize.Y);
+            this.origin = -worldSize / 2;
+
+            this.lastSeen = new Int32[allObjects.Count];
 
             CutIntoGrid();
         }
@@ -121,195 +185,250 @@ namespace AngryTanks.Common
         /// <returns></returns>
         public List<IWorldObject> PotentialIntersects(IWorldObject worldObject)
         {
-            UniqueList<IWorldObject> collidables = new UniqueList<IWorldObject>();
+            List<IWorldObject> collidables = new List<IWorldObject>();
+
+            Point min, max;
+            GetCellRange(worldObject, out min, out max);
 
-            // find all grid locations that contain the object
-            List<GridLocation> IntersectedGridCells = Intersects(worldObject);
-            foreach (GridLocation gridLocation in IntersectedGridCells)
+            if (++query == Int32.MaxValue)
             {
-                // compile a list of all objects contained in the found Grid Locations
-                collidables.UnionWith(getLocationObjectsOf(gridLocation));
+                Array.Clear(lastSeen, 0, lastSeen.Length);
+                query = 1;
+            }
+
+            for (int y = min.Y; y <= max.Y; y++)
+            {
+                for (int x = min.X; x <= max.X; x++)
+                {
+                    foreach (Int32 index in cells[y * gridSize.X + x])
+                    {
+                        if (lastSeen[index] == query)
+                            continue;
+
+                        lastSeen[index] = query;
+                        collidables.Add(allObjects[index]);
+                    }
+                }
             }
 
             return collidables;
         }
 
         /// <summary>
-        /// 
+        ///
         /// </summary>
         /// <param name="gridLocation"></param>
         /// <returns><see cref="IWorldObject"/>s associated with a given <paramref name="gridLocation"/></returns>
         public List<IWorldObject> getLocationObjectsOf(GridLocation gridLocation)
         {
-            return grid[gridLocation];
+            return cells[gridLocation.Y * gridSize.X + gridLocation.X].Select(i => allObjects[i]).ToList();
         }
 
         /// <summary>
-        /// Cuts the world up into <see cref="GridLocation"/>s and associates
-        /// <see cref="IWorldObject"/>s with cells.
+        ///
         /// </summary>
-        private void CutIntoGrid()
+        /// <param name="worldObject"></param>
+        /// <returns>A list of all <see cref="GridLocation"/>s containing the <see cref="IWorldObject"/></returns>
+        public List<GridLocation> Intersects(IWorldObject worldObject)
         {
-            // STEP 1. Initialize the Dictionary
-            // current grid coords
-            Int16 X, Y;
+            Point min, max;
+            GetCellRange(worldObject, out min, out max);
 
-            // start in the upper left corner
-            X = (Int16)minGrid.X;
-            Y = (Int16)minGrid.Y;
+            List<GridLocation> found = new List<GridLocation>((max.X - min.X + 1) * (max.Y - min.Y + 1));
 
-            // make appropriate number of grid locations, filling the dictionary
-            while (X <= maxGrid.X)
+            // objects in a single cell, or lined up with the grid, cover every cell of their bounding box,
+            // and anything reaching past the edge of the world covers the edge cells it was clamped to
+            bool exact = (min == max) || IsAxisAligned(worldObject.Rotation) || !IsInsideWorld(worldObject);
+
+            for (int y = min.Y; y <= max.Y; y++)
             {
-                while (Y <= maxGrid.Y)
+                for (int x = min.X; x <= max.X; x++)
                 {
-                    grid.Add(new GridLocation(X, Y, cellSize), new List<IWorldObject>());
-                    Y++;
-                }
+                    GridLocation gridLocation = new GridLocation((Int16)x, (Int16)y, origin, cellSize);
 
-                // when finished with one column, reset Y and increment X
-                Y = (Int16)minGrid.Y;
-                X++;
+                    if (exact || worldObject.Bounds.Intersects(gridLocation.Bounds))
+                        found.Add(gridLocation);
+                }
             }
 
-            // STEP 2. Associate objects with their GridLocations
-            foreach (IWorldObject worldObject in allObjects)
+            return found;
+        }
+
+        /// <summary>
+        /// Picks the columns and rows that make queries of <paramref name="querySize"/> cheapest by
+        /// <see cref="EstimateQueryCost"/>.
+        /// </summary>
+        public static Point ChooseGridSize(Vector2 worldSize, IList<IWorldObject> objects, Vector2 querySize)
+        {
+            AxisCost[] columns = GetAxisCosts(worldSize.X, objects.Select(o => GetExtents(o).X).ToList(), querySize.X);
+            AxisCost[] rows    = GetAxisCosts(worldSize.Y, objects.Select(o => GetExtents(o).Y).ToList(), querySize.Y);
+
+            Point best = new Point(1, 1);
+            Double bestCost = Double.MaxValue;
+
+            // coarsest first, so ties go to fewer cells
+            for (int x = 1; x <= MaxCellsPerSide; x++)
             {
-                List<GridLocation> intersectedGridCells = Intersects(worldObject);
-                foreach (GridLocation gridLocation in intersectedGridCells)
+                for (int y = 1; y <= MaxCellsPerSide; y++)
                 {
-                    grid[gridLocation].Add(worldObject);
+                    Double cost = Combine(columns[x], rows[y], objects.Count);
+
+                    if (cost < bestCost)
+                    {
+                        best = new Point(x, y);
+                        bestCost = cost;
+                    }
                 }
             }
+
+            return best;
         }
 
         /// <summary>
-        /// 
+        /// Estimates the relative cost of a query of <paramref name="querySize"/> against a grid of <paramref name="gridSize"/>,
+        /// counting the cells it visits, the objects listed in them and the candidates it returns.
         /// </summary>
-        /// <param name="worldObject"></param>
-        /// <returns>A list of all <see cref="GridLocation"/>s containing the <see cref="IWorldObject"/></returns>
-        public List<GridLocation> Intersects(IWorldObject worldObject)
+        /// <remarks>
+        /// Objects and queries are taken to be anywhere in the world with equal chance, and the two axes to be independent.
+        /// </remarks>
+        public static Double EstimateQueryCost(Vector2 worldSize, Point gridSize, IList<IWorldObject> objects, Vector2 querySize)
         {
-            List<GridLocation> found = new List<GridLocation>(gridSize.X * gridSize.Y);
-            List<GridLocation> missed = new List<GridLocation>(gridSize.X * gridSize.Y);
-            UniqueList<GridLocation> toTest = new UniqueList<GridLocation>(gridSize.X * gridSize.Y);
-            UniqueList<GridLocation> newToBeTested = new UniqueList<GridLocation>(gridSize.X * gridSize.Y);
-
-            // the GridLocation that contains the center of the object
-            GridLocation hasCenter;
-
-            // STEP 1 - determine the GridLocation of the object's center
-            Point cellCoord;
-
-            // Use integer division to find cell coordinates.
-            // Since the grid cell coords are in the upperleft corner
-            // 1 must be subtracted from the division if we are in the negative (left or up)
-            // direction - effectively rounding up in absolute value.
-            if (worldObject.Position.X < 0)
-                cellCoord.X = (Int16)(((Int16)worldObject.Position.X / (Int16)cellSize.X) - 1);
-            else
-                cellCoord.X = (Int16)(((Int16)worldObject.Position.X / (Int16)cellSize.X));
-
-            if (worldObject.Position.Y < 0)
-                cellCoord.Y = (Int16)(((Int16)worldObject.Position.Y / (Int16)cellSize.Y) - 1);
-            else
-                cellCoord.Y = (Int16)(((Int16)worldObject.Position.Y / (Int16)cellSize.Y));
-
-            // check to makes sure these coordinates are in the world
-            if (minGrid.X <= cellCoord.X && cellCoord.X <= maxGrid.X &&
-                minGrid.Y <= cellCoord.Y && cellCoord.Y <= maxGrid.Y)
-            {
-                hasCenter = new GridLocation((Int16)cellCoord.X,
-                                             (Int16)cellCoord.Y,
-                                             cellSize);
-            }
-            // if they are not in the world, return the empty list
-            else
+            AxisCost columns = GetAxisCost(worldSize.X, gridSize.X, objects.Select(o => GetExtents(o).X).ToList(), querySize.X);
+            AxisCost rows    = GetAxisCost(worldSize.Y, gridSize.Y, objects.Select(o => GetExtents(o).Y).ToList(), querySize.Y);
+
+            return Combine(columns, rows, objects.Count);
+        }
+
+        #region Helpers
+
+        /// <summary>
+        /// What a query costs along one axis of the grid.
+        /// </summary>
+        private struct AxisCost
+        {
+            // cells the query covers
+            public Double Cells;
+
+            // chance an object shares a cell with the query, and that times how many cells they share, averaged over objects
+            public Double Overlap, Shared;
+        }
+
+        private static Double Combine(AxisCost columns, AxisCost rows, int objectCount)
+        {
+            return CellCost      * columns.Cells * rows.Cells +
+                   EntryCost     * objectCount * columns.Shared * rows.Shared +
+                   CandidateCost * objectCount * columns.Overlap * rows.Overlap;
+        }
+
+        private static AxisCost[] GetAxisCosts(Single worldSize, List<Single> extents, Single querySize)
+        {
+            AxisCost[] costs = new AxisCost[MaxCellsPerSide + 1];
+
+            for (int count = 1; count <= MaxCellsPerSide; count++)
+                costs[count] = GetAxisCost(worldSize, count, extents, querySize);
+
+            return costs;
+        }
+
+        private static AxisCost GetAxisCost(Single worldSize, int count, List<Single> extents, Single querySize)
+        {
+            Double cell = worldSize / count;
+
+            AxisCost cost;
+            cost.Cells   = Math.Min(count, querySize / cell + 1);
+            cost.Overlap = 0;
+            cost.Shared  = 0;
+
+            if (extents.Count == 0)
+                return cost;
+
+            foreach (Single extent in extents)
             {
-                return found;
+                // two spans land in a common cell when they are within about a cell of touching
+                Double overlap = Math.Min(1, (extent + querySize + cell) / worldSize);
+                Double shared  = Math.Min(count, Math.Min(extent, querySize) / cell + 1);
+
+                cost.Overlap += overlap;
+                cost.Shared  += overlap * shared;
             }
 
-            // add it to the found list
-            found.Add(hasCenter);
+            cost.Overlap /= extents.Count;
+            cost.Shared  /= extents.Count;
 
-            // STEP 2 - determine all surrounding GridLocations that contain the object
-            toTest.UnionWith(GetSurrounding(hasCenter));
+            return cost;
+        }
 
-            while (toTest.Count != 0)
-            {
-                foreach (GridLocation gridLocation in toTest)
-                {
-                    // if a surrounding GridLocation intersects the object do 4 things
-                    if (worldObject.Bounds.Intersects(gridLocation.Bounds))
-                    {
-                        // 1. Add it to the found list
-                        found.Add(gridLocation);
+        /// <summary>
+        /// Gets the width and height of the axis-aligned box enclosing <paramref name="worldObject"/>.
+        /// </summary>
+        private static Vector2 GetExtents(IWorldObject worldObject)
+        {
+            Single cos = Math.Abs((Single)Math.Cos(worldObject.Rotation));
+            Single sin = Math.Abs((Single)Math.Sin(worldObject.Rotation));
 
-                        // 2. Get its surrounding GridLocations
-                        newToBeTested.UnionWith(GetSurrounding(gridLocation));
+            return new Vector2(cos * worldObject.Size.X + sin * worldObject.Size.Y,
+                               sin * worldObject.Size.X + cos * worldObject.Size.Y);
+        }
 
-                        // 3. Remove any that are already known to not contain the object
-                        foreach (GridLocation g in missed)
-                        {
-                            newToBeTested.Remove(g);
-                        }
+        private static bool IsAxisAligned(Single rotation)
+        {
+            Double quarters = rotation / MathHelper.PiOver2;
+            return Math.Abs(quarters - Math.Round(quarters)) < 1e-6;
+        }
 
-                        // 4. Remove any that are already known to contain the object
-                        foreach (GridLocation g in found)
-                        {
-                            newToBeTested.Remove(g);
-                        }
-                    }
-                    // if a surrounding GridLocation DOES NOT intersect the object add it to missed
-                    else
-                    {
-                        missed.Add(gridLocation);
-                    }
-                }
+        /// <summary>
+        /// Finds the cells under the bounding box of <paramref name="worldObject"/>, clamped to the grid.
+        /// </summary>
+        private void GetCellRange(IWorldObject worldObject, out Point min, out Point max)
+        {
+            Vector2 half = GetExtents(worldObject) / 2;
 
-                // since we have checked everything in toTest flush it
-                toTest.Clear();
+            min = new Point(GetColumn(worldObject.Position.X - half.X), GetRow(worldObject.Position.Y - half.Y));
+            max = new Point(GetColumn(worldObject.Position.X + half.X), GetRow(worldObject.Position.Y + half.Y));
+        }
 
-                // add the newly found surrounding candidates to toTest
-                toTest.UnionWith(newToBeTested);
+        private bool IsInsideWorld(IWorldObject worldObject)
+        {
+            Vector2 half = GetExtents(worldObject) / 2;
 
-                // flush the temp list
-                newToBeTested.Clear();
-            }
+            return worldObject.Position.X - half.X >= origin.X && worldObject.Position.X + half.X <= -origin.X &&
+                   worldObject.Position.Y - half.Y >= origin.Y && worldObject.Position.Y + half.Y <= -origin.Y;
+        }
 
-            return found;
+        private int GetColumn(Single x)
+        {
+            Double column = Math.Floor((x - origin.X) * cellsPerUnit.X);
+            return (int)Math.Max(0, Math.Min(gridSize.X - 1, column));
+        }
+
+        private int GetRow(Single y)
+        {
+            Double row = Math.Floor((y - origin.Y) * cellsPerUnit.Y);
+            return (int)Math.Max(0, Math.Min(gridSize.Y - 1, row));
         }
 
         /// <summary>
-        /// 
+        /// Associates <see cref="IWorldObject"/>s with the cells they cover.
         /// </summary>
-        /// <param name="gridLocation"></param>
-        /// <returns>
-        /// A list of the <see cref="GridLocation"/>s surrounding
-        /// <paramref name="gridLocation"/> so long as they exist in the world.
-        /// </returns>
-        private List<GridLocation> GetSurrounding(GridLocation gridLocation)
+        private void CutIntoGrid()
         {
-            GridLocation g = gridLocation;
-
-            List<GridLocation> surrounding = new List<GridLocation>(8);
-
-            surrounding.Add(new GridLocation((Int16)(g.X - 1), (Int16)(g.Y - 1), cellSize));
-            surrounding.Add(new GridLocation((Int16)(g.X - 1), (Int16)g.Y,       cellSize));
-            surrounding.Add(new GridLocation((Int16)(g.X - 1), (Int16)(g.Y + 1), cellSize));
-            surrounding.Add(new GridLocation((Int16)g.X,       (Int16)(g.Y - 1), cellSize));
-            //surrounding.Add(new GridLocation((Int16)g.X,     (Int16)g.Y,       cellSize)); - the cell itself
-            surrounding.Add(new GridLocation((Int16)g.X,       (Int16)(g.Y + 1), cellSize));
-            surrounding.Add(new GridLocation((Int16)(g.X + 1), (Int16)(g.Y - 1), cellSize));
-            surrounding.Add(new GridLocation((Int16)(g.X + 1), (Int16)g.Y,       cellSize));
-            surrounding.Add(new GridLocation((Int16)(g.X + 1), (Int16)(g.Y + 1), cellSize));
-
-            // check to make sure the surrounding cells are inside the world, remove any that don't
-            surrounding.RemoveAll(
-                s => s.X < minGrid.X || s.X > maxGrid.X || s.Y < minGrid.Y || s.Y > maxGrid.Y
-            );
-
-            return surrounding;
+            List<Int32>[] building = new List<Int32>[gridSize.X * gridSize.Y];
+
+            for (int i = 0; i < building.Length; i++)
+                building[i] = new List<Int32>();
+
+            for (int i = 0; i < allObjects.Count; i++)
+            {
+                foreach (GridLocation gridLocation in Intersects(allObjects[i]))
+                    building[gridLocation.Y * gridSize.X + gridLocation.X].Add(i);
+            }
+
+            cells = new Int32[building.Length][];
+
+            for (int i = 0; i < building.Length; i++)
+                cells[i] = building[i].ToArray();
         }
+
+        #endregion
     }
 }
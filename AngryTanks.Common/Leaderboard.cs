@@ -0,0 +1,389 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+
+namespace AngryTanks.Common
+{
+    /// <summary>
+    /// A standing on a <see cref="Leaderboard{TKey}"/>, a copy of the score as it was when set.
+    /// </summary>
+    public struct LeaderboardEntry<TKey>
+    {
+        public readonly TKey  Key;
+        public readonly Int32 Wins, Losses, Teamkills;
+
+        public Int32 Overall
+        {
+            get { return Wins - Losses - Teamkills; }
+        }
+
+        public LeaderboardEntry(TKey key, Int32 wins, Int32 losses, Int32 teamkills)
+        {
+            this.Key       = key;
+            this.Wins      = wins;
+            this.Losses    = losses;
+            this.Teamkills = teamkills;
+        }
+    }
+
+    /// <summary>
+    /// Scores kept in rank order as they change. Most wins ranks first, then the best overall score,
+    /// and remaining ties are broken by key so every peer agrees on the order.
+    /// </summary>
+    /// <remarks>
+    /// Entries live in a treap where every node knows the size of its subtree. Changing a score, finding the rank of a
+    /// key and finding the entry at a rank all take O(log n), and the top k entries are read off in O(log n + k),
+    /// so nothing is ever sorted. <see cref="Version"/> changes whenever the order or any score does, so anything
+    /// drawn from the leaderboard only needs rebuilding when it moves.
+    /// </remarks>
+    public class Leaderboard<TKey>
+    {
+        private class Node
+        {
+            public LeaderboardEntry<TKey> Entry;
+            public readonly Int32 Priority;
+            public Int32 Size = 1;
+            public Node Left, Right;
+
+            public Node(LeaderboardEntry<TKey> entry, Int32 priority)
+            {
+                this.Entry    = entry;
+                this.Priority = priority;
+            }
+        }
+
+        #region Properties
+
+        public Int32 Count
+        {
+            get { return nodes.Count; }
+        }
+
+        private UInt32 version = 0;
+
+        /// <summary>
+        /// Gets how many times the leaderboard has changed.
+        /// </summary>
+        public UInt32 Version
+        {
+            get { return version; }
+        }
+
+        #endregion
+
+        private Node root;
+
+        // every node by key, so finding an entry to change is a lookup rather than a search
+        private Dictionary<TKey, Node> nodes = new Dictionary<TKey, Node>();
+
+        private readonly IComparer<TKey> keyComparer = Comparer<TKey>.Default;
+
+        // the tree only has to be balanced on average, the seed is fixed so runs repeat
+        private readonly Random priorities = new Random(5150);
+
+        /// <summary>
+        /// Sets the score of <paramref name="key"/>, adding it if it isn't on the leaderboard yet.
+        /// </summary>
+        /// <returns>Whether anything changed.</returns>
+        public bool Set(TKey key, Score score)
+        {
+            return Set(key, score.Wins, score.Losses, score.Teamkills);
+        }
+
+        /// <summary>
+        /// Sets the score of <paramref name="key"/>, adding it if it isn't on the leaderboard yet.
+        /// </summary>
+        /// <returns>Whether anything changed.</returns>
+        public bool Set(TKey key, Int32 wins, Int32 losses, Int32 teamkills)
+        {
+            LeaderboardEntry<TKey> entry = new LeaderboardEntry<TKey>(key, wins, losses, teamkills);
+            Node node;
+
+            if (nodes.TryGetValue(key, out node))
+            {
+                if (node.Entry.Wins == wins && node.Entry.Losses == losses && node.Entry.Teamkills == teamkills)
+                    return false;
+
+                root = Remove(root, node.Entry);
+
+                node.Entry = entry;
+                node.Left = node.Right = null;
+                node.Size = 1;
+            }
+            else
+            {
+                node = new Node(entry, priorities.Next());
+                nodes.Add(key, node);
+            }
+
+            root = Insert(root, node);
+
+            ++version;
+
+            return true;
+        }
+
+        /// <summary>
+        /// Adds to the score of <paramref name="key"/>, starting from nothing if it isn't on the leaderboard yet.
+        /// </summary>
+        public void Add(TKey key, Int32 wins, Int32 losses, Int32 teamkills)
+        {
+            Node node;
+
+            if (nodes.TryGetValue(key, out node))
+                Set(key, node.Entry.Wins + wins, node.Entry.Losses + losses, node.Entry.Teamkills + teamkills);
+            else
+                Set(key, wins, losses, teamkills);
+        }
+
+        /// <summary>
+        /// Takes <paramref name="key"/> off the leaderboard.
+        /// </summary>
+        /// <returns>Whether it was on the leaderboard.</returns>
+        public bool Remove(TKey key)
+        {
+            Node node;
+
+            if (!nodes.TryGetValue(key, out node))
+                return false;
+
+            root = Remove(root, node.Entry);
+            nodes.Remove(key);
+
+            ++version;
+
+            return true;
+        }
+
+        public void Clear()
+        {
+            if (nodes.Count == 0)
+                return;
+
+            root = null;
+            nodes.Clear();
+
+            ++version;
+        }
+
+        public bool Contains(TKey key)
+        {
+            return nodes.ContainsKey(key);
+        }
+
+        public bool TryGetEntry(TKey key, out LeaderboardEntry<TKey> entry)
+        {
+            Node node;
+
+            if (nodes.TryGetValue(key, out node))
+            {
+                entry = node.Entry;
+                return true;
+            }
+
+            entry = default(LeaderboardEntry<TKey>);
+            return false;
+        }
+
+        /// <summary>
+        /// Gets the rank of <paramref name="key"/>, where 1 is the top.
+        /// </summary>
+        /// <exception cref="KeyNotFoundException"><paramref name="key"/> is not on the leaderboard.</exception>
+        public Int32 GetRank(TKey key)
+        {
+            LeaderboardEntry<TKey> entry = nodes[key].Entry;
+
+            Int32 rank = 1;
+            Node node = root;
+
+            while (true)
+            {
+                Int32 comparison = Compare(entry, node.Entry);
+
+                if (comparison == 0)
+                    return rank + SizeOf(node.Left);
+
+                if (comparison < 0)
+                {
+                    node = node.Left;
+                }
+                else
+                {
+                    rank += SizeOf(node.Left) + 1;
+                    node = node.Right;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Gets the entry at <paramref name="rank"/>, where 1 is the top.
+        /// </summary>
+        public LeaderboardEntry<TKey> GetEntryAt(Int32 rank)
+        {
+            if (rank < 1 || rank > Count)
+                throw new ArgumentOutOfRangeException("rank", rank, "Rank must be between 1 and the number of entries");
+
+            Node node = root;
+
+            while (true)
+            {
+                Int32 leftSize = SizeOf(node.Left);
+
+                if (rank <= leftSize)
+                {
+                    node = node.Left;
+                }
+                else if (rank == leftSize + 1)
+                {
+                    return node.Entry;
+                }
+                else
+                {
+                    rank -= leftSize + 1;
+                    node = node.Right;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Gets up to <paramref name="count"/> entries from the top down.
+        /// </summary>
+        public List<LeaderboardEntry<TKey>> GetTop(Int32 count)
+        {
+            List<LeaderboardEntry<TKey>> top = new List<LeaderboardEntry<TKey>>(Math.Max(0, Math.Min(count, Count)));
+            Stack<Node> path = new Stack<Node>();
+            Node node = root;
+
+            // in order walk, stopping as soon as we have enough
+            while (top.Count < count && (node != null || path.Count > 0))
+            {
+                if (node != null)
+                {
+                    path.Push(node);
+                    node = node.Left;
+                }
+                else
+                {
+                    node = path.Pop();
+                    top.Add(node.Entry);
+                    node = node.Right;
+                }
+            }
+
+            return top;
+        }
+
+        #region Treap
+
+        private Int32 Compare(LeaderboardEntry<TKey> a, LeaderboardEntry<TKey> b)
+        {
+            // higher scores come first
+            if (a.Wins != b.Wins)
+                return b.Wins.CompareTo(a.Wins);
+
+            if (a.Overall != b.Overall)
+                return b.Overall.CompareTo(a.Overall);
+
+            return keyComparer.Compare(a.Key, b.Key);
+        }
+
+        private static Int32 SizeOf(Node node)
+        {
+            return node != null ? node.Size : 0;
+        }
+
+        private static void Resize(Node node)
+        {
+            node.Size = SizeOf(node.Left) + SizeOf(node.Right) + 1;
+        }
+
+        private Node Insert(Node tree, Node node)
+        {
+            if (tree == null)
+                return node;
+
+            // the new node belongs above this subtree, so everything in it goes either side of the new node
+            if (node.Priority > tree.Priority)
+            {
+                Split(tree, node.Entry, out node.Left, out node.Right);
+                Resize(node);
+                return node;
+            }
+
+            if (Compare(node.Entry, tree.Entry) < 0)
+                tree.Left = Insert(tree.Left, node);
+            else
+                tree.Right = Insert(tree.Right, node);
+
+            Resize(tree);
+            return tree;
+        }
+
+        private Node Remove(Node tree, LeaderboardEntry<TKey> entry)
+        {
+            Int32 comparison = Compare(entry, tree.Entry);
+
+            if (comparison == 0)
+                return Merge(tree.Left, tree.Right);
+
+            if (comparison < 0)
+                tree.Left = Remove(tree.Left, entry);
+            else
+                tree.Right = Remove(tree.Right, entry);
+
+            Resize(tree);
+            return tree;
+        }
+
+        /// <summary>
+        /// Splits a subtree into the entries ranked above <paramref name="entry"/> and the rest.
+        /// </summary>
+        private void Split(Node tree, LeaderboardEntry<TKey> entry, out Node above, out Node below)
+        {
+            if (tree == null)
+            {
+                above = below = null;
+                return;
+            }
+
+            if (Compare(tree.Entry, entry) < 0)
+            {
+                Split(tree.Right, entry, out tree.Right, out below);
+                above = tree;
+            }
+            else
+            {
+                Split(tree.Left, entry, out above, out tree.Left);
+                below = tree;
+            }
+
+            Resize(tree);
+        }
+
+        /// <summary>
+        /// Joins two subtrees where every entry of <paramref name="above"/> ranks above every entry of <paramref name="below"/>.
+        /// </summary>
+        private static Node Merge(Node above, Node below)
+        {
+            if (above == null)
+                return below;
+
+            if (below == null)
+                return above;
+
+            if (above.Priority > below.Priority)
+            {
+                above.Right = Merge(above.Right, below);
+                Resize(above);
+                return above;
+            }
+
+            below.Left = Merge(above, below.Left);
+            Resize(below);
+            return below;
+        }
+
+        #endregion
+    }
+}
@@ -0,0 +1,78 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+
+using SevenZip.Compression.LZMA;
+
+namespace AngryTanks.Common
+{
+    /// <summary>
+    /// Compresses whole buffers with the LZMA codec Nuclex uses for its content packages.
+    /// </summary>
+    public static class Lzma
+    {
+        // coder properties written ahead of the compressed data
+        private const int PropertiesSize = 5;
+
+        /// <summary>
+        /// Compresses <paramref name="data"/>. The result begins with the coder properties,
+        /// the uncompressed length has to be kept elsewhere.
+        /// </summary>
+        /// <param name="data"></param>
+        /// <returns></returns>
+        public static Byte[] Compress(Byte[] data)
+        {
+            MemoryStream destination = new MemoryStream(data.Length / 2 + PropertiesSize);
+
+            Encoder encoder = new Encoder();
+            encoder.WriteCoderProperties(destination);
+            encoder.Code(new MemoryStream(data, false), destination, data.Length, -1, null);
+
+            return destination.ToArray();
+        }
+
+        /// <summary>
+        /// Decompresses data made by <see cref="Compress"/>.
+        /// </summary>
+        /// <param name="data"></param>
+        /// <param name="uncompressedLength">Length of the original data.</param>
+        /// <returns></returns>
+        /// <exception cref="InvalidDataException">The data is not valid LZMA data.</exception>
+        public static Byte[] Decompress(Byte[] data, int uncompressedLength)
+        {
+            if (data.Length < PropertiesSize)
+                throw new InvalidDataException("compressed data is too short");
+
+            Byte[] properties = new Byte[PropertiesSize];
+            Array.Copy(data, properties, PropertiesSize);
+
+            Byte[] result = new Byte[uncompressedLength];
+
+            MemoryStream source = new MemoryStream(data, PropertiesSize, data.Length - PropertiesSize, false);
+            MemoryStream destination = new MemoryStream(result, true);
+
+            try
+            {
+                Decoder decoder = new Decoder();
+                decoder.SetDecoderProperties(properties);
+                decoder.Code(source, destination, data.Length - PropertiesSize, uncompressedLength, null);
+            }
+            catch (ApplicationException e)
+            {
+                // the LZMA SDK reports bad data and bad properties with its own exceptions
+                throw new InvalidDataException("compressed data is corrupt", e);
+            }
+            catch (NotSupportedException e)
+            {
+                // thrown when the data decodes to more than we expected
+                throw new InvalidDataException("compressed data is longer than expected", e);
+            }
+
+            if (destination.Position != uncompressedLength)
+                throw new InvalidDataException("compressed data is shorter than expected");
+
+            return result;
+        }
+    }
+}
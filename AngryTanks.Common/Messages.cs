@@ -126,7 +126,7 @@ namespace AngryTanks.Common
 
         /// <summary>
         /// Sent by the client to indicate it is ready to receive initial state.
-        /// Sent by the server to indicate initial state is fully sent.
+        /// The server answers with a <see cref="MsgJoinSnapshotPacket"/>.
         /// </summary>
         public class MsgStatePacket : MsgBasePacket
         {
@@ -180,7 +180,7 @@ namespace AngryTanks.Common
             {
                 this.TypeCode = variable.TypeCode;
                 this.Name = variable.Name;
-                this.Value = variable.Value;
+                this.Value = variable.BoxedValue;
             }
 
             public static MsgSetVariablePacket Read(NetIncomingMessage packet)
@@ -388,6 +388,188 @@ namespace AngryTanks.Common
             }
         }
 
+        /// <summary>
+        /// Everything a joining player needs to know about one other player.
+        /// </summary>
+        public class JoinSnapshotEntry
+        {
+            public readonly PlayerInformation Player;
+            public readonly PlayerState State;
+            public readonly Score Score;
+            public readonly Vector2 Position;
+            public readonly Single Rotation;
+
+            public JoinSnapshotEntry(PlayerInformation player, PlayerState state, Score score, Vector2 position, Single rotation)
+            {
+                this.Player   = player;
+                this.State    = state;
+                this.Score    = score;
+                this.Position = position;
+                this.Rotation = rotation;
+            }
+        }
+
+        /// <summary>
+        /// Sent by the server as the complete initial state for a joining player: the roster, scores,
+        /// positions of live players and any changed variables, along with the joining player's own slot.
+        /// </summary>
+        /// <remarks>
+        /// Everything but the slot is the same for all players joining in a tick, so the server encodes
+        /// that body once with <see cref="EncodeBody"/> and shares the bytes between them.
+        /// </remarks>
+        public class MsgJoinSnapshotPacket : MsgBasePacket
+        {
+            public override MessageType MsgType
+            {
+                get { return MessageType.MsgJoinSnapshot; }
+            }
+
+            /// <summary>
+            /// Version of the snapshot body layout, bumped whenever it changes.
+            /// </summary>
+            public static readonly Byte SnapshotVersion = 1;
+
+            private const int TeamBits  = 3;
+            private const int StateBits = 3;
+
+            public readonly Byte Slot;
+            public readonly List<JoinSnapshotEntry> Players;
+            public readonly List<MsgSetVariablePacket> Variables;
+
+            private readonly Byte[] body;
+
+            /// <summary>
+            /// Used to construct a <see cref="MsgJoinSnapshotPacket"/> after reading it.
+            /// </summary>
+            public MsgJoinSnapshotPacket(Byte slot, List<JoinSnapshotEntry> players, List<MsgSetVariablePacket> variables)
+            {
+                this.Slot      = slot;
+                this.Players   = players;
+                this.Variables = variables;
+            }
+
+            /// <summary>
+            /// Used to construct a <see cref="MsgJoinSnapshotPacket"/> on the server around a shared body
+            /// previously produced by <see cref="EncodeBody"/>.
+            /// </summary>
+            public MsgJoinSnapshotPacket(Byte slot, Byte[] body)
+            {
+                this.Slot = slot;
+                this.body = body;
+            }
+
+            /// <summary>
+            /// Encodes the part of the snapshot that is shared by all joining players.
+            /// </summary>
+            /// <param name="scratch">An unsent message to encode into, emptied first so the same one can be reused for every snapshot.</param>
+            /// <param name="players"></param>
+            /// <param name="variables"></param>
+            /// <returns>The encoded body, a whole number of bytes.</returns>
+            public static Byte[] EncodeBody(NetOutgoingMessage scratch, List<JoinSnapshotEntry> players, List<MsgSetVariablePacket> variables)
+            {
+                scratch.LengthBits = 0;
+                WriteBody(scratch, players, variables);
+
+                Byte[] encoded = new Byte[scratch.LengthBytes];
+                Buffer.BlockCopy(scratch.PeekDataBuffer(), 0, encoded, 0, encoded.Length);
+
+                return encoded;
+            }
+
+            public static MsgJoinSnapshotPacket Read(NetIncomingMessage packet)
+            {
+                Byte version = packet.ReadByte();
+
+                if (version != SnapshotVersion)
+                    throw new NotSupportedException(String.Format("Join snapshot version {0} is not supported (expected {1})",
+                                                                  version, SnapshotVersion));
+
+                Byte slot = packet.ReadByte();
+
+                int playerCount = packet.ReadRangedInteger(0, ProtocolInformation.MaxPlayers);
+                List<JoinSnapshotEntry> players = new List<JoinSnapshotEntry>(playerCount);
+
+                for (int i = 0; i < playerCount; ++i)
+                {
+                    Byte playerSlot = (Byte)packet.ReadRangedInteger(0, ProtocolInformation.MaxPlayers - 1);
+                    TeamType team = (TeamType)(TeamType.AutomaticTeam + packet.ReadByte(TeamBits));
+                    PlayerState state = (PlayerState)packet.ReadByte(StateBits);
+                    String callsign = packet.ReadString();
+                    String tag = packet.ReadString();
+
+                    Score score = new Score();
+
+                    score.Wins      = packet.ReadVariableInt32();
+                    score.Losses    = packet.ReadVariableInt32();
+                    score.Teamkills = packet.ReadVariableInt32();
+
+                    Vector2 position = Vector2.Zero;
+                    Single rotation = 0;
+
+                    // only live players have a position worth sending
+                    if (state == PlayerState.Alive)
+                    {
+                        position = packet.ReadVector2();
+                        rotation = packet.ReadSingle();
+                    }
+
+                    players.Add(new JoinSnapshotEntry(new PlayerInformation(playerSlot, callsign, tag, team),
+                                                      state, score, position, rotation));
+                }
+
+                UInt32 variableCount = packet.ReadVariableUInt32();
+                List<MsgSetVariablePacket> variables = new List<MsgSetVariablePacket>((int)variableCount);
+
+                for (UInt32 i = 0; i < variableCount; ++i)
+                    variables.Add(MsgSetVariablePacket.Read(packet));
+
+                return new MsgJoinSnapshotPacket(slot, players, variables);
+            }
+
+            public void Write(NetOutgoingMessage packet)
+            {
+                packet.Write(SnapshotVersion);
+                packet.Write(this.Slot);
+
+                if (body != null)
+                    packet.Write(body);
+                else
+                    WriteBody(packet, this.Players, this.Variables);
+            }
+
+            private static void WriteBody(NetOutgoingMessage packet, List<JoinSnapshotEntry> players, List<MsgSetVariablePacket> variables)
+            {
+                packet.WriteRangedInteger(0, ProtocolInformation.MaxPlayers, players.Count);
+
+                foreach (JoinSnapshotEntry entry in players)
+                {
+                    packet.WriteRangedInteger(0, ProtocolInformation.MaxPlayers - 1, entry.Player.Slot);
+                    packet.Write((Byte)(entry.Player.Team - TeamType.AutomaticTeam), TeamBits);
+                    packet.Write((Byte)entry.State, StateBits);
+                    packet.Write(entry.Player.Callsign);
+                    packet.Write(entry.Player.Tag);
+
+                    packet.WriteVariableInt32(entry.Score.Wins);
+                    packet.WriteVariableInt32(entry.Score.Losses);
+                    packet.WriteVariableInt32(entry.Score.Teamkills);
+
+                    if (entry.State == PlayerState.Alive)
+                    {
+                        packet.Write(entry.Position);
+                        packet.Write(entry.Rotation);
+                    }
+                }
+
+                packet.WriteVariableUInt32((UInt32)variables.Count);
+
+                foreach (MsgSetVariablePacket variable in variables)
+                    variable.Write(packet);
+
+                // keep the body a whole number of bytes so it can be copied around as such
+                packet.WritePadBits();
+            }
+        }
+
         /// <summary>
         /// Sent by the server to remove a player.
         /// </summary>
@@ -423,7 +605,88 @@ namespace AngryTanks.Common
         }
 
         /// <summary>
-        /// Sent by the server to give the client the map.
+        /// Sent by the server when a client joins to tell it which world is being played.
+        /// Clients that have no compiled copy of it cached answer with a <see cref="MsgWorldRequestPacket"/>.
+        /// </summary>
+        public class MsgWorldInfoPacket : MsgBasePacket
+        {
+            public override MessageType MsgType
+            {
+                get { return MessageType.MsgWorldInfo; }
+            }
+
+            // SHA-1 of the world's .bzw text
+            public readonly Byte[] Hash;
+
+            // SHA-1 of the compiled world, whatever is loaded from the cache or downloaded must hash to it
+            public readonly Byte[] Digest;
+
+            // sizes of the compressed stream and of the compiled world it expands to
+            public readonly UInt32 CompressedLength, Length;
+
+            public MsgWorldInfoPacket(Byte[] hash, Byte[] digest, UInt32 compressedLength, UInt32 length)
+            {
+                this.Hash = hash;
+                this.Digest = digest;
+                this.CompressedLength = compressedLength;
+                this.Length = length;
+            }
+
+            public static MsgWorldInfoPacket Read(NetIncomingMessage packet)
+            {
+                Byte[] hash = packet.ReadBytes(20);
+                Byte[] digest = packet.ReadBytes(20);
+                UInt32 compressedLength = packet.ReadVariableUInt32();
+                UInt32 length = packet.ReadVariableUInt32();
+
+                if (compressedLength > ProtocolInformation.MaxWorldSize || length > ProtocolInformation.MaxWorldSize)
+                    throw new InvalidDataException(String.Format("world is too large ({0} bytes)", Math.Max(compressedLength, length)));
+
+                return new MsgWorldInfoPacket(hash, digest, compressedLength, length);
+            }
+
+            public void Write(NetOutgoingMessage packet)
+            {
+                packet.Write(this.Hash);
+                packet.Write(this.Digest);
+                packet.WriteVariableUInt32(this.CompressedLength);
+                packet.WriteVariableUInt32(this.Length);
+            }
+        }
+
+        /// <summary>
+        /// Sent by the client to ask for the world named in <see cref="MsgWorldInfoPacket"/> to be streamed to it.
+        /// </summary>
+        public class MsgWorldRequestPacket : MsgBasePacket
+        {
+            public override MessageType MsgType
+            {
+                get { return MessageType.MsgWorldRequest; }
+            }
+
+            public readonly Byte[] Hash;
+
+            public MsgWorldRequestPacket(Byte[] hash)
+            {
+                this.Hash = hash;
+            }
+
+            public static MsgWorldRequestPacket Read(NetIncomingMessage packet)
+            {
+                Byte[] hash = packet.ReadBytes(20);
+
+                return new MsgWorldRequestPacket(hash);
+            }
+
+            public void Write(NetOutgoingMessage packet)
+            {
+                packet.Write(this.Hash);
+            }
+        }
+
+        /// <summary>
+        /// Sent by the server as <see cref="TrafficClass.Bulk"/>, carries one chunk of the LZMA
+        /// compressed world. Chunks arrive in order and together make up <see cref="MsgWorldInfoPacket.CompressedLength"/> bytes.
         /// </summary>
         public class MsgWorldPacket : MsgBasePacket
         {
@@ -432,34 +695,38 @@ namespace AngryTanks.Common
                 get { return MessageType.MsgWorld; }
             }
 
-            public readonly UInt16 Length;
-            public readonly StreamReader Map;
+            // where this chunk goes in the compressed world
+            public readonly UInt32 Offset;
+
+            public readonly Byte[] Data;
+            public readonly Int32 Start, Count;
 
-            public MsgWorldPacket(UInt16 mapLength, StreamReader map)
+            public MsgWorldPacket(UInt32 offset, Byte[] data, Int32 start, Int32 count)
             {
-                this.Length = mapLength;
-                this.Map = map;
+                this.Offset = offset;
+                this.Data = data;
+                this.Start = start;
+                this.Count = count;
             }
 
             public static MsgWorldPacket Read(NetIncomingMessage packet)
             {
-                throw new NotImplementedException();
+                UInt32 offset = packet.ReadVariableUInt32();
+                Int32 count = (Int32)packet.ReadVariableUInt32();
 
-                /*
-                UInt16 mapLength = packet.ReadUInt16();
-                Byte[] rawWorld = new Byte[mapLength];
-                packet.ReadBytes(mapLength, out rawWorld);
+                Byte[] data;
 
-                MemoryStream ms = new MemoryStream(rawWorld);
-                StreamReader sr = new StreamReader(ms);
+                if (count < 0 || count > ProtocolInformation.WorldChunkSize || !packet.ReadBytes(count, out data))
+                    throw new InvalidDataException("world chunk is malformed");
 
-                return new MsgWorldPacket(mapLength, sr);
-                */
+                return new MsgWorldPacket(offset, data, 0, count);
             }
 
             public void Write(NetOutgoingMessage packet)
             {
-                throw new NotImplementedException();
+                packet.WriteVariableUInt32(this.Offset);
+                packet.WriteVariableUInt32((UInt32)this.Count);
+                packet.Write(this.Data, this.Start, this.Count);
             }
         }
 
@@ -698,6 +965,10 @@ namespace AngryTanks.Common
         /// Sent by the client to begin a shot.
         /// Sent by the server to tell other players to begin the shot.
         /// </summary>
+        /// <remarks>
+        /// This is all there is to a shot, everyone works out where it goes and where it ends with <see cref="ShotPath"/>.
+        /// The rotation travels quantized to 16 bits and the start tick is in the server's shot clock.
+        /// </remarks>
         public class MsgBeginShotPacket : MsgBasePacket
         {
             public override MessageType MsgType
@@ -709,25 +980,25 @@ namespace AngryTanks.Common
             public readonly Byte ShotSlot;
             public readonly Vector2 Position;
             public readonly Single Rotation;
-            public readonly Vector2 Velocity;
+            public readonly UInt32 StartTick;
 
             /// <summary>
             /// Used to construct a <see cref="MsgBeginShotPacket"/> on the client to notify about a new shot.
             /// </summary>
-            public MsgBeginShotPacket(Byte shotSlot, Vector2 position, Single rotation, Vector2 velocity)
-                : this(ProtocolInformation.DummySlot, shotSlot, position, rotation, velocity)
+            public MsgBeginShotPacket(Byte shotSlot, Vector2 position, Single rotation, UInt32 startTick)
+                : this(ProtocolInformation.DummySlot, shotSlot, position, rotation, startTick)
             { }
 
             /// <summary>
-            /// Used to construct a <see cref="MsgShotBegin"/> on the server to inform about a shot.
+            /// Used to construct a <see cref="MsgBeginShotPacket"/> on the server to inform about a shot.
             /// </summary>
-            public MsgBeginShotPacket(Byte slot, Byte shotSlot, Vector2 position, Single rotation, Vector2 velocity)
+            public MsgBeginShotPacket(Byte slot, Byte shotSlot, Vector2 position, Single rotation, UInt32 startTick)
             {
-                this.Slot     = slot;
-                this.ShotSlot = shotSlot;
-                this.Position = position;
-                this.Rotation = rotation;
-                this.Velocity = velocity;
+                this.Slot      = slot;
+                this.ShotSlot  = shotSlot;
+                this.Position  = position;
+                this.Rotation  = ShotPath.DequantizeRotation(ShotPath.QuantizeRotation(rotation));
+                this.StartTick = startTick;
             }
 
             public static MsgBeginShotPacket Read(NetIncomingMessage packet)
@@ -735,10 +1006,10 @@ namespace AngryTanks.Common
                 Byte slot = packet.ReadByte();
                 Byte shotSlot = packet.ReadByte();
                 Vector2 position = packet.ReadVector2();
-                Single rotation = packet.ReadSingle();
-                Vector2 velocity = packet.ReadVector2();
+                Single rotation = ShotPath.DequantizeRotation(packet.ReadUInt16());
+                UInt32 startTick = packet.ReadUInt32();
 
-                return new MsgBeginShotPacket(slot, shotSlot, position, rotation, velocity);
+                return new MsgBeginShotPacket(slot, shotSlot, position, rotation, startTick);
             }
 
             public void Write(NetOutgoingMessage packet)
@@ -746,8 +1017,8 @@ namespace AngryTanks.Common
                 packet.Write(this.Slot);
                 packet.Write(this.ShotSlot);
                 packet.Write(this.Position);
-                packet.Write(this.Rotation);
-                packet.Write(this.Velocity);
+                packet.Write(ShotPath.QuantizeRotation(this.Rotation));
+                packet.Write(this.StartTick);
             }
         }
 
@@ -799,5 +1070,260 @@ namespace AngryTanks.Common
                 packet.Write(this.Explode);
             }
         }
+
+        /// <summary>
+        /// Sent by the server to deliver every reliable game event of one tick in a single message.
+        /// </summary>
+        /// <remarks>
+        /// Each event is written as a 3 bit tag, followed by its slot coded as a delta from the
+        /// previous event's slot, followed by the rest of the event's fields. The client unpacks the
+        /// bundle back into the individual packets it would otherwise have received.
+        /// </remarks>
+        public class MsgEventBundlePacket : MsgBasePacket
+        {
+            public override MessageType MsgType
+            {
+                get { return MessageType.MsgEventBundle; }
+            }
+
+            private enum EventTag : byte
+            {
+                AddPlayer,
+                RemovePlayer,
+                Death,
+                Spawn,
+                Score,
+                BeginShot,
+                EndShot,
+                SetVariable
+            }
+
+            private const int EventTagBits = 3;
+            private const int ShotSlotBits = 5;
+
+            public readonly List<MsgBasePacket> Events;
+
+            public MsgEventBundlePacket(List<MsgBasePacket> events)
+            {
+                this.Events = events;
+            }
+
+            /// <summary>
+            /// Determines whether a message of type <paramref name="messageType"/> can travel in a bundle.
+            /// </summary>
+            public static bool CanBundle(MessageType messageType)
+            {
+                switch (messageType)
+                {
+                    case MessageType.MsgAddPlayer:
+                    case MessageType.MsgRemovePlayer:
+                    case MessageType.MsgDeath:
+                    case MessageType.MsgSpawn:
+                    case MessageType.MsgScore:
+                    case MessageType.MsgBeginShot:
+                    case MessageType.MsgEndShot:
+                    case MessageType.MsgSetVariable:
+                        return true;
+
+                    default:
+                        return false;
+                }
+            }
+
+            public static MsgEventBundlePacket Read(NetIncomingMessage packet)
+            {
+                UInt32 count = packet.ReadVariableUInt32();
+                List<MsgBasePacket> events = new List<MsgBasePacket>((int)count);
+
+                Int32 lastSlot = 0;
+
+                for (UInt32 i = 0; i < count; ++i)
+                {
+                    EventTag tag = (EventTag)packet.ReadByte(EventTagBits);
+                    Byte slot = (Byte)(lastSlot + packet.ReadVariableInt32());
+
+                    lastSlot = slot;
+
+                    switch (tag)
+                    {
+                        case EventTag.AddPlayer:
+                            {
+                                TeamType team = (TeamType)packet.ReadByte();
+                                String callsign = packet.ReadString();
+                                String tagName = packet.ReadString();
+                                bool addMyself = packet.ReadBoolean();
+
+                                events.Add(new MsgAddPlayerPacket(new PlayerInformation(slot, callsign, tagName, team), addMyself));
+                                break;
+                            }
+
+                        case EventTag.RemovePlayer:
+                            events.Add(new MsgRemovePlayerPacket(slot, packet.ReadString()));
+                            break;
+
+                        case EventTag.Death:
+                            events.Add(new MsgDeathPacket(slot, packet.ReadByte()));
+                            break;
+
+                        case EventTag.Spawn:
+                            {
+                                Vector2 position = packet.ReadVector2();
+                                Single rotation = packet.ReadSingle();
+
+                                events.Add(new MsgSpawnPacket(slot, position, rotation));
+                                break;
+                            }
+
+                        case EventTag.Score:
+                            {
+                                Score score = new Score();
+
+                                score.Wins      = packet.ReadVariableInt32();
+                                score.Losses    = packet.ReadVariableInt32();
+                                score.Teamkills = packet.ReadVariableInt32();
+
+                                events.Add(new MsgScorePacket(slot, score));
+                                break;
+                            }
+
+                        case EventTag.BeginShot:
+                            {
+                                Byte shotSlot = packet.ReadByte(ShotSlotBits);
+                                Vector2 position = packet.ReadVector2();
+                                Single rotation = ShotPath.DequantizeRotation(packet.ReadUInt16());
+                                UInt32 startTick = packet.ReadUInt32();
+
+                                events.Add(new MsgBeginShotPacket(slot, shotSlot, position, rotation, startTick));
+                                break;
+                            }
+
+                        case EventTag.EndShot:
+                            {
+                                Byte shotSlot = packet.ReadByte(ShotSlotBits);
+                                bool explode = packet.ReadBoolean();
+
+                                events.Add(new MsgEndShotPacket(slot, shotSlot, explode));
+                                break;
+                            }
+
+                        case EventTag.SetVariable:
+                            events.Add(MsgSetVariablePacket.Read(packet));
+                            break;
+
+                        default:
+                            throw new NotSupportedException(String.Format("Unknown event tag {0} in event bundle", tag));
+                    }
+                }
+
+                return new MsgEventBundlePacket(events);
+            }
+
+            public void Write(NetOutgoingMessage packet)
+            {
+                packet.WriteVariableUInt32((UInt32)this.Events.Count);
+
+                Int32 lastSlot = 0;
+
+                foreach (MsgBasePacket message in this.Events)
+                {
+                    switch (message.MsgType)
+                    {
+                        case MessageType.MsgAddPlayer:
+                            {
+                                MsgAddPlayerPacket addPlayer = (MsgAddPlayerPacket)message;
+
+                                WriteHeader(packet, EventTag.AddPlayer, addPlayer.Player.Slot, ref lastSlot);
+                                packet.Write((Byte)addPlayer.Player.Team);
+                                packet.Write(addPlayer.Player.Callsign);
+                                packet.Write(addPlayer.Player.Tag);
+                                packet.Write(addPlayer.AddMyself);
+                                break;
+                            }
+
+                        case MessageType.MsgRemovePlayer:
+                            {
+                                MsgRemovePlayerPacket removePlayer = (MsgRemovePlayerPacket)message;
+
+                                WriteHeader(packet, EventTag.RemovePlayer, removePlayer.Slot, ref lastSlot);
+                                packet.Write(removePlayer.Reason);
+                                break;
+                            }
+
+                        case MessageType.MsgDeath:
+                            {
+                                MsgDeathPacket death = (MsgDeathPacket)message;
+
+                                WriteHeader(packet, EventTag.Death, death.Slot, ref lastSlot);
+                                packet.Write(death.Killer);
+                                break;
+                            }
+
+                        case MessageType.MsgSpawn:
+                            {
+                                MsgSpawnPacket spawn = (MsgSpawnPacket)message;
+
+                                WriteHeader(packet, EventTag.Spawn, spawn.Slot, ref lastSlot);
+                                packet.Write(spawn.Position);
+                                packet.Write(spawn.Rotation);
+                                break;
+                            }
+
+                        case MessageType.MsgScore:
+                            {
+                                MsgScorePacket score = (MsgScorePacket)message;
+
+                                WriteHeader(packet, EventTag.Score, score.Slot, ref lastSlot);
+                                packet.WriteVariableInt32(score.Score.Wins);
+                                packet.WriteVariableInt32(score.Score.Losses);
+                                packet.WriteVariableInt32(score.Score.Teamkills);
+                                break;
+                            }
+
+                        case MessageType.MsgBeginShot:
+                            {
+                                MsgBeginShotPacket beginShot = (MsgBeginShotPacket)message;
+
+                                WriteHeader(packet, EventTag.BeginShot, beginShot.Slot, ref lastSlot);
+                                packet.Write(beginShot.ShotSlot, ShotSlotBits);
+                                packet.Write(beginShot.Position);
+                                packet.Write(ShotPath.QuantizeRotation(beginShot.Rotation));
+                                packet.Write(beginShot.StartTick);
+                                break;
+                            }
+
+                        case MessageType.MsgEndShot:
+                            {
+                                MsgEndShotPacket endShot = (MsgEndShotPacket)message;
+
+                                WriteHeader(packet, EventTag.EndShot, endShot.Slot, ref lastSlot);
+                                packet.Write(endShot.ShotSlot, ShotSlotBits);
+                                packet.Write(endShot.Explode);
+                                break;
+                            }
+
+                        case MessageType.MsgSetVariable:
+                            {
+                                MsgSetVariablePacket setVariable = (MsgSetVariablePacket)message;
+
+                                // variables belong to no one, so keep the slot where it is
+                                WriteHeader(packet, EventTag.SetVariable, (Byte)lastSlot, ref lastSlot);
+                                setVariable.Write(packet);
+                                break;
+                            }
+
+                        default:
+                            throw new NotSupportedException(String.Format("{0} can not be sent in an event bundle", message.MsgType));
+                    }
+                }
+            }
+
+            private static void WriteHeader(NetOutgoingMessage packet, EventTag tag, Byte slot, ref Int32 lastSlot)
+            {
+                packet.Write((Byte)tag, EventTagBits);
+                packet.WriteVariableInt32(slot - lastSlot);
+
+                lastSlot = slot;
+            }
+        }
     }
 }
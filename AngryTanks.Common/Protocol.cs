@@ -5,17 +5,22 @@ using System.Text;
 using Microsoft.Xna.Framework;
 using Microsoft.Xna.Framework.Graphics;
 
+using Lidgren.Network;
+
 namespace AngryTanks.Common
 {
     namespace Protocol
     {
         public static class ProtocolInformation
         {
-            public static readonly UInt16 ProtocolVersion = 14;
+            public static readonly UInt16 ProtocolVersion = 22;
             public static readonly Byte MaxPlayers = 100;
             public static readonly Byte DummySlot = 255;
             public static readonly Byte MaxShots = 20;
             public static readonly Byte DummyShot = Byte.MaxValue;
+
+            public static readonly int WorldChunkSize = 1024;
+            public static readonly UInt32 MaxWorldSize = 64 * 1024 * 1024;
         }
 
         public enum MessageType
@@ -26,14 +31,109 @@ namespace AngryTanks.Common
             MsgSetVariable,
             MsgAddPlayer,
             MsgRemovePlayer,
-            MsgWorld,
+            MsgWorld, // from server to client, one chunk of the compressed world
             MsgPlayerClientUpdate, // from client to server
             MsgPlayerServerUpdate, // from server to client
             MsgDeath,
             MsgSpawn,
             MsgScore,
             MsgBeginShot,
-            MsgEndShot
+            MsgEndShot,
+            MsgEventBundle, // from server to client, carries a tick's worth of reliable events
+            MsgJoinSnapshot, // from server to client, carries the complete initial state
+            MsgWorldInfo, // from server to client, identifies the world being played
+            MsgWorldRequest // from client to server, asks for the world to be streamed
+        }
+
+        /// <summary>
+        /// What a message is for, which decides how it travels. See <see cref="TrafficClasses"/>.
+        /// </summary>
+        public enum TrafficClass
+        {
+            Bulk, // joining and the world, large and ordered but in no hurry
+            Events, // game events and the snapshot they build on, reliable and ordered among themselves
+            Shots, // reliable, but each one stands alone
+            Cosmetic // state where only the newest matters
+        }
+
+        /// <summary>
+        /// A delivery method and sequence channel to send on.
+        /// </summary>
+        public struct TrafficRoute
+        {
+            public readonly NetDeliveryMethod Method;
+            public readonly int Channel;
+
+            public TrafficRoute(NetDeliveryMethod method, int channel)
+            {
+                this.Method = method;
+                this.Channel = channel;
+            }
+        }
+
+        /// <summary>
+        /// Maps every <see cref="MessageType"/> to its <see cref="TrafficClass"/> and the route that class takes.
+        /// </summary>
+        /// <remarks>
+        /// Each class gets its own stream, so a lost packet only holds up messages of its own class.
+        /// A spawn no longer waits behind a world transfer, and a lost world chunk no longer stalls the game.
+        /// The join snapshot is an event because the events that follow it are changes to it, and must not overtake it.
+        /// All send sites go through here rather than picking a delivery method themselves.
+        /// </remarks>
+        public static class TrafficClasses
+        {
+            private static readonly TrafficRoute[] routes =
+            {
+                new TrafficRoute(NetDeliveryMethod.ReliableOrdered, 1), // Bulk
+                new TrafficRoute(NetDeliveryMethod.ReliableOrdered, 0), // Events
+                new TrafficRoute(NetDeliveryMethod.ReliableUnordered, 0), // Shots
+                new TrafficRoute(NetDeliveryMethod.UnreliableSequenced, 0) // Cosmetic
+            };
+
+            public static TrafficClass GetClass(MessageType messageType)
+            {
+                switch (messageType)
+                {
+                    case MessageType.MsgEnter:
+                    case MessageType.MsgGameInformation:
+                    case MessageType.MsgState:
+                    case MessageType.MsgWorld:
+                    case MessageType.MsgWorldInfo:
+                    case MessageType.MsgWorldRequest:
+                        return TrafficClass.Bulk;
+
+                    case MessageType.MsgSetVariable:
+                    case MessageType.MsgAddPlayer:
+                    case MessageType.MsgRemovePlayer:
+                    case MessageType.MsgDeath:
+                    case MessageType.MsgSpawn:
+                    case MessageType.MsgScore:
+                    case MessageType.MsgEventBundle:
+                    case MessageType.MsgJoinSnapshot:
+                        return TrafficClass.Events;
+
+                    case MessageType.MsgBeginShot:
+                    case MessageType.MsgEndShot:
+                        return TrafficClass.Shots;
+
+                    case MessageType.MsgPlayerClientUpdate:
+                    case MessageType.MsgPlayerServerUpdate:
+                        return TrafficClass.Cosmetic;
+
+                    default: // WTF?
+                        throw new ArgumentOutOfRangeException("messageType", messageType, "message type has no traffic class");
+                }
+            }
+
+            public static TrafficRoute GetRoute(TrafficClass trafficClass)
+            {
+                return routes[(int)trafficClass];
+            }
+
+            public static TrafficRoute GetRoute(MessageType messageType)
+            {
+                return routes[(int)GetClass(messageType)];
+            }
         }
 
         public enum GamePlayType
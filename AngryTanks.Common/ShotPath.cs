@@ -0,0 +1,322 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+using Microsoft.Xna.Framework;
+
+namespace AngryTanks.Common
+{
+    /// <summary>
+    /// The complete flight of a shot, worked out the moment it is fired.
+    /// </summary>
+    /// <remarks>
+    /// A shot flies in a straight line at a fixed speed until it hits a wall, leaves its range or runs out of time,
+    /// so its origin, rotation and start tick decide everything else. Every peer builds the same path from the same
+    /// <see cref="WorldMap.Colliders"/> and variables, which means only hits on tanks ever need to be sent.
+    /// Rotations are quantized to what a <see cref="Messages.MsgBeginShotPacket"/> carries so the shooter flies
+    /// exactly the path everyone else sees.
+    /// </remarks>
+    public class ShotPath
+    {
+        /// <summary>
+        /// Ticks per second of the clock shots are timed by, which is the server's <see cref="Lidgren.Network.NetTime"/>.
+        /// </summary>
+        public const int TicksPerSecond = 100;
+
+        /// <summary>
+        /// Half the width of a shot, walls are hit when its edge touches them.
+        /// </summary>
+        public const Single Radius = 1;
+
+        private const Double RotationStep = (2 * Math.PI) / 65536;
+
+        #region Properties
+
+        private readonly Vector2 origin;
+
+        public Vector2 Origin
+        {
+            get { return origin; }
+        }
+
+        private readonly Single rotation;
+
+        /// <summary>
+        /// Rotation of the shot in radians, after quantization.
+        /// </summary>
+        public Single Rotation
+        {
+            get { return rotation; }
+        }
+
+        private readonly Vector2 direction;
+
+        /// <summary>
+        /// Unit vector the shot travels along.
+        /// </summary>
+        public Vector2 Direction
+        {
+            get { return direction; }
+        }
+
+        private readonly Single speed;
+
+        public Single Speed
+        {
+            get { return speed; }
+        }
+
+        private readonly Single distance;
+
+        /// <summary>
+        /// How far the shot travels before it ends.
+        /// </summary>
+        public Single Distance
+        {
+            get { return distance; }
+        }
+
+        private readonly bool hitsWall;
+
+        /// <summary>
+        /// Whether the shot ends against a wall rather than running out of range or time.
+        /// </summary>
+        public bool HitsWall
+        {
+            get { return hitsWall; }
+        }
+
+        private readonly UInt32 startTick, endTick;
+
+        public UInt32 StartTick
+        {
+            get { return startTick; }
+        }
+
+        /// <summary>
+        /// First tick the shot is no longer flying.
+        /// </summary>
+        public UInt32 EndTick
+        {
+            get { return endTick; }
+        }
+
+        /// <summary>
+        /// Where the shot ends.
+        /// </summary>
+        public Vector2 EndPosition
+        {
+            get { return origin + direction * distance; }
+        }
+
+        /// <summary>
+        /// Seconds the shot flies for.
+        /// </summary>
+        public Single Duration
+        {
+            get { return speed > 0 ? distance / speed : 0; }
+        }
+
+        #endregion
+
+        /// <summary>
+        /// Builds the path of a shot with the shot variables from <paramref name="variables"/>.
+        /// </summary>
+        public ShotPath(WorldMap map, VariableDatabase variables, Vector2 origin, Single rotation, UInt32 startTick)
+            : this(map, origin, rotation, startTick,
+                   variables.ShotSpeed.Value,
+                   variables.ShotRange.Value,
+                   variables.ReloadTime.Value)
+        { }
+
+        /// <summary>
+        /// Builds the path of a shot.
+        /// </summary>
+        /// <param name="map">Static collision data the shot flies through, null if none is loaded yet.</param>
+        /// <param name="origin">Where the shot is fired from.</param>
+        /// <param name="rotation">Rotation of the shot in radians, it is quantized.</param>
+        /// <param name="startTick">Tick the shot is fired at.</param>
+        /// <param name="speed">Speed in world units per second.</param>
+        /// <param name="range">Furthest distance the shot travels.</param>
+        /// <param name="lifetime">Longest time in seconds the shot flies for.</param>
+        public ShotPath(WorldMap map, Vector2 origin, Single rotation, UInt32 startTick, Single speed, Single range, Single lifetime)
+        {
+            this.origin = origin;
+            this.rotation = DequantizeRotation(QuantizeRotation(rotation));
+            this.speed = speed;
+            this.startTick = startTick;
+
+            // same forward vector tanks use
+            this.direction = new Vector2((Single)Math.Cos(this.rotation - Math.PI / 2),
+                                         (Single)Math.Sin(this.rotation - Math.PI / 2));
+
+            Single maxDistance = Math.Max(0, Math.Min(range, speed * lifetime));
+
+            this.distance = maxDistance;
+            this.hitsWall = false;
+
+            Single wallDistance;
+
+            if (map != null && CastAgainst(map, origin, direction, maxDistance, out wallDistance))
+            {
+                this.distance = wallDistance;
+                this.hitsWall = true;
+            }
+
+            this.endTick = unchecked(startTick + (UInt32)Math.Ceiling(Duration * TicksPerSecond));
+        }
+
+        /// <summary>
+        /// Gets the position of the shot <paramref name="elapsed"/> seconds after it was fired.
+        /// </summary>
+        public Vector2 GetPosition(Double elapsed)
+        {
+            Single travelled = (Single)(speed * Math.Max(0, elapsed));
+
+            return origin + direction * Math.Min(travelled, distance);
+        }
+
+        /// <summary>
+        /// Gets the seconds since the shot was fired at <paramref name="time"/>, in seconds of the shot clock.
+        /// </summary>
+        public Double GetElapsed(Double time)
+        {
+            return time - (Double)startTick / TicksPerSecond;
+        }
+
+        /// <summary>
+        /// Determines whether the shot is still in flight at <paramref name="tick"/>.
+        /// </summary>
+        public bool IsActive(UInt32 tick)
+        {
+            return TicksSince(startTick, tick) >= 0 && TicksSince(endTick, tick) < 0;
+        }
+
+        #region Helpers
+
+        /// <summary>
+        /// Converts seconds of the shot clock to a tick.
+        /// </summary>
+        public static UInt32 ToTick(Double time)
+        {
+            return unchecked((UInt32)(Int64)Math.Floor(time * TicksPerSecond));
+        }
+
+        /// <summary>
+        /// Gets the ticks from <paramref name="from"/> to <paramref name="to"/>, negative if <paramref name="to"/> is earlier.
+        /// </summary>
+        public static Int32 TicksSince(UInt32 from, UInt32 to)
+        {
+            return unchecked((Int32)(to - from));
+        }
+
+        public static UInt16 QuantizeRotation(Single rotation)
+        {
+            return unchecked((UInt16)((Int64)Math.Round(rotation / RotationStep) & 0xFFFF));
+        }
+
+        public static Single DequantizeRotation(UInt16 rotation)
+        {
+            return (Single)(rotation * RotationStep);
+        }
+
+        /// <summary>
+        /// Finds how far along a ray the shot first touches a map object or the edge of the world.
+        /// </summary>
+        private static bool CastAgainst(WorldMap map, Vector2 origin, Vector2 direction, Single maxDistance, out Single hitDistance)
+        {
+            hitDistance = maxDistance;
+            bool hit = false;
+
+            // the edge of the world is just inside the boundary walls
+            Single half = map.Size / 2 - Radius;
+
+            if (direction.X != 0)
+                hit |= Closer((Math.Sign(direction.X) * half - origin.X) / direction.X, ref hitDistance);
+
+            if (direction.Y != 0)
+                hit |= Closer((Math.Sign(direction.Y) * half - origin.Y) / direction.Y, ref hitDistance);
+
+            foreach (MapObject mapObject in map.Colliders)
+            {
+                Vector2 end = origin + direction * hitDistance;
+
+                // broad phase against the prebuilt bounds, grown by the shot's radius
+                if (Math.Max(origin.X, end.X) < mapObject.Min.X - Radius || Math.Min(origin.X, end.X) > mapObject.Max.X + Radius ||
+                    Math.Max(origin.Y, end.Y) < mapObject.Min.Y - Radius || Math.Min(origin.Y, end.Y) > mapObject.Max.Y + Radius)
+                    continue;
+
+                Single objectDistance;
+
+                if (CastAgainst(mapObject, origin, direction, hitDistance, out objectDistance))
+                    hit |= Closer(objectDistance, ref hitDistance);
+            }
+
+            return hit;
+        }
+
+        /// <summary>
+        /// Slab test of a ray against a rotated rectangle, done in the rectangle's own frame.
+        /// </summary>
+        private static bool CastAgainst(MapObject mapObject, Vector2 origin, Vector2 direction, Single maxDistance, out Single hitDistance)
+        {
+            Single cos = (Single)Math.Cos(mapObject.Rotation);
+            Single sin = (Single)Math.Sin(mapObject.Rotation);
+
+            Vector2 offset = origin - mapObject.Position;
+
+            Vector2 localOrigin = new Vector2(offset.X * cos + offset.Y * sin, -offset.X * sin + offset.Y * cos);
+            Vector2 localDirection = new Vector2(direction.X * cos + direction.Y * sin, -direction.X * sin + direction.Y * cos);
+            Vector2 extents = mapObject.Size / 2 + new Vector2(Radius, Radius);
+
+            Single enter = 0;
+            Single exit = maxDistance;
+
+            hitDistance = maxDistance;
+
+            if (!Slab(localOrigin.X, localDirection.X, extents.X, ref enter, ref exit) ||
+                !Slab(localOrigin.Y, localDirection.Y, extents.Y, ref enter, ref exit))
+                return false;
+
+            // starting inside the object is a hit on the spot
+            hitDistance = enter;
+
+            return true;
+        }
+
+        private static bool Slab(Single origin, Single direction, Single extent, ref Single enter, ref Single exit)
+        {
+            if (direction == 0)
+                return Math.Abs(origin) <= extent;
+
+            Single near = (-extent - origin) / direction;
+            Single far = (extent - origin) / direction;
+
+            if (near > far)
+            {
+                Single swap = near;
+                near = far;
+                far = swap;
+            }
+
+            enter = Math.Max(enter, near);
+            exit = Math.Min(exit, far);
+
+            return enter <= exit;
+        }
+
+        private static bool Closer(Single candidate, ref Single hitDistance)
+        {
+            candidate = Math.Max(0, candidate);
+
+            if (candidate >= hitDistance)
+                return false;
+
+            hitDistance = candidate;
+
+            return true;
+        }
+
+        #endregion
+    }
+}
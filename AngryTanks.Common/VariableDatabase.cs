@@ -1,69 +1,151 @@
 ﻿using System;
 using System.Collections.Generic;
+using System.Globalization;
 using System.Linq;
 using System.Text;
 
 namespace AngryTanks.Common
 {
-    public class VariableStore
+    public class VariableChangedEvent : EventArgs
+    {
+        public readonly VariableStore Variable;
+
+        public VariableChangedEvent(VariableStore variable)
+        {
+            this.Variable = variable;
+        }
+    }
+
+    /// <summary>
+    /// A variable as seen by code that only knows it by name, like the network and the command line.
+    /// Game code should hold on to the typed <see cref="Variable{T}"/> instead.
+    /// </summary>
+    public abstract class VariableStore
     {
         public readonly TypeCode TypeCode;
         public readonly String Name, Description;
 
-        private Object defaultValue;
-        public Object DefaultValue
+        private UInt32 version = 0;
+
+        /// <summary>
+        /// Gets how many times the value has changed.
+        /// </summary>
+        public UInt32 Version
         {
-            get
-            {
-                return Convert.ChangeType(defaultValue, TypeCode);
-            }
-            set
-            {
-                this.defaultValue = value;
-            }
+            get { return version; }
         }
 
-        private Object value = null;
-        public Object Value
+        /// <summary>
+        /// Raised after the value changes.
+        /// </summary>
+        public event EventHandler<VariableChangedEvent> ValueChanged;
+
+        // the database we belong to, told about every change
+        internal VariableDatabase Database;
+
+        protected VariableStore(String name, String description, TypeCode typeCode)
         {
-            get
-            {
-                if (value != null)
-                    return Convert.ChangeType(value, TypeCode);
-                else
-                    return DefaultValue;
-            }
+            this.Name        = name;
+            this.Description = description;
+            this.TypeCode    = typeCode;
+        }
+
+        /// <summary>
+        /// Gets or sets the value boxed. Setting converts from any compatible type, including strings.
+        /// </summary>
+        public abstract Object BoxedValue
+        {
+            get;
+            set;
+        }
+
+        public abstract Object BoxedDefaultValue
+        {
+            get;
+        }
+
+        /// <summary>
+        /// Gets whether the variable is at its default value.
+        /// </summary>
+        public abstract bool IsDefault
+        {
+            get;
+        }
+
+        public abstract void Reset();
+
+        protected void OnValueChanged()
+        {
+            ++version;
+
+            EventHandler<VariableChangedEvent> handler = ValueChanged;
+
+            // prevent race condition
+            if (handler != null)
+                handler(this, new VariableChangedEvent(this));
+
+            if (Database != null)
+                Database.OnVariableChanged(this);
+        }
+    }
+
+    /// <summary>
+    /// A handle on a variable of type <typeparamref name="T"/>, reading it costs no more than reading a field.
+    /// </summary>
+    public sealed class Variable<T> : VariableStore
+    {
+        private readonly T defaultValue;
+
+        public T DefaultValue
+        {
+            get { return defaultValue; }
+        }
+
+        private T value;
+
+        public T Value
+        {
+            get { return value; }
             set
             {
+                if (EqualityComparer<T>.Default.Equals(this.value, value))
+                    return;
+
                 this.value = value;
+
+                OnValueChanged();
             }
         }
 
-        public bool Changed
+        public override Object BoxedValue
         {
-            get
-            {
-                if (DefaultValue.Equals(Value) || value == null)
-                    return false;
-                else
-                    return true;
-            }
+            get { return value; }
+            set { Value = (T)Convert.ChangeType(value, typeof(T), CultureInfo.InvariantCulture); }
         }
 
-        public VariableStore(String name, String description, Object defaultValue, TypeCode typeCode)
+        public override Object BoxedDefaultValue
+        {
+            get { return defaultValue; }
+        }
+
+        public override bool IsDefault
+        {
+            get { return EqualityComparer<T>.Default.Equals(value, defaultValue); }
+        }
+
+        public Variable(String name, String description, T defaultValue)
+            : base(name, description, Type.GetTypeCode(typeof(T)))
         {
             if (defaultValue == null)
                 throw new ArgumentNullException("defaultValue", "Default value can not be null");
 
-            this.Name         = name;
-            this.Description  = description;
-            this.TypeCode     = typeCode;
             this.defaultValue = defaultValue;
+            this.value        = defaultValue;
         }
 
-        public void Reset()
+        public override void Reset()
         {
-            Value = null;
+            Value = defaultValue;
         }
     }
 
@@ -95,30 +177,63 @@ namespace AngryTanks.Common
          * tinyFactor
          */
 
+        #region Variables
+
+        public readonly Variable<Single> ExplodeTime;
+        public readonly Variable<Single> FlagRadius;
+        public readonly Variable<Single> ReloadTime;
+        public readonly Variable<Single> ShotRange;
+        public readonly Variable<Byte>   ShotSlots;
+        public readonly Variable<Single> ShotSpeed;
+        public readonly Variable<Single> TankAngVel;
+        public readonly Variable<Single> TankLength;
+        public readonly Variable<Single> TankSpeed;
+        public readonly Variable<Single> TankWidth;
+        public readonly Variable<UInt16> UpdatesPerSecond;
+
+        #endregion
+
         // where we store all our variables. variables are case-sensitive.
         // (they preserve case once stored, but accessing them and trying to add more is case-insensitive)
         private Dictionary<String, VariableStore> variables = new Dictionary<string, VariableStore>(StringComparer.OrdinalIgnoreCase);
 
+        // variables changed since TakeChanges was last called, each once, in the order they first changed
+        private List<VariableStore> pendingChanges = new List<VariableStore>();
+
+        private UInt32 version = 0;
+
+        /// <summary>
+        /// Gets how many times any variable has changed.
+        /// </summary>
+        public UInt32 Version
+        {
+            get { return version; }
+        }
+
+        /// <summary>
+        /// Raised after any variable changes.
+        /// </summary>
+        public event EventHandler<VariableChangedEvent> VariableChanged;
+
         public VariableStore this[String name]
         {
-            get 
+            get
             {
                 return variables[name];
             }
-            set
-            {
-                variables[name] = value;
-            }
         }
 
-        public List<VariableStore> Changed
+        /// <summary>
+        /// Gets the variables that are not at their default value.
+        /// </summary>
+        public List<VariableStore> NonDefault
         {
             get
             {
                 List<VariableStore> result = new List<VariableStore>();
                 foreach (VariableStore variable in variables.Values)
                 {
-                    if (variable.Changed)
+                    if (!variable.IsDefault)
                         result.Add(variable);
                 }
 
@@ -128,42 +243,86 @@ namespace AngryTanks.Common
 
         public VariableDatabase()
         {
-            AddDefaultVariables();
-        }
-
-        private void AddDefaultVariables()
-        {
-            AddVariable("explodeTime",
-                        "Time (in seconds) to respawn after being killed", 5f, typeof(Single));
-            AddVariable("flagRadius",
-                        "Determines how close a tank must be to a flag to pick it up", 2.5f, typeof(Single));
-            AddVariable("reloadTime",
-                        "Time (in seconds) between shot reloads", 3.5f, typeof(Single));
-            AddVariable("shotRange",
-                        "Range of shots", 350f, typeof(Single));
-            AddVariable("shotSlots",
-                        "Number of shot slots", 5, typeof(Byte));
-            AddVariable("shotSpeed",
-                        "Speed of shots", 50f, typeof(Single));
-            AddVariable("tankAngVel",
-                        "Angular speed (radians/sec) of the tank", (Single)Math.PI / 2, typeof(Single));
-            AddVariable("tankLength",
-                        "Length of the tank", 6f, typeof(Single));
-            AddVariable("tankSpeed",
-                        "Speed of the tank", 25f, typeof(Single));
-            AddVariable("tankWidth",
-                        "Width of the tank", 4.86f, typeof(Single));
-            AddVariable("updatesPerSecond",
-                        "Number of network updates per second", 45, typeof(UInt16));
-        }
-
-        public VariableStore AddVariable(String name, String description, Object defaultValue, Type type)
-        {
-            VariableStore variable = new VariableStore(name, description, defaultValue, Type.GetTypeCode(type));
+            ExplodeTime = AddVariable("explodeTime",
+                                      "Time (in seconds) to respawn after being killed", 5f);
+            FlagRadius = AddVariable("flagRadius",
+                                     "Determines how close a tank must be to a flag to pick it up", 2.5f);
+            ReloadTime = AddVariable("reloadTime",
+                                     "Time (in seconds) between shot reloads", 3.5f);
+            ShotRange = AddVariable("shotRange",
+                                    "Range of shots", 350f);
+            ShotSlots = AddVariable("shotSlots",
+                                    "Number of shot slots", (Byte)5);
+            ShotSpeed = AddVariable("shotSpeed",
+                                    "Speed of shots", 50f);
+            TankAngVel = AddVariable("tankAngVel",
+                                     "Angular speed (radians/sec) of the tank", (Single)Math.PI / 2);
+            TankLength = AddVariable("tankLength",
+                                     "Length of the tank", 6f);
+            TankSpeed = AddVariable("tankSpeed",
+                                    "Speed of the tank", 25f);
+            TankWidth = AddVariable("tankWidth",
+                                    "Width of the tank", 4.86f);
+            UpdatesPerSecond = AddVariable("updatesPerSecond",
+                                           "Number of network updates per second", (UInt16)45);
+        }
+
+        public Variable<T> AddVariable<T>(String name, String description, T defaultValue)
+        {
+            Variable<T> variable = new Variable<T>(name, description, defaultValue);
+            variable.Database = this;
             variables.Add(name, variable);
             return variable;
         }
 
+        /// <summary>
+        /// Resolves the typed handle of a variable, which should be done once and kept.
+        /// </summary>
+        /// <exception cref="KeyNotFoundException">There is no such variable.</exception>
+        /// <exception cref="InvalidCastException">The variable is not of type <typeparamref name="T"/>.</exception>
+        public Variable<T> Get<T>(String name)
+        {
+            Variable<T> variable = variables[name] as Variable<T>;
+
+            if (variable == null)
+                throw new InvalidCastException(String.Format("Variable {0} is a {1}, not a {2}",
+                                                             name, variables[name].TypeCode, typeof(T).Name));
+
+            return variable;
+        }
+
+        /// <summary>
+        /// Adds the variables changed since this was last called to <paramref name="changes"/> and starts over.
+        /// </summary>
+        /// <returns>How many variables were added.</returns>
+        public int TakeChanges(List<VariableStore> changes)
+        {
+            int count = pendingChanges.Count;
+
+            // nearly every tick changes nothing
+            if (count == 0)
+                return 0;
+
+            changes.AddRange(pendingChanges);
+            pendingChanges.Clear();
+
+            return count;
+        }
+
+        internal void OnVariableChanged(VariableStore variable)
+        {
+            ++version;
+
+            if (!pendingChanges.Contains(variable))
+                pendingChanges.Add(variable);
+
+            EventHandler<VariableChangedEvent> handler = VariableChanged;
+
+            // prevent race condition
+            if (handler != null)
+                handler(this, new VariableChangedEvent(variable));
+        }
+
         public void ResetAllVariables()
         {
             foreach (VariableStore variable in variables.Values)
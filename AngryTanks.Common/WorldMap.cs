@@ -0,0 +1,708 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Collections.ObjectModel;
+using System.Globalization;
+using System.IO;
+using System.Linq;
+using System.Security.Cryptography;
+using System.Text;
+using Microsoft.Xna.Framework;
+
+using log4net;
+
+namespace AngryTanks.Common
+{
+    /// <summary>
+    /// Kinds of static objects a map can hold.
+    /// </summary>
+    public enum MapObjectType : byte
+    {
+        Box,
+        Pyramid
+    }
+
+    /// <summary>
+    /// A single static map object in its final form, along with the collision data prebuilt for it.
+    /// </summary>
+    public struct MapObject
+    {
+        public readonly MapObjectType Type;
+
+        // center of the object and its full size, in world units
+        public readonly Vector2 Position, Size;
+
+        // rotation in radians
+        public readonly Single Rotation;
+
+        // axis-aligned box enclosing the rotated object, prebuilt so broad phase collision needs no trigonometry
+        public readonly Vector2 Min, Max;
+
+        public MapObject(MapObjectType type, Vector2 position, Vector2 size, Single rotation)
+        {
+            this.Type = type;
+            this.Position = position;
+            this.Size = size;
+            this.Rotation = rotation;
+
+            Single cos = Math.Abs((Single)Math.Cos(rotation));
+            Single sin = Math.Abs((Single)Math.Sin(rotation));
+
+            Vector2 extents = new Vector2(cos * size.X + sin * size.Y, sin * size.X + cos * size.Y) / 2;
+
+            this.Min = position - extents;
+            this.Max = position + extents;
+        }
+
+        internal MapObject(MapObjectType type, Vector2 position, Vector2 size, Single rotation, Vector2 min, Vector2 max)
+        {
+            this.Type = type;
+            this.Position = position;
+            this.Size = size;
+            this.Rotation = rotation;
+            this.Min = min;
+            this.Max = max;
+        }
+    }
+
+    /// <summary>
+    /// <para>
+    ///     A map compiled from its .bzw text into an object table plus prebuilt collision data.
+    /// </para>
+    /// <para>
+    ///     The server parses and validates the text once, then serves the binary form from <see cref="GetBytes"/>.
+    ///     Clients only ever load the binary form with <see cref="FromBytes"/>.
+    /// </para>
+    /// </summary>
+    public class WorldMap
+    {
+        private static readonly ILog Log = LogManager.GetLogger(System.Reflection.MethodBase.GetCurrentMethod().DeclaringType);
+
+        #region Format
+
+        // "ATWM" in little endian
+        public const UInt32 Magic = 0x4D575441;
+
+        /// <summary>
+        /// Bump whenever the binary layout changes, cached maps of other versions are recompiled.
+        /// </summary>
+        public const UInt16 FormatVersion = 2;
+
+        // compiled maps end with a SHA-1 digest of everything before it
+        private const int DigestLength = 20;
+
+        /// <summary>
+        /// Extension used for compiled maps in the cache.
+        /// </summary>
+        public const String CompiledExtension = ".atwm";
+
+        #endregion
+
+        #region Properties
+
+        private readonly String name;
+
+        public String Name
+        {
+            get { return name; }
+        }
+
+        private readonly Single size;
+
+        public Single Size
+        {
+            get { return size; }
+        }
+
+        private readonly ReadOnlyCollection<MapObject> objects;
+
+        public ReadOnlyCollection<MapObject> Objects
+        {
+            get { return objects; }
+        }
+
+        private ReadOnlyCollection<MapObject> colliders;
+
+        /// <summary>
+        /// Gets the objects to collide against, with objects that make up larger rectangles merged together.
+        /// Built on first use by <see cref="ColliderSimplifier"/>.
+        /// </summary>
+        public ReadOnlyCollection<MapObject> Colliders
+        {
+            get
+            {
+                if (colliders == null)
+                    colliders = ColliderSimplifier.Simplify(objects).AsReadOnly();
+
+                return colliders;
+            }
+        }
+
+        private readonly Byte[] hash;
+
+        /// <summary>
+        /// SHA-1 of the .bzw text this map was compiled from.
+        /// </summary>
+        public Byte[] Hash
+        {
+            get { return (Byte[])hash.Clone(); }
+        }
+
+        /// <summary>
+        /// Gets the <see cref="Hash"/> as a lowercase hex string.
+        /// </summary>
+        public String HashString
+        {
+            get { return HashToString(hash); }
+        }
+
+        /// <summary>
+        /// SHA-1 of the compiled binary form, which <see cref="FromBytes"/> checks against the data itself
+        /// and clients check against the one the server announced.
+        /// </summary>
+        public Byte[] Digest
+        {
+            get
+            {
+                Byte[] bytes = GetBytes();
+                Byte[] digest = new Byte[DigestLength];
+
+                Buffer.BlockCopy(bytes, bytes.Length - DigestLength, digest, 0, DigestLength);
+                return digest;
+            }
+        }
+
+        private readonly Int32 badObjects;
+
+        /// <summary>
+        /// Number of object blocks in the source that were incomplete and thrown away.
+        /// </summary>
+        public Int32 BadObjects
+        {
+            get { return badObjects; }
+        }
+
+        #endregion
+
+        // binary form, built on first use since the map can not change after construction
+        private Byte[] compiled;
+
+        public WorldMap(String name, Single size, IList<MapObject> objects, Byte[] hash)
+            : this(name, size, objects, hash, 0)
+        {
+        }
+
+        private WorldMap(String name, Single size, IList<MapObject> objects, Byte[] hash, Int32 badObjects)
+        {
+            if (hash == null || hash.Length != 20)
+                throw new ArgumentException("hash must be a SHA-1 digest", "hash");
+
+            this.name = name;
+            this.size = size;
+            this.objects = new List<MapObject>(objects).AsReadOnly();
+            this.hash = (Byte[])hash.Clone();
+            this.badObjects = badObjects;
+        }
+
+        #region Compiling
+
+        /// <summary>
+        /// Compiles the .bzw file at <paramref name="path"/>, reusing a previously compiled copy from
+        /// <paramref name="cacheDirectory"/> when one exists for the same content.
+        /// </summary>
+        /// <param name="path">Path to the .bzw file.</param>
+        /// <param name="cacheDirectory">Directory to keep compiled maps in, or null to not cache.</param>
+        /// <returns>The validated map.</returns>
+        /// <exception cref="InvalidDataException">The map is not valid.</exception>
+        public static WorldMap Compile(String path, String cacheDirectory)
+        {
+            Byte[] source = File.ReadAllBytes(path);
+            Byte[] hash = ComputeHash(source);
+
+            if (cacheDirectory != null)
+            {
+                WorldMap cached = LoadCached(cacheDirectory, hash);
+
+                if (cached != null)
+                {
+                    Log.DebugFormat("Loaded compiled map for '{0}' from the cache", path);
+                    return cached;
+                }
+            }
+
+            WorldMap map = Parse(source, hash);
+
+            if (map.BadObjects > 0)
+                Log.WarnFormat("{0} incomplete object(s) in '{1}' were skipped", map.BadObjects, path);
+
+            map.Validate();
+
+            if (cacheDirectory != null)
+                map.SaveToCache(cacheDirectory);
+
+            return map;
+        }
+
+        /// <summary>
+        /// Loads the compiled map for <paramref name="hash"/> from <paramref name="cacheDirectory"/>.
+        /// </summary>
+        /// <param name="cacheDirectory"></param>
+        /// <param name="hash">Hash of the .bzw text the map was compiled from.</param>
+        /// <returns>The map, or null if it is not cached or the cached copy is unusable.</returns>
+        public static WorldMap LoadCached(String cacheDirectory, Byte[] hash)
+        {
+            return LoadCached(cacheDirectory, hash, null);
+        }
+
+        /// <summary>
+        /// Loads the compiled map for <paramref name="hash"/> from <paramref name="cacheDirectory"/>,
+        /// making sure its bytes are exactly the ones <paramref name="digest"/> was taken of.
+        /// </summary>
+        /// <param name="cacheDirectory"></param>
+        /// <param name="hash">Hash of the .bzw text the map was compiled from.</param>
+        /// <param name="digest">Expected <see cref="Digest"/>, or null to only check the file against its own.</param>
+        /// <returns>The map, or null if it is not cached or the cached copy is unusable.</returns>
+        public static WorldMap LoadCached(String cacheDirectory, Byte[] hash, Byte[] digest)
+        {
+            String cachePath = Path.Combine(cacheDirectory, HashToString(hash) + CompiledExtension);
+
+            if (!File.Exists(cachePath))
+                return null;
+
+            try
+            {
+                // reading it recomputes its digest, so a damaged file never loads
+                WorldMap cached = FromBytes(File.ReadAllBytes(cachePath));
+
+                if (cached.HashString != HashToString(hash))
+                    Log.WarnFormat("Compiled map at '{0}' does not match its name", cachePath);
+                else if (digest != null && HashToString(cached.Digest) != HashToString(digest))
+                    Log.WarnFormat("Compiled map at '{0}' is not the one expected", cachePath);
+                else
+                    return cached;
+            }
+            catch (Exception e)
+            {
+                if (!(e is InvalidDataException || e is IOException || e is UnauthorizedAccessException))
+                    throw;
+
+                Log.WarnFormat("Compiled map at '{0}' could not be loaded", cachePath);
+                Log.Warn(e.Message);
+            }
+
+            return null;
+        }
+
+        /// <summary>
+        /// Writes the compiled form of this map to <paramref name="cacheDirectory"/>, named after its <see cref="Hash"/>.
+        /// Failing to do so is only logged, as it just costs a parse or a download later on.
+        /// </summary>
+        /// <param name="cacheDirectory"></param>
+        public void SaveToCache(String cacheDirectory)
+        {
+            String cachePath = Path.Combine(cacheDirectory, HashString + CompiledExtension);
+
+            try
+            {
+                Directory.CreateDirectory(cacheDirectory);
+                File.WriteAllBytes(cachePath, GetBytes());
+            }
+            catch (Exception e)
+            {
+                if (!(e is IOException || e is UnauthorizedAccessException))
+                    throw;
+
+                Log.WarnFormat("Could not cache compiled map at '{0}'", cachePath);
+                Log.Warn(e.Message);
+            }
+        }
+
+        public static Byte[] ComputeHash(Byte[] source)
+        {
+            using (SHA1 sha1 = SHA1.Create())
+                return sha1.ComputeHash(source);
+        }
+
+        public static String HashToString(Byte[] hash)
+        {
+            StringBuilder sb = new StringBuilder(hash.Length * 2);
+
+            foreach (Byte b in hash)
+                sb.Append(b.ToString("x2", CultureInfo.InvariantCulture));
+
+            return sb.ToString();
+        }
+
+        #endregion
+
+        #region Parsing
+
+        /// <summary>
+        /// Parses .bzw text into a <see cref="WorldMap"/>.
+        /// </summary>
+        /// <param name="source">Raw bytes of the .bzw file.</param>
+        /// <returns></returns>
+        public static WorldMap Parse(Byte[] source)
+        {
+            return Parse(source, ComputeHash(source));
+        }
+
+        private static WorldMap Parse(Byte[] source, Byte[] hash)
+        {
+            using (StreamReader sr = new StreamReader(new MemoryStream(source, false)))
+                return Parse(sr, hash);
+        }
+
+        /// <summary>
+        /// <para>
+        ///     Parses .bzw text into a <see cref="WorldMap"/>. Sizes are doubled since BZFlag gives half sizes,
+        ///     and rotations are converted from degrees to radians.
+        /// </para>
+        /// <para>
+        ///     If there is no world block, the world name and size default to "No Name" and 800 world units.
+        /// </para>
+        /// </summary>
+        /// <param name="reader"></param>
+        /// <param name="hash">Hash of the text being read.</param>
+        /// <returns></returns>
+        public static WorldMap Parse(TextReader reader, Byte[] hash)
+        {
+            List<MapObject> objects = new List<MapObject>();
+
+            String worldName = "No Name";
+            Single worldSize = 800;
+
+            Vector2? position = null;
+            Vector2? size = null;
+            Single rotation = 0;
+            MapObjectType currentType = MapObjectType.Box;
+            int badObjects = 0; // counts object blocks that failed to load
+
+            // control flags
+            bool inWorldBlock = false;
+            bool inBlock = false;
+
+            String line;
+            Single[] coords = new Single[3];
+
+            while ((line = reader.ReadLine()) != null)
+            {
+                line = line.Trim();
+
+                if (line.Length == 0 || line[0] == '#')
+                    continue;
+
+                int keywordEnd = 0;
+                while (keywordEnd < line.Length && !Char.IsWhiteSpace(line[keywordEnd]))
+                    keywordEnd++;
+
+                String keyword = line.Substring(0, keywordEnd).ToLowerInvariant();
+                String rest = line.Substring(keywordEnd).Trim();
+
+                switch (keyword)
+                {
+                    case "world":
+                        inWorldBlock = true;
+                        inBlock = false;
+                        continue;
+
+                    case "box":
+                    case "pyramid":
+                        inWorldBlock = false;
+                        inBlock = true;
+                        currentType = keyword == "box" ? MapObjectType.Box : MapObjectType.Pyramid;
+                        continue;
+
+                    case "end":
+                        if (inBlock)
+                        {
+                            if (position.HasValue && size.HasValue)
+                                objects.Add(new MapObject(currentType, position.Value, size.Value * 2,
+                                                          MathHelper.ToRadians(rotation)));
+                            else
+                                badObjects++;
+                        }
+
+                        // when finished with one block clear all variables
+                        inWorldBlock = false;
+                        inBlock = false;
+                        position = null;
+                        size = null;
+                        rotation = 0;
+                        continue;
+                }
+
+                if (inWorldBlock)
+                {
+                    if (keyword == "name")
+                    {
+                        worldName = rest;
+                    }
+                    else if (keyword == "size")
+                    {
+                        if (ParseNumbers(rest, coords) >= 1)
+                            worldSize = coords[0];
+                    }
+                }
+                else if (inBlock)
+                {
+                    int count = ParseNumbers(rest, coords);
+
+                    if (keyword == "position" || keyword == "pos")
+                    {
+                        // only load objects with at least x, y and a zero z-position
+                        if (count == 2 || (count == 3 && Math.Abs(coords[2]) <= Single.Epsilon))
+                            position = new Vector2(coords[0], coords[1]);
+                    }
+                    else if (keyword == "size")
+                    {
+                        // only load objects with at least x and y size
+                        if (count >= 2)
+                            size = new Vector2(coords[0], coords[1]);
+                    }
+                    else if (keyword == "rotation" || keyword == "rot")
+                    {
+                        if (count >= 1)
+                            rotation = coords[0];
+                    }
+                }
+            }
+
+            return new WorldMap(worldName, worldSize, objects, hash, badObjects);
+        }
+
+        /// <summary>
+        /// Parses up to <paramref name="values"/>.Length whitespace separated numbers from <paramref name="s"/>.
+        /// </summary>
+        /// <returns>How many numbers there were, or -1 if any of them is malformed.</returns>
+        private static int ParseNumbers(String s, Single[] values)
+        {
+            int count = 0;
+            int i = 0;
+
+            while (i < s.Length)
+            {
+                while (i < s.Length && Char.IsWhiteSpace(s[i]))
+                    i++;
+
+                if (i == s.Length)
+                    break;
+
+                int start = i;
+                while (i < s.Length && !Char.IsWhiteSpace(s[i]))
+                    i++;
+
+                Single value;
+                if (!Single.TryParse(s.Substring(start, i - start), NumberStyles.Float,
+                                     CultureInfo.InvariantCulture, out value))
+                    return -1;
+
+                if (count < values.Length)
+                    values[count] = value;
+
+                count++;
+            }
+
+            return count;
+        }
+
+        #endregion
+
+        #region Validation
+
+        /// <summary>
+        /// Checks the map is something we can play on.
+        /// Objects lying entirely outside the world are only warned about.
+        /// </summary>
+        /// <exception cref="InvalidDataException">The map is not valid.</exception>
+        public void Validate()
+        {
+            if (Single.IsNaN(size) || Single.IsInfinity(size) || size <= 0)
+                throw new InvalidDataException(String.Format("world size must be positive (got {0})", size));
+
+            Single halfSize = size / 2;
+
+            for (int i = 0; i < objects.Count; i++)
+            {
+                MapObject obj = objects[i];
+
+                if (!IsFinite(obj.Position) || !IsFinite(obj.Size) || !IsFinite(obj.Rotation))
+                    throw new InvalidDataException(String.Format("object #{0} has a non-finite position, size or rotation", i));
+
+                if (obj.Size.X <= 0 || obj.Size.Y <= 0)
+                    throw new InvalidDataException(String.Format("object #{0} has a non-positive size ({1})", i, obj.Size));
+
+                if (obj.Max.X < -halfSize || obj.Min.X > halfSize || obj.Max.Y < -halfSize || obj.Min.Y > halfSize)
+                    Log.WarnFormat("Object #{0} at {1} lies outside the world", i, obj.Position);
+            }
+        }
+
+        private static bool IsFinite(Single value)
+        {
+            return !Single.IsNaN(value) && !Single.IsInfinity(value);
+        }
+
+        private static bool IsFinite(Vector2 value)
+        {
+            return IsFinite(value.X) && IsFinite(value.Y);
+        }
+
+        #endregion
+
+        #region Binary Form
+
+        /// <summary>
+        /// Gets the compiled binary form of this map. The same array is returned every time, do not modify it.
+        /// </summary>
+        /// <returns></returns>
+        public Byte[] GetBytes()
+        {
+            if (compiled == null)
+            {
+                MemoryStream ms = new MemoryStream(64 + objects.Count * 37 + DigestLength);
+                Write(ms);
+                compiled = ms.ToArray();
+            }
+
+            return compiled;
+        }
+
+        public void Write(Stream stream)
+        {
+            MemoryStream body = new MemoryStream(64 + objects.Count * 37);
+            WriteBody(body);
+
+            Byte[] digest;
+
+            using (SHA1 sha1 = SHA1.Create())
+                digest = sha1.ComputeHash(body.GetBuffer(), 0, (int)body.Length);
+
+            stream.Write(body.GetBuffer(), 0, (int)body.Length);
+            stream.Write(digest, 0, digest.Length);
+        }
+
+        private void WriteBody(Stream stream)
+        {
+            BinaryWriter writer = new BinaryWriter(stream, Encoding.UTF8);
+
+            writer.Write(Magic);
+            writer.Write(FormatVersion);
+            writer.Write(hash);
+            writer.Write(name);
+            writer.Write(size);
+            writer.Write(objects.Count);
+
+            foreach (MapObject obj in objects)
+            {
+                writer.Write((Byte)obj.Type);
+                writer.Write(obj.Position.X);
+                writer.Write(obj.Position.Y);
+                writer.Write(obj.Size.X);
+                writer.Write(obj.Size.Y);
+                writer.Write(obj.Rotation);
+                writer.Write(obj.Min.X);
+                writer.Write(obj.Min.Y);
+                writer.Write(obj.Max.X);
+                writer.Write(obj.Max.Y);
+            }
+
+            writer.Flush();
+        }
+
+        /// <summary>
+        /// Loads a map from its compiled binary form.
+        /// </summary>
+        /// <param name="data"></param>
+        /// <returns></returns>
+        /// <exception cref="InvalidDataException">The data is not a compiled map of this version, or does not match its digest.</exception>
+        public static WorldMap FromBytes(Byte[] data)
+        {
+            if (data.Length < DigestLength)
+                throw new InvalidDataException("compiled map is truncated");
+
+            int bodyLength = data.Length - DigestLength;
+            Byte[] digest;
+
+            using (SHA1 sha1 = SHA1.Create())
+                digest = sha1.ComputeHash(data, 0, bodyLength);
+
+            for (int i = 0; i < DigestLength; i++)
+            {
+                if (digest[i] != data[bodyLength + i])
+                    throw new InvalidDataException("compiled map does not match its digest");
+            }
+
+            WorldMap map;
+
+            using (MemoryStream ms = new MemoryStream(data, 0, bodyLength, false))
+                map = Read(ms);
+
+            // it is exactly what GetBytes would build
+            map.compiled = data;
+
+            return map;
+        }
+
+        private static WorldMap Read(Stream stream)
+        {
+            try
+            {
+                return ReadCompiled(stream);
+            }
+            catch (EndOfStreamException e)
+            {
+                throw new InvalidDataException("compiled map is truncated", e);
+            }
+            catch (FormatException e)
+            {
+                // a corrupt string length
+                throw new InvalidDataException("compiled map is corrupt", e);
+            }
+        }
+
+        private static WorldMap ReadCompiled(Stream stream)
+        {
+            BinaryReader reader = new BinaryReader(stream, Encoding.UTF8);
+
+            if (reader.ReadUInt32() != Magic)
+                throw new InvalidDataException("not a compiled map");
+
+            UInt16 version = reader.ReadUInt16();
+            if (version != FormatVersion)
+                throw new InvalidDataException(String.Format("compiled map version {0} is not supported (expected {1})",
+                                                             version, FormatVersion));
+
+            Byte[] hash = reader.ReadBytes(20);
+            if (hash.Length != 20)
+                throw new EndOfStreamException();
+
+            String name = reader.ReadString();
+            Single size = reader.ReadSingle();
+            Int32 count = reader.ReadInt32();
+
+            // each object takes 37 bytes, don't let a bad count make us allocate the world
+            if (count < 0 || (stream.CanSeek && count > (stream.Length - stream.Position) / 37))
+                throw new InvalidDataException(String.Format("compiled map has a bad object count ({0})", count));
+
+            List<MapObject> objects = new List<MapObject>(count);
+
+            for (int i = 0; i < count; i++)
+            {
+                MapObjectType type = (MapObjectType)reader.ReadByte();
+                if (type != MapObjectType.Box && type != MapObjectType.Pyramid)
+                    throw new InvalidDataException(String.Format("object #{0} has an unknown type ({1})", i, (Byte)type));
+
+                Vector2 position = new Vector2(reader.ReadSingle(), reader.ReadSingle());
+                Vector2 objSize = new Vector2(reader.ReadSingle(), reader.ReadSingle());
+                Single rotation = reader.ReadSingle();
+                Vector2 min = new Vector2(reader.ReadSingle(), reader.ReadSingle());
+                Vector2 max = new Vector2(reader.ReadSingle(), reader.ReadSingle());
+
+                objects.Add(new MapObject(type, position, objSize, rotation, min, max));
+            }
+
+            return new WorldMap(name, size, objects, hash);
+        }
+
+        #endregion
+    }
+}
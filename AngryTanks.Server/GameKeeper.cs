@@ -1,9 +1,10 @@
 ﻿using System;
 using System.Collections.Generic;
+using System.Globalization;
 using System.Linq;
 using System.Text;
+using Microsoft.Xna.Framework;
 
-using log4net;
 using Lidgren.Network;
 
 using AngryTanks.Common;
@@ -14,7 +15,7 @@ namespace AngryTanks.Server
 {
     public class GameKeeper
     {
-        private static readonly ILog Log = LogManager.GetLogger(System.Reflection.MethodBase.GetCurrentMethod().DeclaringType);
+        private static readonly FastLog Log = FastLog.GetLogger(System.Reflection.MethodBase.GetCurrentMethod().DeclaringType);
 
         #region GameKeeper Properties
 
@@ -40,21 +41,169 @@ namespace AngryTanks.Server
             get { return server; }
         }
 
-        private readonly Byte[] rawWorld;
+        private readonly WorldMap world;
 
-        public Byte[] RawWorld
+        /// <summary>
+        /// The compiled map being served.
+        /// </summary>
+        public WorldMap World
+        {
+            get { return world; }
+        }
+
+        private readonly Byte[] compressedWorld;
+
+        /// <summary>
+        /// The compiled map compressed with LZMA, as streamed to clients.
+        /// </summary>
+        public Byte[] CompressedWorld
+        {
+            get { return compressedWorld; }
+        }
+
+        private DateTime now = DateTime.MinValue;
+
+        /// <summary>
+        /// Gets the time of the current tick, which is what all game logic should go by so replays are deterministic.
+        /// </summary>
+        public DateTime Now
         {
-            get { return rawWorld; }
+            get { return now; }
+        }
+
+        private UInt32 shotTick;
+
+        /// <summary>
+        /// Gets the tick of the shot clock at the current tick, see <see cref="ShotPath"/>.
+        /// </summary>
+        public UInt32 ShotTick
+        {
+            get { return shotTick; }
+        }
+
+        /// <summary>
+        /// Gets or sets the <see cref="ReplayRecorder"/> everything coming in is recorded to, if any.
+        /// </summary>
+        public ReplayRecorder Recorder
+        {
+            get;
+            set;
+        }
+
+        private readonly TickProfiler profiler = new TickProfiler();
+
+        /// <summary>
+        /// Gets the <see cref="TickProfiler"/> timing this game's ticks and counting its traffic.
+        /// </summary>
+        public TickProfiler Profiler
+        {
+            get { return profiler; }
         }
 
         private Dictionary<Byte, Player> players = new Dictionary<Byte, Player>();
 
+        // where players spawn is picked from a distance field of the world's obstacles, built once
+        private readonly SpawnField spawnField;
+
+        // cells of the spawn field are at least this big, about half a tank
+        private static readonly Single SpawnCellSize = 2;
+
+        /// <summary>
+        /// Gets or sets whether players spawn out of sight of enemies when possible.
+        /// </summary>
+        public bool SpawnOutOfSight
+        {
+            get;
+            set;
+        }
+
         private VariableDatabase VarDB = new VariableDatabase();
 
-        public GameKeeper(NetServer server, Byte[] rawWorld)
+        /// <summary>
+        /// Gets the variables in play. Changes go out to everyone with the next tick's events.
+        /// </summary>
+        public VariableDatabase Variables
+        {
+            get { return VarDB; }
+        }
+
+        private Leaderboard<Byte> standings = new Leaderboard<Byte>();
+
+        /// <summary>
+        /// Gets the score of every player in the game by slot, in rank order.
+        /// </summary>
+        public Leaderboard<Byte> Standings
+        {
+            get { return standings; }
+        }
+
+        private Leaderboard<TeamType> teamStandings = new Leaderboard<TeamType>();
+
+        /// <summary>
+        /// Gets the scores of the teams, in rank order. Players leaving take nothing away from their team.
+        /// </summary>
+        public Leaderboard<TeamType> TeamStandings
+        {
+            get { return teamStandings; }
+        }
+
+        // versions of the standings last written to standingsJson
+        private UInt32 publishedStandings = UInt32.MaxValue, publishedTeamStandings = UInt32.MaxValue;
+
+        private volatile String standingsJson = "{\"players\":[],\"teams\":[]}";
+
+        /// <summary>
+        /// Gets the standings as a JSON object, safe to read from any thread. It is rewritten at the end of a tick they changed in.
+        /// </summary>
+        public String StandingsJson
+        {
+            get { return standingsJson; }
+        }
+
+        /// <summary>
+        /// A reliable game event waiting to be bundled, along with the <see cref="Player"/> it should not be sent to.
+        /// </summary>
+        private struct PendingEvent
+        {
+            public readonly MsgBasePacket Packet;
+            public readonly Player Except;
+
+            public PendingEvent(MsgBasePacket packet, Player except)
+            {
+                this.Packet = packet;
+                this.Except = except;
+            }
+        }
+
+        // reliable game events queued during this tick, sent out as one MsgEventBundle per client by FlushEvents
+        private List<PendingEvent> pendingEvents = new List<PendingEvent>();
+
+        // variables changed during this tick, kept so FlushEvents doesn't need a new list every tick
+        private List<VariableStore> changedVariables = new List<VariableStore>();
+
+        // the events and recipients of the bundle being sent, kept so FlushEvents doesn't need new lists every tick
+        private List<MsgBasePacket> bundleEvents = new List<MsgBasePacket>();
+        private List<NetConnection> sharedRecipients = new List<NetConnection>();
+
+        // players who asked for their initial state during this tick, they all share one join snapshot
+        private List<Player> pendingJoins = new List<Player>();
+
+        // never sent, join snapshots are encoded into it and copied out so it can be kept for the next one
+        private NetOutgoingMessage snapshotScratch;
+
+        public GameKeeper(NetServer server, WorldMap world)
         {
             this.server = server;
-            this.rawWorld = rawWorld;
+            this.world = world;
+
+            // every download is the same, so compress just the once
+            this.compressedWorld = Lzma.Compress(world.GetBytes());
+
+            Log.InfoFormat("World compressed from {0} to {1} bytes", world.GetBytes().Length, compressedWorld.Length);
+
+            this.spawnField = new SpawnField(world, SpawnCellSize, 5150);
+
+            Log.InfoFormat("Spawn field built with {0}x{0} cells of {1} units", spawnField.CellsPerSide, spawnField.CellSize);
         }
 
         /// <summary>
@@ -63,8 +212,347 @@ namespace AngryTanks.Server
         /// <param name="lastUpdate"></param>
         public void Update(DateTime lastUpdate)
         {
+            Update(lastUpdate, NetTime.Now);
+        }
+
+        /// <summary>
+        /// Runs one tick.
+        /// </summary>
+        /// <param name="lastUpdate"></param>
+        /// <param name="shotTime">Seconds on the clock shots are timed by, which clients see through Lidgren's remote time.</param>
+        public void Update(DateTime lastUpdate, Double shotTime)
+        {
+            now = lastUpdate;
+            shotTick = ShotPath.ToTick(shotTime);
+
+            if (Recorder != null)
+                Recorder.RecordTick(lastUpdate);
+
+            Int64 start = profiler.Start();
+
+            // get everyone who asked for initial state caught up at once, it's rare enough not to time otherwise
+            if (pendingJoins.Count > 0)
+            {
+                SendJoinSnapshots();
+                start = profiler.EndPhase(TickPhase.Send, start);
+            }
+
             foreach (Player player in Players)
                 player.Update(lastUpdate);
+            start = profiler.EndPhase(TickPhase.Update, start);
+
+            // everything that happened this tick goes out together
+            FlushEvents();
+            profiler.EndPhase(TickPhase.Send, start);
+
+            // only joins, leaves and kills move the standings
+            if (standings.Version != publishedStandings || teamStandings.Version != publishedTeamStandings)
+                PublishStandings();
+
+            profiler.EndTick();
+        }
+
+        /// <summary>
+        /// Writes the standings out for <see cref="StandingsJson"/>, in rank order.
+        /// </summary>
+        private void PublishStandings()
+        {
+            StringBuilder json = new StringBuilder();
+
+            json.Append("{\"players\":[");
+            for (Int32 rank = 1; rank <= standings.Count; rank++)
+            {
+                LeaderboardEntry<Byte> entry = standings.GetEntryAt(rank);
+
+                if (rank > 1)
+                    json.Append(",");
+
+                json.AppendFormat(CultureInfo.InvariantCulture, "{{\"slot\":{0},\"callsign\":", entry.Key);
+                AppendJsonString(json, players[entry.Key].Callsign);
+                json.AppendFormat(CultureInfo.InvariantCulture, ",\"team\":\"{0}\",", players[entry.Key].Team);
+                AppendJsonScore(json, entry);
+                json.Append("}");
+            }
+
+            json.Append("],\"teams\":[");
+            for (Int32 rank = 1; rank <= teamStandings.Count; rank++)
+            {
+                LeaderboardEntry<TeamType> entry = teamStandings.GetEntryAt(rank);
+
+                if (rank > 1)
+                    json.Append(",");
+
+                json.AppendFormat(CultureInfo.InvariantCulture, "{{\"team\":\"{0}\",", entry.Key);
+                AppendJsonScore(json, entry);
+                json.Append("}");
+            }
+            json.Append("]}");
+
+            standingsJson = json.ToString();
+            publishedStandings = standings.Version;
+            publishedTeamStandings = teamStandings.Version;
+        }
+
+        private static void AppendJsonScore<TKey>(StringBuilder json, LeaderboardEntry<TKey> entry)
+        {
+            json.AppendFormat(CultureInfo.InvariantCulture, "\"wins\":{0},\"losses\":{1},\"teamkills\":{2},\"overall\":{3}",
+                              entry.Wins, entry.Losses, entry.Teamkills, entry.Overall);
+        }
+
+        private static void AppendJsonString(StringBuilder json, String value)
+        {
+            json.Append('"');
+
+            foreach (Char c in value)
+            {
+                if (c == '"' || c == '\\')
+                    json.Append('\\').Append(c);
+                else if (c < ' ')
+                    json.AppendFormat(CultureInfo.InvariantCulture, "\\u{0:x4}", (Int32)c);
+                else
+                    json.Append(c);
+            }
+
+            json.Append('"');
+        }
+
+        /// <summary>
+        /// Works out the path of a shot against the world being served, the same way every client does.
+        /// </summary>
+        public ShotPath CreateShotPath(Vector2 origin, Single rotation, UInt32 startTick)
+        {
+            return new ShotPath(world, VarDB, origin, rotation, startTick);
+        }
+
+        /// <summary>
+        /// Queues a reliable game event to be sent to every <see cref="Player"/> at the end of the tick.
+        /// </summary>
+        /// <param name="packet">The event, which must be bundleable.</param>
+        /// <param name="except"><see cref="Player"/> who should not receive the event, or null.</param>
+        public void QueueEvent(MsgBasePacket packet, Player except)
+        {
+            if (!MsgEventBundlePacket.CanBundle(packet.MsgType))
+                throw new ArgumentException(String.Format("{0} can not be sent in an event bundle", packet.MsgType), "packet");
+
+            pendingEvents.Add(new PendingEvent(packet, except));
+        }
+
+        /// <summary>
+        /// Sends all queued events as a single <see cref="MsgEventBundlePacket"/> to each <see cref="Player"/>.
+        /// </summary>
+        /// <remarks>
+        /// Players still joining are skipped; the initial state they get covers everything queued so far.
+        /// Players who are the source of an event get their own bundle without it, everyone else shares one.
+        /// </remarks>
+        public void FlushEvents()
+        {
+            // variables changed during the tick go first, so everything else this tick is seen under them
+            changedVariables.Clear();
+
+            if (VarDB.TakeChanges(changedVariables) > 0)
+            {
+                for (int i = 0; i < changedVariables.Count; ++i)
+                    pendingEvents.Insert(i, new PendingEvent(new MsgSetVariablePacket(changedVariables[i]), null));
+            }
+
+            if (pendingEvents.Count == 0)
+                return;
+
+            sharedRecipients.Clear();
+
+            foreach (Player player in players.Values)
+            {
+                if (player.State == PlayerState.Joining || player.Connection == null)
+                    continue;
+
+                if (!IsEventSource(player))
+                {
+                    sharedRecipients.Add(player.Connection);
+                    continue;
+                }
+
+                bundleEvents.Clear();
+
+                for (int i = 0; i < pendingEvents.Count; ++i)
+                {
+                    if (pendingEvents[i].Except != player)
+                        bundleEvents.Add(pendingEvents[i].Packet);
+                }
+
+                if (bundleEvents.Count > 0)
+                    player.SendMessage(CreateEventBundle(bundleEvents), MessageType.MsgEventBundle);
+            }
+
+            if (sharedRecipients.Count > 0)
+            {
+                bundleEvents.Clear();
+
+                for (int i = 0; i < pendingEvents.Count; ++i)
+                    bundleEvents.Add(pendingEvents[i].Packet);
+
+                NetOutgoingMessage bundleMessage = CreateEventBundle(bundleEvents);
+
+                profiler.MessageSent(bundleMessage, sharedRecipients.Count);
+
+                TrafficRoute route = TrafficClasses.GetRoute(MessageType.MsgEventBundle);
+                Server.SendMessage(bundleMessage, sharedRecipients, route.Method, route.Channel);
+            }
+
+            pendingEvents.Clear();
+            sharedRecipients.Clear();
+        }
+
+        /// <summary>
+        /// Gets whether any queued event came from <paramref name="player"/>, who then needs a bundle of their own.
+        /// </summary>
+        private bool IsEventSource(Player player)
+        {
+            for (int i = 0; i < pendingEvents.Count; ++i)
+            {
+                if (pendingEvents[i].Except == player)
+                    return true;
+            }
+
+            return false;
+        }
+
+        /// <summary>
+        /// Queues a <see cref="Player"/> to receive its initial state at the start of the next tick.
+        /// </summary>
+        /// <param name="player"></param>
+        public void QueueJoin(Player player)
+        {
+            if (!pendingJoins.Contains(player))
+                pendingJoins.Add(player);
+        }
+
+        /// <summary>
+        /// Builds one join snapshot of the current game and sends it to every queued <see cref="Player"/>.
+        /// </summary>
+        private void SendJoinSnapshots()
+        {
+            if (pendingJoins.Count == 0)
+                return;
+
+            // get anything still queued out to everyone else first, the snapshot already reflects it
+            FlushEvents();
+
+            List<JoinSnapshotEntry> roster = new List<JoinSnapshotEntry>(players.Count);
+
+            foreach (Player player in players.Values)
+                roster.Add(player.GetSnapshotEntry());
+
+            List<MsgSetVariablePacket> variables = VarDB.NonDefault.ConvertAll(v => new MsgSetVariablePacket(v));
+
+            if (snapshotScratch == null)
+                snapshotScratch = Server.CreateMessage();
+
+            Byte[] snapshotBody = MsgJoinSnapshotPacket.EncodeBody(snapshotScratch, roster, variables);
+
+            Log.DebugFormat("Join snapshot compiled ({0} bytes, {1} players) for {2} joining players",
+                            snapshotBody.Length, roster.Count, pendingJoins.Count);
+
+            foreach (Player player in pendingJoins)
+                player.SendState(snapshotBody);
+
+            pendingJoins.Clear();
+        }
+
+        private NetOutgoingMessage CreateEventBundle(List<MsgBasePacket> events)
+        {
+            NetOutgoingMessage bundleMessage = Server.CreateMessage();
+
+            MsgEventBundlePacket bundlePacket = new MsgEventBundlePacket(events);
+
+            bundleMessage.Write((Byte)bundlePacket.MsgType);
+            bundlePacket.Write(bundleMessage);
+
+            return bundleMessage;
+        }
+
+        /// <summary>
+        /// Handles a message read from the <see cref="NetServer"/>, which is all a main loop needs to do between ticks.
+        /// </summary>
+        /// <param name="msg"></param>
+        public void HandleMessage(NetIncomingMessage msg)
+        {
+            switch (msg.MessageType)
+            {
+                case NetIncomingMessageType.WarningMessage:
+                    Log.Warn(msg.ReadString());
+                    break;
+
+                case NetIncomingMessageType.ErrorMessage:
+                    Log.Error(msg.ReadString());
+                    break;
+
+                case NetIncomingMessageType.DebugMessage:
+                    Log.Debug(msg.ReadString());
+                    break;
+
+                case NetIncomingMessageType.DiscoveryRequest:
+                    break;
+
+                case NetIncomingMessageType.StatusChanged:
+                    {
+                        // we're not interested in status changes on the server yet
+                        if (msg.SenderConnection == null)
+                            break;
+
+                        HandleStatusChange(msg);
+
+                        break;
+                    }
+
+                case NetIncomingMessageType.ConnectionApproval:
+                    HandleApproval(msg);
+                    break;
+
+                case NetIncomingMessageType.Data:
+                    HandleIncomingData(msg);
+                    break;
+
+                default:
+                    // welp... what shall we do?
+                    break;
+            }
+        }
+
+        /// <summary>
+        /// Lets a connecting client in as a new <see cref="Player"/>, or denies it.
+        /// </summary>
+        /// <param name="msg">The connection approval message, carrying the client's MsgEnter.</param>
+        private void HandleApproval(NetIncomingMessage msg)
+        {
+            // chop off header
+            MessageType messageType = (MessageType)msg.ReadByte();
+
+            // WTF?
+            if (messageType != MessageType.MsgEnter)
+            {
+                String rejection = String.Format("message type not as expected (expected {0}, you sent {1})",
+                                                 MessageType.MsgEnter, messageType);
+                msg.SenderConnection.Deny(rejection);
+                return;
+            }
+
+            UInt16 clientProtoVersion = msg.ReadUInt16();
+
+            if (clientProtoVersion != ProtocolInformation.ProtocolVersion)
+            {
+                String rejection = String.Format("protocol versions do not match (server is {0}, you are {1})",
+                                                 ProtocolInformation.ProtocolVersion, clientProtoVersion);
+                msg.SenderConnection.Deny(rejection);
+                return;
+            }
+
+            TeamType team = (TeamType)msg.ReadByte();
+            String callsign = msg.ReadString();
+            String tag = msg.ReadString();
+
+            PlayerInformation playerInfo = new PlayerInformation(ProtocolInformation.DummySlot, callsign, tag, team);
+
+            AddPlayer(msg.SenderConnection, playerInfo);
         }
 
         /// <summary>
@@ -76,7 +564,20 @@ namespace AngryTanks.Server
             Player player = GetPlayerByConnection(incomingMessage.SenderConnection);
 
             if (player != null)
-                player.HandleData(incomingMessage);
+                HandleIncomingData(player, incomingMessage);
+        }
+
+        /// <summary>
+        /// Handles data from a known <see cref="Player"/>, this is also where replays feed messages in.
+        /// </summary>
+        /// <param name="player"></param>
+        /// <param name="incomingMessage"></param>
+        public void HandleIncomingData(Player player, NetIncomingMessage incomingMessage)
+        {
+            if (Recorder != null)
+                Recorder.RecordData(player.Slot, incomingMessage);
+
+            player.HandleData(incomingMessage);
         }
 
         /// <summary>
@@ -105,9 +606,10 @@ namespace AngryTanks.Server
         /// <summary>
         /// 
         /// </summary>
-        /// <param name="connection"></param>
+        /// <param name="connection">The player's connection, or null for a player being replayed.</param>
         /// <param name="playerInfo"></param>
-        public void AddPlayer(NetConnection connection, PlayerInformation playerInfo)
+        /// <returns>The new <see cref="Player"/>, or null if they were rejected.</returns>
+        public Player AddPlayer(NetConnection connection, PlayerInformation playerInfo)
         {
             String denyReason;
             Byte slot = AllocateSlot(playerInfo, out denyReason);
@@ -117,31 +619,31 @@ namespace AngryTanks.Server
             {
                 Log.InfoFormat("Player \"{0}\" from {1} tried to join, but was rejected ({2}).",
                                playerInfo.Callsign, connection, denyReason);
-                connection.Deny(denyReason);
-                return;
+
+                if (connection != null)
+                    connection.Deny(denyReason);
+
+                return null;
             }
 
             // we can now approve the player if we get here
-            connection.Approve();
+            if (connection != null)
+                connection.Approve();
+
+            if (Recorder != null)
+                Recorder.RecordJoin(slot, playerInfo);
 
             // add player to our list
             players[slot] = new Player(this, slot, connection, playerInfo);
+            standings.Set(slot, players[slot].Score);
 
             // and tell everyone else about this awesome new player
-            Log.DebugFormat("Sending MsgAddPlayer to everyone else about player #{0}", slot);
-
-            NetOutgoingMessage packet = Server.CreateMessage();
-
-            MsgAddPlayerPacket message = new MsgAddPlayerPacket(players[slot].PlayerInfo, false);
-
-            packet.Write((Byte)message.MsgType);
-            message.Write(packet);
-
-            Log.DebugFormat("MsgAddPlayer Compiled ({0} bytes) and being sent to {1} recipients",
-                            packet.LengthBytes, players.Count - 1);
+            Log.DebugFormat("Queueing MsgAddPlayer to everyone else about player #{0}", slot);
 
             // send to everyone except our new player, we let Player itself decide when to send the state to the new guy
-            Server.SendToAll(packet, connection, NetDeliveryMethod.ReliableOrdered, 0);
+            QueueEvent(new MsgAddPlayerPacket(players[slot].PlayerInfo, false), players[slot]);
+
+            return players[slot];
         }
 
         /// <summary>
@@ -153,26 +655,70 @@ namespace AngryTanks.Server
         {
             Log.InfoFormat("Removing player #{0} ({1})", player.Slot, reason);
 
+            if (Recorder != null)
+                Recorder.RecordLeave(player.Slot, reason);
+
             // nuke player from the dictionary
             players.Remove(player.Slot);
+            pendingJoins.Remove(player);
+            standings.Remove(player.Slot);
 
             // now let's tell all the other players the dude left
-            NetOutgoingMessage packet = Server.CreateMessage();
-
-            MsgRemovePlayerPacket message =
-                new MsgRemovePlayerPacket(player.Slot, reason);
-
-            packet.Write((Byte)message.MsgType);
-            message.Write(packet);
+            QueueEvent(new MsgRemovePlayerPacket(player.Slot, reason), null);
 
-            // send to all
-            Server.SendToAll(packet, null, NetDeliveryMethod.ReliableOrdered, 0);
-            
             // disposing of player would be a good idea
             if (player.Connection != null)
                 player.Connection.Disconnect(reason);
         }
 
+        /// <summary>
+        /// Picks where a <see cref="Player"/> spawns, clear of obstacles and as far from live tanks as can be found.
+        /// </summary>
+        /// <param name="player">Player that is spawning.</param>
+        /// <param name="rotation">Which way the player should face.</param>
+        /// <returns>Where the player should spawn.</returns>
+        public Vector2 FindSpawn(Player player, out Single rotation)
+        {
+            List<Vector2> tanks = new List<Vector2>(players.Count);
+            List<Vector2> enemies = SpawnOutOfSight ? new List<Vector2>(players.Count) : null;
+
+            foreach (Player other in players.Values)
+            {
+                if (other == player || other.State != PlayerState.Alive)
+                    continue;
+
+                tanks.Add(other.Position);
+
+                if (enemies != null && (other.Team != player.Team || other.Team == TeamType.RogueTeam))
+                    enemies.Add(other.Position);
+            }
+
+            // a tank can be facing any way, so it needs its half diagonal clear all around
+            Single clearance = new Vector2(VarDB.TankWidth.Value, VarDB.TankLength.Value).Length() / 2;
+
+            Vector2 position;
+
+            if (!spawnField.FindSpawn(clearance, tanks, enemies, out position, out rotation))
+                Log.WarnFormat("Nowhere in the world is clear enough to spawn player #{0}", player.Slot);
+
+            return position;
+        }
+
+        /// <summary>
+        /// Adds to a <see cref="Player"/>'s score, moves them and their team in the standings and tells everyone.
+        /// </summary>
+        public void AddScore(Player player, Int32 wins, Int32 losses, Int32 teamkills)
+        {
+            player.Score.Wins      += wins;
+            player.Score.Losses    += losses;
+            player.Score.Teamkills += teamkills;
+
+            standings.Set(player.Slot, player.Score);
+            teamStandings.Add(player.Team, wins, losses, teamkills);
+
+            QueueEvent(player.GetScorePacket(), null);
+        }
+
         /// <summary>
         /// Gets the <see cref="Player"/> associated with a certain instance of <see cref="NetConnection"/>.
         /// </summary>
@@ -0,0 +1,138 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+using System.Threading;
+
+namespace AngryTanks.Server
+{
+    /// <summary>
+    /// A log-linear latency histogram in the style of HdrHistogram, recording microseconds to within 1/16th.
+    /// </summary>
+    /// <remarks>
+    /// Recording is lock-free and allocation-free so it can sit on the hot path of the tick,
+    /// and it is safe to read from another thread while being recorded to. Only one thread may record at a time.
+    /// </remarks>
+    public class LatencyHistogram
+    {
+        // each power of two is split into this many linear buckets
+        private const int SubBucketBits  = 4;
+        private const int SubBucketCount = 1 << SubBucketBits;
+
+        // anything beyond 2^32 us (over an hour) is clamped into the last bucket
+        private const int MaxValueBits = 32;
+        private const Int64 MaxValue   = (1L << MaxValueBits) - 1;
+
+        private const int BucketCount = (MaxValueBits - SubBucketBits + 1) * SubBucketCount;
+
+        private readonly Int64[] counts = new Int64[BucketCount];
+        private Int64 totalSum, maxValue;
+
+        /// <summary>
+        /// Gets the number of values recorded.
+        /// </summary>
+        public Int64 Count
+        {
+            get
+            {
+                // added up here so recording has one less interlocked operation to do
+                Int64 count = 0;
+
+                for (int i = 0; i < BucketCount; i++)
+                    count += Interlocked.Read(ref counts[i]);
+
+                return count;
+            }
+        }
+
+        /// <summary>
+        /// Gets the sum of every value recorded, in microseconds.
+        /// </summary>
+        public Int64 Sum
+        {
+            get { return Interlocked.Read(ref totalSum); }
+        }
+
+        /// <summary>
+        /// Gets the largest value recorded, in microseconds.
+        /// </summary>
+        public Int64 Max
+        {
+            get { return Interlocked.Read(ref maxValue); }
+        }
+
+        /// <summary>
+        /// Records a value.
+        /// </summary>
+        /// <param name="value">The value in microseconds, negative values count as 0.</param>
+        public void Record(Int64 value)
+        {
+            if (value < 0)
+                value = 0;
+            else if (value > MaxValue)
+                value = MaxValue;
+
+            Interlocked.Increment(ref counts[GetIndex(value)]);
+            Interlocked.Add(ref totalSum, value);
+
+            // nobody else writes it, so only a new maximum needs publishing
+            if (value > maxValue)
+                Interlocked.Exchange(ref maxValue, value);
+        }
+
+        /// <summary>
+        /// Gets the values at the given quantiles.
+        /// </summary>
+        /// <param name="quantiles">Quantiles between 0 and 1, in ascending order.</param>
+        /// <returns>The upper bound of the bucket each quantile falls in, in microseconds.</returns>
+        public Int64[] GetQuantiles(Double[] quantiles)
+        {
+            // work off a copy, recording carries on while we read
+            Int64[] snapshot = new Int64[BucketCount];
+            Int64 count = 0;
+
+            for (int i = 0; i < BucketCount; i++)
+            {
+                snapshot[i] = Interlocked.Read(ref counts[i]);
+                count += snapshot[i];
+            }
+
+            Int64[] values = new Int64[quantiles.Length];
+            Int64 seen = 0;
+            int q = 0;
+
+            for (int i = 0; i < BucketCount && q < quantiles.Length; i++)
+            {
+                seen += snapshot[i];
+
+                while (q < quantiles.Length && count > 0 && seen >= Math.Ceiling(quantiles[q] * count))
+                    values[q++] = Math.Min(GetUpperBound(i), Max);
+            }
+
+            return values;
+        }
+
+        private static int GetIndex(Int64 value)
+        {
+            if (value < SubBucketCount)
+                return (int)value;
+
+            // how far we need to shift to leave SubBucketBits + 1 significant bits
+            int shift = 0;
+            while ((value >> shift) >= 2 * SubBucketCount)
+                shift++;
+
+            return (shift + 1) * SubBucketCount + (int)((value >> shift) - SubBucketCount);
+        }
+
+        private static Int64 GetUpperBound(int index)
+        {
+            if (index < SubBucketCount)
+                return index;
+
+            int shift = index / SubBucketCount - 1;
+
+            return ((Int64)(SubBucketCount + index % SubBucketCount + 1) << shift) - 1;
+        }
+    }
+}
@@ -4,10 +4,10 @@ using System.Linq;
 using System.Text;
 using Microsoft.Xna.Framework;
 
-using log4net;
 using Lidgren.Network;
 
 using AngryTanks.Common;
+using AngryTanks.Common.Extensions.DictionaryExtensions;
 using AngryTanks.Common.Messages;
 using AngryTanks.Common.Protocol;
 
@@ -15,7 +15,7 @@ namespace AngryTanks.Server
 {
     public class Player
     {
-        private static readonly ILog Log = LogManager.GetLogger(System.Reflection.MethodBase.GetCurrentMethod().DeclaringType);
+        private static readonly FastLog Log = FastLog.GetLogger(System.Reflection.MethodBase.GetCurrentMethod().DeclaringType);
 
         #region Player Properties
 
@@ -44,6 +44,19 @@ namespace AngryTanks.Server
             get { return score; }
         }
 
+        // last known position and rotation, as reported by the player
+        private Vector2 position = Vector2.Zero;
+        public Vector2 Position
+        {
+            get { return position; }
+        }
+
+        private Single rotation = 0;
+        public Single Rotation
+        {
+            get { return rotation; }
+        }
+
         #endregion
 
         private GameKeeper gameKeeper;
@@ -54,6 +67,21 @@ namespace AngryTanks.Server
         // 5 second respawn
         private TimeSpan respawnTime = new TimeSpan(0, 0, 5);
 
+        // how far into the compressed world we've streamed, or -1 if we're not streaming it
+        private int worldStreamOffset = -1;
+
+        // chunks sent per update, with an update every 10ms this streams up to 1.6 MB/s
+        private static readonly int WorldChunksPerUpdate = 16;
+
+        // shots in flight by shot slot, kept to check hits on tanks against
+        private Dictionary<Byte, ShotPath> shots = new Dictionary<Byte, ShotPath>();
+
+        // a hit is reported by the victim after seeing the shot, so it may reach us a little after the shot ended
+        private static readonly Int32 ShotHitGraceTicks = ShotPath.TicksPerSecond;
+
+        // a shot is fired at the shooter's guess of our clock, so its start tick can only be so far from ours
+        private static readonly Int32 ShotStartSkewTicks = ShotPath.TicksPerSecond / 2;
+
         public Player(GameKeeper gameKeeper, Byte slot, NetConnection connection, PlayerInformation playerInfo)
         {
             this.Slot       = slot;
@@ -76,9 +104,16 @@ namespace AngryTanks.Server
         /// <param name="lastUpdate"></param>
         public void Update(DateTime lastUpdate)
         {
-            if ((State == PlayerState.Dead) && (lastDiedTime + respawnTime <= DateTime.Now))
+            if ((State == PlayerState.Dead) && (lastDiedTime + respawnTime <= gameKeeper.Now))
                 Spawn();
 
+            if (worldStreamOffset >= 0)
+                StreamWorld();
+
+            // forget shots nobody can claim a hit from anymore
+            if (shots.Count > 0)
+                shots.RemoveAll(kvp => ShotPath.TicksSince(kvp.Value.EndTick, gameKeeper.ShotTick) > ShotHitGraceTicks);
+
             return;
         }
 
@@ -90,10 +125,16 @@ namespace AngryTanks.Server
         {
             MessageType messageType = (MessageType)incomingMsg.ReadByte();
 
+            Int64 start = gameKeeper.Profiler.MessageReceived(messageType, incomingMsg.LengthBytes);
+
             switch (messageType)
             {
                 case MessageType.MsgState:
-                    SendState();
+                    gameKeeper.QueueJoin(this);
+                    break;
+
+                case MessageType.MsgWorldRequest:
+                    RequestWorld(incomingMsg);
                     break;
 
                 case MessageType.MsgPlayerClientUpdate:
@@ -115,88 +156,100 @@ namespace AngryTanks.Server
                 default:
                     break;
             }
+
+            // only some are timed
+            if (start != 0)
+                gameKeeper.Profiler.MessageHandled(messageType, start);
         }
 
         /// <summary>
         /// Sends initial state to this <see cref="Player"/>.
         /// </summary>
-        private void SendState()
+        /// <param name="snapshotBody">Join snapshot body shared by everyone joining this tick.</param>
+        public void SendState(Byte[] snapshotBody)
         {
             Log.DebugFormat("Sending state to #{0}...", Slot);
 
-            // TODO we should clamp world size to no more than UInt16.MaxValue bytes large
-            // first send the world
-            NetOutgoingMessage worldMsg = gameKeeper.Server.CreateMessage(1 + 2 + (UInt16)gameKeeper.RawWorld.Length);
-            worldMsg.Write((Byte)MessageType.MsgWorld);
-            worldMsg.Write((UInt16)gameKeeper.RawWorld.Length);
-            worldMsg.Write(gameKeeper.RawWorld);
-            SendMessage(worldMsg, NetDeliveryMethod.ReliableOrdered, 0);
+            // first say which world we're on, they'll ask for it if they don't have it cached
+            NetOutgoingMessage worldInfoMsg = gameKeeper.Server.CreateMessage();
 
-            // TODO send other state information... like flags
-
-            // tell him about everyone else
-            Log.DebugFormat("Sending MsgAddPlayer for each player to #{0}", Slot);
+            MsgWorldInfoPacket worldInfoPacket = new MsgWorldInfoPacket(gameKeeper.World.Hash,
+                                                                        gameKeeper.World.Digest,
+                                                                        (UInt32)gameKeeper.CompressedWorld.Length,
+                                                                        (UInt32)gameKeeper.World.GetBytes().Length);
 
-            NetOutgoingMessage addPlayerMessage;
-            MsgAddPlayerPacket addPlayerPacket;
+            worldInfoMsg.Write((Byte)worldInfoPacket.MsgType);
+            worldInfoPacket.Write(worldInfoMsg);
 
-            foreach (Player otherPlayer in gameKeeper.Players)
-            {
-                // don't want to tell our player about himself just yet...
-                if (otherPlayer == this)
-                    continue;
+            SendMessage(worldInfoMsg, worldInfoPacket.MsgType);
 
-                addPlayerMessage = gameKeeper.Server.CreateMessage();
+            // TODO send other state information... like flags
 
-                addPlayerPacket = new MsgAddPlayerPacket(otherPlayer.PlayerInfo, false);
+            // then everything else in one go: everyone's information, scores and positions, along with his slot
+            NetOutgoingMessage snapshotMessage = gameKeeper.Server.CreateMessage(1 + 2 + snapshotBody.Length);
 
-                addPlayerMessage.Write((Byte)addPlayerPacket.MsgType);
-                addPlayerPacket.Write(addPlayerMessage);
+            MsgJoinSnapshotPacket snapshotPacket = new MsgJoinSnapshotPacket(Slot, snapshotBody);
 
-                Log.DebugFormat("MsgAddPlayer Compiled ({0} bytes) for player #{1} and being sent to player #{2}",
-                                addPlayerMessage.LengthBytes, otherPlayer.Slot, this.Slot);
+            snapshotMessage.Write((Byte)snapshotPacket.MsgType);
+            snapshotPacket.Write(snapshotMessage);
 
-                SendMessage(addPlayerMessage, NetDeliveryMethod.ReliableOrdered, 0);
-            }
+            SendMessage(snapshotMessage, snapshotPacket.MsgType);
 
-            // send everyones' scores to him
-            NetOutgoingMessage scoreMessage;
+            // we're now ready to move to the spawn state and spawn
+            this.state = PlayerState.Spawning;
 
-            foreach (Player otherPlayer in gameKeeper.Players)
-            {
-                // no reason to give our player his score... he has none yet
-                if (otherPlayer == this)
-                    continue;
+            this.Spawn();
+        }
 
-                scoreMessage = otherPlayer.GetMsgScore();
+        /// <summary>
+        /// Starts streaming the world to this <see cref="Player"/> after a <see cref="MsgWorldRequestPacket"/>.
+        /// </summary>
+        /// <param name="incomingMessage"></param>
+        private void RequestWorld(NetIncomingMessage incomingMessage)
+        {
+            MsgWorldRequestPacket worldRequestPacket = MsgWorldRequestPacket.Read(incomingMessage);
 
-                SendMessage(scoreMessage, NetDeliveryMethod.ReliableOrdered, 0);
+            if (WorldMap.HashToString(worldRequestPacket.Hash) != gameKeeper.World.HashString)
+            {
+                Log.WarnFormat("Player #{0} asked for a world we don't serve ({1})",
+                               Slot, WorldMap.HashToString(worldRequestPacket.Hash));
+                return;
             }
 
-            // send back one last MsgAddPlayer with their full information (which could be changed!)
-            addPlayerMessage = gameKeeper.Server.CreateMessage();
+            // already on its way
+            if (worldStreamOffset >= 0)
+                return;
 
-            addPlayerPacket = new MsgAddPlayerPacket(PlayerInfo, true);
+            Log.DebugFormat("Streaming world to #{0}", Slot);
 
-            addPlayerMessage.Write((Byte)addPlayerPacket.MsgType);
-            addPlayerPacket.Write(addPlayerMessage);
+            worldStreamOffset = 0;
+        }
 
-            SendMessage(addPlayerMessage, NetDeliveryMethod.ReliableOrdered, 0);
+        /// <summary>
+        /// Sends the next few chunks of the world as bulk traffic, so game messages are never stuck behind it.
+        /// </summary>
+        private void StreamWorld()
+        {
+            Byte[] compressedWorld = gameKeeper.CompressedWorld;
 
-            // let them know we're ready to move on, and give him his slot
-            NetOutgoingMessage stateMessage = gameKeeper.Server.CreateMessage();
+            for (int i = 0; i < WorldChunksPerUpdate && worldStreamOffset < compressedWorld.Length; i++)
+            {
+                int count = Math.Min(ProtocolInformation.WorldChunkSize, compressedWorld.Length - worldStreamOffset);
 
-            MsgStatePacket statePacket = new MsgStatePacket(Slot);
+                NetOutgoingMessage worldMsg = gameKeeper.Server.CreateMessage(1 + 5 + 5 + count);
+                MsgWorldPacket worldPacket = new MsgWorldPacket((UInt32)worldStreamOffset, compressedWorld, worldStreamOffset, count);
 
-            stateMessage.Write((Byte)statePacket.MsgType);
-            statePacket.Write(stateMessage);
+                worldMsg.Write((Byte)worldPacket.MsgType);
+                worldPacket.Write(worldMsg);
 
-            SendMessage(stateMessage, NetDeliveryMethod.ReliableOrdered, 0);
+                SendMessage(worldMsg, worldPacket.MsgType);
 
-            // we're now ready to move to the spawn state and spawn
-            this.state = PlayerState.Spawning;
+                worldStreamOffset += count;
+            }
 
-            this.Spawn();
+            // all done
+            if (worldStreamOffset >= compressedWorld.Length)
+                worldStreamOffset = -1;
         }
 
         /// <summary>
@@ -208,6 +261,10 @@ namespace AngryTanks.Server
         {
             MsgPlayerClientUpdatePacket clientUpdatePacket = MsgPlayerClientUpdatePacket.Read(msg);
 
+            // remember where they are for anyone joining later
+            position = clientUpdatePacket.Position;
+            rotation = clientUpdatePacket.Rotation;
+
             NetOutgoingMessage serverUpdateMessage = gameKeeper.Server.CreateMessage();
             MsgPlayerServerUpdatePacket serverUpdatePacket = new MsgPlayerServerUpdatePacket(this.Slot, clientUpdatePacket);
 
@@ -215,7 +272,11 @@ namespace AngryTanks.Server
             serverUpdatePacket.Write(serverUpdateMessage);
 
             // send to everyone but us
-            gameKeeper.Server.SendToAll(serverUpdateMessage, this.Connection, NetDeliveryMethod.UnreliableSequenced, 0);
+            gameKeeper.Profiler.MessageSent(serverUpdateMessage,
+                                            gameKeeper.Server.ConnectionsCount - (this.Connection != null ? 1 : 0));
+
+            TrafficRoute route = TrafficClasses.GetRoute(serverUpdatePacket.MsgType);
+            gameKeeper.Server.SendToAll(serverUpdateMessage, this.Connection, route.Method, route.Channel);
         }
 
         /// <summary>
@@ -223,17 +284,13 @@ namespace AngryTanks.Server
         /// </summary>
         public void Spawn()
         {
-            // create our spawn message and packet
-            NetOutgoingMessage spawnMessage = gameKeeper.Server.CreateMessage();
+            position = gameKeeper.FindSpawn(this, out rotation);
 
-            MsgSpawnPacket spawnPacket = new MsgSpawnPacket(this.Slot, Vector2.Zero, 0);
+            // clients end a player's shots when it spawns
+            shots.Clear();
 
-            // write to the message
-            spawnMessage.Write((Byte)spawnPacket.MsgType);
-            spawnPacket.Write(spawnMessage);
-
-            // send the spawn message to everyone
-            gameKeeper.Server.SendToAll(spawnMessage, null, NetDeliveryMethod.ReliableOrdered, 0);
+            // let everyone know about the spawn
+            gameKeeper.QueueEvent(new MsgSpawnPacket(this.Slot, position, rotation), null);
 
             // they're now alive as far as we're concerned
             state = PlayerState.Alive;
@@ -247,20 +304,8 @@ namespace AngryTanks.Server
         {
             MsgDeathPacket incomingDeathPacket = MsgDeathPacket.Read(incomingMessage);
 
-            // create our death message and packet
-            NetOutgoingMessage deathMessage = gameKeeper.Server.CreateMessage();
-
-            MsgDeathPacket deathPacket = new MsgDeathPacket(this.Slot, incomingDeathPacket.Killer);
-
-            // write to the message
-            deathMessage.Write((Byte)deathPacket.MsgType);
-            deathPacket.Write(deathMessage);
-
-            // send the death message to everyone except the player who reported it
-            gameKeeper.Server.SendToAll(deathMessage, this.Connection, NetDeliveryMethod.ReliableOrdered, 0);
-
-            // update our score
-            this.Score.Losses++;
+            // tell everyone except the player who reported it about the death
+            gameKeeper.QueueEvent(new MsgDeathPacket(this.Slot, incomingDeathPacket.Killer), this);
 
             // update killer's score, but only if the killer wasn't myself
             if (this.Slot != incomingDeathPacket.Killer)
@@ -268,17 +313,14 @@ namespace AngryTanks.Server
                 Player killer = gameKeeper.GetPlayerBySlot(incomingDeathPacket.Killer);
 
                 if (killer != null)
-                {
-                    killer.Score.Wins++;
-                    gameKeeper.Server.SendToAll(killer.GetMsgScore(), null, NetDeliveryMethod.ReliableOrdered, 0);
-                }
+                    gameKeeper.AddScore(killer, 1, 0, 0);
             }
 
-            // broadcast our score
-            gameKeeper.Server.SendToAll(this.GetMsgScore(), null, NetDeliveryMethod.ReliableOrdered, 0);
+            // update and broadcast our score
+            gameKeeper.AddScore(this, 0, 1, 0);
 
             // update our last died time
-            lastDiedTime = DateTime.Now;
+            lastDiedTime = gameKeeper.Now;
 
             // we're now dead as far as we're concerned
             state = PlayerState.Dead;
@@ -292,71 +334,136 @@ namespace AngryTanks.Server
         {
             MsgBeginShotPacket incomingBeginShotPacket = MsgBeginShotPacket.Read(incomingMessage);
 
-            // create our shot begin message and packet
-            NetOutgoingMessage beginShotMessage = gameKeeper.Server.CreateMessage();
+            if (incomingBeginShotPacket.ShotSlot >= ProtocolInformation.MaxShots)
+            {
+                Log.WarnFormat("Player #{0} fired from shot slot {1}, which doesn't exist", Slot, incomingBeginShotPacket.ShotSlot);
+                return;
+            }
+
+            // keep the start tick near ours, otherwise a shot could be fired long ago or far ahead and linger for hits
+            UInt32 startTick = incomingBeginShotPacket.StartTick;
+            Int32 skew = ShotPath.TicksSince(gameKeeper.ShotTick, startTick);
+
+            if (Math.Abs(skew) > ShotStartSkewTicks)
+            {
+                Log.DebugFormat("Player #{0} fired {1} ticks off our shot clock, clamping", Slot, skew);
+                startTick = unchecked(gameKeeper.ShotTick + (UInt32)(Math.Sign(skew) * ShotStartSkewTicks));
+            }
+
+            // work out the shot the same way the clients will, so we know when hits on it stop being possible
+            shots[incomingBeginShotPacket.ShotSlot] = gameKeeper.CreateShotPath(incomingBeginShotPacket.Position,
+                                                                                incomingBeginShotPacket.Rotation,
+                                                                                startTick);
 
+            // everyone else gets the clamped tick, so they all fly the same shot we check hits against
             MsgBeginShotPacket beginShotPacket =
                 new MsgBeginShotPacket(this.Slot,
                                        incomingBeginShotPacket.ShotSlot,
                                        incomingBeginShotPacket.Position,
                                        incomingBeginShotPacket.Rotation,
-                                       incomingBeginShotPacket.Velocity);
-
-            // write to the message
-            beginShotMessage.Write((Byte)beginShotPacket.MsgType);
-            beginShotPacket.Write(beginShotMessage);
+                                       startTick);
 
-            // send the shot begin message to everyone except the player who reported it
-            gameKeeper.Server.SendToAll(beginShotMessage, this.Connection, NetDeliveryMethod.ReliableUnordered, 0);
+            // send the shot begin to everyone except the player who reported it
+            gameKeeper.QueueEvent(beginShotPacket, this);
         }
 
         /// <summary>
-        /// Handles end shots by players and broadcasts that to all other <see cref="Player"/>s.
+        /// Handles a <see cref="Player"/> reporting being hit by a shot and broadcasts that to all other <see cref="Player"/>s.
         /// </summary>
+        /// <remarks>
+        /// Shots ending on walls, range or time are never sent, everyone works those out. Only hits on tanks get here.
+        /// </remarks>
         /// <param name="incomingMessage"></param>
         public void EndShot(NetIncomingMessage incomingMessage)
         {
             MsgEndShotPacket incomingShotEndPacket = MsgEndShotPacket.Read(incomingMessage);
 
-            // create our shot end message and packet
-            NetOutgoingMessage shotEndMessage = gameKeeper.Server.CreateMessage();
+            Player shooter = gameKeeper.GetPlayerBySlot(incomingShotEndPacket.Slot);
+
+            if (shooter == null || !shooter.ClaimShot(incomingShotEndPacket.ShotSlot))
+            {
+                Log.DebugFormat("Player #{0} was hit by shot {1} of #{2}, which is not in flight",
+                                Slot, incomingShotEndPacket.ShotSlot, incomingShotEndPacket.Slot);
+                return;
+            }
 
             MsgEndShotPacket shotEndPacket = new MsgEndShotPacket(incomingShotEndPacket.Slot, incomingShotEndPacket.ShotSlot, incomingShotEndPacket.Explode);
 
-            // write to the message
-            shotEndMessage.Write((Byte)shotEndPacket.MsgType);
-            shotEndPacket.Write(shotEndMessage);
+            // send the shot end to everyone except the player who reported it
+            gameKeeper.QueueEvent(shotEndPacket, this);
+        }
+
+        /// <summary>
+        /// Gets the shot in flight at <paramref name="shotSlot"/>, or null if there is none.
+        /// </summary>
+        public ShotPath GetShot(Byte shotSlot)
+        {
+            ShotPath shot;
+
+            if (shots.TryGetValue(shotSlot, out shot))
+                return shot;
 
-            // send the shot end message to everyone except the player who reported it
-            gameKeeper.Server.SendToAll(shotEndMessage, this.Connection, NetDeliveryMethod.ReliableUnordered, 0);
+            return null;
         }
 
         /// <summary>
-        /// 
+        /// Ends one of this <see cref="Player"/>'s shots because it hit a tank.
         /// </summary>
-        /// <returns></returns>
-        public NetOutgoingMessage GetMsgScore()
+        /// <returns>false if the shot had already ended, so could not have hit anything.</returns>
+        public bool ClaimShot(Byte shotSlot)
         {
-            NetOutgoingMessage scoreMessage = gameKeeper.Server.CreateMessage();
+            ShotPath shot = GetShot(shotSlot);
 
-            MsgScorePacket scorePacket = new MsgScorePacket(this.Slot, this.Score);
+            if (shot == null || ShotPath.TicksSince(shot.EndTick, gameKeeper.ShotTick) > ShotHitGraceTicks)
+                return false;
 
-            scoreMessage.Write((Byte)scorePacket.MsgType);
-            scorePacket.Write(scoreMessage);
+            shots.Remove(shotSlot);
 
-            return scoreMessage;
+            return true;
         }
 
-        #region Connection Helpers
+        /// <summary>
+        /// Gets a <see cref="MsgScorePacket"/> with a snapshot of this <see cref="Player"/>'s current score.
+        /// </summary>
+        /// <returns></returns>
+        public MsgScorePacket GetScorePacket()
+        {
+            Score snapshot = new Score();
+
+            snapshot.Wins      = this.Score.Wins;
+            snapshot.Losses    = this.Score.Losses;
+            snapshot.Teamkills = this.Score.Teamkills;
 
-        public NetSendResult SendMessage(NetOutgoingMessage msg, NetDeliveryMethod method)
+            return new MsgScorePacket(this.Slot, snapshot);
+        }
+
+        /// <summary>
+        /// Gets a <see cref="JoinSnapshotEntry"/> describing this <see cref="Player"/> to someone joining.
+        /// </summary>
+        /// <returns></returns>
+        public JoinSnapshotEntry GetSnapshotEntry()
         {
-            return gameKeeper.Server.SendMessage(msg, Connection, method);
+            return new JoinSnapshotEntry(PlayerInfo, State, GetScorePacket().Score, Position, Rotation);
         }
 
-        public NetSendResult SendMessage(NetOutgoingMessage msg, NetDeliveryMethod method, int sequenceChannel)
+        #region Connection Helpers
+
+        /// <summary>
+        /// Sends a message the way its <see cref="TrafficClass"/> travels.
+        /// </summary>
+        /// <param name="msg"></param>
+        /// <param name="messageType">Type of the message, which picks its delivery method and channel.</param>
+        /// <returns></returns>
+        public NetSendResult SendMessage(NetOutgoingMessage msg, MessageType messageType)
         {
-            return gameKeeper.Server.SendMessage(msg, Connection, method, sequenceChannel);
+            // players being replayed have nobody on the other end
+            if (Connection == null)
+                return NetSendResult.FailedNotConnected;
+
+            gameKeeper.Profiler.MessageSent(msg, 1);
+
+            TrafficRoute route = TrafficClasses.GetRoute(messageType);
+            return gameKeeper.Server.SendMessage(msg, Connection, route.Method, route.Channel);
         }
 
         #endregion
@@ -21,17 +21,24 @@ namespace AngryTanks.Server
 
         private static NetServer server;
         private static GameKeeper gameKeeper;
-        private static Byte[] rawWorld;
+        private static WorldMap world;
 
         private static TimeSpan updateInterval = new TimeSpan(0, 0, 0, 0, 10);
         private static DateTime lastUpdate = DateTime.MinValue;
 
+        // set by Ctrl+C, the main loop notices and shuts down on its own thread
+        private static volatile bool stopping = false;
+
         static void Main(String[] args)
         {
             UInt16 port = 5150;
             int verbosity = 0;
             bool showHelp = false;
             String worldFilePath = null;
+            String worldCachePath = Path.Combine(AppDomain.CurrentDomain.BaseDirectory, "WorldCache");
+            String recordPath = null;
+            Int16 statsPort = 0;
+            bool spawnOutOfSight = false;
             Dictionary<String, String> variables = new Dictionary<String, String>();
 
             OptionSet p = new OptionSet()
@@ -46,6 +53,26 @@ namespace AngryTanks.Server
                     "sets the world file to serve",
                     (String v) => worldFilePath = v
                 },
+                {
+                    "c|world-cache=",
+                    "sets the directory compiled worlds are cached in",
+                    (String v) => worldCachePath = v
+                },
+                {
+                    "r|record=",
+                    "records everything players send to a replay file",
+                    (String v) => recordPath = v
+                },
+                {
+                    "stats-port=",
+                    "serves tick and traffic statistics over HTTP on this local port",
+                    (Int16 v) => statsPort = v
+                },
+                {
+                    "spawn-out-of-sight",
+                    "spawns players out of sight of enemies when possible",
+                    v => spawnOutOfSight = v != null
+                },
                 {
                     "s|set=",
                     "sets a variable",
@@ -91,6 +118,7 @@ namespace AngryTanks.Server
                 loggingLevel = log4net.Core.Level.Debug;
 
             ((log4net.Repository.Hierarchy.Logger)Log.Logger).Level = loggingLevel;
+            FastLog.RefreshLevels();
 
             // do we need to show help?
             if (showHelp)
@@ -107,10 +135,27 @@ namespace AngryTanks.Server
                 return;
             }
 
-            // let's read the world now and save it
-            rawWorld = ReadWorld(worldFilePath);
+            // let's compile the world now, which also checks if it's valid
+            try
+            {
+                world = WorldMap.Compile(worldFilePath, worldCachePath);
+            }
+            catch (InvalidDataException e)
+            {
+                Log.FatalFormat("The world file at '{0}' is not valid: {1}", worldFilePath, e.Message);
+                return;
+            }
+
+            if (world.GetBytes().Length > ProtocolInformation.MaxWorldSize)
+            {
+                Log.FatalFormat("The world file at '{0}' is too large to serve ({1} bytes compiled, at most {2})",
+                                worldFilePath, world.GetBytes().Length, ProtocolInformation.MaxWorldSize);
+                return;
+            }
 
-            // TODO parse world, also checks if valid
+            Log.InfoFormat("Serving world \"{0}\" ({1} objects, {2} bytes compiled)",
+                           world.Name, world.Objects.Count, world.GetBytes().Length);
+            Log.InfoFormat("Simplified {0} colliders to {1}", world.Objects.Count, world.Colliders.Count);
 
             NetPeerConfiguration config = new NetPeerConfiguration("AngryTanks");
 
@@ -121,15 +166,74 @@ namespace AngryTanks.Server
             // use configured port
             config.Port = port;
 
+            // batch datagrams through recvmmsg/sendmmsg on Linux; elsewhere this falls back on its own
+            config.EnableBatchedSocketIO = true;
+
             // start server
             server = new NetServer(config);
             server.Start();
 
+            // stop between ticks rather than wherever the main loop happens to be, a second Ctrl+C still kills us outright
+            Console.CancelKeyPress += delegate(object sender, ConsoleCancelEventArgs e)
+            {
+                e.Cancel = !stopping;
+                stopping = true;
+            };
+
             // let's start game keeper
-            gameKeeper = new GameKeeper(server, rawWorld);
+            gameKeeper = new GameKeeper(server, world);
+            gameKeeper.SpawnOutOfSight = spawnOutOfSight;
+
+            // anyone joining gets these in their join snapshot
+            foreach (KeyValuePair<String, String> variable in variables)
+            {
+                try
+                {
+                    gameKeeper.Variables[variable.Key].BoxedValue = variable.Value;
+                }
+                catch (KeyNotFoundException)
+                {
+                    Log.FatalFormat("There is no variable named '{0}'", variable.Key);
+                    server.Shutdown("bad configuration");
+                    return;
+                }
+                catch (FormatException)
+                {
+                    Log.FatalFormat("'{0}' is not a valid value for {1}", variable.Value, variable.Key);
+                    server.Shutdown("bad configuration");
+                    return;
+                }
+                catch (OverflowException)
+                {
+                    Log.FatalFormat("'{0}' is out of range for {1}", variable.Value, variable.Key);
+                    server.Shutdown("bad configuration");
+                    return;
+                }
+            }
+
+            if (recordPath != null)
+                gameKeeper.Recorder = new ReplayRecorder(recordPath, world);
+
+            if (statsPort > 0)
+            {
+                new StatsServer(gameKeeper, statsPort).Start();
+
+                Log.InfoFormat("Serving statistics at http://127.0.0.1:{0}/stats and /metrics", statsPort);
+            }
 
             // go to main loop
             AppLoop();
+
+            Log.Info("Shutting down...");
+
+            // the main loop is done with it, so whatever is still buffered can make it to disk
+            if (gameKeeper.Recorder != null)
+                gameKeeper.Recorder.Dispose();
+
+            server.Shutdown("server shutting down");
+
+            // get anything the log writer still has queued out
+            FastLog.Flush();
         }
 
         public static void ShowHelp(OptionSet p, string[] args)
@@ -141,112 +245,22 @@ namespace AngryTanks.Server
             p.WriteOptionDescriptions(Console.Out);
         }
 
-        private static Byte[] ReadWorld(String worldPath)
-        {
-            FileStream worldStream = new FileStream(worldPath, FileMode.Open, FileAccess.Read);
-
-            Byte[] bytes = new Byte[(int)worldStream.Length];
-
-            int bytesToRead = (int)worldStream.Length;
-            int bytesAlreadyRead = 0;
-
-            while (bytesToRead > 0)
-            {
-                int n = worldStream.Read(bytes, bytesAlreadyRead, bytesToRead);
-
-                // we reached the end of the file
-                if (n == 0)
-                    break;
-
-                bytesAlreadyRead += n;
-                bytesToRead -= n;
-            }
-
-            return bytes;
-        }
-
         private static void AppLoop()
         {
             NetIncomingMessage msg;
             
-            while (true)
+            while (!stopping)
             {
+                Int64 receiveStart = gameKeeper.Profiler.Start();
+
                 if ((msg = server.ReadMessage()) != null)
                 {
-                    switch (msg.MessageType)
-                    {
-                        case NetIncomingMessageType.WarningMessage:
-                            Log.Warn(msg.ReadString());
-                            break;
-
-                        case NetIncomingMessageType.ErrorMessage:
-                            Log.Error(msg.ReadString());
-                            break;
-
-                        case NetIncomingMessageType.DebugMessage:
-                            Log.Debug(msg.ReadString());
-                            break;
-
-                        case NetIncomingMessageType.DiscoveryRequest:
-                            break;
-
-                        case NetIncomingMessageType.StatusChanged:
-                            {
-                                // we're not interested in status changes on the server yet
-                                if (msg.SenderConnection == null)
-                                    break;
-
-                                gameKeeper.HandleStatusChange(msg);
-
-                                break;
-                            }
-
-                        case NetIncomingMessageType.ConnectionApproval:
-                            {
-                                // chop off header
-                                MessageType messageType = (MessageType)msg.ReadByte();
-
-                                // WTF?
-                                if (messageType != MessageType.MsgEnter)
-                                {
-                                    String rejection = String.Format("message type not as expected (expected {0}, you sent {1})",
-                                                                     MessageType.MsgEnter, messageType);
-                                    msg.SenderConnection.Deny(rejection);
-                                    break;
-                                }
-
-                                UInt16 clientProtoVersion = msg.ReadUInt16();
-
-                                if (clientProtoVersion != ProtocolInformation.ProtocolVersion)
-                                {
-                                    String rejection = String.Format("protocol versions do not match (server is {0}, you are {1})",
-                                                                     ProtocolInformation.ProtocolVersion, clientProtoVersion);
-                                    msg.SenderConnection.Deny(rejection);
-                                    break;
-                                }
-
-                                TeamType team = (TeamType)msg.ReadByte();
-                                String callsign = msg.ReadString();
-                                String tag = msg.ReadString();
-
-                                PlayerInformation playerInfo = new PlayerInformation(ProtocolInformation.DummySlot, callsign, tag, team);
-
-                                gameKeeper.AddPlayer(msg.SenderConnection, playerInfo);
-
-                                break;
-                            }
-
-                        case NetIncomingMessageType.Data:
-                            gameKeeper.HandleIncomingData(msg);
-                            break;
-
-                        default:
-                            // welp... what shall we do?
-                            break;
-                    }
+                    gameKeeper.HandleMessage(msg);
 
                     // reduce GC pressure by recycling
                     server.Recycle(msg);
+
+                    gameKeeper.Profiler.EndPhase(TickPhase.Receive, receiveStart);
                 }
 
                 // see if we need to run an update pass
@@ -0,0 +1,213 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+using log4net;
+
+using AngryTanks.Common.Messages;
+using AngryTanks.Common.Protocol;
+
+namespace AngryTanks.Server
+{
+    /// <summary>
+    /// One record read from a replay. <see cref="ReplayReader"/> reuses the same instance for every record.
+    /// </summary>
+    public class ReplayRecord
+    {
+        public ReplayRecordType Type;
+
+        // Join, Leave and Data
+        public Byte Slot;
+
+        // Join
+        public PlayerInformation PlayerInfo;
+
+        // Leave
+        public String Reason;
+
+        // Data, only the first (LengthBits + 7) / 8 bytes of Payload are valid
+        public Byte[] Payload = new Byte[1024];
+        public Int32 LengthBits;
+
+        // Tick
+        public DateTime Time;
+
+        // Index
+        public Int64 TickCount, PreviousIndexOffset;
+    }
+
+    /// <summary>
+    /// Reads a replay written by <see cref="ReplayRecorder"/> front to back.
+    /// </summary>
+    /// <remarks>
+    /// The file is streamed through a fixed size buffer and records reuse one <see cref="ReplayRecord"/>,
+    /// so recordings of any length replay in constant memory.
+    /// </remarks>
+    public class ReplayReader : IDisposable
+    {
+        private static readonly ILog Log = LogManager.GetLogger(System.Reflection.MethodBase.GetCurrentMethod().DeclaringType);
+
+        private FileStream stream;
+        private BinaryReader reader;
+
+        private ReplayRecord record = new ReplayRecord();
+
+        #region Header
+
+        public readonly UInt16 ProtocolVersion;
+        public readonly Byte[] WorldHash;
+        public readonly DateTime StartTime;
+
+        #endregion
+
+        /// <summary>
+        /// Gets the length of the replay in bytes.
+        /// </summary>
+        public Int64 Length
+        {
+            get { return stream.Length; }
+        }
+
+        /// <summary>
+        /// Gets how far into the replay we've read, in bytes.
+        /// </summary>
+        public Int64 Position
+        {
+            get { return stream.Position; }
+        }
+
+        /// <exception cref="InvalidDataException">The file is not a replay we can read.</exception>
+        public ReplayReader(String path)
+        {
+            stream = new FileStream(path, FileMode.Open, FileAccess.Read, FileShare.ReadWrite, 64 * 1024, FileOptions.SequentialScan);
+            reader = new BinaryReader(stream, Encoding.UTF8);
+
+            try
+            {
+                if (reader.ReadUInt32() != ReplayRecorder.Magic)
+                    throw new InvalidDataException("not a replay");
+
+                UInt16 version = reader.ReadUInt16();
+                if (version != ReplayRecorder.FormatVersion)
+                    throw new InvalidDataException(String.Format("replay version {0} is not supported (expected {1})",
+                                                                 version, ReplayRecorder.FormatVersion));
+
+                ProtocolVersion = reader.ReadUInt16();
+                WorldHash = reader.ReadBytes(20);
+                StartTime = new DateTime(reader.ReadInt64());
+            }
+            catch (EndOfStreamException)
+            {
+                reader.Close();
+                throw new InvalidDataException("replay header is cut short");
+            }
+            catch (InvalidDataException)
+            {
+                reader.Close();
+                throw;
+            }
+
+            if (ProtocolVersion != ProtocolInformation.ProtocolVersion)
+                Log.WarnFormat("Replay was recorded with protocol version {0}, we are {1}",
+                               ProtocolVersion, ProtocolInformation.ProtocolVersion);
+        }
+
+        ~ReplayReader()
+        {
+            Dispose(false);
+        }
+
+        public void Dispose()
+        {
+            Dispose(true);
+            GC.SuppressFinalize(this);
+        }
+
+        protected virtual void Dispose(bool disposing)
+        {
+            if (!disposing || reader == null)
+                return;
+
+            reader.Close();
+            reader = null;
+            stream = null;
+        }
+
+        /// <summary>
+        /// Reads the next record.
+        /// </summary>
+        /// <returns>The record, which is only valid until the next call, or null at the end of the replay.</returns>
+        /// <exception cref="InvalidDataException">The replay is corrupt.</exception>
+        public ReplayRecord Read()
+        {
+            if (stream.Position >= stream.Length)
+                return null;
+
+            try
+            {
+                record.Type = (ReplayRecordType)reader.ReadByte();
+
+                switch (record.Type)
+                {
+                    case ReplayRecordType.Join:
+                        {
+                            record.Slot = reader.ReadByte();
+                            TeamType team = (TeamType)reader.ReadByte();
+                            String callsign = reader.ReadString();
+                            String tag = reader.ReadString();
+
+                            record.PlayerInfo = new PlayerInformation(record.Slot, callsign, tag, team);
+                            break;
+                        }
+
+                    case ReplayRecordType.Leave:
+                        record.Slot = reader.ReadByte();
+                        record.Reason = reader.ReadString();
+                        break;
+
+                    case ReplayRecordType.Data:
+                        {
+                            record.Slot = reader.ReadByte();
+                            record.LengthBits = reader.ReadInt32();
+
+                            int length = (record.LengthBits + 7) / 8;
+
+                            if (length < 0 || length > stream.Length - stream.Position)
+                                throw new EndOfStreamException();
+
+                            if (record.Payload.Length < length)
+                                record.Payload = new Byte[Math.Max(length, record.Payload.Length * 2)];
+
+                            if (reader.Read(record.Payload, 0, length) != length)
+                                throw new EndOfStreamException();
+
+                            break;
+                        }
+
+                    case ReplayRecordType.Tick:
+                        record.Time = new DateTime(reader.ReadInt64());
+                        break;
+
+                    case ReplayRecordType.Index:
+                        record.TickCount = reader.ReadInt64();
+                        record.PreviousIndexOffset = reader.ReadInt64();
+                        break;
+
+                    default:
+                        throw new InvalidDataException(String.Format("unknown record type {0} at {1}",
+                                                                     (Byte)record.Type, stream.Position - 1));
+                }
+            }
+            catch (EndOfStreamException)
+            {
+                // the server went down partway through a record, which is as far as the replay goes
+                Log.Warn("Replay ends partway through a record");
+                return null;
+            }
+
+            return record;
+        }
+    }
+}
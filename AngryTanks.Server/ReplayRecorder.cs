@@ -0,0 +1,166 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+using log4net;
+using Lidgren.Network;
+
+using AngryTanks.Common;
+using AngryTanks.Common.Messages;
+using AngryTanks.Common.Protocol;
+
+namespace AngryTanks.Server
+{
+    /// <summary>
+    /// Kinds of records in a replay.
+    /// </summary>
+    public enum ReplayRecordType : byte
+    {
+        /// <summary>
+        /// A player was added, carries their slot and <see cref="PlayerInformation"/>
+        /// </summary>
+        Join,
+
+        /// <summary>
+        /// A player was removed, carries their slot and the reason
+        /// </summary>
+        Leave,
+
+        /// <summary>
+        /// A data message from a player, carries their slot and the message as received
+        /// </summary>
+        Data,
+
+        /// <summary>
+        /// <see cref="GameKeeper.Update"/> ran, carries the time it ran at
+        /// </summary>
+        Tick,
+
+        /// <summary>
+        /// Written every <see cref="ReplayRecorder.IndexInterval"/> ticks, carries the tick count
+        /// and where the previous index frame starts, so a reader can find its way around
+        /// </summary>
+        Index
+    }
+
+    /// <summary>
+    /// <para>
+    ///     Records everything coming into a <see cref="GameKeeper"/> to an append-only binary log,
+    ///     so a session can be fed back through <see cref="GameKeeper"/> later without any sockets.
+    /// </para>
+    /// <para>
+    ///     The log starts with a header (magic, format version, protocol version, world hash, start time)
+    ///     followed by records, each being a <see cref="ReplayRecordType"/> and its fields.
+    /// </para>
+    /// </summary>
+    public class ReplayRecorder : IDisposable
+    {
+        private static readonly ILog Log = LogManager.GetLogger(System.Reflection.MethodBase.GetCurrentMethod().DeclaringType);
+
+        // "ATRP" in little endian
+        public const UInt32 Magic = 0x50525441;
+
+        public const UInt16 FormatVersion = 1;
+
+        /// <summary>
+        /// Ticks between index frames, at an update every 10ms this is every 10 seconds.
+        /// </summary>
+        public const Int32 IndexInterval = 1000;
+
+        private FileStream stream;
+        private BinaryWriter writer;
+
+        private Int64 ticks = 0;
+        private Int64 lastIndexOffset = -1;
+
+        public ReplayRecorder(String path, WorldMap world)
+        {
+            // large buffer, we don't want to hit the disk on every message
+            stream = new FileStream(path, FileMode.Create, FileAccess.Write, FileShare.Read, 64 * 1024);
+            writer = new BinaryWriter(stream, Encoding.UTF8);
+
+            writer.Write(Magic);
+            writer.Write(FormatVersion);
+            writer.Write(ProtocolInformation.ProtocolVersion);
+            writer.Write(world.Hash);
+            writer.Write(DateTime.Now.Ticks);
+
+            Log.InfoFormat("Recording to '{0}'", path);
+        }
+
+        ~ReplayRecorder()
+        {
+            Dispose(false);
+        }
+
+        public void Dispose()
+        {
+            Dispose(true);
+            GC.SuppressFinalize(this);
+        }
+
+        protected virtual void Dispose(bool disposing)
+        {
+            if (!disposing || writer == null)
+                return;
+
+            writer.Close();
+            writer = null;
+            stream = null;
+        }
+
+        public void RecordJoin(Byte slot, PlayerInformation playerInfo)
+        {
+            writer.Write((Byte)ReplayRecordType.Join);
+            writer.Write(slot);
+            writer.Write((Byte)playerInfo.Team);
+            writer.Write(playerInfo.Callsign);
+            writer.Write(playerInfo.Tag);
+        }
+
+        public void RecordLeave(Byte slot, String reason)
+        {
+            writer.Write((Byte)ReplayRecordType.Leave);
+            writer.Write(slot);
+            writer.Write(reason ?? "");
+        }
+
+        /// <summary>
+        /// Records a data message exactly as it was received, it must not have been read from yet.
+        /// </summary>
+        /// <param name="slot"></param>
+        /// <param name="msg"></param>
+        public void RecordData(Byte slot, NetIncomingMessage msg)
+        {
+            writer.Write((Byte)ReplayRecordType.Data);
+            writer.Write(slot);
+            writer.Write(msg.LengthBits);
+            writer.Write(msg.PeekDataBuffer(), 0, msg.LengthBytes);
+        }
+
+        public void RecordTick(DateTime time)
+        {
+            writer.Write((Byte)ReplayRecordType.Tick);
+            writer.Write(time.Ticks);
+
+            if (++ticks % IndexInterval == 0)
+                WriteIndex();
+        }
+
+        private void WriteIndex()
+        {
+            Int64 offset = stream.Position;
+
+            writer.Write((Byte)ReplayRecordType.Index);
+            writer.Write(ticks);
+            writer.Write(lastIndexOffset);
+
+            lastIndexOffset = offset;
+
+            // an index frame is also a good point to get everything onto disk, in case we go down
+            writer.Flush();
+        }
+    }
+}
@@ -0,0 +1,345 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+using Microsoft.Xna.Framework;
+
+using AngryTanks.Common;
+
+namespace AngryTanks.Server
+{
+    /// <summary>
+    /// A coarse distance field of a <see cref="WorldMap"/>'s static obstacles that spawn points are picked from.
+    /// </summary>
+    /// <remarks>
+    /// Every cell holds the distance from its center to the nearest cell covered by a map object, or to the edge of
+    /// the world if that is closer. It is built once per map from the same collision data shots use. Cells clear
+    /// enough for a tank are kept in a list, so picking a spawn means sampling a few of them and scoring them against
+    /// the live tanks, with no collision tests. Line of sight is checked by marching through the field, stepping as
+    /// far as each cell's distance allows.
+    /// </remarks>
+    public class SpawnField
+    {
+        // cells scored for each spawn
+        private const int Samples = 32;
+
+        // the grid never grows beyond this many cells a side, larger worlds get coarser cells
+        private const int MaxCellsPerSide = 512;
+
+        private static readonly Single Sqrt2 = (Single)Math.Sqrt(2);
+
+        // a 1, sqrt(2) chamfer transform overstates true distances by up to sqrt(4 - 2 sqrt(2)), about 1.0824
+        private const Single ChamferError = 1.0824f;
+
+        #region Properties
+
+        private readonly Single cellSize;
+
+        /// <summary>
+        /// Width and height of a cell, in world units.
+        /// </summary>
+        public Single CellSize
+        {
+            get { return cellSize; }
+        }
+
+        private readonly Int32 cellsPerSide;
+
+        public Int32 CellsPerSide
+        {
+            get { return cellsPerSide; }
+        }
+
+        /// <summary>
+        /// Gets how many cells were clear for the last clearance asked for.
+        /// </summary>
+        public Int32 FreeCells
+        {
+            get { return free.Count; }
+        }
+
+        #endregion
+
+        // world position of the corner of the first cell
+        private readonly Single origin;
+
+        private readonly Single[] distances;
+
+        // cells at least freeClearance from anything, rebuilt whenever another clearance is asked for
+        private List<Int32> free = new List<Int32>();
+        private Single freeClearance = Single.NaN;
+
+        private Random random;
+
+        // scratch space for scoring samples
+        private Int32[]  sampled = new Int32[Samples];
+        private Single[] scores  = new Single[Samples];
+
+        /// <summary>
+        /// Builds the distance field of <paramref name="map"/>.
+        /// </summary>
+        /// <param name="map">Map to build the field of.</param>
+        /// <param name="cellSize">Smallest size of a cell in world units, it grows on large maps.</param>
+        /// <param name="seed">Seed for picking spawns, so the same game spawns the same way.</param>
+        public SpawnField(WorldMap map, Single cellSize, Int32 seed)
+        {
+            this.cellSize = Math.Max(cellSize, map.Size / MaxCellsPerSide);
+            this.cellsPerSide = Math.Max(1, (Int32)Math.Ceiling(map.Size / this.cellSize));
+            this.origin = -map.Size / 2;
+            this.distances = new Single[cellsPerSide * cellsPerSide];
+            this.random = new Random(seed);
+
+            // start from the distance to the edge of the world, then cover the objects
+            Single half = map.Size / 2;
+
+            for (int y = 0; y < cellsPerSide; y++)
+            {
+                for (int x = 0; x < cellsPerSide; x++)
+                {
+                    Vector2 center = GetCenter(x, y);
+                    distances[y * cellsPerSide + x] = Math.Max(0, half - Math.Max(Math.Abs(center.X), Math.Abs(center.Y)));
+                }
+            }
+
+            foreach (MapObject mapObject in map.Colliders)
+                Cover(mapObject);
+
+            Propagate();
+        }
+
+        /// <summary>
+        /// Gets roughly how far <paramref name="position"/> is from the nearest obstacle.
+        /// </summary>
+        public Single GetDistance(Vector2 position)
+        {
+            Int32 x = Clamp((Int32)Math.Floor((position.X - origin) / cellSize));
+            Int32 y = Clamp((Int32)Math.Floor((position.Y - origin) / cellSize));
+
+            return distances[y * cellsPerSide + x];
+        }
+
+        /// <summary>
+        /// Picks a spawn point clear of obstacles, as far as it can find from other tanks and out of sight of enemies.
+        /// </summary>
+        /// <param name="clearance">How far the spawn point must be from any obstacle.</param>
+        /// <param name="tanks">Positions of the live tanks to keep away from.</param>
+        /// <param name="enemies">Positions of the tanks that shouldn't see the spawn point, or null to not check.</param>
+        /// <param name="position">Where to spawn.</param>
+        /// <param name="rotation">Which way to face, in radians.</param>
+        /// <returns>Whether anywhere was clear, if not the spawn point is the center of the world.</returns>
+        public bool FindSpawn(Single clearance, IList<Vector2> tanks, IList<Vector2> enemies, out Vector2 position, out Single rotation)
+        {
+            if (clearance != freeClearance)
+                FindFree(clearance);
+
+            rotation = (Single)(random.NextDouble() * 2 * Math.PI);
+
+            if (free.Count == 0)
+            {
+                position = Vector2.Zero;
+                return false;
+            }
+
+            // score a handful of clear cells by how far they are from the nearest tank
+            for (int i = 0; i < Samples; i++)
+            {
+                Int32 cell = free[random.Next(free.Count)];
+                Vector2 center = GetCenter(cell % cellsPerSide, cell / cellsPerSide);
+
+                Single nearest = Single.MaxValue;
+
+                foreach (Vector2 tank in tanks)
+                    nearest = Math.Min(nearest, Vector2.DistanceSquared(center, tank));
+
+                sampled[i] = cell;
+                scores[i]  = -nearest;
+            }
+
+            Array.Sort(scores, sampled);
+
+            // the best one nobody can see, or just the best one if they can all be seen
+            Int32 chosen = sampled[0];
+
+            if (enemies != null && enemies.Count > 0)
+            {
+                for (int i = 0; i < Samples; i++)
+                {
+                    Vector2 center = GetCenter(sampled[i] % cellsPerSide, sampled[i] / cellsPerSide);
+
+                    if (!IsSeenByAny(center, enemies))
+                    {
+                        chosen = sampled[i];
+                        break;
+                    }
+                }
+            }
+
+            position = GetCenter(chosen % cellsPerSide, chosen / cellsPerSide);
+            return true;
+        }
+
+        /// <summary>
+        /// Determines whether there are no obstacles between <paramref name="from"/> and <paramref name="to"/>.
+        /// </summary>
+        public bool InSight(Vector2 from, Vector2 to)
+        {
+            Vector2 delta = to - from;
+            Single length = delta.Length();
+
+            if (length == 0)
+                return true;
+
+            Vector2 direction = delta / length;
+
+            // a point may be up to half a cell's diagonal closer to an obstacle than the center of its cell
+            Single slack = cellSize * Sqrt2 / 2;
+
+            for (Single travelled = 0; travelled < length; )
+            {
+                Single distance = GetDistance(from + direction * travelled);
+
+                // tanks right up against a wall sit in covered cells themselves, which doesn't block their view
+                if (distance == 0 && travelled > slack && travelled < length - slack)
+                    return false;
+
+                travelled += Math.Max(distance / ChamferError - slack, cellSize / 2);
+            }
+
+            return true;
+        }
+
+        #region Helpers
+
+        private bool IsSeenByAny(Vector2 position, IList<Vector2> enemies)
+        {
+            foreach (Vector2 enemy in enemies)
+            {
+                if (InSight(enemy, position))
+                    return true;
+            }
+
+            return false;
+        }
+
+        private Vector2 GetCenter(Int32 x, Int32 y)
+        {
+            return new Vector2(origin + (x + 0.5f) * cellSize, origin + (y + 0.5f) * cellSize);
+        }
+
+        private Int32 Clamp(Int32 cell)
+        {
+            return Math.Max(0, Math.Min(cellsPerSide - 1, cell));
+        }
+
+        /// <summary>
+        /// Zeroes every cell whose center is within half a cell's diagonal of the object, so thin walls always cover a cell.
+        /// </summary>
+        private void Cover(MapObject mapObject)
+        {
+            Single slack = cellSize * Sqrt2 / 2;
+
+            Int32 minX = Clamp((Int32)Math.Floor((mapObject.Min.X - slack - origin) / cellSize));
+            Int32 minY = Clamp((Int32)Math.Floor((mapObject.Min.Y - slack - origin) / cellSize));
+            Int32 maxX = Clamp((Int32)Math.Floor((mapObject.Max.X + slack - origin) / cellSize));
+            Int32 maxY = Clamp((Int32)Math.Floor((mapObject.Max.Y + slack - origin) / cellSize));
+
+            Single cos = (Single)Math.Cos(mapObject.Rotation);
+            Single sin = (Single)Math.Sin(mapObject.Rotation);
+
+            Vector2 extents = mapObject.Size / 2 + new Vector2(slack, slack);
+
+            for (int y = minY; y <= maxY; y++)
+            {
+                for (int x = minX; x <= maxX; x++)
+                {
+                    // the same local frame shots are tested in
+                    Vector2 offset = GetCenter(x, y) - mapObject.Position;
+
+                    if (Math.Abs(offset.X * cos + offset.Y * sin) <= extents.X &&
+                        Math.Abs(-offset.X * sin + offset.Y * cos) <= extents.Y)
+                        distances[y * cellsPerSide + x] = 0;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Spreads distances out from the covered cells with a two pass chamfer transform.
+        /// </summary>
+        private void Propagate()
+        {
+            Single straight = cellSize;
+            Single diagonal = cellSize * Sqrt2;
+
+            for (int y = 0; y < cellsPerSide; y++)
+            {
+                for (int x = 0; x < cellsPerSide; x++)
+                {
+                    Int32 i = y * cellsPerSide + x;
+
+                    if (x > 0)
+                        Relax(i, i - 1, straight);
+
+                    if (y > 0)
+                    {
+                        Relax(i, i - cellsPerSide, straight);
+
+                        if (x > 0)
+                            Relax(i, i - cellsPerSide - 1, diagonal);
+
+                        if (x < cellsPerSide - 1)
+                            Relax(i, i - cellsPerSide + 1, diagonal);
+                    }
+                }
+            }
+
+            for (int y = cellsPerSide - 1; y >= 0; y--)
+            {
+                for (int x = cellsPerSide - 1; x >= 0; x--)
+                {
+                    Int32 i = y * cellsPerSide + x;
+
+                    if (x < cellsPerSide - 1)
+                        Relax(i, i + 1, straight);
+
+                    if (y < cellsPerSide - 1)
+                    {
+                        Relax(i, i + cellsPerSide, straight);
+
+                        if (x < cellsPerSide - 1)
+                            Relax(i, i + cellsPerSide + 1, diagonal);
+
+                        if (x > 0)
+                            Relax(i, i + cellsPerSide - 1, diagonal);
+                    }
+                }
+            }
+        }
+
+        private void Relax(Int32 cell, Int32 neighbour, Single step)
+        {
+            Single through = distances[neighbour] + step;
+
+            if (through < distances[cell])
+                distances[cell] = through;
+        }
+
+        private void FindFree(Single clearance)
+        {
+            free.Clear();
+
+            // every point of an object is within half a cell's diagonal of a covered cell's center,
+            // so the real obstacle can be that much closer than the field says
+            Single needed = (clearance + cellSize * Sqrt2 / 2) * ChamferError;
+
+            for (int i = 0; i < distances.Length; i++)
+            {
+                if (distances[i] >= needed)
+                    free.Add(i);
+            }
+
+            freeClearance = clearance;
+        }
+
+        #endregion
+    }
+}
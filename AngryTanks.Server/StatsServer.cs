@@ -0,0 +1,96 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Net.Sockets;
+using System.Text;
+
+using log4net;
+using Nuclex.Networking.Http;
+
+namespace AngryTanks.Server
+{
+    /// <summary>
+    /// Serves the <see cref="TickProfiler"/> statistics over HTTP on the loopback interface,
+    /// as JSON at /stats along with the standings, and in the Prometheus text format at /metrics.
+    /// </summary>
+    public class StatsServer : HttpServer
+    {
+        private static readonly ILog Log = LogManager.GetLogger(System.Reflection.MethodBase.GetCurrentMethod().DeclaringType);
+
+        private readonly GameKeeper gameKeeper;
+        private readonly TickProfiler profiler;
+
+        public StatsServer(GameKeeper gameKeeper, Int16 port)
+            : base(port)
+        {
+            this.gameKeeper = gameKeeper;
+            this.profiler = gameKeeper.Profiler;
+        }
+
+        private String CreateStatsJson()
+        {
+            StringBuilder json = new StringBuilder();
+
+            json.Append("{");
+            profiler.AppendJsonMembers(json);
+            json.Append(",\"standings\":");
+            json.Append(gameKeeper.StandingsJson);
+            json.Append("}");
+
+            return json.ToString();
+        }
+
+        protected override ClientConnection AcceptClientConnection(Socket connectedSocket)
+        {
+            return new StatsConnection(this, connectedSocket);
+        }
+
+        private class StatsConnection : ClientConnection
+        {
+            private readonly StatsServer server;
+
+            public StatsConnection(StatsServer server, Socket socket)
+                : base(server, socket)
+            {
+                this.server = server;
+            }
+
+            protected override Response ProcessRequest(Request request)
+            {
+                if (request.Method != "GET")
+                    return new Response(StatusCode.S405_Method_Not_Allowed);
+
+                switch (request.Uri)
+                {
+                    case "/":
+                    case "/stats":
+                        return CreateResponse(server.CreateStatsJson(), "application/json");
+
+                    case "/metrics":
+                        return CreateResponse(server.profiler.ToPrometheus(), "text/plain; version=0.0.4");
+
+                    default:
+                        Log.DebugFormat("Stats request for unknown URI {0}", request.Uri);
+                        return new Response(StatusCode.S404_Not_Found);
+                }
+            }
+
+            private static Response CreateResponse(String body, String contentType)
+            {
+                Byte[] bytes = Encoding.UTF8.GetBytes(body);
+
+                Response response = new Response(StatusCode.S200_OK);
+
+                response.Headers.Add("Cache-Control", "no-cache");
+                response.Headers.Add("Content-Type", contentType + "; charset=utf-8");
+                response.Headers.Add("Content-Length", bytes.Length.ToString());
+
+                // the whole of the stream's buffer gets sent, so it must be exactly the size of the body
+                response.AttachStream(new MemoryStream(bytes, 0, bytes.Length, false, true));
+
+                return response;
+            }
+        }
+    }
+}
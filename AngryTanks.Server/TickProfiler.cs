@@ -0,0 +1,464 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Globalization;
+using System.Linq;
+using System.Text;
+using System.Threading;
+
+using log4net;
+using Lidgren.Network;
+
+using AngryTanks.Common.Protocol;
+
+namespace AngryTanks.Server
+{
+    /// <summary>
+    /// The parts of a server tick that are timed separately.
+    /// </summary>
+    public enum TickPhase
+    {
+        /// <summary>
+        /// Draining and handling incoming messages between ticks.
+        /// </summary>
+        Receive,
+
+        /// <summary>
+        /// Game logic in <see cref="GameKeeper.Update"/>.
+        /// </summary>
+        Update,
+
+        /// <summary>
+        /// Encoding and sending join snapshots and event bundles at the end of the tick.
+        /// </summary>
+        Send
+    }
+
+    /// <summary>
+    /// Keeps latency histograms of each tick phase and of handling each <see cref="MessageType"/>,
+    /// along with message and byte counters, cheaply enough to always be left on.
+    /// </summary>
+    /// <remarks>
+    /// <para>
+    ///     Everything is recorded from the server's main thread, and can be read at any time from any other thread.
+    /// </para>
+    /// <para>
+    ///     Reading the clock costs more than handling a small message takes to begin with, so only one in every
+    ///     <see cref="TickSampleInterval"/> ticks is timed, and one in every <see cref="HandleSampleInterval"/>
+    ///     messages of each type, while counters stay exact. Counters are kept in plain fields and published at the
+    ///     end of each timed tick, so readers lag by at most that many ticks.
+    /// </para>
+    /// </remarks>
+    public class TickProfiler
+    {
+        private static readonly ILog Log = LogManager.GetLogger(System.Reflection.MethodBase.GetCurrentMethod().DeclaringType);
+
+        private static readonly int PhaseCount = Enum.GetValues(typeof(TickPhase)).Length;
+
+        // converts Stopwatch timestamps to microseconds
+        private static readonly Double MicrosecondsPerTick = 1000000.0 / Stopwatch.Frequency;
+
+        /// <summary>
+        /// Phase and tick times are recorded for one in this many ticks.
+        /// </summary>
+        public const int TickSampleInterval = 4;
+
+        /// <summary>
+        /// Handle times are recorded for one in this many messages of each type.
+        /// </summary>
+        public const int HandleSampleInterval = 64;
+
+        /// <summary>
+        /// Gets or sets whether anything is recorded.
+        /// </summary>
+        public bool Enabled
+        {
+            get;
+            set;
+        }
+
+        private readonly LatencyHistogram tickHistogram = new LatencyHistogram();
+        private readonly LatencyHistogram[] phaseHistograms = new LatencyHistogram[PhaseCount];
+
+        // time spent in each phase so far this tick, in Stopwatch ticks
+        private readonly Int64[] phaseElapsed = new Int64[PhaseCount];
+
+        // when the last phase ended, so the end of the tick needs no clock reading of its own
+        private Int64 lastPhaseEnd;
+
+        // whether this tick is being timed, and ticks until the next one is
+        private bool timingTick = true;
+        private int tickCountdown = TickSampleInterval;
+
+        // what the main thread has counted of one message type during this tick,
+        // kept together so a message only touches one cache line
+        private struct PendingCounts
+        {
+            public Int64 MessagesReceived, BytesReceived, MessagesSent, BytesSent;
+
+            // messages until the next one is timed
+            public Int32 HandleCountdown;
+        }
+
+        private readonly PendingCounts[] pending = new PendingCounts[256];
+
+        // the types published at the end of each tick
+        private readonly Byte[] messageTypes;
+
+        // indexed by message type, histograms only exist for the types we know
+        private readonly LatencyHistogram[] handleHistograms = new LatencyHistogram[256];
+        private readonly Int64[] messagesReceived = new Int64[256], bytesReceived = new Int64[256];
+        private readonly Int64[] messagesSent     = new Int64[256], bytesSent     = new Int64[256];
+
+        // per second rates over the last whole second, and the totals they were worked out from
+        private readonly Int64[] messagesReceivedRate = new Int64[256], bytesReceivedRate = new Int64[256];
+        private readonly Int64[] messagesSentRate     = new Int64[256], bytesSentRate     = new Int64[256];
+        private readonly Int64[] lastMessagesReceived = new Int64[256], lastBytesReceived = new Int64[256];
+        private readonly Int64[] lastMessagesSent     = new Int64[256], lastBytesSent     = new Int64[256];
+        private Int64 lastRateTimestamp = Stopwatch.GetTimestamp();
+
+        private readonly DateTime startTime = DateTime.Now;
+
+        public TickProfiler()
+        {
+            Enabled = true;
+
+            for (int i = 0; i < PhaseCount; i++)
+                phaseHistograms[i] = new LatencyHistogram();
+
+            Array values = Enum.GetValues(typeof(MessageType));
+            messageTypes = new Byte[values.Length];
+
+            for (int i = 0; i < values.Length; i++)
+            {
+                messageTypes[i] = (Byte)(MessageType)values.GetValue(i);
+                handleHistograms[messageTypes[i]] = new LatencyHistogram();
+            }
+        }
+
+        #region Recording
+
+        /// <summary>
+        /// Gets a timestamp to pass to <see cref="EndPhase"/> later.
+        /// </summary>
+        /// <returns>The timestamp, or 0 if this tick isn't timed.</returns>
+        public Int64 Start()
+        {
+            if (!Enabled || !timingTick)
+                return 0;
+
+            return Stopwatch.GetTimestamp();
+        }
+
+        /// <summary>
+        /// Adds the time since <paramref name="start"/> to a phase of the current tick.
+        /// </summary>
+        /// <param name="phase"></param>
+        /// <param name="start">Timestamp from <see cref="Start"/> or from the phase before.</param>
+        /// <returns>When the phase ended, to start the next one from without reading the clock again.</returns>
+        public Int64 EndPhase(TickPhase phase, Int64 start)
+        {
+            if (!Enabled || start == 0)
+                return 0;
+
+            lastPhaseEnd = Stopwatch.GetTimestamp();
+            phaseElapsed[(int)phase] += lastPhaseEnd - start;
+
+            return lastPhaseEnd;
+        }
+
+        /// <summary>
+        /// Counts a message received by a <see cref="Player"/>, before it is handled.
+        /// </summary>
+        /// <param name="messageType"></param>
+        /// <param name="length">Length of the message in bytes.</param>
+        /// <returns>
+        /// A timestamp to pass to <see cref="MessageHandled"/> once it has been handled if its handle time is sampled,
+        /// otherwise 0.
+        /// </returns>
+        public Int64 MessageReceived(MessageType messageType, int length)
+        {
+            if (!Enabled)
+                return 0;
+
+            Byte index = (Byte)messageType;
+
+            pending[index].MessagesReceived++;
+            pending[index].BytesReceived += length;
+
+            if (--pending[index].HandleCountdown > 0)
+                return 0;
+
+            pending[index].HandleCountdown = HandleSampleInterval;
+
+            return Stopwatch.GetTimestamp();
+        }
+
+        /// <summary>
+        /// Records how long a sampled message took to handle.
+        /// </summary>
+        /// <param name="messageType"></param>
+        /// <param name="start">Timestamp from <see cref="MessageReceived"/>.</param>
+        public void MessageHandled(MessageType messageType, Int64 start)
+        {
+            LatencyHistogram histogram = handleHistograms[(Byte)messageType];
+
+            if (histogram != null)
+                histogram.Record(ToMicroseconds(Stopwatch.GetTimestamp() - start));
+        }
+
+        /// <summary>
+        /// Records a message about to be sent.
+        /// </summary>
+        /// <param name="msg">The message, which must start with its <see cref="MessageType"/>.</param>
+        /// <param name="recipients">How many connections it is being sent to.</param>
+        public void MessageSent(NetOutgoingMessage msg, int recipients)
+        {
+            if (!Enabled || recipients <= 0 || msg.LengthBytes == 0)
+                return;
+
+            Byte index = msg.PeekDataBuffer()[0];
+
+            pending[index].MessagesSent += recipients;
+            pending[index].BytesSent += (Int64)msg.LengthBytes * recipients;
+        }
+
+        /// <summary>
+        /// Records the phases of the tick that just finished, called at the end of every tick.
+        /// </summary>
+        public void EndTick()
+        {
+            if (!Enabled)
+                return;
+
+            bool timed = timingTick;
+
+            if (timingTick = --tickCountdown <= 0)
+                tickCountdown = TickSampleInterval;
+
+            if (!timed)
+                return;
+
+            Int64 total = 0;
+
+            for (int i = 0; i < PhaseCount; i++)
+            {
+                phaseHistograms[i].Record(ToMicroseconds(phaseElapsed[i]));
+                total += phaseElapsed[i];
+                phaseElapsed[i] = 0;
+            }
+
+            tickHistogram.Record(ToMicroseconds(total));
+
+            // publish the counts of this tick and the untimed ones before it
+            foreach (Byte index in messageTypes)
+            {
+                // most types are only ever received or only ever sent, and most not every tick
+                if (pending[index].MessagesReceived != 0)
+                {
+                    Interlocked.Add(ref messagesReceived[index], pending[index].MessagesReceived);
+                    Interlocked.Add(ref bytesReceived[index], pending[index].BytesReceived);
+                    pending[index].MessagesReceived = pending[index].BytesReceived = 0;
+                }
+
+                if (pending[index].MessagesSent != 0)
+                {
+                    Interlocked.Add(ref messagesSent[index], pending[index].MessagesSent);
+                    Interlocked.Add(ref bytesSent[index], pending[index].BytesSent);
+                    pending[index].MessagesSent = pending[index].BytesSent = 0;
+                }
+            }
+
+            Int64 now = lastPhaseEnd != 0 ? lastPhaseEnd : Stopwatch.GetTimestamp();
+            Int64 elapsed = now - lastRateTimestamp;
+
+            // rates are worked out once a second
+            if (elapsed >= Stopwatch.Frequency)
+            {
+                Double seconds = (Double)elapsed / Stopwatch.Frequency;
+
+                UpdateRates(messagesReceived, lastMessagesReceived, messagesReceivedRate, seconds);
+                UpdateRates(bytesReceived, lastBytesReceived, bytesReceivedRate, seconds);
+                UpdateRates(messagesSent, lastMessagesSent, messagesSentRate, seconds);
+                UpdateRates(bytesSent, lastBytesSent, bytesSentRate, seconds);
+
+                lastRateTimestamp = now;
+            }
+        }
+
+        private static void UpdateRates(Int64[] totals, Int64[] lastTotals, Int64[] rates, Double seconds)
+        {
+            for (int i = 0; i < totals.Length; i++)
+            {
+                Int64 current = Interlocked.Read(ref totals[i]);
+
+                Interlocked.Exchange(ref rates[i], (Int64)((current - lastTotals[i]) / seconds));
+                lastTotals[i] = current;
+            }
+        }
+
+        private static Int64 ToMicroseconds(Int64 stopwatchTicks)
+        {
+            return (Int64)(stopwatchTicks * MicrosecondsPerTick);
+        }
+
+        #endregion
+
+        #region Reporting
+
+        private static readonly Double[] Quantiles = { 0.5, 0.9, 0.99, 0.999 };
+
+        /// <summary>
+        /// Writes every statistic as a JSON object.
+        /// </summary>
+        /// <returns></returns>
+        public String ToJson()
+        {
+            StringBuilder json = new StringBuilder();
+
+            json.Append("{");
+            AppendJsonMembers(json);
+            json.Append("}");
+
+            return json.ToString();
+        }
+
+        /// <summary>
+        /// Writes every statistic as the members of a JSON object, so they can share one with other statistics.
+        /// </summary>
+        public void AppendJsonMembers(StringBuilder json)
+        {
+            json.AppendFormat(CultureInfo.InvariantCulture, "\"uptime\":{0:F0},", (DateTime.Now - startTime).TotalSeconds);
+            json.AppendFormat("\"enabled\":{0},", Enabled ? "true" : "false");
+
+            json.Append("\"tick\":");
+            AppendJson(json, tickHistogram);
+
+            json.Append(",\"phases\":{");
+            for (int i = 0; i < PhaseCount; i++)
+            {
+                if (i > 0)
+                    json.Append(",");
+
+                json.AppendFormat("\"{0}\":", ((TickPhase)i).ToString().ToLowerInvariant());
+                AppendJson(json, phaseHistograms[i]);
+            }
+            json.Append("}");
+
+            json.Append(",\"messages\":{");
+            bool first = true;
+            for (int i = 0; i < 256; i++)
+            {
+                if (Interlocked.Read(ref messagesReceived[i]) == 0 && Interlocked.Read(ref messagesSent[i]) == 0)
+                    continue;
+
+                if (!first)
+                    json.Append(",");
+                first = false;
+
+                json.AppendFormat(CultureInfo.InvariantCulture,
+                                  "\"{0}\":{{\"received\":{1},\"receivedBytes\":{2},\"receivedPerSecond\":{3},\"receivedBytesPerSecond\":{4}," +
+                                  "\"sent\":{5},\"sentBytes\":{6},\"sentPerSecond\":{7},\"sentBytesPerSecond\":{8}",
+                                  (MessageType)i,
+                                  Interlocked.Read(ref messagesReceived[i]), Interlocked.Read(ref bytesReceived[i]),
+                                  Interlocked.Read(ref messagesReceivedRate[i]), Interlocked.Read(ref bytesReceivedRate[i]),
+                                  Interlocked.Read(ref messagesSent[i]), Interlocked.Read(ref bytesSent[i]),
+                                  Interlocked.Read(ref messagesSentRate[i]), Interlocked.Read(ref bytesSentRate[i]));
+
+                if (handleHistograms[i] != null && handleHistograms[i].Count > 0)
+                {
+                    json.Append(",\"handle\":");
+                    AppendJson(json, handleHistograms[i]);
+                }
+
+                json.Append("}");
+            }
+            json.Append("}");
+        }
+
+        private static void AppendJson(StringBuilder json, LatencyHistogram histogram)
+        {
+            Int64[] values = histogram.GetQuantiles(Quantiles);
+
+            // all in microseconds
+            json.AppendFormat(CultureInfo.InvariantCulture,
+                              "{{\"count\":{0},\"sum\":{1},\"max\":{2},\"p50\":{3},\"p90\":{4},\"p99\":{5},\"p999\":{6}}}",
+                              histogram.Count, histogram.Sum, histogram.Max, values[0], values[1], values[2], values[3]);
+        }
+
+        /// <summary>
+        /// Writes every statistic in the Prometheus text exposition format.
+        /// </summary>
+        /// <returns></returns>
+        public String ToPrometheus()
+        {
+            StringBuilder text = new StringBuilder();
+
+            text.Append("# HELP angrytanks_tick_seconds Time spent in a server tick.\n");
+            text.Append("# TYPE angrytanks_tick_seconds summary\n");
+            AppendSummary(text, "angrytanks_tick_seconds", "", tickHistogram);
+
+            text.Append("# HELP angrytanks_tick_phase_seconds Time spent in each phase of a server tick.\n");
+            text.Append("# TYPE angrytanks_tick_phase_seconds summary\n");
+            for (int i = 0; i < PhaseCount; i++)
+            {
+                AppendSummary(text, "angrytanks_tick_phase_seconds",
+                              String.Format("phase=\"{0}\"", ((TickPhase)i).ToString().ToLowerInvariant()),
+                              phaseHistograms[i]);
+            }
+
+            text.Append("# HELP angrytanks_message_handle_seconds Time spent handling each type of message.\n");
+            text.Append("# TYPE angrytanks_message_handle_seconds summary\n");
+            for (int i = 0; i < 256; i++)
+            {
+                if (handleHistograms[i] != null && handleHistograms[i].Count > 0)
+                    AppendSummary(text, "angrytanks_message_handle_seconds", TypeLabel(i), handleHistograms[i]);
+            }
+
+            AppendCounter(text, "angrytanks_messages_received_total", "Messages received of each type.", messagesReceived);
+            AppendCounter(text, "angrytanks_received_bytes_total", "Bytes received in each type of message.", bytesReceived);
+            AppendCounter(text, "angrytanks_messages_sent_total", "Messages sent of each type, once per recipient.", messagesSent);
+            AppendCounter(text, "angrytanks_sent_bytes_total", "Bytes sent in each type of message, once per recipient.", bytesSent);
+
+            return text.ToString();
+        }
+
+        private static String TypeLabel(int messageType)
+        {
+            return String.Format("type=\"{0}\"", (MessageType)messageType);
+        }
+
+        private static void AppendSummary(StringBuilder text, String name, String labels, LatencyHistogram histogram)
+        {
+            Int64[] values = histogram.GetQuantiles(Quantiles);
+            String separator = labels.Length > 0 ? "," : "";
+
+            for (int i = 0; i < Quantiles.Length; i++)
+            {
+                text.AppendFormat(CultureInfo.InvariantCulture, "{0}{{{1}{2}quantile=\"{3}\"}} {4:0.######}\n",
+                                  name, labels, separator, Quantiles[i], values[i] / 1000000.0);
+            }
+
+            String braces = labels.Length > 0 ? "{" + labels + "}" : "";
+
+            text.AppendFormat(CultureInfo.InvariantCulture, "{0}_sum{1} {2:0.######}\n", name, braces, histogram.Sum / 1000000.0);
+            text.AppendFormat(CultureInfo.InvariantCulture, "{0}_count{1} {2}\n", name, braces, histogram.Count);
+        }
+
+        private static void AppendCounter(StringBuilder text, String name, String help, Int64[] counters)
+        {
+            text.AppendFormat("# HELP {0} {1}\n", name, help);
+            text.AppendFormat("# TYPE {0} counter\n", name);
+
+            for (int i = 0; i < counters.Length; i++)
+            {
+                Int64 value = Interlocked.Read(ref counters[i]);
+
+                if (value > 0)
+                    text.AppendFormat(CultureInfo.InvariantCulture, "{0}{{{1}}} {2}\n", name, TypeLabel(i), value);
+            }
+        }
+
+        #endregion
+    }
+}
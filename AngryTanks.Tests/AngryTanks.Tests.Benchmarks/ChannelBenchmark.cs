@@ -0,0 +1,249 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Net;
+using System.Threading;
+using Microsoft.Xna.Framework;
+
+using Lidgren.Network;
+using NDesk.Options;
+
+using AngryTanks.Common;
+using AngryTanks.Common.Messages;
+using AngryTanks.Common.Protocol;
+using AngryTanks.Server;
+
+namespace AngryTanks.Tests.Benchmarks
+{
+    /// <summary>
+    /// Streams a world to one client over loopback while sending it spawn events, and reports how long the spawns
+    /// take to arrive. It runs once with everything on one reliable ordered stream, as before <see cref="TrafficClasses"/>,
+    /// and once routed by traffic class.
+    /// </summary>
+    /// <remarks>
+    /// Loss needs Lidgren's latency simulation, which only exists in DEBUG builds. Without it the spawns still queue
+    /// behind the world on a single stream, they just never wait for a resend.
+    /// </remarks>
+    static class ChannelBenchmark
+    {
+        private static readonly TimeSpan UpdateInterval = TimeSpan.FromMilliseconds(10);
+
+        // the same pace as Player.StreamWorld
+        private static readonly int WorldChunksPerUpdate = 16;
+
+        private static readonly Double[] Quantiles = { 0.5, 0.9, 0.99 };
+
+        public static void Run(String[] args)
+        {
+            int worldKilobytes = 2048;
+            Double spawnInterval = 50;
+            Single loss = 0.01f;
+            Single latency = 0.02f;
+            int seed = 5150;
+            bool showHelp = false;
+
+            OptionSet p = new OptionSet()
+            {
+                {
+                    "k|kilobytes=",
+                    "size of the world to stream in KB (default 2048)",
+                    (int v) => worldKilobytes = v
+                },
+                {
+                    "i|interval=",
+                    "milliseconds between spawns (default 50)",
+                    (Double v) => spawnInterval = v
+                },
+                {
+                    "l|loss=",
+                    "packet loss of the server to client link, 0 to 1 (default 0.01, DEBUG builds only)",
+                    (Single v) => loss = v
+                },
+                {
+                    "t|latency=",
+                    "one way latency in seconds (default 0.02, DEBUG builds only)",
+                    (Single v) => latency = v
+                },
+                {
+                    "s|seed=",
+                    "seed for the impairments",
+                    (int v) => seed = v
+                },
+                {
+                    "h|?|help",
+                    "shows this message and exits",
+                    v => showHelp = v != null
+                },
+            };
+
+            try
+            {
+                p.Parse(args);
+            }
+            catch (OptionException e)
+            {
+                Console.WriteLine(e.Message);
+                showHelp = true;
+            }
+
+            if (showHelp)
+            {
+                p.WriteOptionDescriptions(Console.Out);
+                return;
+            }
+
+#if DEBUG
+            Console.WriteLine("Streaming {0} KB with a spawn every {1} ms, {2:P1} loss and {3} ms latency (seed {4})",
+                              worldKilobytes, spawnInterval, loss, latency * 1000, seed);
+#else
+            Console.WriteLine("Streaming {0} KB with a spawn every {1} ms; no loss or latency without a DEBUG build",
+                              worldKilobytes, spawnInterval);
+#endif
+            Console.WriteLine();
+            Console.WriteLine("  {0,-20} {1,10} {2,10} {3,10} {4,10} {5,10} {6,10}", "spawn latency ms", "count", "p50", "p90", "p99", "max", "world s");
+
+            TrafficRoute single = new TrafficRoute(NetDeliveryMethod.ReliableOrdered, 0);
+
+            Transfer("one stream", worldKilobytes * 1024, spawnInterval / 1000, loss, latency, seed, t => single);
+            Transfer("traffic classes", worldKilobytes * 1024, spawnInterval / 1000, loss, latency, seed, t => TrafficClasses.GetRoute(t));
+        }
+
+        private static void Transfer(String name, int worldBytes, Double spawnInterval, Single loss, Single latency, int seed,
+                                     Func<MessageType, TrafficRoute> route)
+        {
+            NetServer server = new NetServer(new NetPeerConfiguration("channelbenchmark"));
+            server.Start();
+
+            NetClient client = new NetClient(new NetPeerConfiguration("channelbenchmark"));
+            client.Start();
+
+#if DEBUG
+            NetImpairmentProfile impaired = new NetImpairmentProfile();
+            impaired.Loss = loss;
+            impaired.MinimumLatency = latency;
+
+            NetImpairmentProfile clean = new NetImpairmentProfile();
+            clean.MinimumLatency = latency;
+
+            server.SetSimulatedImpairment(new IPEndPoint(IPAddress.Loopback, client.Port), new NetImpairmentTimeline(impaired), seed);
+            client.SetSimulatedImpairment(new IPEndPoint(IPAddress.Loopback, server.Port), new NetImpairmentTimeline(clean), seed + 1);
+#endif
+
+            client.Connect("127.0.0.1", server.Port);
+
+            Stopwatch waited = Stopwatch.StartNew();
+            while (server.ConnectionsCount == 0 || client.ConnectionStatus != NetConnectionStatus.Connected)
+            {
+                if (waited.Elapsed.TotalSeconds > 20)
+                    throw new TimeoutException("client never connected");
+
+                Drain(server);
+                Drain(client);
+                Thread.Sleep(10);
+            }
+
+            NetConnection connection = server.Connections[0];
+
+            Byte[] world = new Byte[worldBytes];
+            new Random(seed).NextBytes(world);
+
+            List<Double> spawnSentAt = new List<Double>();
+            LatencyHistogram spawnLatency = new LatencyHistogram();
+
+            int worldSent = 0;
+            int worldReceived = 0;
+            Double start = NetTime.Now;
+            Double nextUpdate = start;
+            Double nextSpawn = start;
+
+            while (worldReceived < worldBytes)
+            {
+                Double now = NetTime.Now;
+
+                if (now - start > 300)
+                    throw new TimeoutException("world transfer never finished");
+
+                if (now >= nextUpdate)
+                {
+                    nextUpdate += UpdateInterval.TotalSeconds;
+
+                    for (int i = 0; i < WorldChunksPerUpdate && worldSent < worldBytes; i++)
+                    {
+                        int count = Math.Min(ProtocolInformation.WorldChunkSize, worldBytes - worldSent);
+                        MsgWorldPacket packet = new MsgWorldPacket((UInt32)worldSent, world, worldSent, count);
+
+                        NetOutgoingMessage msg = server.CreateMessage(1 + 5 + 5 + count);
+                        msg.Write((Byte)packet.MsgType);
+                        packet.Write(msg);
+                        Send(server, connection, msg, route(packet.MsgType));
+
+                        worldSent += count;
+                    }
+                }
+
+                if (now >= nextSpawn)
+                {
+                    nextSpawn += spawnInterval;
+
+                    // the spawn's number rides in the rotation
+                    MsgSpawnPacket packet = new MsgSpawnPacket(0, Vector2.Zero, spawnSentAt.Count);
+
+                    NetOutgoingMessage msg = server.CreateMessage();
+                    msg.Write((Byte)packet.MsgType);
+                    packet.Write(msg);
+                    Send(server, connection, msg, route(packet.MsgType));
+
+                    spawnSentAt.Add(now);
+                }
+
+                Drain(server);
+
+                NetIncomingMessage inc;
+                while ((inc = client.ReadMessage()) != null)
+                {
+                    if (inc.MessageType == NetIncomingMessageType.Data)
+                    {
+                        MessageType messageType = (MessageType)inc.ReadByte();
+
+                        if (messageType == MessageType.MsgWorld)
+                        {
+                            worldReceived += (int)MsgWorldPacket.Read(inc).Count;
+                        }
+                        else if (messageType == MessageType.MsgSpawn)
+                        {
+                            int index = (int)MsgSpawnPacket.Read(inc).Rotation;
+                            spawnLatency.Record((Int64)((NetTime.Now - spawnSentAt[index]) * 1000000));
+                        }
+                    }
+
+                    client.Recycle(inc);
+                }
+
+                Thread.Sleep(1);
+            }
+
+            Double seconds = NetTime.Now - start;
+            Int64[] values = spawnLatency.GetQuantiles(Quantiles);
+
+            Console.WriteLine("  {0,-20} {1,10} {2,10:F2} {3,10:F2} {4,10:F2} {5,10:F2} {6,10:F2}",
+                              name, spawnLatency.Count, values[0] / 1000.0, values[1] / 1000.0, values[2] / 1000.0,
+                              spawnLatency.Max / 1000.0, seconds);
+
+            client.Shutdown("benchmark over");
+            server.Shutdown("benchmark over");
+        }
+
+        private static void Send(NetServer server, NetConnection connection, NetOutgoingMessage msg, TrafficRoute route)
+        {
+            server.SendMessage(msg, connection, route.Method, route.Channel);
+        }
+
+        private static void Drain(NetPeer peer)
+        {
+            NetIncomingMessage msg;
+
+            while ((msg = peer.ReadMessage()) != null)
+                peer.Recycle(msg);
+        }
+    }
+}
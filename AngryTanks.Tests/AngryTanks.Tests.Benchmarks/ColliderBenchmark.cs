@@ -0,0 +1,201 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.Linq;
+using System.Text;
+using Microsoft.Xna.Framework;
+
+using NDesk.Options;
+
+using AngryTanks.Common;
+
+namespace AngryTanks.Tests.Benchmarks
+{
+    /// <summary>
+    /// Simplifies the colliders of a map built from walls of touching boxes and of a map of scattered objects, then
+    /// times the broad and narrow phases against the original objects and the simplified ones. Checks tanks collide
+    /// in exactly the same places either way.
+    /// </summary>
+    static class ColliderBenchmark
+    {
+        public static void Run(String[] args)
+        {
+            int walls = 300;
+            int objectCount = 2000;
+            int probes = 2000;
+            int seed = 5150;
+            bool showHelp = false;
+
+            OptionSet p = new OptionSet()
+            {
+                {
+                    "w|walls=",
+                    "walls of touching boxes in the walled map (default 300)",
+                    (int v) => walls = v
+                },
+                {
+                    "o|objects=",
+                    "objects in the scattered map (default 2000)",
+                    (int v) => objectCount = v
+                },
+                {
+                    "p|probes=",
+                    "tank sized collision queries per timed run (default 2000)",
+                    (int v) => probes = v
+                },
+                {
+                    "s|seed=",
+                    "seed for the maps and the queries",
+                    (int v) => seed = v
+                },
+                {
+                    "h|?|help",
+                    "shows this message and exits",
+                    v => showHelp = v != null
+                },
+            };
+
+            try
+            {
+                p.Parse(args);
+            }
+            catch (OptionException e)
+            {
+                Console.WriteLine(e.Message);
+                showHelp = true;
+            }
+
+            if (showHelp)
+            {
+                p.WriteOptionDescriptions(Console.Out);
+                return;
+            }
+
+            Measure("walls", WorldMap.Parse(SynthesizeWalls(walls, seed)), probes, seed);
+            Measure("scattered", WorldMap.Parse(WorldMapBenchmark.Synthesize(objectCount, seed)), probes, seed);
+        }
+
+        private static void Measure(String name, WorldMap map, int probeCount, int seed)
+        {
+            List<IWorldObject> original = map.Objects.Select(o => (IWorldObject)new WorldObject(o.Position, o.Size, o.Rotation)).ToList();
+            List<IWorldObject> simplified = ColliderSimplifier.Simplify(original);
+
+            Console.WriteLine("{0}: {1} colliders simplified to {2}", name, original.Count, simplified.Count);
+
+            Program.Time("simplify", 10, () => ColliderSimplifier.Simplify(original));
+
+            Vector2 gridSize = new Vector2(map.Size, map.Size);
+
+            Program.Time("grid, original", 3, () => new Grid(gridSize, original));
+            Program.Time("grid, simplified", 3, () => new Grid(gridSize, simplified));
+
+            Grid originalGrid = new Grid(gridSize, original);
+            Grid simplifiedGrid = new Grid(gridSize, simplified);
+
+            // tanks all over the map, facing every which way
+            Random random = new Random(seed);
+            List<IWorldObject> probes = new List<IWorldObject>(probeCount);
+
+            for (int i = 0; i < probeCount; i++)
+            {
+                Vector2 position = new Vector2((Single)((random.NextDouble() - 0.5) * map.Size),
+                                               (Single)((random.NextDouble() - 0.5) * map.Size));
+
+                probes.Add(new WorldObject(position, new Vector2(4.86f, 6), (Single)(random.NextDouble() * 2 * Math.PI)));
+            }
+
+            int originalCandidates = 0, simplifiedCandidates = 0;
+
+            foreach (IWorldObject probe in probes)
+            {
+                List<IWorldObject> originalHits = originalGrid.PotentialIntersects(probe);
+                List<IWorldObject> simplifiedHits = simplifiedGrid.PotentialIntersects(probe);
+
+                originalCandidates += originalHits.Count;
+                simplifiedCandidates += simplifiedHits.Count;
+
+                if (originalHits.Any(o => o.Bounds.Intersects(probe.Bounds)) != simplifiedHits.Any(o => o.Bounds.Intersects(probe.Bounds)))
+                    throw new InvalidOperationException(String.Format("A tank at {0} collides differently once simplified", probe.Position));
+            }
+
+            Console.WriteLine("  broad phase found {0:F2} candidates per tank, {1:F2} simplified",
+                              (Double)originalCandidates / probeCount, (Double)simplifiedCandidates / probeCount);
+
+            Double before = Program.Time("collide, original", 5, () => Collide(originalGrid, probes));
+            Double after = Program.Time("collide, simplified", 5, () => Collide(simplifiedGrid, probes));
+
+            Console.WriteLine("  {0,-24} {1,12:F1}x", "speedup", before / after);
+            Console.WriteLine();
+        }
+
+        /// <summary>
+        /// Both phases, the way <c>LocalPlayer</c> checks its tank against the map every frame.
+        /// </summary>
+        private static int Collide(Grid grid, List<IWorldObject> probes)
+        {
+            int collisions = 0;
+
+            foreach (IWorldObject probe in probes)
+            {
+                foreach (IWorldObject candidate in grid.PotentialIntersects(probe))
+                {
+                    Single overlap;
+                    Vector2 projection;
+
+                    if (candidate.Bounds.Intersects(probe.Bounds, out overlap, out projection))
+                        collisions++;
+                }
+            }
+
+            return collisions;
+        }
+
+        /// <summary>
+        /// Builds .bzw text of <paramref name="wallCount"/> walls, each a row of touching boxes, the way maps are usually built.
+        /// </summary>
+        private static Byte[] SynthesizeWalls(int wallCount, int seed)
+        {
+            Random random = new Random(seed);
+            Single worldSize = (Single)Math.Max(800, Math.Sqrt(wallCount) * 60);
+
+            StringBuilder sb = new StringBuilder(wallCount * 800);
+
+            sb.AppendLine("world");
+            sb.AppendLine("  name Walls");
+            sb.AppendLine("  size " + worldSize.ToString(CultureInfo.InvariantCulture));
+            sb.AppendLine("end");
+            sb.AppendLine();
+
+            for (int i = 0; i < wallCount; i++)
+            {
+                // most walls line up with the world, some are turned
+                Double degrees = random.Next(4) == 0 ? random.NextDouble() * 360 : random.Next(4) * 90;
+                Double radians = degrees * Math.PI / 180;
+
+                Double halfSize = 2;
+                int boxes = 4 + random.Next(13);
+
+                Double startX = (random.NextDouble() - 0.5) * (worldSize - 100);
+                Double startY = (random.NextDouble() - 0.5) * (worldSize - 100);
+
+                for (int j = 0; j < boxes; j++)
+                {
+                    // each box sits right against the last along the wall's own x axis
+                    Double along = j * halfSize * 2;
+
+                    sb.AppendLine("box");
+                    sb.AppendFormat(CultureInfo.InvariantCulture, "  position {0:F4} {1:F4} 0",
+                                    startX + along * Math.Cos(radians), startY + along * Math.Sin(radians));
+                    sb.AppendLine();
+                    sb.AppendFormat(CultureInfo.InvariantCulture, "  size {0:F4} {0:F4} 10", halfSize);
+                    sb.AppendLine();
+                    sb.AppendFormat(CultureInfo.InvariantCulture, "  rotation {0:F4}", degrees);
+                    sb.AppendLine();
+                    sb.AppendLine("end");
+                }
+            }
+
+            return Encoding.ASCII.GetBytes(sb.ToString());
+        }
+    }
+}
@@ -0,0 +1,221 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Linq;
+using Microsoft.Xna.Framework;
+
+using NDesk.Options;
+
+using AngryTanks.Common;
+
+namespace AngryTanks.Tests.Benchmarks
+{
+    /// <summary>
+    /// Sweeps the resolution of a <see cref="Grid"/> over a map's colliders, printing what the cost model expects of each
+    /// resolution next to how long tank sized queries really take, then compares the resolution the grid picks for itself
+    /// with the fastest one swept.
+    /// </summary>
+    static class GridBenchmark
+    {
+        private static readonly int[] Resolutions = { 4, 8, 16, 32, 64, 128, 256 };
+
+        public static void Run(String[] args)
+        {
+            String world = null;
+            int objectCount = 2000;
+            Single query = new Vector2(4.86f, 6).Length();
+            int probes = 100000;
+            int seed = 5150;
+            bool showHelp = false;
+
+            OptionSet p = new OptionSet()
+            {
+                {
+                    "w|world=",
+                    "the .bzw map to sweep, otherwise a synthetic one",
+                    v => world = v
+                },
+                {
+                    "o|objects=",
+                    "objects in the synthetic map (default 2000)",
+                    (int v) => objectCount = v
+                },
+                {
+                    "q|query=",
+                    "width and height of a query, in world units (default a tank's diagonal)",
+                    (Single v) => query = v
+                },
+                {
+                    "n|probes=",
+                    "queries per timed run (default 100000)",
+                    (int v) => probes = v
+                },
+                {
+                    "s|seed=",
+                    "seed for the synthetic map and the queries",
+                    (int v) => seed = v
+                },
+                {
+                    "h|?|help",
+                    "shows this message and exits",
+                    v => showHelp = v != null
+                },
+            };
+
+            try
+            {
+                p.Parse(args);
+            }
+            catch (OptionException e)
+            {
+                Console.WriteLine(e.Message);
+                showHelp = true;
+            }
+
+            if (showHelp)
+            {
+                p.WriteOptionDescriptions(Console.Out);
+                return;
+            }
+
+            WorldMap map;
+
+            if (world != null)
+                map = WorldMap.Parse(File.ReadAllBytes(world));
+            else
+                map = WorldMap.Parse(WorldMapBenchmark.Synthesize(objectCount, seed));
+
+            // the same objects the client builds its grid from
+            List<IWorldObject> colliders = map.Colliders.Select(o => (IWorldObject)new WorldObject(o.Position, o.Size, o.Rotation)).ToList();
+
+            Vector2 worldSize = new Vector2(map.Size, map.Size);
+            Vector2 querySize = new Vector2(query, query);
+
+            Console.WriteLine("{0} colliders in a world of {1} units, queries of {2:F2} units:", colliders.Count, map.Size, query);
+
+            // tanks all over the map, facing every which way, scaled so their diagonal is the query size
+            Vector2 tank = new Vector2(4.86f, 6);
+            Random random = new Random(seed);
+            List<IWorldObject> queries = new List<IWorldObject>(probes);
+
+            for (int i = 0; i < probes; i++)
+            {
+                Vector2 position = new Vector2((Single)((random.NextDouble() - 0.5) * map.Size),
+                                               (Single)((random.NextDouble() - 0.5) * map.Size));
+
+                queries.Add(new WorldObject(position, tank * (query / tank.Length()), (Single)(random.NextDouble() * 2 * Math.PI)));
+            }
+
+            Point chosen = Grid.ChooseGridSize(worldSize, colliders, querySize);
+
+            List<Point> sizes = new List<Point>();
+
+            foreach (int x in Resolutions)
+            {
+                foreach (int y in Resolutions)
+                    sizes.Add(new Point(x, y));
+            }
+
+            if (!sizes.Contains(chosen))
+                sizes.Add(chosen);
+
+            List<Grid> grids = sizes.Select(s => new Grid(worldSize, s, colliders)).ToList();
+            Double[] times = Measure(grids, queries);
+
+            Console.WriteLine("  {0,-10} {1,-16} {2,12} {3,12} {4,12}", "cells", "cell size", "model", "candidates", "ms");
+
+            Point best = chosen;
+            Double bestTime = Double.MaxValue;
+            Double chosenTime = 0;
+
+            for (int i = 0; i < sizes.Count; i++)
+            {
+                Point size = sizes[i];
+                Grid grid = grids[i];
+
+                int candidates = 0;
+
+                foreach (IWorldObject probe in queries)
+                    candidates += grid.PotentialIntersects(probe).Count;
+
+                Double cost = Grid.EstimateQueryCost(worldSize, size, colliders, querySize);
+                Double time = times[i];
+
+                Console.WriteLine("  {0,-10} {1,-16} {2,12:F1} {3,12:F2} {4,12:F3}{5}",
+                                  String.Format("{0}x{1}", size.X, size.Y),
+                                  String.Format("{0:F1}x{1:F1}", grid.CellSize.X, grid.CellSize.Y),
+                                  cost, (Double)candidates / probes, time,
+                                  size == chosen ? "  <- chosen" : "");
+
+                if (time < bestTime)
+                {
+                    best = size;
+                    bestTime = time;
+                }
+
+                if (size == chosen)
+                    chosenTime = time;
+            }
+
+            Console.WriteLine();
+            Console.WriteLine("  {0,-24} {1,12}", "fastest swept", String.Format("{0}x{1}", best.X, best.Y));
+            Console.WriteLine("  {0,-24} {1,12}", "chosen", String.Format("{0}x{1}", chosen.X, chosen.Y));
+            Console.WriteLine("  {0,-24} {1,12:F2}x", "chosen against fastest", chosenTime / bestTime);
+        }
+
+        /// <summary>
+        /// Fastest of several runs of both phases over every query, for each grid. Runs take turns across the grids after a
+        /// round to warm up, so the JIT settling, collections and the scheduler land on every resolution alike rather
+        /// than deciding which one looks best.
+        /// </summary>
+        private static Double[] Measure(List<Grid> grids, List<IWorldObject> queries)
+        {
+            const int runs = 9;
+
+            Double[] fastest = new Double[grids.Count];
+
+            for (int i = 0; i < grids.Count; i++)
+            {
+                Collide(grids[i], queries);
+                fastest[i] = Double.MaxValue;
+            }
+
+            for (int run = 0; run < runs; run++)
+            {
+                for (int i = 0; i < grids.Count; i++)
+                {
+                    Stopwatch stopwatch = Stopwatch.StartNew();
+                    Collide(grids[i], queries);
+                    stopwatch.Stop();
+
+                    fastest[i] = Math.Min(fastest[i], stopwatch.Elapsed.TotalMilliseconds);
+                }
+            }
+
+            return fastest;
+        }
+
+        /// <summary>
+        /// Both phases, the way <c>LocalPlayer</c> checks its tank against the map every frame.
+        /// </summary>
+        private static int Collide(Grid grid, List<IWorldObject> queries)
+        {
+            int collisions = 0;
+
+            foreach (IWorldObject probe in queries)
+            {
+                foreach (IWorldObject candidate in grid.PotentialIntersects(probe))
+                {
+                    Single overlap;
+                    Vector2 projection;
+
+                    if (candidate.Bounds.Intersects(probe.Bounds, out overlap, out projection))
+                        collisions++;
+                }
+            }
+
+            return collisions;
+        }
+    }
+}
@@ -0,0 +1,200 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+
+using NDesk.Options;
+
+using AngryTanks.Common;
+
+namespace AngryTanks.Tests.Benchmarks
+{
+    /// <summary>
+    /// Feeds a stream of score changes to a <see cref="Leaderboard{TKey}"/> and times it against sorting every player
+    /// after each change, which is what the scoreboard used to do every frame. Checks both give the same standings.
+    /// </summary>
+    static class LeaderboardBenchmark
+    {
+        public static void Run(String[] args)
+        {
+            int players = 100;
+            int changes = 10000;
+            int top = 20;
+            int seed = 5150;
+            bool showHelp = false;
+
+            OptionSet p = new OptionSet()
+            {
+                {
+                    "p|players=",
+                    "players on the leaderboard (default 100)",
+                    (int v) => players = v
+                },
+                {
+                    "c|changes=",
+                    "score changes per timed run (default 10000)",
+                    (int v) => changes = v
+                },
+                {
+                    "t|top=",
+                    "rows read off the top after each change (default 20)",
+                    (int v) => top = v
+                },
+                {
+                    "s|seed=",
+                    "seed for the score changes",
+                    (int v) => seed = v
+                },
+                {
+                    "h|?|help",
+                    "shows this message and exits",
+                    v => showHelp = v != null
+                },
+            };
+
+            try
+            {
+                p.Parse(args);
+            }
+            catch (OptionException e)
+            {
+                Console.WriteLine(e.Message);
+                showHelp = true;
+            }
+
+            if (showHelp)
+            {
+                p.WriteOptionDescriptions(Console.Out);
+                return;
+            }
+
+            // each change is a kill: one player wins and another loses
+            Random random = new Random(seed);
+            int[,] kills = new int[changes, 2];
+
+            for (int i = 0; i < changes; i++)
+            {
+                kills[i, 0] = random.Next(players);
+                kills[i, 1] = random.Next(players);
+            }
+
+            Check(players, kills);
+
+            Console.WriteLine("{0} kills among {1} players, reading the top {2} after each:", changes, players, top);
+
+            Double sorted = Program.Time("sort every change", 5, () =>
+            {
+                Score[] scores = NewScores(players);
+
+                for (int i = 0; i < changes; i++)
+                {
+                    scores[kills[i, 0]].Wins++;
+                    scores[kills[i, 1]].Losses++;
+
+                    Sort(scores).Take(top).ToList();
+                }
+            });
+
+            Double ranked = Program.Time("leaderboard", 5, () =>
+            {
+                Leaderboard<Byte> leaderboard = NewLeaderboard(players);
+
+                for (int i = 0; i < changes; i++)
+                {
+                    leaderboard.Add((Byte)kills[i, 0], 1, 0, 0);
+                    leaderboard.Add((Byte)kills[i, 1], 0, 1, 0);
+
+                    leaderboard.GetTop(top);
+                }
+            });
+
+            Console.WriteLine("  {0,-24} {1,12:F1}x", "speedup", sorted / ranked);
+        }
+
+        /// <summary>
+        /// Replays the kills on a leaderboard and on plain scores, and compares the leaderboard to a full sort as it goes.
+        /// </summary>
+        private static void Check(int players, int[,] kills)
+        {
+            Score[] scores = NewScores(players);
+            Leaderboard<Byte> leaderboard = NewLeaderboard(players);
+
+            for (int i = 0; i < kills.GetLength(0); i++)
+            {
+                UInt32 version = leaderboard.Version;
+
+                scores[kills[i, 0]].Wins++;
+                scores[kills[i, 1]].Losses++;
+
+                leaderboard.Add((Byte)kills[i, 0], 1, 0, 0);
+                leaderboard.Add((Byte)kills[i, 1], 0, 1, 0);
+
+                if (leaderboard.Version == version)
+                    throw new InvalidOperationException(String.Format("Leaderboard version didn't move after kill {0}", i));
+
+                // a full comparison every so often, it's quadratic
+                if (i % 97 != 0)
+                    continue;
+
+                List<int> expected = Sort(scores).ToList();
+                List<LeaderboardEntry<Byte>> actual = leaderboard.GetTop(players);
+
+                for (int rank = 1; rank <= players; rank++)
+                {
+                    int slot = expected[rank - 1];
+
+                    if (actual[rank - 1].Key != slot || leaderboard.GetEntryAt(rank).Key != slot || leaderboard.GetRank((Byte)slot) != rank)
+                        throw new InvalidOperationException(String.Format("Rank {0} should be player {1} after kill {2}", rank, slot, i));
+
+                    if (actual[rank - 1].Wins != scores[slot].Wins || actual[rank - 1].Losses != scores[slot].Losses)
+                        throw new InvalidOperationException(String.Format("Player {0} has the wrong score after kill {1}", slot, i));
+                }
+            }
+
+            // setting a score to what it already is changes nothing
+            LeaderboardEntry<Byte> first = leaderboard.GetEntryAt(1);
+            UInt32 before = leaderboard.Version;
+
+            if (leaderboard.Set(first.Key, first.Wins, first.Losses, first.Teamkills) || leaderboard.Version != before)
+                throw new InvalidOperationException("Setting an unchanged score moved the leaderboard");
+
+            leaderboard.Remove(first.Key);
+
+            if (leaderboard.Count != players - 1 || leaderboard.Contains(first.Key) || leaderboard.GetEntryAt(1).Key == first.Key)
+                throw new InvalidOperationException("Removed player is still on the leaderboard");
+
+            Console.WriteLine("Leaderboard matched a full sort through {0} kills", kills.GetLength(0));
+            Console.WriteLine();
+        }
+
+        private static Score[] NewScores(int players)
+        {
+            Score[] scores = new Score[players];
+
+            for (int i = 0; i < players; i++)
+                scores[i] = new Score();
+
+            return scores;
+        }
+
+        private static Leaderboard<Byte> NewLeaderboard(int players)
+        {
+            Leaderboard<Byte> leaderboard = new Leaderboard<Byte>();
+
+            for (int i = 0; i < players; i++)
+                leaderboard.Set((Byte)i, 0, 0, 0);
+
+            return leaderboard;
+        }
+
+        /// <summary>
+        /// Slots in the order the scoreboard used to sort them, with ties broken by slot like the leaderboard does.
+        /// </summary>
+        private static IEnumerable<int> Sort(Score[] scores)
+        {
+            return Enumerable.Range(0, scores.Length)
+                             .OrderByDescending(s => scores[s].Wins)
+                             .ThenByDescending(s => scores[s].Overall)
+                             .ThenBy(s => s);
+        }
+    }
+}
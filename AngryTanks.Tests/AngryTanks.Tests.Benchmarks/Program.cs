@@ -0,0 +1,114 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Linq;
+using System.Text;
+
+namespace AngryTanks.Tests.Benchmarks
+{
+    static class Program
+    {
+        /// <summary>
+        /// The main entry point for the application.
+        /// </summary>
+        static void Main(String[] args)
+        {
+            if (args.Length == 0)
+            {
+                ShowHelp();
+                return;
+            }
+
+            String[] rest = args.Skip(1).ToArray();
+
+            switch (args[0].ToLowerInvariant())
+            {
+                case "world":
+                    WorldMapBenchmark.Run(rest);
+                    break;
+
+                case "replay":
+                    ReplayBenchmark.Run(rest);
+                    break;
+
+                case "soak":
+                    SoakBenchmark.Run(rest);
+                    break;
+
+                case "channels":
+                    ChannelBenchmark.Run(rest);
+                    break;
+
+                case "shots":
+                    ShotBenchmark.Run(rest);
+                    break;
+
+                case "variables":
+                    VariableBenchmark.Run(rest);
+                    break;
+
+                case "leaderboard":
+                    LeaderboardBenchmark.Run(rest);
+                    break;
+
+                case "spawns":
+                    SpawnBenchmark.Run(rest);
+                    break;
+
+                case "colliders":
+                    ColliderBenchmark.Run(rest);
+                    break;
+
+                case "grid":
+                    GridBenchmark.Run(rest);
+                    break;
+
+                default:
+                    ShowHelp();
+                    break;
+            }
+        }
+
+        private static void ShowHelp()
+        {
+            Console.WriteLine("Usage: " + AppDomain.CurrentDomain.FriendlyName + " BENCHMARK [OPTIONS]");
+            Console.WriteLine();
+            Console.WriteLine("Benchmarks:");
+            Console.WriteLine("  world        parse and load times of compiled worlds");
+            Console.WriteLine("  replay       runs a server replay through GameKeeper without sockets");
+            Console.WriteLine("  soak         a server and many headless clients over impaired loopback links");
+            Console.WriteLine("  channels     spawn latency while a world transfer is in flight, per traffic class routing");
+            Console.WriteLine("  shots        checks shots end alike on the server and a client, and counts their messages");
+            Console.WriteLine("  variables    typed variable reads against lookups by name, and syncing a batch of changes");
+            Console.WriteLine("  leaderboard  ranking players as scores change against sorting them every time");
+            Console.WriteLine("  spawns       picking spawn points on a dense map full of tanks");
+            Console.WriteLine("  colliders    merging touching map objects and what it saves the broad and narrow phases");
+            Console.WriteLine("  grid         query cost of the collision grid against its resolution");
+            Console.WriteLine();
+            Console.WriteLine("Pass -h to a benchmark to see its options.");
+        }
+
+        /// <summary>
+        /// Runs <paramref name="action"/> once to warm up, then <paramref name="iterations"/> times,
+        /// and prints the mean time per run.
+        /// </summary>
+        /// <returns>Mean time per run, in milliseconds.</returns>
+        public static Double Time(String label, int iterations, Action action)
+        {
+            action();
+
+            Stopwatch stopwatch = Stopwatch.StartNew();
+
+            for (int i = 0; i < iterations; i++)
+                action();
+
+            stopwatch.Stop();
+
+            Double mean = stopwatch.Elapsed.TotalMilliseconds / iterations;
+
+            Console.WriteLine("  {0,-24} {1,12:F4} ms  ({2} runs)", label, mean, iterations);
+
+            return mean;
+        }
+    }
+}
@@ -0,0 +1,350 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Linq;
+using System.Reflection;
+
+using Lidgren.Network;
+using NDesk.Options;
+
+using AngryTanks.Common;
+using AngryTanks.Common.Protocol;
+using AngryTanks.Server;
+
+namespace AngryTanks.Tests.Benchmarks
+{
+    /// <summary>
+    /// Feeds a replay recorded with the server's --record option through a <see cref="GameKeeper"/>
+    /// as fast as it will go, with no sockets involved. This is the regression benchmark for server changes.
+    /// </summary>
+    static class ReplayBenchmark
+    {
+        // NetIncomingMessage can only be made by Lidgren itself, so we fill one in the same way its unit tests do
+        private static readonly FieldInfo DataField =
+            typeof(NetIncomingMessage).GetField("m_data", BindingFlags.NonPublic | BindingFlags.Instance);
+        private static readonly FieldInfo BitLengthField =
+            typeof(NetIncomingMessage).GetField("m_bitLength", BindingFlags.NonPublic | BindingFlags.Instance);
+
+        public static void Run(String[] args)
+        {
+            String replayPath = null;
+            String worldFilePath = null;
+            String worldCachePath = "WorldCache";
+            int overheadRuns = 0;
+            bool showHelp = false;
+
+            OptionSet p = new OptionSet()
+            {
+                {
+                    "r|replay=",
+                    "the replay to run",
+                    (String v) => replayPath = v
+                },
+                {
+                    "w|world=",
+                    "the .bzw the replay was recorded on, otherwise it's looked up in the world cache",
+                    (String v) => worldFilePath = v
+                },
+                {
+                    "c|world-cache=",
+                    "the directory compiled worlds are cached in",
+                    (String v) => worldCachePath = v
+                },
+                {
+                    "o|overhead=",
+                    "instead replays this many times with the tick profiler off and on, and compares them",
+                    (int v) => overheadRuns = v
+                },
+                {
+                    "h|?|help",
+                    "shows this message and exits",
+                    v => showHelp = v != null
+                },
+            };
+
+            try
+            {
+                p.Parse(args);
+
+                if (replayPath == null && !showHelp)
+                    throw new OptionException("Missing required replay option", "-r|--replay");
+            }
+            catch (OptionException e)
+            {
+                Console.WriteLine(e.Message);
+                showHelp = true;
+            }
+
+            if (showHelp)
+            {
+                p.WriteOptionDescriptions(Console.Out);
+                return;
+            }
+
+            WorldMap world;
+
+            using (ReplayReader reader = new ReplayReader(replayPath))
+                world = LoadWorld(reader.WorldHash, worldFilePath, worldCachePath);
+
+            if (overheadRuns > 0)
+            {
+                MeasureProfilerOverhead(replayPath, world, overheadRuns);
+                return;
+            }
+
+            using (ReplayReader reader = new ReplayReader(replayPath))
+                Replay(reader, CreateGameKeeper(world));
+        }
+
+        private static GameKeeper CreateGameKeeper(WorldMap world)
+        {
+            // never started, so nothing is ever sent anywhere
+            NetServer server = new NetServer(new NetPeerConfiguration("AngryTanks"));
+
+            return new GameKeeper(server, world);
+        }
+
+        private static WorldMap LoadWorld(Byte[] hash, String worldFilePath, String worldCachePath)
+        {
+            if (worldFilePath != null)
+                return WorldMap.Compile(worldFilePath, worldCachePath);
+
+            WorldMap world = WorldMap.LoadCached(worldCachePath, hash);
+
+            if (world != null)
+                return world;
+
+            // the server doesn't look at the world yet, so an empty one does just as well
+            Console.WriteLine("World {0} not found, replaying on an empty world", WorldMap.HashToString(hash));
+            return new WorldMap("Replay", 800, new List<MapObject>(), hash);
+        }
+
+        private static void Replay(ReplayReader reader, GameKeeper gameKeeper)
+        {
+            // recorded slots to the players they became in this run
+            Dictionary<Byte, Player> players = new Dictionary<Byte, Player>();
+
+            NetIncomingMessage msg = (NetIncomingMessage)Activator.CreateInstance(typeof(NetIncomingMessage), true);
+
+            // time spent and counts per message type, and for updates
+            Int64[] messageTicks = new Int64[256];
+            Int32[] messageCounts = new Int32[256];
+            Int64 updateTicks = 0;
+            Int32 updateCount = 0;
+
+            // approximate, we only see what GC.GetTotalMemory sees between collections
+            Int64 allocated = 0;
+            Int32 startCollections = GC.CollectionCount(0);
+
+            Stopwatch total = Stopwatch.StartNew();
+            Stopwatch one = new Stopwatch();
+
+            ReplayRecord record;
+
+            while ((record = reader.Read()) != null)
+            {
+                Player player;
+                Int64 memoryBefore = GC.GetTotalMemory(false);
+
+                switch (record.Type)
+                {
+                    case ReplayRecordType.Join:
+                        player = gameKeeper.AddPlayer(null, record.PlayerInfo);
+
+                        if (player != null)
+                            players[record.Slot] = player;
+
+                        break;
+
+                    case ReplayRecordType.Leave:
+                        if (players.TryGetValue(record.Slot, out player))
+                        {
+                            gameKeeper.RemovePlayer(player, record.Reason);
+                            players.Remove(record.Slot);
+                        }
+
+                        break;
+
+                    case ReplayRecordType.Data:
+                        {
+                            if (record.LengthBits < 8 || !players.TryGetValue(record.Slot, out player))
+                                break;
+
+                            Fill(msg, record.Payload, record.LengthBits);
+
+                            Byte messageType = record.Payload[0];
+
+                            memoryBefore = GC.GetTotalMemory(false);
+
+                            one.Reset();
+                            one.Start();
+                            gameKeeper.HandleIncomingData(player, msg);
+                            one.Stop();
+
+                            messageTicks[messageType] += one.ElapsedTicks;
+                            messageCounts[messageType]++;
+
+                            break;
+                        }
+
+                    case ReplayRecordType.Tick:
+                        one.Reset();
+                        one.Start();
+                        gameKeeper.Update(record.Time);
+                        one.Stop();
+
+                        updateTicks += one.ElapsedTicks;
+                        updateCount++;
+
+                        break;
+                }
+
+                Int64 memoryAfter = GC.GetTotalMemory(false);
+
+                if (memoryAfter > memoryBefore)
+                    allocated += memoryAfter - memoryBefore;
+            }
+
+            total.Stop();
+
+            Double seconds = total.Elapsed.TotalSeconds;
+
+            Console.WriteLine("Replayed {0} ticks in {1:F3} s: {2:F0} ticks/sec",
+                              updateCount, seconds, updateCount / seconds);
+            Console.WriteLine("Allocated about {0:F1} MB ({1:F1} MB/s), {2} gen 0 collections",
+                              allocated / 1048576.0, allocated / 1048576.0 / seconds,
+                              GC.CollectionCount(0) - startCollections);
+            Console.WriteLine();
+            Console.WriteLine("  {0,-24} {1,10} {2,12} {3,12}", "", "count", "total ms", "mean us");
+
+            for (int i = 0; i < messageCounts.Length; i++)
+            {
+                if (messageCounts[i] > 0)
+                    PrintCost(((MessageType)i).ToString(), messageCounts[i], messageTicks[i]);
+            }
+
+            PrintCost("GameKeeper.Update", updateCount, updateTicks);
+        }
+
+        /// <summary>
+        /// Replays with nothing but the <see cref="TickProfiler"/> measuring, in pairs of one run with it off and one
+        /// with it on, and takes the median difference of the pairs.
+        /// </summary>
+        /// <remarks>
+        /// A replay only takes tens of milliseconds, so a single hiccup can outweigh the profiler. Comparing each run
+        /// with its neighbour rather than the best of each cancels out drift, and the median ignores the hiccups.
+        /// </remarks>
+        private static void MeasureProfilerOverhead(String replayPath, WorldMap world, int runs)
+        {
+            Double bestOff = Double.MaxValue, bestOn = Double.MaxValue;
+            List<Double> overheads = new List<Double>(runs);
+
+            for (int run = 0; run < runs; run++)
+            {
+                Double off, on;
+
+                // take turns going first so neither side always gets the warmer caches
+                if (run % 2 == 0)
+                {
+                    off = ReplayPlain(replayPath, world, false);
+                    on  = ReplayPlain(replayPath, world, true);
+                }
+                else
+                {
+                    on  = ReplayPlain(replayPath, world, true);
+                    off = ReplayPlain(replayPath, world, false);
+                }
+
+                bestOff = Math.Min(bestOff, off);
+                bestOn  = Math.Min(bestOn, on);
+                overheads.Add((on - off) / off);
+            }
+
+            overheads.Sort();
+
+            Double overhead = overheads[runs / 2];
+
+            Console.WriteLine("Profiler off: {0:F3} s, on: {1:F3} s, best of {2}", bestOff, bestOn, runs);
+            Console.WriteLine("Tick profiler overhead: {0:P2}, {1:P2} to {2:P2} between the quartiles, median of {3} pairs ({4})",
+                              overhead, overheads[runs / 4], overheads[runs * 3 / 4], runs,
+                              overhead < 0.01 ? "under 1%" : "OVER 1%");
+        }
+
+        private static Double ReplayPlain(String replayPath, WorldMap world, bool profile)
+        {
+            GameKeeper gameKeeper = CreateGameKeeper(world);
+            gameKeeper.Profiler.Enabled = profile;
+
+            Dictionary<Byte, Player> players = new Dictionary<Byte, Player>();
+            NetIncomingMessage msg = (NetIncomingMessage)Activator.CreateInstance(typeof(NetIncomingMessage), true);
+
+            using (ReplayReader reader = new ReplayReader(replayPath))
+            {
+                // don't let the last run's garbage be collected on this one's time
+                GC.Collect();
+                GC.WaitForPendingFinalizers();
+
+                Stopwatch total = Stopwatch.StartNew();
+                ReplayRecord record;
+
+                while ((record = reader.Read()) != null)
+                {
+                    Player player;
+
+                    switch (record.Type)
+                    {
+                        case ReplayRecordType.Join:
+                            player = gameKeeper.AddPlayer(null, record.PlayerInfo);
+
+                            if (player != null)
+                                players[record.Slot] = player;
+
+                            break;
+
+                        case ReplayRecordType.Leave:
+                            if (players.TryGetValue(record.Slot, out player))
+                            {
+                                gameKeeper.RemovePlayer(player, record.Reason);
+                                players.Remove(record.Slot);
+                            }
+
+                            break;
+
+                        case ReplayRecordType.Data:
+                            if (record.LengthBits < 8 || !players.TryGetValue(record.Slot, out player))
+                                break;
+
+                            Fill(msg, record.Payload, record.LengthBits);
+
+                            gameKeeper.HandleIncomingData(player, msg);
+
+                            break;
+
+                        case ReplayRecordType.Tick:
+                            gameKeeper.Update(record.Time);
+                            break;
+                    }
+                }
+
+                return total.Elapsed.TotalSeconds;
+            }
+        }
+
+        /// <summary>
+        /// Makes <paramref name="msg"/> read back <paramref name="lengthBits"/> bits of <paramref name="payload"/> from the start.
+        /// </summary>
+        internal static void Fill(NetIncomingMessage msg, Byte[] payload, Int32 lengthBits)
+        {
+            DataField.SetValue(msg, payload);
+            BitLengthField.SetValue(msg, lengthBits);
+            msg.Position = 0;
+        }
+
+        private static void PrintCost(String name, Int32 count, Int64 ticks)
+        {
+            Double milliseconds = ticks * 1000.0 / Stopwatch.Frequency;
+
+            Console.WriteLine("  {0,-24} {1,10} {2,12:F3} {3,12:F3}", name, count, milliseconds, milliseconds * 1000 / count);
+        }
+    }
+}
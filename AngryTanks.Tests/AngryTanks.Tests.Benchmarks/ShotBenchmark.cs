@@ -0,0 +1,337 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using Microsoft.Xna.Framework;
+
+using Lidgren.Network;
+using NDesk.Options;
+
+using AngryTanks.Common;
+using AngryTanks.Common.Messages;
+using AngryTanks.Common.Protocol;
+using AngryTanks.Server;
+
+namespace AngryTanks.Tests.Benchmarks
+{
+    /// <summary>
+    /// Fires shots at a <see cref="GameKeeper"/> on a synthetic world with no sockets involved, and flies the same shots in a
+    /// headless client at uneven frame rates. Every shot must end at the same tick and place on both, and every hit the
+    /// client reports on a tank must be accepted. Then it counts the reliable shot messages sent against what
+    /// reporting every wall hit used to cost.
+    /// </summary>
+    /// <remarks>
+    /// Time is simulated, so this runs as fast as it can and the same seed always gives the same run.
+    /// </remarks>
+    static class ShotBenchmark
+    {
+        private static readonly Double TickInterval = 0.01;
+
+        // a slot is only reused once its shot is long gone, on the client and in the server's hit window
+        private static readonly Double SlotReuseSeconds = 5.0;
+
+        private class FiredShot
+        {
+            public Byte Slot;
+            public Double FiredAt;
+            public ShotPath ShooterPath, ClientPath, ServerPath;
+
+            // what the headless client saw
+            public bool Ended, HitTank;
+            public Double EndedAt;
+            public Vector2 EndedPosition;
+        }
+
+        private struct Delivery
+        {
+            public Double At;
+            public Player From;
+            public Byte[] Data;
+            public Int32 LengthBits;
+            public FiredShot Shot;
+        }
+
+        public static void Run(String[] args)
+        {
+            int shotCount = 2000;
+            int objectCount = 2000;
+            int playerCount = 8;
+            int tankCount = 40;
+            Double latency = 0.05;
+            int seed = 5150;
+            bool showHelp = false;
+
+            OptionSet p = new OptionSet()
+            {
+                {
+                    "n|shots=",
+                    "number of shots to fire (default 2000)",
+                    (int v) => shotCount = v
+                },
+                {
+                    "o|objects=",
+                    "number of objects in the synthetic world (default 2000)",
+                    (int v) => objectCount = v
+                },
+                {
+                    "p|players=",
+                    "players in the game, for counting messages (default 8)",
+                    (int v) => playerCount = v
+                },
+                {
+                    "k|tanks=",
+                    "tanks standing around to be hit (default 40)",
+                    (int v) => tankCount = v
+                },
+                {
+                    "l|latency=",
+                    "one way latency in seconds (default 0.05)",
+                    (Double v) => latency = v
+                },
+                {
+                    "s|seed=",
+                    "seed for the world and the shots",
+                    (int v) => seed = v
+                },
+                {
+                    "h|?|help",
+                    "shows this message and exits",
+                    v => showHelp = v != null
+                },
+            };
+
+            try
+            {
+                p.Parse(args);
+            }
+            catch (OptionException e)
+            {
+                Console.WriteLine(e.Message);
+                showHelp = true;
+            }
+
+            if (showHelp)
+            {
+                p.WriteOptionDescriptions(Console.Out);
+                return;
+            }
+
+            // the server compiles the world, the client loads what it was sent
+            WorldMap serverMap = WorldMap.Parse(WorldMapBenchmark.Synthesize(objectCount, seed));
+            WorldMap clientMap = WorldMap.FromBytes(serverMap.GetBytes());
+            VariableDatabase clientVariables = new VariableDatabase();
+
+            Console.WriteLine("Firing {0} shots on a {1} object world, {2} ms latency (seed {3})",
+                              shotCount, serverMap.Objects.Count, latency * 1000, seed);
+
+            Random random = new Random(seed);
+
+            Single tankSize = clientVariables.TankLength.Value;
+            List<Vector2> tanks = new List<Vector2>(tankCount);
+
+            for (int i = 0; i < tankCount; i++)
+                tanks.Add(RandomPosition(random, serverMap.Size));
+
+            // never started, so nothing is ever sent anywhere
+            NetServer server = new NetServer(new NetPeerConfiguration("AngryTanks"));
+            GameKeeper gameKeeper = new GameKeeper(server, serverMap);
+
+            Player shooter = gameKeeper.AddPlayer(null, new PlayerInformation(ProtocolInformation.DummySlot, "shooter", "", TeamType.RedTeam));
+            Player victim = gameKeeper.AddPlayer(null, new PlayerInformation(ProtocolInformation.DummySlot, "victim", "", TeamType.BlueTeam));
+
+            NetIncomingMessage incoming = (NetIncomingMessage)Activator.CreateInstance(typeof(NetIncomingMessage), true);
+
+            List<FiredShot> fired = new List<FiredShot>(shotCount);
+            List<Delivery> toServer = new List<Delivery>();
+            int hitsReported = 0, hitsAccepted = 0;
+
+            Double fireInterval = SlotReuseSeconds / ProtocolInformation.MaxShots;
+            Double time = 1000;
+            Double nextTick = time;
+            Double nextFire = time;
+
+            while (fired.Count < shotCount || fired.Exists(s => !s.Ended) || toServer.Count > 0)
+            {
+                // a client frame of uneven length
+                time += 0.005 + random.NextDouble() * 0.025;
+
+                // the server ticks at its own pace, handling whatever has arrived
+                for (; nextTick <= time; nextTick += TickInterval)
+                {
+                    List<Delivery> due = toServer.FindAll(d => d.At <= nextTick);
+                    toServer.RemoveAll(d => d.At <= nextTick);
+
+                    foreach (Delivery delivery in due)
+                    {
+                        ReplayBenchmark.Fill(incoming, delivery.Data, delivery.LengthBits);
+
+                        if (delivery.From == shooter)
+                        {
+                            gameKeeper.HandleIncomingData(shooter, incoming);
+                            delivery.Shot.ServerPath = shooter.GetShot(delivery.Shot.Slot);
+                        }
+                        else
+                        {
+                            bool inFlight = shooter.GetShot(delivery.Shot.Slot) != null;
+
+                            gameKeeper.HandleIncomingData(victim, incoming);
+
+                            if (inFlight && shooter.GetShot(delivery.Shot.Slot) == null)
+                                hitsAccepted++;
+                        }
+                    }
+
+                    gameKeeper.Update(DateTime.MinValue + TimeSpan.FromSeconds(nextTick), nextTick);
+                }
+
+                // fire
+                for (; fired.Count < shotCount && nextFire <= time; nextFire += fireInterval)
+                {
+                    FiredShot shot = new FiredShot();
+                    shot.Slot = (Byte)(fired.Count % ProtocolInformation.MaxShots);
+                    shot.FiredAt = time;
+
+                    Vector2 origin = RandomPosition(random, serverMap.Size);
+                    Single rotation = (Single)(random.NextDouble() * MathHelper.TwoPi);
+                    UInt32 startTick = ShotPath.ToTick(time);
+
+                    // the shooter flies its shot straight away, from the rotation it has before it is quantized
+                    shot.ShooterPath = new ShotPath(clientMap, clientVariables, origin, rotation, startTick);
+
+                    MsgBeginShotPacket packet = new MsgBeginShotPacket(shot.Slot, origin, rotation, startTick);
+                    NetOutgoingMessage message = server.CreateMessage();
+                    message.Write((Byte)packet.MsgType);
+                    packet.Write(message);
+
+                    // everyone else flies what came over the wire
+                    ReplayBenchmark.Fill(incoming, message.PeekDataBuffer(), message.LengthBits);
+                    incoming.ReadByte();
+                    MsgBeginShotPacket received = MsgBeginShotPacket.Read(incoming);
+
+                    shot.ClientPath = new ShotPath(clientMap, clientVariables, received.Position, received.Rotation, received.StartTick);
+
+                    toServer.Add(CreateDelivery(time + latency, shooter, message, shot));
+                    fired.Add(shot);
+                }
+
+                // the headless client, which hears of a shot once it has been to the server and back
+                foreach (FiredShot shot in fired)
+                {
+                    if (shot.Ended || time < shot.FiredAt + 2 * latency)
+                        continue;
+
+                    Double elapsed = shot.ClientPath.GetElapsed(time);
+                    Vector2 position = shot.ClientPath.GetPosition(elapsed);
+
+                    // like Shot.Update, a shot that has reached the end of its path can't hit anything
+                    if (elapsed >= shot.ClientPath.Duration)
+                    {
+                        EndShot(shot, time, position);
+                    }
+                    else if (tanks.Exists(t => Math.Abs(t.X - position.X) <= tankSize / 2 + ShotPath.Radius &&
+                                               Math.Abs(t.Y - position.Y) <= tankSize / 2 + ShotPath.Radius))
+                    {
+                        shot.HitTank = true;
+                        EndShot(shot, time, position);
+
+                        MsgEndShotPacket packet = new MsgEndShotPacket(shooter.Slot, shot.Slot, false);
+                        NetOutgoingMessage message = server.CreateMessage();
+                        message.Write((Byte)packet.MsgType);
+                        packet.Write(message);
+
+                        toServer.Add(CreateDelivery(time + latency, victim, message, shot));
+                        hitsReported++;
+                    }
+                }
+            }
+
+            // run the server on until every hit window has closed
+            for (Double end = time + SlotReuseSeconds; nextTick <= end; nextTick += TickInterval)
+                gameKeeper.Update(DateTime.MinValue + TimeSpan.FromSeconds(nextTick), nextTick);
+
+            int walls = 0;
+
+            foreach (FiredShot shot in fired)
+            {
+                Check(shot, shot.ServerPath != null, "never reached the server's shot table");
+                Check(shot, SamePath(shot.ShooterPath, shot.ClientPath), "flew differently for the shooter than for everyone else");
+                Check(shot, SamePath(shot.ServerPath, shot.ClientPath), "ended differently on the server than on the client");
+
+                if (!shot.HitTank)
+                {
+                    Check(shot, shot.EndedPosition == shot.ClientPath.EndPosition, "client stopped it short of where its path ends");
+                    Check(shot, ShotPath.TicksSince(shot.ClientPath.EndTick, ShotPath.ToTick(shot.EndedAt)) >= -1, "client ended it early");
+                }
+
+                if (!shot.HitTank && shot.ClientPath.HitsWall)
+                    walls++;
+            }
+
+            for (Byte slot = 0; slot < ProtocolInformation.MaxShots; slot++)
+            {
+                if (shooter.GetShot(slot) != null)
+                    throw new InvalidOperationException(String.Format("Shot slot {0} never left the server's shot table", slot));
+            }
+
+            if (hitsAccepted != hitsReported)
+                throw new InvalidOperationException(String.Format("Server accepted {0} of {1} hits on tanks", hitsAccepted, hitsReported));
+
+            Console.WriteLine("All {0} shots ended alike: {1} on walls, {2} on tanks, {3} out of range or time",
+                              fired.Count, walls, hitsReported, fired.Count - walls - hitsReported);
+            Console.WriteLine();
+
+            // each message is sent once to the server and relayed to everyone else
+            int fanOut = playerCount;
+            int before = (fired.Count + walls + hitsReported) * fanOut;
+            int after = (fired.Count + hitsReported) * fanOut;
+
+            Console.WriteLine("Reliable shot messages with {0} players:", playerCount);
+            Console.WriteLine("  {0,-32} {1,10}", "begin, wall hits and tank hits", before);
+            Console.WriteLine("  {0,-32} {1,10}", "begin and tank hits", after);
+            Console.WriteLine("  {0,-32} {1,10:P1}", "saved", 1 - (Double)after / before);
+            Console.WriteLine();
+
+            int pathIndex = 0;
+            Program.Time("ShotPath on this world", 10000, () =>
+            {
+                FiredShot shot = fired[pathIndex++ % fired.Count];
+                new ShotPath(serverMap, clientVariables, shot.ClientPath.Origin, shot.ClientPath.Rotation, shot.ClientPath.StartTick);
+            });
+        }
+
+        private static Vector2 RandomPosition(Random random, Single worldSize)
+        {
+            return new Vector2((Single)((random.NextDouble() - 0.5) * (worldSize - 20)),
+                               (Single)((random.NextDouble() - 0.5) * (worldSize - 20)));
+        }
+
+        private static Delivery CreateDelivery(Double at, Player from, NetOutgoingMessage message, FiredShot shot)
+        {
+            Delivery delivery = new Delivery();
+            delivery.At = at;
+            delivery.From = from;
+            delivery.Data = message.PeekDataBuffer();
+            delivery.LengthBits = message.LengthBits;
+            delivery.Shot = shot;
+            return delivery;
+        }
+
+        private static void EndShot(FiredShot shot, Double time, Vector2 position)
+        {
+            shot.Ended = true;
+            shot.EndedAt = time;
+            shot.EndedPosition = position;
+        }
+
+        private static bool SamePath(ShotPath a, ShotPath b)
+        {
+            return a.StartTick == b.StartTick && a.EndTick == b.EndTick && a.HitsWall == b.HitsWall &&
+                   a.Distance == b.Distance && a.EndPosition == b.EndPosition;
+        }
+
+        private static void Check(FiredShot shot, bool condition, String problem)
+        {
+            if (!condition)
+                throw new InvalidOperationException(String.Format("Shot in slot {0} fired at {1:F2} s {2}", shot.Slot, shot.FiredAt, problem));
+        }
+    }
+}
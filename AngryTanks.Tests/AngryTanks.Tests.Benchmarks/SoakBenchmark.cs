@@ -0,0 +1,327 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Linq;
+using System.Net;
+using System.Threading;
+
+using Lidgren.Network;
+using NDesk.Options;
+
+using AngryTanks.Common;
+using AngryTanks.Common.Protocol;
+using AngryTanks.Server;
+
+namespace AngryTanks.Tests.Benchmarks
+{
+    /// <summary>
+    /// Runs a server and many headless clients in this one process over loopback, with every link impaired
+    /// by a seeded, scripted network profile, and reports delivery latency, bandwidth and tick times.
+    /// This is the benchmark for protocol changes, it needs no real network and runs the same way every time.
+    /// </summary>
+    /// <remarks>
+    /// The impairments are Lidgren's latency simulation, which only exists in DEBUG builds.
+    /// Each link draws from its own seed, so a given profile and seed give the same losses, delays and
+    /// duplicates for the same packets. Which packets are sent still depends on thread timing.
+    /// </remarks>
+    static class SoakBenchmark
+    {
+        private static readonly TimeSpan UpdateInterval = TimeSpan.FromMilliseconds(10);
+
+        private static readonly Double[] Quantiles = { 0.5, 0.9, 0.99, 0.999 };
+
+        public static void Run(String[] args)
+        {
+            int clientCount = 32;
+            Double duration = 30;
+            String profileName = "broadband";
+            int seed = 5150;
+            String worldFilePath = null;
+            int objectCount = 1000;
+            bool showHelp = false;
+
+            OptionSet p = new OptionSet()
+            {
+                {
+                    "c|clients=",
+                    "number of headless clients (default 32)",
+                    (int v) => clientCount = v
+                },
+                {
+                    "d|duration=",
+                    "seconds to run for once everyone has had a chance to join (default 30)",
+                    (Double v) => duration = v
+                },
+                {
+                    "p|profile=",
+                    "network profile of every link: " + String.Join(", ", ProfileNames) + " (default broadband)",
+                    (String v) => profileName = v
+                },
+                {
+                    "s|seed=",
+                    "seed for the impairments and the synthetic world",
+                    (int v) => seed = v
+                },
+                {
+                    "w|world=",
+                    "a .bzw file to serve instead of a synthetic world",
+                    (String v) => worldFilePath = v
+                },
+                {
+                    "n|objects=",
+                    "number of objects in the synthetic world (default 1000)",
+                    (int v) => objectCount = v
+                },
+                {
+                    "h|?|help",
+                    "shows this message and exits",
+                    v => showHelp = v != null
+                },
+            };
+
+            try
+            {
+                p.Parse(args);
+
+                if (!ProfileNames.Contains(profileName))
+                    throw new OptionException("Unknown profile " + profileName, "-p|--profile");
+            }
+            catch (OptionException e)
+            {
+                Console.WriteLine(e.Message);
+                showHelp = true;
+            }
+
+            if (showHelp)
+            {
+                p.WriteOptionDescriptions(Console.Out);
+                return;
+            }
+
+#if DEBUG
+            WorldMap world = worldFilePath != null
+                ? WorldMap.Compile(worldFilePath, null)
+                : WorldMap.Parse(WorldMapBenchmark.Synthesize(objectCount, seed));
+
+            Soak(world, clientCount, duration, profileName, seed);
+#else
+            Console.WriteLine("The soak benchmark needs Lidgren's latency simulation, which is only in DEBUG builds");
+#endif
+        }
+
+        #region Profiles
+
+        private static readonly String[] ProfileNames = { "lan", "broadband", "wifi", "mobile", "outage" };
+
+        /// <summary>
+        /// Builds the named network profile, the same for both directions of a link.
+        /// </summary>
+        private static NetImpairmentTimeline CreateProfile(String name)
+        {
+            NetImpairmentProfile broadband = new NetImpairmentProfile();
+            broadband.MinimumLatency = 0.02f;
+            broadband.RandomLatency = 0.01f;
+            broadband.Loss = 0.005f;
+            broadband.BandwidthBytesPerSecond = 1000000;
+
+            switch (name)
+            {
+                case "lan":
+                    return new NetImpairmentTimeline(new NetImpairmentProfile());
+
+                case "broadband":
+                    return new NetImpairmentTimeline(broadband);
+
+                case "wifi":
+                    {
+                        // short bursts of heavy loss, and enough jitter to reorder
+                        NetImpairmentProfile wifi = new NetImpairmentProfile();
+                        wifi.MinimumLatency = 0.015f;
+                        wifi.RandomLatency = 0.03f;
+                        wifi.Loss = 0.005f;
+                        wifi.BurstLoss = 0.3f;
+                        wifi.BurstStartChance = 0.01f;
+                        wifi.BurstEndChance = 0.2f;
+                        wifi.ReorderChance = 0.01f;
+                        wifi.ReorderDelay = 0.02f;
+                        wifi.DuplicateChance = 0.005f;
+                        return new NetImpairmentTimeline(wifi);
+                    }
+
+                case "mobile":
+                    {
+                        // slow, deep-buffered and lossy
+                        NetImpairmentProfile mobile = new NetImpairmentProfile();
+                        mobile.MinimumLatency = 0.06f;
+                        mobile.RandomLatency = 0.04f;
+                        mobile.Loss = 0.01f;
+                        mobile.BurstLoss = 0.5f;
+                        mobile.BurstStartChance = 0.005f;
+                        mobile.BurstEndChance = 0.1f;
+                        mobile.ReorderChance = 0.02f;
+                        mobile.ReorderDelay = 0.05f;
+                        mobile.DuplicateChance = 0.01f;
+                        mobile.BandwidthBytesPerSecond = 128 * 1024;
+                        mobile.QueueBytes = 32 * 1024;
+                        return new NetImpairmentTimeline(mobile);
+                    }
+
+                case "outage":
+                    {
+                        // broadband that drops everything for three seconds, then congests while it recovers
+                        NetImpairmentProfile dead = broadband.Clone();
+                        dead.Loss = 1.0f;
+
+                        NetImpairmentProfile congested = broadband.Clone();
+                        congested.BandwidthBytesPerSecond = 64 * 1024;
+                        congested.QueueBytes = 16 * 1024;
+
+                        return new NetImpairmentTimeline(broadband)
+                            .Add(10, dead)
+                            .Add(13, congested)
+                            .Add(18, broadband);
+                    }
+
+                default:
+                    throw new ArgumentException("unknown profile " + name, "name");
+            }
+        }
+
+        #endregion
+
+#if DEBUG
+        private static void Soak(WorldMap world, int clientCount, Double duration, String profileName, int seed)
+        {
+            NetPeerConfiguration config = new NetPeerConfiguration("AngryTanks");
+
+            // the same as the real server
+            config.EnableMessageType(NetIncomingMessageType.ConnectionApproval);
+            config.EnableMessageType(NetIncomingMessageType.ConnectionLatencyUpdated);
+            config.EnableBatchedSocketIO = true;
+
+            NetServer server = new NetServer(config);
+            server.Start();
+
+            GameKeeper gameKeeper = new GameKeeper(server, world);
+            IPEndPoint serverEndpoint = new IPEndPoint(IPAddress.Loopback, server.Port);
+
+            LatencyHistogram updateLatency = new LatencyHistogram();
+            LatencyHistogram eventLatency = new LatencyHistogram();
+            LatencyHistogram joinTime = new LatencyHistogram();
+            LatencyHistogram tickTime = new LatencyHistogram();
+            LatencyHistogram tickInterval = new LatencyHistogram();
+
+            SoakClient[] clientsBySlot = new SoakClient[256];
+            List<SoakClient> clients = new List<SoakClient>(clientCount);
+
+            for (int i = 0; i < clientCount; i++)
+            {
+                SoakClient client = new SoakClient(i, clientsBySlot, updateLatency, eventLatency, joinTime);
+
+                // each direction of each link gets its own draws
+                NetImpairmentTimeline profile = CreateProfile(profileName);
+                IPEndPoint clientEndpoint = new IPEndPoint(IPAddress.Loopback, client.Client.Port);
+
+                server.SetSimulatedImpairment(clientEndpoint, profile, seed + 2 * i);
+                client.Client.SetSimulatedImpairment(serverEndpoint, profile, seed + 2 * i + 1);
+
+                clients.Add(client);
+            }
+
+            Console.WriteLine("Soaking {0} clients on profile {1} (seed {2}), world \"{3}\" ({4} objects, {5} bytes compressed)",
+                              clientCount, profileName, seed, world.Name, world.Objects.Count, gameKeeper.CompressedWorld.Length);
+
+            // joins are spread over the first second, like a server filling up
+            Double joinWindow = 1.0;
+            Double start = NetTime.Now;
+            Double end = start + joinWindow + duration;
+            Double lastTick = start;
+            Double nextTick = start;
+            int connected = 0;
+
+            Int32 sentBefore = server.Statistics.SentBytes;
+            Int32 receivedBefore = server.Statistics.ReceivedBytes;
+
+            Stopwatch one = new Stopwatch();
+
+            NetIncomingMessage msg;
+
+            while (NetTime.Now < end)
+            {
+                Double now = NetTime.Now;
+
+                while (connected < clientCount && now >= start + joinWindow * connected / clientCount)
+                    clients[connected++].Connect(serverEndpoint, now);
+
+                // the server's main loop, as in Program.AppLoop
+                while ((msg = server.ReadMessage()) != null)
+                {
+                    Int64 receiveStart = gameKeeper.Profiler.Start();
+
+                    gameKeeper.HandleMessage(msg);
+                    server.Recycle(msg);
+
+                    gameKeeper.Profiler.EndPhase(TickPhase.Receive, receiveStart);
+                }
+
+                if (now >= nextTick)
+                {
+                    tickInterval.Record((Int64)((now - lastTick) * 1000000));
+                    lastTick = now;
+                    nextTick += UpdateInterval.TotalSeconds;
+
+                    // don't try to catch up on ticks we've fallen behind on
+                    if (nextTick < now)
+                        nextTick = now;
+
+                    one.Reset();
+                    one.Start();
+                    gameKeeper.Update(DateTime.Now);
+                    one.Stop();
+
+                    tickTime.Record((Int64)(one.Elapsed.TotalMilliseconds * 1000));
+                }
+
+                foreach (SoakClient client in clients)
+                    client.Update(NetTime.Now);
+
+                Thread.Sleep(1);
+            }
+
+            Double seconds = NetTime.Now - start;
+
+            Int64 serverSent = server.Statistics.SentBytes - sentBefore;
+            Int64 serverReceived = server.Statistics.ReceivedBytes - receivedBefore;
+            Int64 clientsReceived = clients.Sum(c => (Int64)c.Client.Statistics.ReceivedBytes);
+            Int64 clientsSent = clients.Sum(c => (Int64)c.Client.Statistics.SentBytes);
+
+            Console.WriteLine("{0} of {1} clients joined over {2:F1} s", clients.Count(c => c.Joined), clientCount, seconds);
+            Console.WriteLine();
+            Console.WriteLine("  {0,-20} {1,10} {2,10} {3,10} {4,10} {5,10} {6,10}", "ms", "count", "p50", "p90", "p99", "p99.9", "max");
+            PrintDistribution("join", joinTime);
+            PrintDistribution("update latency", updateLatency);
+            PrintDistribution("event latency", eventLatency);
+            PrintDistribution("tick time", tickTime);
+            PrintDistribution("tick interval", tickInterval);
+            Console.WriteLine();
+            Console.WriteLine("  server sent {0:F1} KB/s, received {1:F1} KB/s", serverSent / 1024.0 / seconds, serverReceived / 1024.0 / seconds);
+            Console.WriteLine("  each client received {0:F1} KB/s, sent {1:F1} KB/s on average",
+                              clientsReceived / 1024.0 / seconds / clientCount, clientsSent / 1024.0 / seconds / clientCount);
+
+            foreach (SoakClient client in clients)
+                client.Client.Shutdown("soak over");
+
+            server.Shutdown("soak over");
+        }
+
+        private static void PrintDistribution(String name, LatencyHistogram histogram)
+        {
+            Int64[] values = histogram.GetQuantiles(Quantiles);
+
+            Console.WriteLine("  {0,-20} {1,10} {2,10:F2} {3,10:F2} {4,10:F2} {5,10:F2} {6,10:F2}",
+                              name, histogram.Count, values[0] / 1000.0, values[1] / 1000.0, values[2] / 1000.0, values[3] / 1000.0,
+                              histogram.Max / 1000.0);
+        }
+#endif
+    }
+}
@@ -0,0 +1,246 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Net;
+
+using Microsoft.Xna.Framework;
+using Lidgren.Network;
+
+using AngryTanks.Common;
+using AngryTanks.Common.Messages;
+using AngryTanks.Common.Protocol;
+using AngryTanks.Server;
+
+namespace AngryTanks.Tests.Benchmarks
+{
+    /// <summary>
+    /// A headless client for <see cref="SoakBenchmark"/>: joins like the real one, downloading the world,
+    /// then drives its tank in a circle and shoots now and then.
+    /// </summary>
+    /// <remarks>
+    /// Everything runs in one process, so delivery latency is measured by looking up when the sending client
+    /// sent what arrived. Updates carry a sequence number in their rotation for that, shots in their start tick.
+    /// </remarks>
+    class SoakClient
+    {
+        // how many sends we remember the time of, per kind
+        private const int HistoryLength = 1024;
+
+        private static readonly TimeSpan UpdateInterval = TimeSpan.FromMilliseconds(1000 / 45);
+        private static readonly TimeSpan ShotInterval = TimeSpan.FromSeconds(2);
+
+        private readonly int index;
+        private readonly NetClient client;
+
+        // every client in the run by slot, so we can find out when something we got was sent
+        private readonly SoakClient[] clientsBySlot;
+
+        private readonly LatencyHistogram updateLatency, eventLatency, joinTime;
+
+        private Byte slot = ProtocolInformation.DummySlot;
+        private double connectTime;
+        private UInt32 worldBytesExpected, worldBytesReceived;
+        private bool haveWorld, haveSnapshot, joined;
+
+        private double nextUpdate, nextShot;
+        private int updatesSent, shotsSent;
+        private readonly double[] updateSentAt = new double[HistoryLength];
+        private readonly double[] shotSentAt = new double[HistoryLength];
+
+        public SoakClient(int index, SoakClient[] clientsBySlot,
+                          LatencyHistogram updateLatency, LatencyHistogram eventLatency, LatencyHistogram joinTime)
+        {
+            this.index = index;
+            this.clientsBySlot = clientsBySlot;
+            this.updateLatency = updateLatency;
+            this.eventLatency = eventLatency;
+            this.joinTime = joinTime;
+
+            NetPeerConfiguration config = new NetPeerConfiguration("AngryTanks");
+            config.EnableMessageType(NetIncomingMessageType.ConnectionApproval);
+            config.EnableMessageType(NetIncomingMessageType.ConnectionLatencyUpdated);
+
+            client = new NetClient(config);
+            client.Start();
+        }
+
+        public NetClient Client
+        {
+            get { return client; }
+        }
+
+        public bool Joined
+        {
+            get { return joined; }
+        }
+
+        public void Connect(IPEndPoint server, double now)
+        {
+            NetOutgoingMessage hailMessage = client.CreateMessage();
+
+            hailMessage.Write((Byte)MessageType.MsgEnter);
+            hailMessage.Write(ProtocolInformation.ProtocolVersion);
+            hailMessage.Write((Byte)TeamType.AutomaticTeam);
+            hailMessage.Write("soak" + index);
+            hailMessage.Write("");
+
+            connectTime = now;
+            client.Connect(server, hailMessage);
+        }
+
+        /// <summary>
+        /// Reads everything that has arrived, then sends whatever is due.
+        /// </summary>
+        /// <param name="now"><see cref="NetTime.Now"/>.</param>
+        public void Update(double now)
+        {
+            NetIncomingMessage msg;
+
+            while ((msg = client.ReadMessage()) != null)
+            {
+                if (msg.MessageType == NetIncomingMessageType.StatusChanged)
+                {
+                    // ready for initial state, the same as the real client
+                    if ((NetConnectionStatus)msg.ReadByte() == NetConnectionStatus.Connected)
+                        Send(CreateMessage(MessageType.MsgState), MessageType.MsgState);
+                }
+                else if (msg.MessageType == NetIncomingMessageType.Data)
+                {
+                    HandleData(now, msg);
+                }
+
+                client.Recycle(msg);
+            }
+
+            if (!joined)
+                return;
+
+            if (now >= nextUpdate)
+            {
+                nextUpdate = now + UpdateInterval.TotalSeconds;
+
+                // round in a circle, the rotation is just an id
+                Single angle = (Single)(now * 0.5 + index);
+                Vector2 position = new Vector2((Single)Math.Cos(angle), (Single)Math.Sin(angle)) * 50;
+
+                MsgPlayerClientUpdatePacket packet = new MsgPlayerClientUpdatePacket(position, updatesSent);
+                NetOutgoingMessage updateMessage = CreateMessage(packet.MsgType);
+                packet.Write(updateMessage);
+
+                updateSentAt[updatesSent++ % HistoryLength] = now;
+                Send(updateMessage, packet.MsgType);
+            }
+
+            if (now >= nextShot)
+            {
+                nextShot = now + ShotInterval.TotalSeconds;
+
+                MsgBeginShotPacket packet = new MsgBeginShotPacket((Byte)(shotsSent % 10), Vector2.Zero, 0, (UInt32)shotsSent);
+                NetOutgoingMessage shotMessage = CreateMessage(packet.MsgType);
+                packet.Write(shotMessage);
+
+                shotSentAt[shotsSent++ % HistoryLength] = now;
+                Send(shotMessage, packet.MsgType);
+            }
+        }
+
+        private void HandleData(double now, NetIncomingMessage msg)
+        {
+            MessageType messageType = (MessageType)msg.ReadByte();
+
+            switch (messageType)
+            {
+                case MessageType.MsgWorldInfo:
+                    {
+                        MsgWorldInfoPacket packet = MsgWorldInfoPacket.Read(msg);
+
+                        // never cached, every client downloads it like a first time player
+                        worldBytesExpected = packet.CompressedLength;
+
+                        MsgWorldRequestPacket requestPacket = new MsgWorldRequestPacket(packet.Hash);
+                        NetOutgoingMessage requestMessage = CreateMessage(requestPacket.MsgType);
+                        requestPacket.Write(requestMessage);
+
+                        Send(requestMessage, requestPacket.MsgType);
+                        break;
+                    }
+
+                case MessageType.MsgWorld:
+                    worldBytesReceived += (UInt32)MsgWorldPacket.Read(msg).Count;
+                    haveWorld = worldBytesReceived >= worldBytesExpected;
+                    CheckJoined(now);
+                    break;
+
+                case MessageType.MsgJoinSnapshot:
+                    slot = MsgJoinSnapshotPacket.Read(msg).Slot;
+                    haveSnapshot = true;
+                    CheckJoined(now);
+                    break;
+
+                case MessageType.MsgPlayerServerUpdate:
+                    {
+                        MsgPlayerServerUpdatePacket packet = MsgPlayerServerUpdatePacket.Read(msg);
+                        RecordLatency(updateLatency, now, packet.Slot, packet.Rotation, false);
+                        break;
+                    }
+
+                case MessageType.MsgEventBundle:
+                    foreach (MsgBasePacket bundled in MsgEventBundlePacket.Read(msg).Events)
+                    {
+                        MsgBeginShotPacket shot = bundled as MsgBeginShotPacket;
+
+                        if (shot != null)
+                            RecordLatency(eventLatency, now, shot.Slot, shot.StartTick, true);
+                    }
+                    break;
+            }
+        }
+
+        private void CheckJoined(double now)
+        {
+            if (joined || !haveWorld || !haveSnapshot)
+                return;
+
+            joined = true;
+            clientsBySlot[slot] = this;
+            joinTime.Record((Int64)((now - connectTime) * 1000000));
+
+            // spread everyone's sends out rather than have them all go at once
+            nextUpdate = now + index % 10 * UpdateInterval.TotalSeconds / 10;
+            nextShot = now + index % 20 * ShotInterval.TotalSeconds / 20;
+        }
+
+        private void RecordLatency(LatencyHistogram histogram, double now, Byte senderSlot, Single id, bool shot)
+        {
+            SoakClient sender = clientsBySlot[senderSlot];
+
+            if (sender == null)
+                return;
+
+            int sequence = (int)id;
+            int sent = shot ? sender.shotsSent : sender.updatesSent;
+
+            // too old to still be remembered
+            if (sequence < 0 || sequence >= sent || sent - sequence > HistoryLength)
+                return;
+
+            double sentAt = (shot ? sender.shotSentAt : sender.updateSentAt)[sequence % HistoryLength];
+
+            histogram.Record((Int64)((now - sentAt) * 1000000));
+        }
+
+        private NetOutgoingMessage CreateMessage(MessageType messageType)
+        {
+            NetOutgoingMessage msg = client.CreateMessage();
+
+            msg.Write((Byte)messageType);
+
+            return msg;
+        }
+
+        private void Send(NetOutgoingMessage msg, MessageType messageType)
+        {
+            TrafficRoute route = TrafficClasses.GetRoute(messageType);
+            client.SendMessage(msg, route.Method, route.Channel);
+        }
+    }
+}
@@ -0,0 +1,215 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using Microsoft.Xna.Framework;
+
+using NDesk.Options;
+
+using AngryTanks.Common;
+using AngryTanks.Server;
+
+namespace AngryTanks.Tests.Benchmarks
+{
+    /// <summary>
+    /// Times picking spawn points from a <see cref="SpawnField"/> on a dense synthetic map full of live tanks, with and
+    /// without line of sight checks, against trying random points until one passes an exact test against every object.
+    /// Checks every spawn really is clear of the map.
+    /// </summary>
+    static class SpawnBenchmark
+    {
+        // half diagonal of a default tank
+        private static readonly Single Clearance = new Vector2(4.86f, 6f).Length() / 2;
+
+        public static void Run(String[] args)
+        {
+            int objectCount = 4000;
+            int players = 100;
+            int spawns = 1000;
+            int seed = 5150;
+            bool showHelp = false;
+
+            OptionSet p = new OptionSet()
+            {
+                {
+                    "o|objects=",
+                    "objects in the synthetic map (default 4000)",
+                    (int v) => objectCount = v
+                },
+                {
+                    "p|players=",
+                    "live tanks on the map (default 100)",
+                    (int v) => players = v
+                },
+                {
+                    "n|spawns=",
+                    "spawns per timed run (default 1000)",
+                    (int v) => spawns = v
+                },
+                {
+                    "s|seed=",
+                    "seed for the map and the spawns",
+                    (int v) => seed = v
+                },
+                {
+                    "h|?|help",
+                    "shows this message and exits",
+                    v => showHelp = v != null
+                },
+            };
+
+            try
+            {
+                p.Parse(args);
+            }
+            catch (OptionException e)
+            {
+                Console.WriteLine(e.Message);
+                showHelp = true;
+            }
+
+            if (showHelp)
+            {
+                p.WriteOptionDescriptions(Console.Out);
+                return;
+            }
+
+            WorldMap map = WorldMap.Parse(WorldMapBenchmark.Synthesize(objectCount, seed));
+
+            Console.WriteLine("{0} objects in a world of {1} units, {2} live tanks:", map.Objects.Count, map.Size, players);
+
+            Program.Time("build field", 10, () => new SpawnField(map, 2, seed));
+
+            SpawnField field = new SpawnField(map, 2, seed);
+
+            // everyone spawns the way the server would spawn them
+            List<Vector2> tanks = new List<Vector2>(players);
+            Vector2 position;
+            Single rotation;
+
+            for (int i = 0; i < players; i++)
+            {
+                field.FindSpawn(Clearance, tanks, null, out position, out rotation);
+                tanks.Add(position);
+            }
+
+            Console.WriteLine("  {0}x{0} cells of {1} units, {2} clear for a tank",
+                              field.CellsPerSide, field.CellSize, field.FreeCells);
+
+            Check(map, field, tanks);
+
+            Double fromField = Program.Time("spawn from field", 5, () =>
+            {
+                for (int i = 0; i < spawns; i++)
+                    field.FindSpawn(Clearance, tanks, null, out position, out rotation);
+            });
+
+            Program.Time("spawn out of sight", 5, () =>
+            {
+                for (int i = 0; i < spawns; i++)
+                    field.FindSpawn(Clearance, tanks, tanks, out position, out rotation);
+            });
+
+            Random random = new Random(seed);
+
+            Double sampled = Program.Time("random until clear", 5, () =>
+            {
+                for (int i = 0; i < spawns; i++)
+                    SampleUntilClear(map, tanks, random);
+            });
+
+            Console.WriteLine("  {0,-24} {1,12:F1}x", "speedup", sampled / fromField);
+        }
+
+        /// <summary>
+        /// Spawns more tanks and makes sure each one is clear of the map and sits well away from the others.
+        /// </summary>
+        private static void Check(WorldMap map, SpawnField field, List<Vector2> tanks)
+        {
+            Double spread = 0;
+            int outOfSight = 0;
+
+            for (int i = 0; i < 200; i++)
+            {
+                Vector2 position;
+                Single rotation;
+
+                field.FindSpawn(Clearance, tanks, tanks, out position, out rotation);
+
+                if (!IsClear(map, position))
+                    throw new InvalidOperationException(String.Format("Spawn at {0} overlaps the map", position));
+
+                if (!tanks.Any(t => field.InSight(t, position)))
+                    outOfSight++;
+
+                spread += tanks.Min(t => Vector2.Distance(t, position));
+            }
+
+            Console.WriteLine("  200 spawns clear of the map, {0:F1} units from the nearest tank on average, {1} out of sight",
+                              spread / 200, outOfSight);
+        }
+
+        /// <summary>
+        /// How spawning would go without the field: random points, each tested against every object.
+        /// </summary>
+        private static Vector2 SampleUntilClear(WorldMap map, List<Vector2> tanks, Random random)
+        {
+            Vector2 best = Vector2.Zero;
+            Single bestDistance = -1;
+
+            for (int found = 0; found < 32; )
+            {
+                Vector2 candidate = new Vector2((Single)((random.NextDouble() - 0.5) * map.Size),
+                                                (Single)((random.NextDouble() - 0.5) * map.Size));
+
+                if (!IsClear(map, candidate))
+                    continue;
+
+                found++;
+
+                Single nearest = tanks.Count > 0 ? tanks.Min(t => Vector2.Distance(t, candidate)) : Single.MaxValue;
+
+                if (nearest > bestDistance)
+                {
+                    best = candidate;
+                    bestDistance = nearest;
+                }
+            }
+
+            return best;
+        }
+
+        /// <summary>
+        /// Exact test of a tank's circle against the edge of the world and every object.
+        /// </summary>
+        private static bool IsClear(WorldMap map, Vector2 position)
+        {
+            Single half = map.Size / 2 - Clearance;
+
+            if (Math.Abs(position.X) > half || Math.Abs(position.Y) > half)
+                return false;
+
+            foreach (MapObject mapObject in map.Objects)
+            {
+                if (position.X < mapObject.Min.X - Clearance || position.X > mapObject.Max.X + Clearance ||
+                    position.Y < mapObject.Min.Y - Clearance || position.Y > mapObject.Max.Y + Clearance)
+                    continue;
+
+                Single cos = (Single)Math.Cos(mapObject.Rotation);
+                Single sin = (Single)Math.Sin(mapObject.Rotation);
+
+                Vector2 offset = position - mapObject.Position;
+                Vector2 local = new Vector2(offset.X * cos + offset.Y * sin, -offset.X * sin + offset.Y * cos);
+                Vector2 extents = mapObject.Size / 2;
+
+                // closest point of the rectangle to the circle's center
+                Vector2 closest = new Vector2(MathHelper.Clamp(local.X, -extents.X, extents.X),
+                                              MathHelper.Clamp(local.Y, -extents.Y, extents.Y));
+
+                if (Vector2.DistanceSquared(local, closest) < Clearance * Clearance)
+                    return false;
+            }
+
+            return true;
+        }
+    }
+}
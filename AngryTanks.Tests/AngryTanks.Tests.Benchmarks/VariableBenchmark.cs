@@ -0,0 +1,131 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.Linq;
+
+using Lidgren.Network;
+using NDesk.Options;
+
+using AngryTanks.Common;
+using AngryTanks.Common.Messages;
+
+namespace AngryTanks.Tests.Benchmarks
+{
+    /// <summary>
+    /// Times reading a variable through a typed handle against looking it up by name and converting the boxed value,
+    /// which is how every read used to go. Then changes variables on one database, sends the tick's batch through an
+    /// event bundle and checks another database ends up the same.
+    /// </summary>
+    static class VariableBenchmark
+    {
+        // keeps the reads from being optimized away
+        private static Single sink;
+
+        public static void Run(String[] args)
+        {
+            int reads = 1000000;
+            bool showHelp = false;
+
+            OptionSet p = new OptionSet()
+            {
+                {
+                    "n|reads=",
+                    "reads per timed run (default 1000000)",
+                    (int v) => reads = v
+                },
+                {
+                    "h|?|help",
+                    "shows this message and exits",
+                    v => showHelp = v != null
+                },
+            };
+
+            try
+            {
+                p.Parse(args);
+            }
+            catch (OptionException e)
+            {
+                Console.WriteLine(e.Message);
+                showHelp = true;
+            }
+
+            if (showHelp)
+            {
+                p.WriteOptionDescriptions(Console.Out);
+                return;
+            }
+
+            VariableDatabase variables = new VariableDatabase();
+            Variable<Single> shotSpeed = variables.ShotSpeed;
+
+            Console.WriteLine("{0} reads of shotSpeed:", reads);
+
+            Double byName = Program.Time("by name, boxed", 10, () =>
+            {
+                for (int i = 0; i < reads; i++)
+                    sink += (Single)Convert.ChangeType(variables["shotSpeed"].BoxedValue, TypeCode.Single, CultureInfo.InvariantCulture);
+            });
+
+            Double byHandle = Program.Time("typed handle", 10, () =>
+            {
+                for (int i = 0; i < reads; i++)
+                    sink += shotSpeed.Value;
+            });
+
+            Console.WriteLine("  {0,-24} {1,12:F1}x", "speedup", byName / byHandle);
+            Console.WriteLine();
+
+            CheckSync();
+        }
+
+        private static void CheckSync()
+        {
+            VariableDatabase server = new VariableDatabase();
+            VariableDatabase client = new VariableDatabase();
+
+            int clientNotified = 0;
+            client.TankSpeed.ValueChanged += (sender, e) => clientNotified++;
+
+            // two changes to one variable in a tick go out once, with the final value
+            server.TankSpeed.Value = 30;
+            server.TankSpeed.Value = 35;
+            server.ShotSlots.BoxedValue = "7";
+
+            List<VariableStore> changes = new List<VariableStore>();
+            server.TakeChanges(changes);
+
+            if (changes.Count != 2 || server.TakeChanges(changes) != 0)
+                throw new InvalidOperationException(String.Format("Expected a batch of 2 changed variables, got {0}", changes.Count));
+
+            if (server.TankSpeed.Version != 2 || server.ShotSlots.Version != 1 || server.Version != 3)
+                throw new InvalidOperationException("Variable versions don't count the changes made");
+
+            // over the wire in the tick's event bundle
+            NetServer peer = new NetServer(new NetPeerConfiguration("AngryTanks"));
+            NetOutgoingMessage message = peer.CreateMessage();
+
+            List<MsgBasePacket> events = changes.ConvertAll(v => (MsgBasePacket)new MsgSetVariablePacket(v));
+            new MsgEventBundlePacket(events).Write(message);
+
+            NetIncomingMessage incoming = (NetIncomingMessage)Activator.CreateInstance(typeof(NetIncomingMessage), true);
+            ReplayBenchmark.Fill(incoming, message.PeekDataBuffer(), message.LengthBits);
+
+            foreach (MsgSetVariablePacket variable in MsgEventBundlePacket.Read(incoming).Events.Cast<MsgSetVariablePacket>())
+                client[variable.Name].BoxedValue = variable.Value;
+
+            if (client.TankSpeed.Value != 35 || client.ShotSlots.Value != 7)
+                throw new InvalidOperationException(String.Format("Client has tankSpeed {0} and shotSlots {1} after the batch",
+                                                                  client.TankSpeed.Value, client.ShotSlots.Value));
+
+            if (clientNotified != 1)
+                throw new InvalidOperationException(String.Format("Client was told about tankSpeed changing {0} times", clientNotified));
+
+            // and anyone joining later gets the same from their snapshot
+            if (server.NonDefault.Count != 2)
+                throw new InvalidOperationException(String.Format("{0} variables would go in the join snapshot, expected 2", server.NonDefault.Count));
+
+            Console.WriteLine("Variable batch of {0} changes synced in {1} bytes", changes.Count, message.LengthBytes);
+        }
+    }
+}
@@ -0,0 +1,132 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+using NDesk.Options;
+
+using AngryTanks.Common;
+
+namespace AngryTanks.Tests.Benchmarks
+{
+    /// <summary>
+    /// Compares parsing a .bzw on every load against loading the compiled form, along with
+    /// the cost of compressing it for transfer, on a real map and on a synthetic one with many objects.
+    /// </summary>
+    static class WorldMapBenchmark
+    {
+        public static void Run(String[] args)
+        {
+            String worldFilePath = null;
+            int objectCount = 10000;
+            int seed = 5150;
+            bool showHelp = false;
+
+            OptionSet p = new OptionSet()
+            {
+                {
+                    "w|world=",
+                    "a .bzw file to benchmark, such as ducati_style_random.bzw",
+                    (String v) => worldFilePath = v
+                },
+                {
+                    "n|objects=",
+                    "number of objects in the synthetic world (default 10000)",
+                    (int v) => objectCount = v
+                },
+                {
+                    "seed=",
+                    "seed for the synthetic world",
+                    (int v) => seed = v
+                },
+                {
+                    "h|?|help",
+                    "shows this message and exits",
+                    v => showHelp = v != null
+                },
+            };
+
+            try
+            {
+                p.Parse(args);
+            }
+            catch (OptionException e)
+            {
+                Console.WriteLine(e.Message);
+                showHelp = true;
+            }
+
+            if (showHelp)
+            {
+                p.WriteOptionDescriptions(Console.Out);
+                return;
+            }
+
+            if (worldFilePath != null)
+                Measure(Path.GetFileName(worldFilePath), File.ReadAllBytes(worldFilePath));
+
+            Measure(String.Format("synthetic ({0} objects)", objectCount), Synthesize(objectCount, seed));
+        }
+
+        private static void Measure(String name, Byte[] source)
+        {
+            WorldMap map = WorldMap.Parse(source);
+            Byte[] compiled = map.GetBytes();
+
+            Console.WriteLine("{0}: {1} objects, {2} bytes of text, {3} bytes compiled",
+                              name, map.Objects.Count, source.Length, compiled.Length);
+
+            // keep each measurement around a second no matter how large the map is
+            int iterations = Math.Max(10, 200000 / Math.Max(1, map.Objects.Count));
+
+            Double parse = Program.Time("parse text", iterations, delegate { WorldMap.Parse(source); });
+            Program.Time("validate", iterations, delegate { map.Validate(); });
+            Program.Time("write compiled", iterations, delegate { map.Write(new MemoryStream(compiled.Length)); });
+            Double load = Program.Time("load compiled", iterations, delegate { WorldMap.FromBytes(compiled); });
+
+            // what a client downloading the world pays on top of loading it
+            Byte[] compressed = Lzma.Compress(compiled);
+            Console.WriteLine("  compressed for transfer to {0} bytes", compressed.Length);
+            Program.Time("compress", Math.Max(1, iterations / 10), delegate { Lzma.Compress(compiled); });
+            Program.Time("decompress", iterations, delegate { Lzma.Decompress(compressed, compiled.Length); });
+
+            Console.WriteLine("  loading compiled is {0:F1}x faster than parsing", parse / load);
+            Console.WriteLine();
+        }
+
+        /// <summary>
+        /// Builds .bzw text of <paramref name="objectCount"/> randomly placed boxes and pyramids.
+        /// </summary>
+        internal static Byte[] Synthesize(int objectCount, int seed)
+        {
+            Random random = new Random(seed);
+            Single worldSize = (Single)Math.Max(800, Math.Sqrt(objectCount) * 40);
+
+            StringBuilder sb = new StringBuilder(objectCount * 80);
+
+            sb.AppendLine("world");
+            sb.AppendLine("  name Synthetic");
+            sb.AppendLine("  size " + worldSize.ToString(CultureInfo.InvariantCulture));
+            sb.AppendLine("end");
+            sb.AppendLine();
+
+            for (int i = 0; i < objectCount; i++)
+            {
+                sb.AppendLine(random.Next(4) == 0 ? "pyramid" : "box");
+                sb.AppendFormat(CultureInfo.InvariantCulture, "  position {0:F3} {1:F3} 0",
+                                (random.NextDouble() - 0.5) * worldSize, (random.NextDouble() - 0.5) * worldSize);
+                sb.AppendLine();
+                sb.AppendFormat(CultureInfo.InvariantCulture, "  size {0:F3} {1:F3} {2:F3}",
+                                2 + random.NextDouble() * 18, 2 + random.NextDouble() * 18, 10 + random.NextDouble() * 10);
+                sb.AppendLine();
+                sb.AppendFormat(CultureInfo.InvariantCulture, "  rotation {0:F3}", random.NextDouble() * 360);
+                sb.AppendLine();
+                sb.AppendLine("end");
+            }
+
+            return Encoding.ASCII.GetBytes(sb.ToString());
+        }
+    }
+}
@@ -0,0 +1,339 @@
+﻿using System;
+
+namespace Lidgren.Network
+{
+	/// <summary>
+	/// ChaCha20-Poly1305 authenticated encryption (RFC 8439), in place and without allocating; not threadsafe
+	/// </summary>
+	/// <remarks>
+	/// The 96 bit nonce is a 32 bit fixed part followed by a 64 bit counter, both little endian.
+	/// A nonce must never be used twice with the same key.
+	/// </remarks>
+	public sealed class NetChaCha20Poly1305
+	{
+		/// <summary>
+		/// Key size in bytes
+		/// </summary>
+		public const int KeySize = 32;
+
+		/// <summary>
+		/// Size in bytes of the authentication tag written after the ciphertext
+		/// </summary>
+		public const int TagSize = 16;
+
+		private const uint c_mask26 = 0x3ffffff;
+
+		private readonly uint[] m_state = new uint[16];
+		private readonly uint[] m_block = new uint[16];
+		private readonly byte[] m_padded = new byte[16];
+
+		// poly1305 state in 26 bit limbs
+		private uint m_r0, m_r1, m_r2, m_r3, m_r4;
+		private uint m_s1, m_s2, m_s3, m_s4;
+		private uint m_h0, m_h1, m_h2, m_h3, m_h4;
+		private uint m_pad0, m_pad1, m_pad2, m_pad3;
+
+		/// <summary>
+		/// NetChaCha20Poly1305 constructor
+		/// </summary>
+		public NetChaCha20Poly1305(byte[] key)
+		{
+			if (key == null)
+				throw new ArgumentNullException("key");
+			if (key.Length != KeySize)
+				throw new NetException("ChaCha20-Poly1305 key must be " + KeySize + " bytes");
+
+			m_state[0] = 0x61707865; // "expand 32-byte k"
+			m_state[1] = 0x3320646e;
+			m_state[2] = 0x79622d32;
+			m_state[3] = 0x6b206574;
+			for (int i = 0; i < 8; i++)
+				m_state[4 + i] = ReadUInt32(key, i * 4);
+		}
+
+		/// <summary>
+		/// Encrypts length bytes at offset in place and writes the tag right after them; the associated data is authenticated but not encrypted
+		/// </summary>
+		[CLSCompliant(false)]
+		public void Seal(uint nonceFixed, ulong nonceCounter, byte[] buffer, int associatedOffset, int associatedLength, int offset, int length)
+		{
+			Start(nonceFixed, nonceCounter);
+			Cipher(buffer, offset, length);
+			Authenticate(buffer, associatedOffset, associatedLength, offset, length);
+			WriteTag(buffer, offset + length);
+		}
+
+		/// <summary>
+		/// Checks the tag after length bytes at offset and, if it is genuine, decrypts them in place
+		/// </summary>
+		/// <returns>false if the data or associated data has been tampered with, or another key or nonce was used; the buffer is left untouched</returns>
+		[CLSCompliant(false)]
+		public bool Open(uint nonceFixed, ulong nonceCounter, byte[] buffer, int associatedOffset, int associatedLength, int offset, int length)
+		{
+			Start(nonceFixed, nonceCounter);
+			Authenticate(buffer, associatedOffset, associatedLength, offset, length);
+			if (!VerifyTag(buffer, offset + length))
+				return false;
+			Cipher(buffer, offset, length);
+			return true;
+		}
+
+		// sets the nonce and derives the one time poly1305 key from block zero
+		private void Start(uint nonceFixed, ulong nonceCounter)
+		{
+			m_state[13] = nonceFixed;
+			m_state[14] = (uint)nonceCounter;
+			m_state[15] = (uint)(nonceCounter >> 32);
+
+			m_state[12] = 0;
+			Block();
+
+			uint t0 = m_block[0];
+			uint t1 = m_block[1];
+			uint t2 = m_block[2];
+			uint t3 = m_block[3];
+
+			// clamp r
+			m_r0 = t0 & 0x3ffffff;
+			m_r1 = ((t0 >> 26) | (t1 << 6)) & 0x3ffff03;
+			m_r2 = ((t1 >> 20) | (t2 << 12)) & 0x3ffc0ff;
+			m_r3 = ((t2 >> 14) | (t3 << 18)) & 0x3f03fff;
+			m_r4 = (t3 >> 8) & 0x00fffff;
+
+			m_s1 = m_r1 * 5;
+			m_s2 = m_r2 * 5;
+			m_s3 = m_r3 * 5;
+			m_s4 = m_r4 * 5;
+
+			m_h0 = m_h1 = m_h2 = m_h3 = m_h4 = 0;
+
+			m_pad0 = m_block[4];
+			m_pad1 = m_block[5];
+			m_pad2 = m_block[6];
+			m_pad3 = m_block[7];
+		}
+
+		//
+		// ChaCha20
+		//
+
+		// xors the key stream, from block one, over the data
+		private void Cipher(byte[] buffer, int offset, int length)
+		{
+			uint[] x = m_block;
+			uint counter = 1;
+			while (length > 0)
+			{
+				m_state[12] = counter++;
+				Block();
+
+				if (length >= 64)
+				{
+					for (int i = 0; i < 16; i++)
+					{
+						uint k = x[i];
+						int p = offset + i * 4;
+						buffer[p] ^= (byte)k;
+						buffer[p + 1] ^= (byte)(k >> 8);
+						buffer[p + 2] ^= (byte)(k >> 16);
+						buffer[p + 3] ^= (byte)(k >> 24);
+					}
+					offset += 64;
+					length -= 64;
+				}
+				else
+				{
+					for (int i = 0; i < length; i++)
+						buffer[offset + i] ^= (byte)(x[i >> 2] >> ((i & 3) * 8));
+					length = 0;
+				}
+			}
+		}
+
+		// one block of key stream from the state into m_block
+		private void Block()
+		{
+			uint[] s = m_state;
+			uint x0 = s[0], x1 = s[1], x2 = s[2], x3 = s[3];
+			uint x4 = s[4], x5 = s[5], x6 = s[6], x7 = s[7];
+			uint x8 = s[8], x9 = s[9], x10 = s[10], x11 = s[11];
+			uint x12 = s[12], x13 = s[13], x14 = s[14], x15 = s[15];
+
+			for (int i = 0; i < 10; i++)
+			{
+				// columns
+				x0 += x4; x12 = Rotate(x12 ^ x0, 16); x8 += x12; x4 = Rotate(x4 ^ x8, 12);
+				x0 += x4; x12 = Rotate(x12 ^ x0, 8); x8 += x12; x4 = Rotate(x4 ^ x8, 7);
+				x1 += x5; x13 = Rotate(x13 ^ x1, 16); x9 += x13; x5 = Rotate(x5 ^ x9, 12);
+				x1 += x5; x13 = Rotate(x13 ^ x1, 8); x9 += x13; x5 = Rotate(x5 ^ x9, 7);
+				x2 += x6; x14 = Rotate(x14 ^ x2, 16); x10 += x14; x6 = Rotate(x6 ^ x10, 12);
+				x2 += x6; x14 = Rotate(x14 ^ x2, 8); x10 += x14; x6 = Rotate(x6 ^ x10, 7);
+				x3 += x7; x15 = Rotate(x15 ^ x3, 16); x11 += x15; x7 = Rotate(x7 ^ x11, 12);
+				x3 += x7; x15 = Rotate(x15 ^ x3, 8); x11 += x15; x7 = Rotate(x7 ^ x11, 7);
+
+				// diagonals
+				x0 += x5; x15 = Rotate(x15 ^ x0, 16); x10 += x15; x5 = Rotate(x5 ^ x10, 12);
+				x0 += x5; x15 = Rotate(x15 ^ x0, 8); x10 += x15; x5 = Rotate(x5 ^ x10, 7);
+				x1 += x6; x12 = Rotate(x12 ^ x1, 16); x11 += x12; x6 = Rotate(x6 ^ x11, 12);
+				x1 += x6; x12 = Rotate(x12 ^ x1, 8); x11 += x12; x6 = Rotate(x6 ^ x11, 7);
+				x2 += x7; x13 = Rotate(x13 ^ x2, 16); x8 += x13; x7 = Rotate(x7 ^ x8, 12);
+				x2 += x7; x13 = Rotate(x13 ^ x2, 8); x8 += x13; x7 = Rotate(x7 ^ x8, 7);
+				x3 += x4; x14 = Rotate(x14 ^ x3, 16); x9 += x14; x4 = Rotate(x4 ^ x9, 12);
+				x3 += x4; x14 = Rotate(x14 ^ x3, 8); x9 += x14; x4 = Rotate(x4 ^ x9, 7);
+			}
+
+			uint[] b = m_block;
+			b[0] = x0 + s[0]; b[1] = x1 + s[1]; b[2] = x2 + s[2]; b[3] = x3 + s[3];
+			b[4] = x4 + s[4]; b[5] = x5 + s[5]; b[6] = x6 + s[6]; b[7] = x7 + s[7];
+			b[8] = x8 + s[8]; b[9] = x9 + s[9]; b[10] = x10 + s[10]; b[11] = x11 + s[11];
+			b[12] = x12 + s[12]; b[13] = x13 + s[13]; b[14] = x14 + s[14]; b[15] = x15 + s[15];
+		}
+
+		private static uint Rotate(uint v, int c)
+		{
+			return (v << c) | (v >> (32 - c));
+		}
+
+		//
+		// Poly1305
+		//
+
+		// macs the associated data and ciphertext, each zero padded to 16 bytes, then both lengths
+		private void Authenticate(byte[] buffer, int associatedOffset, int associatedLength, int offset, int length)
+		{
+			MacPadded(buffer, associatedOffset, associatedLength);
+			MacPadded(buffer, offset, length);
+
+			byte[] p = m_padded;
+			WriteUInt32((uint)associatedLength, p, 0);
+			WriteUInt32(0, p, 4);
+			WriteUInt32((uint)length, p, 8);
+			WriteUInt32(0, p, 12);
+			MacBlock(p, 0);
+		}
+
+		private void MacPadded(byte[] buffer, int offset, int length)
+		{
+			while (length >= 16)
+			{
+				MacBlock(buffer, offset);
+				offset += 16;
+				length -= 16;
+			}
+
+			if (length > 0)
+			{
+				byte[] p = m_padded;
+				Buffer.BlockCopy(buffer, offset, p, 0, length);
+				Array.Clear(p, length, 16 - length);
+				MacBlock(p, 0);
+			}
+		}
+
+		// h = (h + block) * r mod 2^130 - 5, for one full 16 byte block
+		private void MacBlock(byte[] data, int offset)
+		{
+			uint t0 = ReadUInt32(data, offset);
+			uint t1 = ReadUInt32(data, offset + 4);
+			uint t2 = ReadUInt32(data, offset + 8);
+			uint t3 = ReadUInt32(data, offset + 12);
+
+			uint h0 = m_h0 + (t0 & c_mask26);
+			uint h1 = m_h1 + (((t0 >> 26) | (t1 << 6)) & c_mask26);
+			uint h2 = m_h2 + (((t1 >> 20) | (t2 << 12)) & c_mask26);
+			uint h3 = m_h3 + (((t2 >> 14) | (t3 << 18)) & c_mask26);
+			uint h4 = m_h4 + ((t3 >> 8) | (1u << 24));
+
+			ulong d0 = (ulong)h0 * m_r0 + (ulong)h1 * m_s4 + (ulong)h2 * m_s3 + (ulong)h3 * m_s2 + (ulong)h4 * m_s1;
+			ulong d1 = (ulong)h0 * m_r1 + (ulong)h1 * m_r0 + (ulong)h2 * m_s4 + (ulong)h3 * m_s3 + (ulong)h4 * m_s2;
+			ulong d2 = (ulong)h0 * m_r2 + (ulong)h1 * m_r1 + (ulong)h2 * m_r0 + (ulong)h3 * m_s4 + (ulong)h4 * m_s3;
+			ulong d3 = (ulong)h0 * m_r3 + (ulong)h1 * m_r2 + (ulong)h2 * m_r1 + (ulong)h3 * m_r0 + (ulong)h4 * m_s4;
+			ulong d4 = (ulong)h0 * m_r4 + (ulong)h1 * m_r3 + (ulong)h2 * m_r2 + (ulong)h3 * m_r1 + (ulong)h4 * m_r0;
+
+			uint c = (uint)(d0 >> 26); h0 = (uint)d0 & c_mask26;
+			d1 += c; c = (uint)(d1 >> 26); h1 = (uint)d1 & c_mask26;
+			d2 += c; c = (uint)(d2 >> 26); h2 = (uint)d2 & c_mask26;
+			d3 += c; c = (uint)(d3 >> 26); h3 = (uint)d3 & c_mask26;
+			d4 += c; c = (uint)(d4 >> 26); h4 = (uint)d4 & c_mask26;
+			h0 += c * 5; c = h0 >> 26; h0 &= c_mask26;
+			h1 += c;
+
+			m_h0 = h0; m_h1 = h1; m_h2 = h2; m_h3 = h3; m_h4 = h4;
+		}
+
+		// fully reduces h, adds the pad and leaves the tag in t0..t3
+		private void Finish(out uint t0, out uint t1, out uint t2, out uint t3)
+		{
+			uint h0 = m_h0, h1 = m_h1, h2 = m_h2, h3 = m_h3, h4 = m_h4;
+
+			uint c = h1 >> 26; h1 &= c_mask26;
+			h2 += c; c = h2 >> 26; h2 &= c_mask26;
+			h3 += c; c = h3 >> 26; h3 &= c_mask26;
+			h4 += c; c = h4 >> 26; h4 &= c_mask26;
+			h0 += c * 5; c = h0 >> 26; h0 &= c_mask26;
+			h1 += c;
+
+			// g = h + 5 - 2^130; take it if it did not go negative
+			uint g0 = h0 + 5; c = g0 >> 26; g0 &= c_mask26;
+			uint g1 = h1 + c; c = g1 >> 26; g1 &= c_mask26;
+			uint g2 = h2 + c; c = g2 >> 26; g2 &= c_mask26;
+			uint g3 = h3 + c; c = g3 >> 26; g3 &= c_mask26;
+			uint g4 = h4 + c - (1u << 26);
+
+			uint mask = (g4 >> 31) - 1;
+			g0 &= mask; g1 &= mask; g2 &= mask; g3 &= mask; g4 &= mask;
+			mask = ~mask;
+			h0 = (h0 & mask) | g0;
+			h1 = (h1 & mask) | g1;
+			h2 = (h2 & mask) | g2;
+			h3 = (h3 & mask) | g3;
+			h4 = (h4 & mask) | g4;
+
+			// to 32 bit words, plus pad mod 2^128
+			h0 = h0 | (h1 << 26);
+			h1 = (h1 >> 6) | (h2 << 20);
+			h2 = (h2 >> 12) | (h3 << 14);
+			h3 = (h3 >> 18) | (h4 << 8);
+
+			ulong f = (ulong)h0 + m_pad0; t0 = (uint)f;
+			f = (ulong)h1 + m_pad1 + (f >> 32); t1 = (uint)f;
+			f = (ulong)h2 + m_pad2 + (f >> 32); t2 = (uint)f;
+			f = (ulong)h3 + m_pad3 + (f >> 32); t3 = (uint)f;
+		}
+
+		private void WriteTag(byte[] buffer, int offset)
+		{
+			uint t0, t1, t2, t3;
+			Finish(out t0, out t1, out t2, out t3);
+			WriteUInt32(t0, buffer, offset);
+			WriteUInt32(t1, buffer, offset + 4);
+			WriteUInt32(t2, buffer, offset + 8);
+			WriteUInt32(t3, buffer, offset + 12);
+		}
+
+		// constant time, so a forger learns nothing from how long a rejection takes
+		private bool VerifyTag(byte[] buffer, int offset)
+		{
+			uint t0, t1, t2, t3;
+			Finish(out t0, out t1, out t2, out t3);
+			uint diff = (t0 ^ ReadUInt32(buffer, offset)) |
+				(t1 ^ ReadUInt32(buffer, offset + 4)) |
+				(t2 ^ ReadUInt32(buffer, offset + 8)) |
+				(t3 ^ ReadUInt32(buffer, offset + 12));
+			return diff == 0;
+		}
+
+		private static uint ReadUInt32(byte[] buffer, int offset)
+		{
+			return (uint)(buffer[offset] | (buffer[offset + 1] << 8) | (buffer[offset + 2] << 16) | (buffer[offset + 3] << 24));
+		}
+
+		private static void WriteUInt32(uint value, byte[] buffer, int offset)
+		{
+			buffer[offset] = (byte)value;
+			buffer[offset + 1] = (byte)(value >> 8);
+			buffer[offset + 2] = (byte)(value >> 16);
+			buffer[offset + 3] = (byte)(value >> 24);
+		}
+	}
+}
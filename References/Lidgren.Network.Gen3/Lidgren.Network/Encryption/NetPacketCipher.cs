@@ -0,0 +1,230 @@
+﻿using System;
+using System.Security.Cryptography;
+using System.Text;
+
+namespace Lidgren.Network
+{
+	/// <summary>
+	/// Seals and opens the packets of one encrypted connection with ChaCha20-Poly1305, keyed by a Diffie-Hellman exchange in the handshake
+	/// </summary>
+	/// <remarks>
+	/// A sealed packet is one Encrypted message wrapping the coalesced messages of a plain packet:
+	/// the usual 5 byte header, an 8 byte packet counter used as the nonce, the ciphertext and a 16 byte tag.
+	/// The header and counter are authenticated with the ciphertext. Each direction has its own key, and
+	/// packets that fail authentication or repeat a counter already seen are dropped. Network thread only.
+	/// </remarks>
+	internal sealed class NetPacketCipher
+	{
+		/// <summary>
+		/// Size in bytes of a key share in the handshake
+		/// </summary>
+		internal const int KeyShareSize = 256;
+
+		/// <summary>
+		/// Bytes ahead of the plaintext in a sealed packet
+		/// </summary>
+		internal const int HeaderSize = NetConstants.HeaderByteSize + 8;
+
+		/// <summary>
+		/// Bytes a sealed packet adds to the plain one
+		/// </summary>
+		internal const int Overhead = HeaderSize + NetChaCha20Poly1305.TagSize;
+
+		private const int c_privateKeySize = 32;
+		private const int c_replayWindow = 64;
+
+		// the 2048 bit MODP group of RFC 3526, generator 2
+		private static readonly NetBigInteger s_prime = new NetBigInteger(
+			"FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DD" +
+			"EF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7ED" +
+			"EE386BFB5A899FA5AE9F24117C4B1FE649286651ECE45B3DC2007CB8A163BF0598DA48361C55D39A69163FA8FD24CF5F" +
+			"83655D23DCA3AD961C62F356208552BB9ED529077096966D670C354E4ABC9804F1746C08CA18217C32905E462E36CE3B" +
+			"E39E772C180E86039B2783A2EC07A28FB5C55DF06F4C52C9DE2BCBF6955817183995497CEA956AE515D2261898FA0510" +
+			"15728E5A8AACAA68FFFFFFFFFFFFFFFF", 16);
+		private static readonly NetBigInteger s_primeMinusOne = s_prime.Subtract(NetBigInteger.One);
+
+		private readonly NetChaCha20Poly1305 m_sender;
+		private readonly NetChaCha20Poly1305 m_receiver;
+		private ulong m_sendCounter;
+
+		// counters seen; bit n of the window is m_highestReceived - n
+		private bool m_receivedAny;
+		private ulong m_highestReceived;
+		private ulong m_receivedWindow;
+
+		private NetPacketCipher(byte[] sendKey, byte[] receiveKey)
+		{
+			m_sender = new NetChaCha20Poly1305(sendKey);
+			m_receiver = new NetChaCha20Poly1305(receiveKey);
+		}
+
+		//
+		// Key exchange
+		//
+
+		/// <summary>
+		/// Creates a random private exponent for one handshake
+		/// </summary>
+		internal static byte[] CreatePrivateKey()
+		{
+			byte[] key = new byte[c_privateKeySize];
+			using (RNGCryptoServiceProvider rng = new RNGCryptoServiceProvider())
+				rng.GetBytes(key);
+			return key;
+		}
+
+		/// <summary>
+		/// Computes the public key share, g^x mod p, to send in the handshake
+		/// </summary>
+		internal static byte[] ComputeKeyShare(byte[] privateKey)
+		{
+			NetBigInteger x = new NetBigInteger(1, privateKey);
+			return ToFixedSize(NetBigInteger.Two.ModPow(x, s_prime));
+		}
+
+		/// <summary>
+		/// Derives the keys of both directions from the shared secret and the handshake that agreed it
+		/// </summary>
+		/// <returns>null if the remote share is not a valid group element</returns>
+		internal static NetPacketCipher Create(byte[] privateKey, byte[] localShare, byte[] remoteShare, bool initiator, string secret)
+		{
+			NetBigInteger remote = new NetBigInteger(1, remoteShare);
+			if (remote.CompareTo(NetBigInteger.One) <= 0 || remote.CompareTo(s_primeMinusOne) >= 0)
+				return null;
+
+			byte[] shared = ToFixedSize(remote.ModPow(new NetBigInteger(1, privateKey), s_prime));
+
+			byte[] initiatorShare = (initiator ? localShare : remoteShare);
+			byte[] responderShare = (initiator ? remoteShare : localShare);
+			byte[] toResponder = DeriveKey(1, shared, initiatorShare, responderShare, secret);
+			byte[] toInitiator = DeriveKey(2, shared, initiatorShare, responderShare, secret);
+
+			return (initiator ? new NetPacketCipher(toResponder, toInitiator) : new NetPacketCipher(toInitiator, toResponder));
+		}
+
+		// SHA-256 of the direction, the shared secret, both shares and the application secret, so both
+		// ends agree on the keys only if they saw the same handshake and know the same secret
+		private static byte[] DeriveKey(byte direction, byte[] shared, byte[] initiatorShare, byte[] responderShare, string secret)
+		{
+			byte[] secretBytes = Encoding.UTF8.GetBytes(secret ?? string.Empty);
+			byte[] input = new byte[1 + shared.Length + initiatorShare.Length + responderShare.Length + secretBytes.Length];
+
+			int ptr = 0;
+			input[ptr++] = direction;
+			Buffer.BlockCopy(shared, 0, input, ptr, shared.Length);
+			ptr += shared.Length;
+			Buffer.BlockCopy(initiatorShare, 0, input, ptr, initiatorShare.Length);
+			ptr += initiatorShare.Length;
+			Buffer.BlockCopy(responderShare, 0, input, ptr, responderShare.Length);
+			ptr += responderShare.Length;
+			Buffer.BlockCopy(secretBytes, 0, input, ptr, secretBytes.Length);
+
+			using (SHA256Managed sha = new SHA256Managed())
+				return sha.ComputeHash(input);
+		}
+
+		// big endian, left padded to the size of the prime
+		private static byte[] ToFixedSize(NetBigInteger value)
+		{
+			byte[] bytes = value.ToByteArrayUnsigned();
+			if (bytes.Length == KeyShareSize)
+				return bytes;
+
+			byte[] retval = new byte[KeyShareSize];
+			Buffer.BlockCopy(bytes, 0, retval, KeyShareSize - bytes.Length, bytes.Length);
+			return retval;
+		}
+
+		//
+		// Packets
+		//
+
+		/// <summary>
+		/// Seals the plaintext in buffer from HeaderSize up to plaintextEnd in place, writing the header in front and the tag behind
+		/// </summary>
+		/// <returns>length of the sealed packet</returns>
+		internal int Seal(byte[] buffer, int plaintextEnd)
+		{
+			int length = plaintextEnd - HeaderSize;
+			int payloadBits = (HeaderSize - NetConstants.HeaderByteSize + length + NetChaCha20Poly1305.TagSize) * 8;
+			NetException.Assert(payloadBits <= ushort.MaxValue, "Packet too large to seal");
+
+			ulong counter = m_sendCounter++;
+
+			buffer[0] = (byte)NetMessageType.Encrypted;
+			buffer[1] = 0; // no sequence number
+			buffer[2] = 0; // no sequence number
+			buffer[3] = (byte)payloadBits;
+			buffer[4] = (byte)(payloadBits >> 8);
+			for (int i = 0; i < 8; i++)
+				buffer[NetConstants.HeaderByteSize + i] = (byte)(counter >> (i * 8));
+
+			m_sender.Seal(0, counter, buffer, 0, HeaderSize, HeaderSize, length);
+			return plaintextEnd + NetChaCha20Poly1305.TagSize;
+		}
+
+		/// <summary>
+		/// Authenticates and decrypts a sealed packet in place; the plaintext runs from HeaderSize to plaintextEnd
+		/// </summary>
+		/// <returns>false if the packet is malformed, forged or replayed</returns>
+		internal bool Open(byte[] buffer, int length, out int plaintextEnd)
+		{
+			plaintextEnd = 0;
+			if (length < Overhead)
+				return false;
+
+			int payloadBits = buffer[3] | (buffer[4] << 8);
+			if (payloadBits != (length - NetConstants.HeaderByteSize) * 8)
+				return false;
+
+			ulong counter = 0;
+			for (int i = 7; i >= 0; i--)
+				counter = (counter << 8) | buffer[NetConstants.HeaderByteSize + i];
+
+			if (IsReplayed(counter))
+				return false;
+
+			if (!m_receiver.Open(0, counter, buffer, 0, HeaderSize, HeaderSize, length - Overhead))
+				return false;
+
+			// only authentic packets move the window
+			MarkReceived(counter);
+			plaintextEnd = length - NetChaCha20Poly1305.TagSize;
+			return true;
+		}
+
+		/// <summary>
+		/// Returns true for the messages that may still arrive unsealed once a connection is encrypted
+		/// </summary>
+		internal static bool IsAllowedUnsealed(NetMessageType tp)
+		{
+			// only the handshake, which carries the key exchange; everything after it, disconnects and pings included, is sealed
+			return tp == NetMessageType.Connect || tp == NetMessageType.ConnectResponse || tp == NetMessageType.ConnectionEstablished;
+		}
+
+		private bool IsReplayed(ulong counter)
+		{
+			if (!m_receivedAny || counter > m_highestReceived)
+				return false;
+
+			ulong age = m_highestReceived - counter;
+			if (age >= c_replayWindow)
+				return true; // too old to tell
+			return (m_receivedWindow & (1UL << (int)age)) != 0;
+		}
+
+		private void MarkReceived(ulong counter)
+		{
+			if (!m_receivedAny || counter > m_highestReceived)
+			{
+				ulong shift = (m_receivedAny ? counter - m_highestReceived : c_replayWindow);
+				m_receivedWindow = (shift >= c_replayWindow ? 0 : m_receivedWindow << (int)shift) | 1;
+				m_highestReceived = counter;
+				m_receivedAny = true;
+				return;
+			}
+
+			m_receivedWindow |= 1UL << (int)(m_highestReceived - counter);
+		}
+	}
+}
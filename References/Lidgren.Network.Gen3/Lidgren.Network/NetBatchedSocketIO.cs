@@ -0,0 +1,364 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Net;
+using System.Net.NetworkInformation;
+using System.Net.Sockets;
+using System.Runtime.InteropServices;
+
+namespace Lidgren.Network
+{
+	/// <summary>
+	/// Reads and writes batches of datagrams with one recvmmsg/sendmmsg call each; Linux only
+	/// </summary>
+	/// <remarks>
+	/// Datagrams live in fixed rings of pinned buffers which the native message headers point at,
+	/// so nothing is allocated per packet once every remote endpoint has been seen once.
+	/// All members must be called on the network thread.
+	/// </remarks>
+	internal sealed class NetBatchedSocketIO : IDisposable
+	{
+		internal const int BatchSize = 32;
+
+		// above the largest MTU that expansion will try
+		private const int c_maxDatagramSize = 8192;
+
+		private const int c_sockaddrInSize = 16;
+		private const ushort c_afInet = 2;
+		private const int c_msgDontWait = 0x40;
+		private const int c_msgTrunc = 0x20;
+		private const int c_errorInterrupted = 4;
+		private const int c_errorAccess = 13;
+		private const int c_errorWouldBlock = 11;
+		private const int c_errorConnectionRefused = 111;
+
+		[DllImport("libc", SetLastError = true)]
+		private static extern int recvmmsg(int sockfd, IntPtr msgvec, uint vlen, int flags, IntPtr timeout);
+
+		[DllImport("libc", SetLastError = true)]
+		private static extern int sendmmsg(int sockfd, IntPtr msgvec, uint vlen, int flags);
+
+		// struct mmsghdr { struct msghdr msg_hdr; unsigned int msg_len; }, laid out for the running word size
+		private static readonly int s_msgNameLenOffset = IntPtr.Size;
+		private static readonly int s_msgIovOffset = IntPtr.Size * 2;
+		private static readonly int s_msgIovLenOffset = IntPtr.Size * 3;
+		private static readonly int s_msgFlagsOffset = IntPtr.Size * 6;
+		private static readonly int s_msgLenOffset = Align(IntPtr.Size * 6 + 4);
+		private static readonly int s_mmsghdrSize = Align(s_msgLenOffset + 4);
+		private static readonly int s_iovecSize = IntPtr.Size * 2;
+
+		private readonly NetPeer m_peer;
+		private readonly int m_socket;
+		private readonly List<GCHandle> m_pinned = new List<GCHandle>();
+
+		private readonly Ring m_receive;
+		private readonly Ring m_send;
+		private readonly IPEndPoint[] m_sendTargets = new IPEndPoint[BatchSize];
+		private int m_sendCount;
+
+		// sending to these needs SO_BROADCAST, which only the unbatched path turns on
+		private readonly List<IPAddress> m_broadcastAddresses = GetBroadcastAddresses();
+
+		// endpoints a flushed datagram was refused by; reported by the next Send() to them, like SendTo reports a reset
+		private readonly List<IPEndPoint> m_refused = new List<IPEndPoint>();
+
+		// endpoints by address and port, so received datagrams don't allocate one each
+		private readonly Dictionary<long, IPEndPoint> m_endpoints = new Dictionary<long, IPEndPoint>();
+		private readonly IPEndPoint[] m_receivedFrom = new IPEndPoint[BatchSize];
+
+		private sealed class Ring
+		{
+			public IntPtr Headers;
+			public IntPtr Vectors;
+			public IntPtr Addresses;
+			public byte[][] Buffers;
+		}
+
+		private NetBatchedSocketIO(NetPeer peer, Socket socket)
+		{
+			m_peer = peer;
+			m_socket = socket.Handle.ToInt32();
+			m_receive = CreateRing();
+			m_send = CreateRing();
+		}
+
+		/// <summary>
+		/// Returns null if batched I/O isn't available here; the caller keeps using the socket directly
+		/// </summary>
+		internal static NetBatchedSocketIO TryCreate(NetPeer peer, Socket socket)
+		{
+			if (Environment.OSVersion.Platform != PlatformID.Unix)
+				return null;
+
+			try
+			{
+				// sending nothing tells us if the calls exist in this libc
+				if (sendmmsg(socket.Handle.ToInt32(), IntPtr.Zero, 0, 0) < 0)
+					return null;
+			}
+			catch (DllNotFoundException)
+			{
+				return null;
+			}
+			catch (EntryPointNotFoundException)
+			{
+				return null;
+			}
+
+			return new NetBatchedSocketIO(peer, socket);
+		}
+
+		private static List<IPAddress> GetBroadcastAddresses()
+		{
+			List<IPAddress> addresses = new List<IPAddress>();
+			try
+			{
+				foreach (NetworkInterface ni in NetworkInterface.GetAllNetworkInterfaces())
+				{
+					foreach (UnicastIPAddressInformation unicastAddress in ni.GetIPProperties().UnicastAddresses)
+					{
+						if (unicastAddress.Address.AddressFamily != AddressFamily.InterNetwork || unicastAddress.IPv4Mask == null)
+							continue;
+
+						byte[] address = unicastAddress.Address.GetAddressBytes();
+						byte[] mask = unicastAddress.IPv4Mask.GetAddressBytes();
+						for (int i = 0; i < address.Length; i++)
+							address[i] |= (byte)~mask[i];
+						addresses.Add(new IPAddress(address));
+					}
+				}
+			}
+			catch (Exception)
+			{
+				// not every runtime knows its netmasks; Flush() learns them from refused sends instead
+			}
+			return addresses;
+		}
+
+		/// <summary>
+		/// Returns false for broadcast addresses and packets larger than a ring slot, which have to be sent unbatched
+		/// </summary>
+		internal bool CanSend(IPEndPoint target, int numBytes)
+		{
+			if (numBytes > c_maxDatagramSize)
+				return false;
+
+			IPAddress address = target.Address;
+			if (address.Equals(IPAddress.Broadcast))
+				return false;
+			for (int i = 0; i < m_broadcastAddresses.Count; i++)
+				if (address.Equals(m_broadcastAddresses[i]))
+					return false;
+			return true;
+		}
+
+		private static int Align(int offset)
+		{
+			return (offset + IntPtr.Size - 1) & ~(IntPtr.Size - 1);
+		}
+
+		private Ring CreateRing()
+		{
+			Ring ring = new Ring();
+			ring.Headers = Marshal.AllocHGlobal(s_mmsghdrSize * BatchSize);
+			ring.Vectors = Marshal.AllocHGlobal(s_iovecSize * BatchSize);
+			ring.Addresses = Marshal.AllocHGlobal(c_sockaddrInSize * BatchSize);
+			ring.Buffers = new byte[BatchSize][];
+
+			for (int i = 0; i < s_mmsghdrSize * BatchSize; i++)
+				Marshal.WriteByte(ring.Headers, i, 0);
+
+			for (int i = 0; i < BatchSize; i++)
+			{
+				byte[] buffer = new byte[c_maxDatagramSize];
+				GCHandle handle = GCHandle.Alloc(buffer, GCHandleType.Pinned);
+				m_pinned.Add(handle);
+				ring.Buffers[i] = buffer;
+
+				IntPtr vector = new IntPtr(ring.Vectors.ToInt64() + i * s_iovecSize);
+				Marshal.WriteIntPtr(vector, 0, handle.AddrOfPinnedObject());
+				Marshal.WriteIntPtr(vector, IntPtr.Size, new IntPtr(c_maxDatagramSize));
+
+				IntPtr header = Header(ring, i);
+				Marshal.WriteIntPtr(header, 0, new IntPtr(ring.Addresses.ToInt64() + i * c_sockaddrInSize));
+				Marshal.WriteInt32(header, s_msgNameLenOffset, c_sockaddrInSize);
+				Marshal.WriteIntPtr(header, s_msgIovOffset, vector);
+				Marshal.WriteIntPtr(header, s_msgIovLenOffset, new IntPtr(1));
+			}
+			return ring;
+		}
+
+		private static IntPtr Header(Ring ring, int index)
+		{
+			return new IntPtr(ring.Headers.ToInt64() + index * s_mmsghdrSize);
+		}
+
+		private static IntPtr Vector(Ring ring, int index)
+		{
+			return new IntPtr(ring.Vectors.ToInt64() + index * s_iovecSize);
+		}
+
+		/// <summary>
+		/// Reads up to BatchSize waiting datagrams without blocking; returns how many were read
+		/// </summary>
+		internal int Receive()
+		{
+			for (int i = 0; i < BatchSize; i++)
+				Marshal.WriteInt32(Header(m_receive, i), s_msgNameLenOffset, c_sockaddrInSize);
+
+			int count = recvmmsg(m_socket, m_receive.Headers, BatchSize, c_msgDontWait, IntPtr.Zero);
+			if (count < 0)
+			{
+				int error = Marshal.GetLastWin32Error();
+				if (error != c_errorWouldBlock && error != c_errorInterrupted && error != c_errorConnectionRefused)
+					m_peer.LogWarning("recvmmsg failed; errno " + error);
+				return 0;
+			}
+
+			for (int i = 0; i < count; i++)
+				m_receivedFrom[i] = GetEndpoint(m_receive.Addresses, i);
+			return count;
+		}
+
+		/// <summary>
+		/// Gets a datagram read by the last Receive(); returns its length, or -1 if it was truncated
+		/// </summary>
+		internal int GetReceived(int index, out byte[] buffer, out IPEndPoint sender)
+		{
+			IntPtr header = Header(m_receive, index);
+			buffer = m_receive.Buffers[index];
+			sender = m_receivedFrom[index];
+
+			if ((Marshal.ReadInt32(header, s_msgFlagsOffset) & c_msgTrunc) != 0)
+				return -1;
+			return Marshal.ReadInt32(header, s_msgLenOffset);
+		}
+
+		private IPEndPoint GetEndpoint(IntPtr addresses, int index)
+		{
+			int offset = index * c_sockaddrInSize;
+			int port = (Marshal.ReadByte(addresses, offset + 2) << 8) | Marshal.ReadByte(addresses, offset + 3);
+			uint address = (uint)Marshal.ReadInt32(addresses, offset + 4);
+
+			long key = ((long)address << 16) | (long)port;
+			IPEndPoint endpoint;
+			if (!m_endpoints.TryGetValue(key, out endpoint))
+			{
+				// a flood of spoofed sources shouldn't grow this forever
+				if (m_endpoints.Count >= 4096)
+					m_endpoints.Clear();
+				endpoint = new IPEndPoint(new IPAddress((long)address), port);
+				m_endpoints[key] = endpoint;
+			}
+			return endpoint;
+		}
+
+		/// <summary>
+		/// Copies a packet into the send ring; it goes on the wire at the next Flush(), or now if the ring is full.
+		/// Returns true if an earlier packet to the same target was refused, which is as soon as a batched send can tell
+		/// </summary>
+		internal bool Send(byte[] data, int numBytes, IPEndPoint target)
+		{
+			NetException.Assert(numBytes <= c_maxDatagramSize, "Packet too large for batched send; check CanSend first");
+
+			if (m_sendCount == BatchSize)
+				Flush();
+
+			bool refused = false;
+			if (m_refused.Count > 0)
+			{
+				int refusedIndex = m_refused.IndexOf(target);
+				if (refusedIndex >= 0)
+				{
+					m_refused.RemoveAt(refusedIndex);
+					refused = true;
+				}
+			}
+
+			int index = m_sendCount++;
+			m_sendTargets[index] = target;
+			Buffer.BlockCopy(data, 0, m_send.Buffers[index], 0, numBytes);
+			Marshal.WriteIntPtr(Vector(m_send, index), IntPtr.Size, new IntPtr(numBytes));
+
+#pragma warning disable 618 // IPv4 only; GetAddressBytes() would allocate
+			int offset = index * c_sockaddrInSize;
+			Marshal.WriteInt16(m_send.Addresses, offset, (short)c_afInet);
+			Marshal.WriteByte(m_send.Addresses, offset + 2, (byte)(target.Port >> 8));
+			Marshal.WriteByte(m_send.Addresses, offset + 3, (byte)target.Port);
+			Marshal.WriteInt32(m_send.Addresses, offset + 4, (int)target.Address.Address);
+			Marshal.WriteInt64(m_send.Addresses, offset + 8, 0);
+#pragma warning restore 618
+
+			return refused;
+		}
+
+		/// <summary>
+		/// Puts every packet in the send ring on the wire
+		/// </summary>
+		internal void Flush()
+		{
+			int sent = 0;
+			while (sent < m_sendCount)
+			{
+				int count = sendmmsg(m_socket, Header(m_send, sent), (uint)(m_sendCount - sent), 0);
+				if (count > 0)
+				{
+					sent += count;
+					continue;
+				}
+
+				if (count == 0)
+				{
+					// nothing sent and no error set, so errno is stale; don't spin on it
+					m_peer.LogWarning("sendmmsg sent nothing; dropping " + (m_sendCount - sent) + " packets");
+					break;
+				}
+
+				int error = Marshal.GetLastWin32Error();
+				if (error == c_errorInterrupted)
+					continue;
+
+				IPEndPoint target = m_sendTargets[sent];
+				if (error == c_errorWouldBlock)
+				{
+					m_peer.LogWarning("Socket would block - send buffer full? Increase in NetPeerConfiguration");
+				}
+				else if (error == c_errorConnectionRefused)
+				{
+					if (!m_refused.Contains(target))
+						m_refused.Add(target);
+				}
+				else if (error == c_errorAccess && !m_broadcastAddresses.Contains(target.Address))
+				{
+					// a broadcast address we didn't know about; send to it unbatched from now on
+					m_peer.LogWarning("sendmmsg to " + target.Address + " refused; treating it as a broadcast address");
+					m_broadcastAddresses.Add(target.Address);
+				}
+				else
+				{
+					m_peer.LogWarning("sendmmsg failed; errno " + error);
+				}
+
+				// drop the one that failed, like a single send would, and carry on with the rest
+				sent++;
+			}
+
+			for (int i = 0; i < m_sendCount; i++)
+				m_sendTargets[i] = null;
+			m_sendCount = 0;
+		}
+
+		public void Dispose()
+		{
+			foreach (GCHandle handle in m_pinned)
+				handle.Free();
+			m_pinned.Clear();
+
+			foreach (Ring ring in new Ring[] { m_receive, m_send })
+			{
+				Marshal.FreeHGlobal(ring.Headers);
+				Marshal.FreeHGlobal(ring.Vectors);
+				Marshal.FreeHGlobal(ring.Addresses);
+			}
+		}
+	}
+}
@@ -27,8 +27,17 @@ namespace Lidgren.Network
 	/// <summary>
 	/// Helper class for NetBuffer to write/read bits
 	/// </summary>
+	/// <remarks>
+	/// Bits are packed least significant first into little endian bytes. Every read or write moves up to
+	/// 57 bits (a 64 bit word less the worst case bit offset) through one 64 bit scratch word, loaded
+	/// and stored a whole word at a time where the buffer allows, rather than shifting and masking each
+	/// byte against its neighbour. Byte aligned reads and writes of whole bytes are copied directly.
+	/// </remarks>
 	public static class NetBitWriter
 	{
+		// the most bits that fit in the scratch word whatever the bit offset
+		private const int c_maxWordBits = 57;
+
 		/// <summary>
 		/// Read 1-8 bits from a buffer into a byte
 		/// </summary>
@@ -36,30 +45,10 @@ namespace Lidgren.Network
 		{
 			NetException.Assert(((numberOfBits > 0) && (numberOfBits < 9)), "Read() can only read between 1 and 8 bits");
 
-			int bytePtr = readBitOffset >> 3;
-			int startReadAtIndex = readBitOffset - (bytePtr * 8); // (readBitOffset % 8);
-
-			if (startReadAtIndex == 0 && numberOfBits == 8)
-				return fromBuffer[bytePtr];
+			if ((readBitOffset & 7) == 0 && numberOfBits == 8)
+				return fromBuffer[readBitOffset >> 3];
 
-			// mask away unused bits lower than (right of) relevant bits in first byte
-			byte returnValue = (byte)(fromBuffer[bytePtr] >> startReadAtIndex);
-
-			int numberOfBitsInSecondByte = numberOfBits - (8 - startReadAtIndex);
-
-			if (numberOfBitsInSecondByte < 1)
-			{
-				// we don't need to read from the second byte, but we DO need
-				// to mask away unused bits higher than (left of) relevant bits
-				return (byte)(returnValue & (255 >> (8 - numberOfBits)));
-			}
-
-			byte second = fromBuffer[bytePtr + 1];
-
-			// mask away unused bits higher than (left of) relevant bits in second byte
-			second &= (byte)(255 >> (8 - numberOfBitsInSecondByte));
-
-			return (byte)(returnValue | (byte)(second << (numberOfBits - numberOfBitsInSecondByte)));
+			return (byte)ReadBits(fromBuffer, numberOfBits, readBitOffset);
 		}
 
 		/// <summary>
@@ -67,32 +56,23 @@ namespace Lidgren.Network
 		/// </summary>
 		public static void ReadBytes(byte[] fromBuffer, int numberOfBytes, int readBitOffset, byte[] destination, int destinationByteOffset)
 		{
-			int readPtr = readBitOffset >> 3;
-			int startReadAtIndex = readBitOffset - (readPtr * 8); // (readBitOffset % 8);
-
-			if (startReadAtIndex == 0)
+			if ((readBitOffset & 7) == 0)
 			{
-				Buffer.BlockCopy(fromBuffer, readPtr, destination, destinationByteOffset, numberOfBytes);
+				Buffer.BlockCopy(fromBuffer, readBitOffset >> 3, destination, destinationByteOffset, numberOfBytes);
 				return;
 			}
 
-			int secondPartLen = 8 - startReadAtIndex;
-			int secondMask = 255 >> secondPartLen;
-
-			for (int i = 0; i < numberOfBytes; i++)
+			// seven bytes per word
+			while (numberOfBytes > 0)
 			{
-				// mask away unused bits lower than (right of) relevant bits in byte
-				int b = fromBuffer[readPtr] >> startReadAtIndex;
-
-				readPtr++;
-
-				// mask away unused bits higher than (left of) relevant bits in second byte
-				int second = fromBuffer[readPtr] & secondMask;
+				int chunk = (numberOfBytes < 7 ? numberOfBytes : 7);
+				ulong word = ReadBits(fromBuffer, chunk * 8, readBitOffset);
+				StoreBytes(word, destination, destinationByteOffset, chunk);
 
-				destination[destinationByteOffset++] = (byte)(b | (second << secondPartLen));
+				readBitOffset += chunk * 8;
+				destinationByteOffset += chunk;
+				numberOfBytes -= chunk;
 			}
-
-			return;
 		}
 
 		/// <summary>
@@ -102,37 +82,14 @@ namespace Lidgren.Network
 		{
 			NetException.Assert(((numberOfBits >= 1) && (numberOfBits <= 8)), "Must write between 1 and 8 bits!");
 
-			// mask out unwanted bits in the source
-			byte isrc = (byte)((uint)source & ((~(uint)0) >> (8 - numberOfBits)));
-
-			int bytePtr = destBitOffset >> 3;
-
-			int localBitLen = (destBitOffset % 8);
-			if (localBitLen == 0)
+			if ((destBitOffset & 7) == 0)
 			{
-				destination[bytePtr] = (byte)isrc;
+				// mask out unwanted bits in the source
+				destination[destBitOffset >> 3] = (byte)((uint)source & (0xffu >> (8 - numberOfBits)));
 				return;
 			}
 
-			//destination[bytePtr] &= (byte)(255 >> (8 - localBitLen)); // clear before writing
-			//destination[bytePtr] |= (byte)(isrc << localBitLen); // write first half
-			destination[bytePtr] = (byte)(
-				(uint)(destination[bytePtr] & (255 >> (8 - localBitLen))) |
-				(uint)(isrc << localBitLen)
-			);
-
-			// need write into next byte?
-			if (localBitLen + numberOfBits > 8)
-			{
-				//destination[bytePtr + 1] &= (byte)(255 << localBitLen); // clear before writing
-				//destination[bytePtr + 1] |= (byte)(isrc >> (8 - localBitLen)); // write second half
-				destination[bytePtr + 1] = (byte)(
-					(uint)(destination[bytePtr + 1] & (255 << localBitLen)) |
-					(uint)(isrc >> (8 - localBitLen))
-				);
-			}
-
-			return;
+			WriteBits(source, numberOfBits, destination, destBitOffset);
 		}
 
 		/// <summary>
@@ -140,148 +97,59 @@ namespace Lidgren.Network
 		/// </summary>
 		public static void WriteBytes(byte[] source, int sourceByteOffset, int numberOfBytes, byte[] destination, int destBitOffset)
 		{
-			int dstBytePtr = destBitOffset >> 3;
-			int firstPartLen = (destBitOffset % 8);
-
-			if (firstPartLen == 0)
+			if ((destBitOffset & 7) == 0)
 			{
-				Buffer.BlockCopy(source, sourceByteOffset, destination, dstBytePtr, numberOfBytes);
+				Buffer.BlockCopy(source, sourceByteOffset, destination, destBitOffset >> 3, numberOfBytes);
 				return;
 			}
 
-			int lastPartLen = 8 - firstPartLen;
-
-			for (int i = 0; i < numberOfBytes; i++)
+			// seven bytes per word
+			while (numberOfBytes > 0)
 			{
-				byte src = source[sourceByteOffset + i];
-
-				// write last part of this byte
-				destination[dstBytePtr] &= (byte)(255 >> lastPartLen); // clear before writing
-				destination[dstBytePtr] |= (byte)(src << firstPartLen); // write first half
+				int chunk = (numberOfBytes < 7 ? numberOfBytes : 7);
+				ulong word = LoadBytes(source, sourceByteOffset, chunk);
+				WriteBits(word, chunk * 8, destination, destBitOffset);
 
-				dstBytePtr++;
-
-				// write first part of next byte
-				destination[dstBytePtr] &= (byte)(255 << firstPartLen); // clear before writing
-				destination[dstBytePtr] |= (byte)(src >> lastPartLen); // write second half
+				destBitOffset += chunk * 8;
+				sourceByteOffset += chunk;
+				numberOfBytes -= chunk;
 			}
-
-			return;
 		}
 
 		/// <summary>
 		/// Reads the specified number of bits into an UInt32
 		/// </summary>
 		[CLSCompliant(false)]
-#if UNSAFE
-		public static unsafe uint ReadUInt32(byte[] fromBuffer, int numberOfBits, int readBitOffset)
+		public static uint ReadUInt32(byte[] fromBuffer, int numberOfBits, int readBitOffset)
 		{
 			NetException.Assert(((numberOfBits > 0) && (numberOfBits <= 32)), "ReadUInt32() can only read between 1 and 32 bits");
+			return (uint)ReadBits(fromBuffer, numberOfBits, readBitOffset);
+		}
 
-			if (numberOfBits == 32 && ((readBitOffset % 8) == 0))
-			{
-				fixed (byte* ptr = &(fromBuffer[readBitOffset / 8]))
-				{
-					return *(((uint*)ptr));
-				}
-			}
-#else
-		
-		public static uint ReadUInt32(byte[] fromBuffer, int numberOfBits, int readBitOffset)
+		/// <summary>
+		/// Reads the specified number of bits into an UInt64
+		/// </summary>
+		[CLSCompliant(false)]
+		public static ulong ReadUInt64(byte[] fromBuffer, int numberOfBits, int readBitOffset)
 		{
-			NetException.Assert(((numberOfBits > 0) && (numberOfBits <= 32)), "ReadUInt32() can only read between 1 and 32 bits");
-#endif
-			uint returnValue;
-			if (numberOfBits <= 8)
-			{
-				returnValue = ReadByte(fromBuffer, numberOfBits, readBitOffset);
-				return returnValue;
-			}
-			returnValue = ReadByte(fromBuffer, 8, readBitOffset);
-			numberOfBits -= 8;
-			readBitOffset += 8;
+			NetException.Assert(((numberOfBits > 0) && (numberOfBits <= 64)), "ReadUInt64() can only read between 1 and 64 bits");
 
-			if (numberOfBits <= 8)
-			{
-				returnValue |= (uint)(ReadByte(fromBuffer, numberOfBits, readBitOffset) << 8);
-				return returnValue;
-			}
-			returnValue |= (uint)(ReadByte(fromBuffer, 8, readBitOffset) << 8);
-			numberOfBits -= 8;
-			readBitOffset += 8;
+			if (numberOfBits <= c_maxWordBits)
+				return ReadBits(fromBuffer, numberOfBits, readBitOffset);
 
-			if (numberOfBits <= 8)
-			{
-				uint r = ReadByte(fromBuffer, numberOfBits, readBitOffset);
-				r <<= 16;
-				returnValue |= r;
-				return returnValue;
-			}
-			returnValue |= (uint)(ReadByte(fromBuffer, 8, readBitOffset) << 16);
-			numberOfBits -= 8;
-			readBitOffset += 8;
-
-			returnValue |= (uint)(ReadByte(fromBuffer, numberOfBits, readBitOffset) << 24);
-
-#if BIGENDIAN
-			// reorder bytes
-			return
-				((a & 0xff000000) >> 24) |
-				((a & 0x00ff0000) >> 8) |
-				((a & 0x0000ff00) << 8) |
-				((a & 0x000000ff) << 24);
-#endif
-
-			return returnValue;
+			ulong low = ReadBits(fromBuffer, 32, readBitOffset);
+			ulong high = ReadBits(fromBuffer, numberOfBits - 32, readBitOffset + 32);
+			return low | (high << 32);
 		}
 
-		//[CLSCompliant(false)]
-		//public static ulong ReadUInt64(byte[] fromBuffer, int numberOfBits, int readBitOffset)
-
 		/// <summary>
 		/// Writes the specified number of bits into a byte array
 		/// </summary>
 		[CLSCompliant(false)]
 		public static int WriteUInt32(uint source, int numberOfBits, byte[] destination, int destinationBitOffset)
 		{
-#if BIGENDIAN
-			// reorder bytes
-			source = ((source & 0xff000000) >> 24) |
-				((source & 0x00ff0000) >> 8) |
-				((source & 0x0000ff00) << 8) |
-				((source & 0x000000ff) << 24);
-#endif
-
-			int returnValue = destinationBitOffset + numberOfBits;
-			if (numberOfBits <= 8)
-			{
-				NetBitWriter.WriteByte((byte)source, numberOfBits, destination, destinationBitOffset);
-				return returnValue;
-			}
-			NetBitWriter.WriteByte((byte)source, 8, destination, destinationBitOffset);
-			destinationBitOffset += 8;
-			numberOfBits -= 8;
-
-			if (numberOfBits <= 8)
-			{
-				NetBitWriter.WriteByte((byte)(source >> 8), numberOfBits, destination, destinationBitOffset);
-				return returnValue;
-			}
-			NetBitWriter.WriteByte((byte)(source >> 8), 8, destination, destinationBitOffset);
-			destinationBitOffset += 8;
-			numberOfBits -= 8;
-
-			if (numberOfBits <= 8)
-			{
-				NetBitWriter.WriteByte((byte)(source >> 16), numberOfBits, destination, destinationBitOffset);
-				return returnValue;
-			}
-			NetBitWriter.WriteByte((byte)(source >> 16), 8, destination, destinationBitOffset);
-			destinationBitOffset += 8;
-			numberOfBits -= 8;
-
-			NetBitWriter.WriteByte((byte)(source >> 24), numberOfBits, destination, destinationBitOffset);
-			return returnValue;
+			WriteBits(source, numberOfBits, destination, destinationBitOffset);
+			return destinationBitOffset + numberOfBits;
 		}
 
 		/// <summary>
@@ -290,91 +158,82 @@ namespace Lidgren.Network
 		[CLSCompliant(false)]
 		public static int WriteUInt64(ulong source, int numberOfBits, byte[] destination, int destinationBitOffset)
 		{
-#if BIGENDIAN
-			source = ((source & 0xff00000000000000L) >> 56) |
-				((source & 0x00ff000000000000L) >> 40) |
-				((source & 0x0000ff0000000000L) >> 24) |
-				((source & 0x000000ff00000000L) >> 8) |
-				((source & 0x00000000ff000000L) << 8) |
-				((source & 0x0000000000ff0000L) << 24) |
-				((source & 0x000000000000ff00L) << 40) |
-				((source & 0x00000000000000ffL) << 56);
-#endif
-
-			int returnValue = destinationBitOffset + numberOfBits;
-			if (numberOfBits <= 8)
+			if (numberOfBits <= c_maxWordBits)
 			{
-				NetBitWriter.WriteByte((byte)source, numberOfBits, destination, destinationBitOffset);
-				return returnValue;
+				WriteBits(source, numberOfBits, destination, destinationBitOffset);
 			}
-			NetBitWriter.WriteByte((byte)source, 8, destination, destinationBitOffset);
-			destinationBitOffset += 8;
-			numberOfBits -= 8;
-
-			if (numberOfBits <= 8)
+			else
 			{
-				NetBitWriter.WriteByte((byte)(source >> 8), numberOfBits, destination, destinationBitOffset);
-				return returnValue;
+				WriteBits(source, 32, destination, destinationBitOffset);
+				WriteBits(source >> 32, numberOfBits - 32, destination, destinationBitOffset + 32);
 			}
-			NetBitWriter.WriteByte((byte)(source >> 8), 8, destination, destinationBitOffset);
-			destinationBitOffset += 8;
-			numberOfBits -= 8;
+			return destinationBitOffset + numberOfBits;
+		}
 
-			if (numberOfBits <= 8)
-			{
-				NetBitWriter.WriteByte((byte)(source >> 16), numberOfBits, destination, destinationBitOffset);
-				return returnValue;
-			}
-			NetBitWriter.WriteByte((byte)(source >> 16), 8, destination, destinationBitOffset);
-			destinationBitOffset += 8;
-			numberOfBits -= 8;
+		//
+		// Scratch word
+		//
 
-			if (numberOfBits <= 8)
-			{
-				NetBitWriter.WriteByte((byte)(source >> 24), numberOfBits, destination, destinationBitOffset);
-				return returnValue;
-			}
-			NetBitWriter.WriteByte((byte)(source >> 24), 8, destination, destinationBitOffset);
-			destinationBitOffset += 8;
-			numberOfBits -= 8;
+		/// <summary>
+		/// Reads 1-57 bits through the scratch word
+		/// </summary>
+		private static ulong ReadBits(byte[] fromBuffer, int numberOfBits, int readBitOffset)
+		{
+			int bytePtr = readBitOffset >> 3;
+			int shift = readBitOffset & 7;
 
-			if (numberOfBits <= 8)
-			{
-				NetBitWriter.WriteByte((byte)(source >> 32), numberOfBits, destination, destinationBitOffset);
-				return returnValue;
-			}
-			NetBitWriter.WriteByte((byte)(source >> 32), 8, destination, destinationBitOffset);
-			destinationBitOffset += 8;
-			numberOfBits -= 8;
+			ulong word;
+			if (BitConverter.IsLittleEndian && bytePtr + 8 <= fromBuffer.Length)
+				word = BitConverter.ToUInt64(fromBuffer, bytePtr); // refill a whole word; surplus bytes are masked away
+			else
+				word = LoadBytes(fromBuffer, bytePtr, (shift + numberOfBits + 7) >> 3);
 
-			if (numberOfBits <= 8)
-			{
-				NetBitWriter.WriteByte((byte)(source >> 40), numberOfBits, destination, destinationBitOffset);
-				return returnValue;
-			}
-			NetBitWriter.WriteByte((byte)(source >> 40), 8, destination, destinationBitOffset);
-			destinationBitOffset += 8;
-			numberOfBits -= 8;
+			return (word >> shift) & (ulong.MaxValue >> (64 - numberOfBits));
+		}
 
-			if (numberOfBits <= 8)
-			{
-				NetBitWriter.WriteByte((byte)(source >> 48), numberOfBits, destination, destinationBitOffset);
-				return returnValue;
-			}
-			NetBitWriter.WriteByte((byte)(source >> 48), 8, destination, destinationBitOffset);
-			destinationBitOffset += 8;
-			numberOfBits -= 8;
+		/// <summary>
+		/// Writes 1-57 bits through the scratch word; bits below the offset in the first byte are kept,
+		/// bits above the last written bit in the last byte are cleared
+		/// </summary>
+		private static void WriteBits(ulong source, int numberOfBits, byte[] destination, int destBitOffset)
+		{
+			int bytePtr = destBitOffset >> 3;
+			int shift = destBitOffset & 7;
 
-			if (numberOfBits <= 8)
+			ulong word = (source & (ulong.MaxValue >> (64 - numberOfBits))) << shift;
+			if (shift != 0)
+				word |= (ulong)destination[bytePtr] & (0xffu >> (8 - shift));
+
+			StoreBytes(word, destination, bytePtr, (shift + numberOfBits + 7) >> 3);
+		}
+
+		/// <summary>
+		/// Loads 1-8 bytes as a little endian word
+		/// </summary>
+		private static ulong LoadBytes(byte[] buffer, int offset, int numberOfBytes)
+		{
+			ulong word = 0;
+			for (int i = numberOfBytes - 1; i >= 0; i--)
+				word = (word << 8) | buffer[offset + i];
+			return word;
+		}
+
+		/// <summary>
+		/// Stores the low 1-8 bytes of a word, little endian
+		/// </summary>
+		private static void StoreBytes(ulong word, byte[] buffer, int offset, int numberOfBytes)
+		{
+			switch (numberOfBytes)
 			{
-				NetBitWriter.WriteByte((byte)(source >> 56), numberOfBits, destination, destinationBitOffset);
-				return returnValue;
+				case 8: buffer[offset + 7] = (byte)(word >> 56); goto case 7;
+				case 7: buffer[offset + 6] = (byte)(word >> 48); goto case 6;
+				case 6: buffer[offset + 5] = (byte)(word >> 40); goto case 5;
+				case 5: buffer[offset + 4] = (byte)(word >> 32); goto case 4;
+				case 4: buffer[offset + 3] = (byte)(word >> 24); goto case 3;
+				case 3: buffer[offset + 2] = (byte)(word >> 16); goto case 2;
+				case 2: buffer[offset + 1] = (byte)(word >> 8); goto case 1;
+				case 1: buffer[offset] = (byte)word; break;
 			}
-			NetBitWriter.WriteByte((byte)(source >> 56), 8, destination, destinationBitOffset);
-			destinationBitOffset += 8;
-			numberOfBits -= 8;
-
-			return returnValue;
 		}
 
 		//
@@ -0,0 +1,125 @@
+﻿using System;
+
+namespace Lidgren.Network
+{
+	/// <summary>
+	/// AIMD congestion window shared by the reliable channels of one connection
+	/// </summary>
+	/// <remarks>
+	/// The window, counted in messages, grows by one per ack up to the slow start threshold and by one per
+	/// window's worth of acks beyond it. A hole in the ack sequence halves it; a resend timeout drops it to
+	/// the minimum. Only one decrease is taken per round trip, since the losses of one window are one event.
+	/// Network thread only.
+	/// </remarks>
+	internal sealed class NetCongestionControl
+	{
+		private const float c_minimumWindow = 2.0f;
+		private const float c_initialWindow = 4.0f;
+
+		private readonly float m_maximumWindow;
+
+		private float m_window;
+		private float m_slowStartThreshold;
+		private int m_inFlight;
+		private float m_recoveryUntil;
+
+		private float m_smoothedRoundtrip;
+		private float m_averageMessageBytes;
+
+		internal NetCongestionControl(int maximumWindow)
+		{
+			m_maximumWindow = (float)maximumWindow;
+			Reset();
+		}
+
+		/// <summary>
+		/// Gets the congestion window, in messages
+		/// </summary>
+		internal float Window { get { return m_window; } }
+
+		/// <summary>
+		/// Gets the rate the window allows, in bytes per second; zero until a round trip has been measured
+		/// </summary>
+		internal float SendRate
+		{
+			get
+			{
+				if (m_smoothedRoundtrip <= 0.0f)
+					return 0.0f;
+				return m_window * m_averageMessageBytes / m_smoothedRoundtrip;
+			}
+		}
+
+		internal void Reset()
+		{
+			m_window = c_initialWindow;
+			m_slowStartThreshold = m_maximumWindow;
+			m_inFlight = 0;
+			m_recoveryUntil = 0.0f;
+			m_smoothedRoundtrip = 0.0f;
+			m_averageMessageBytes = 0.0f;
+		}
+
+		/// <summary>
+		/// Returns how many more new messages may be put in flight right now
+		/// </summary>
+		internal int GetAllowedSends()
+		{
+			int allowed = (int)m_window - m_inFlight;
+			return (allowed < 0 ? 0 : allowed);
+		}
+
+		/// <summary>
+		/// A new message has been sent for the first time
+		/// </summary>
+		internal void MessageSent(int encodedBytes)
+		{
+			m_inFlight++;
+
+			if (m_averageMessageBytes <= 0.0f)
+				m_averageMessageBytes = encodedBytes;
+			else
+				m_averageMessageBytes = (m_averageMessageBytes * 0.9f) + (encodedBytes * 0.1f);
+		}
+
+		/// <summary>
+		/// A message has been acknowledged; roundtrip is its round trip time, or a negative value if it was resent and is ambiguous
+		/// </summary>
+		internal void MessageAcknowledged(float roundtrip)
+		{
+			if (m_inFlight > 0)
+				m_inFlight--;
+
+			if (roundtrip >= 0.0f)
+			{
+				if (m_smoothedRoundtrip <= 0.0f)
+					m_smoothedRoundtrip = roundtrip;
+				else
+					m_smoothedRoundtrip = (m_smoothedRoundtrip * 0.875f) + (roundtrip * 0.125f);
+			}
+
+			if (m_window < m_slowStartThreshold)
+				m_window += 1.0f;
+			else
+				m_window += 1.0f / m_window;
+
+			if (m_window > m_maximumWindow)
+				m_window = m_maximumWindow;
+		}
+
+		/// <summary>
+		/// A message is being resent; timedOut is true if it went unacknowledged for the full resend delay
+		/// </summary>
+		internal void MessageLost(float now, bool timedOut)
+		{
+			if (now < m_recoveryUntil)
+				return; // already backed off for this window
+
+			m_slowStartThreshold = Math.Max(m_window * 0.5f, c_minimumWindow);
+			m_window = (timedOut ? c_minimumWindow : m_slowStartThreshold);
+
+			float rtt = (m_smoothedRoundtrip > 0.0f ? m_smoothedRoundtrip : 0.1f);
+			m_recoveryUntil = now + rtt;
+		}
+	}
+}
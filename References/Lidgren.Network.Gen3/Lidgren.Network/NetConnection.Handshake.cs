@@ -14,6 +14,11 @@ namespace Lidgren.Network
 		internal float m_lastHandshakeSendTime;
 		internal int m_handshakeAttempts;
 
+		// packet encryption key exchange; kept for handshake resends
+		private byte[] m_keyExchangePrivate;
+		private byte[] m_localKeyShare;
+		private byte[] m_remoteKeyShare;
+
 		/// <summary>
 		/// The message that the remote part specified via Connect() or Approve() - can be null.
 		/// </summary>
@@ -102,6 +107,8 @@ namespace Lidgren.Network
 				if (channel != null)
 					channel.Reset();
 			}
+			if (m_congestion != null)
+				m_congestion.Reset();
 
 			if (sendByeMessage)
 				SendDisconnect(reason, true);
@@ -127,6 +134,7 @@ namespace Lidgren.Network
 			om.Write(m_peer.m_uniqueIdentifier);
 			om.Write(now);
 
+			WriteLocalKeyShare(om);
 			WriteLocalHail(om);
 			
 			m_peer.SendLibrary(om, m_remoteEndpoint);
@@ -151,6 +159,7 @@ namespace Lidgren.Network
 			om.Write(m_peer.m_uniqueIdentifier);
 			om.Write(now);
 
+			WriteLocalKeyShare(om);
 			WriteLocalHail(om);
 
 			if (onLibraryThread)
@@ -175,11 +184,49 @@ namespace Lidgren.Network
 			NetOutgoingMessage om = m_peer.CreateMessage(reason);
 			om.m_messageType = NetMessageType.Disconnect;
 			if (onLibraryThread)
-				m_peer.SendLibrary(om, m_remoteEndpoint);
+				SendLibraryPacket(om);
 			else
 				m_peer.m_unsentUnconnectedMessages.Enqueue(new NetTuple<System.Net.IPEndPoint, NetOutgoingMessage>(m_remoteEndpoint, om));
 		}
 
+		// the Diffie-Hellman share, ahead of the hail, when packets are to be encrypted
+		private void WriteLocalKeyShare(NetOutgoingMessage om)
+		{
+			if (!m_peerConfiguration.m_enablePacketEncryption)
+				return;
+
+			if (m_localKeyShare == null)
+			{
+				m_keyExchangePrivate = NetPacketCipher.CreatePrivateKey();
+				m_localKeyShare = NetPacketCipher.ComputeKeyShare(m_keyExchangePrivate);
+			}
+			om.Write(m_localKeyShare);
+		}
+
+		// derives the keys once both shares are known; false if the remote share is bad
+		private bool CreatePacketCipher()
+		{
+			if (!m_peerConfiguration.m_enablePacketEncryption || m_packetCipher != null)
+				return true;
+
+			if (m_localKeyShare == null)
+			{
+				m_keyExchangePrivate = NetPacketCipher.CreatePrivateKey();
+				m_localKeyShare = NetPacketCipher.ComputeKeyShare(m_keyExchangePrivate);
+			}
+
+			NetPacketCipher cipher = NetPacketCipher.Create(m_keyExchangePrivate, m_localKeyShare, m_remoteKeyShare, m_connectionInitiator, m_peerConfiguration.m_packetEncryptionSecret);
+			if (cipher == null)
+			{
+				ExecuteDisconnect("Bad key share in handshake", true);
+				return false;
+			}
+
+			SetPacketCipher(cipher);
+			m_keyExchangePrivate = null;
+			return true;
+		}
+
 		private void WriteLocalHail(NetOutgoingMessage om)
 		{
 			if (m_localHailMessage != null)
@@ -262,7 +309,7 @@ namespace Lidgren.Network
 			m_peer.m_handshakes.Remove(m_remoteEndpoint); // TODO: make this more thread safe? we're on user thread
 		}
 
-		internal void ReceivedHandshake(double now, NetMessageType tp, int ptr, int payloadLength)
+		internal void ReceivedHandshake(byte[] data, double now, NetMessageType tp, int ptr, int payloadLength)
 		{
 			m_peer.VerifyNetworkThread();
 
@@ -273,7 +320,7 @@ namespace Lidgren.Network
 					if (m_status == NetConnectionStatus.None)
 					{
 						// Whee! Server full has already been checked
-						bool ok = ValidateHandshakeData(ptr, payloadLength, out hail);
+						bool ok = ValidateHandshakeData(ptr, payloadLength, out hail) && CreatePacketCipher();
 						if (ok)
 						{
 							if (hail != null)
@@ -322,7 +369,7 @@ namespace Lidgren.Network
 					{
 						case NetConnectionStatus.InitiatedConnect:
 							// awesome
-							bool ok = ValidateHandshakeData(ptr, payloadLength, out hail);
+							bool ok = ValidateHandshakeData(ptr, payloadLength, out hail) && CreatePacketCipher();
 							if (ok)
 							{
 								if (hail != null)
@@ -396,11 +443,11 @@ namespace Lidgren.Network
 					break;
 
 				case NetMessageType.Discovery:
-					m_peer.HandleIncomingDiscoveryRequest(now, m_remoteEndpoint, ptr, payloadLength);
+					m_peer.HandleIncomingDiscoveryRequest(data, now, m_remoteEndpoint, ptr, payloadLength);
 					return;
 
 				case NetMessageType.DiscoveryResponse:
-					m_peer.HandleIncomingDiscoveryResponse(now, m_remoteEndpoint, ptr, payloadLength);
+					m_peer.HandleIncomingDiscoveryResponse(data, now, m_remoteEndpoint, ptr, payloadLength);
 					return;
 
 				case NetMessageType.Ping:
@@ -425,6 +472,13 @@ namespace Lidgren.Network
 				long remoteUniqueIdentifier = msg.ReadInt64();
 				InitializeRemoteTimeOffset(msg.ReadSingle());
 
+				if (m_peerConfiguration.m_enablePacketEncryption)
+				{
+					if (payloadLength - (msg.PositionInBytes - ptr) < NetPacketCipher.KeyShareSize)
+						throw new NetException("No key share; is packet encryption enabled on both peers?");
+					m_remoteKeyShare = msg.ReadBytes(NetPacketCipher.KeyShareSize);
+				}
+
 				int remainingBytes = payloadLength - (msg.PositionInBytes - ptr);
 				if (remainingBytes > 0)
 					hail = msg.ReadBytes(remainingBytes);
@@ -466,6 +520,7 @@ namespace Lidgren.Network
 
 			m_handshakeAttempts = 0;
 			m_disconnectRequested = true;
+			Wake();
 		}
 	}
 }
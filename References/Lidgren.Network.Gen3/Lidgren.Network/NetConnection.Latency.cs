@@ -69,11 +69,7 @@ namespace Lidgren.Network
 			om.Write((byte)m_sentPingNumber); // truncating to 0-255
 			om.m_messageType = NetMessageType.Ping;
 
-			int len = om.Encode(m_peer.m_sendBuffer, 0, 0);
-			bool connectionReset;
-			m_peer.SendPacket(len, m_remoteEndpoint, 1, out connectionReset);
-
-			m_statistics.PacketSent(len, 1);
+			SendLibraryPacket(om);
 		}
 
 		internal void SendPong(int pingNumber)
@@ -85,12 +81,7 @@ namespace Lidgren.Network
 			om.Write((float)NetTime.Now); // we should update this value to reflect the exact point in time the packet is SENT
 			om.m_messageType = NetMessageType.Pong;
 
-			int len = om.Encode(m_peer.m_sendBuffer, 0, 0);
-			bool connectionReset;
-
-			m_peer.SendPacket(len, m_remoteEndpoint, 1, out connectionReset);
-
-			m_statistics.PacketSent(len, 1);
+			SendLibraryPacket(om);
 		}
 
 		internal void ReceivedPong(float now, int pongNumber, float remoteSendTime)
@@ -65,6 +65,16 @@ namespace Lidgren.Network
 			}
 		}
 
+		// when MTUExpansionHeartbeat() next has something to do
+		private float GetNextMTUExpansionTime(float now)
+		{
+			if (m_expandMTUStatus == ExpandMTUStatus.Finished)
+				return float.MaxValue;
+			if (m_expandMTUStatus == ExpandMTUStatus.None)
+				return now;
+			return (float)(m_lastSentMTUAttemptTime + m_peerConfiguration.ExpandMTUFrequency);
+		}
+
 		private void ExpandMTU(double now, bool succeeded)
 		{
 			int tryMTU;
@@ -102,7 +112,9 @@ namespace Lidgren.Network
 			byte[] tmp = new byte[size];
 			om.Write(tmp);
 			om.m_messageType = NetMessageType.ExpandMTURequest;
-			int len = om.Encode(m_peer.m_sendBuffer, 0, 0);
+
+			// sealing makes the probe larger than size; the mtu found is a little short of what the path takes, never over
+			int len = EncodeLibraryPacket(om);
 
 			bool ok = m_peer.SendMTUPacket(len, m_remoteEndpoint);
 			if (ok == false)
@@ -146,13 +158,9 @@ namespace Lidgren.Network
 			NetOutgoingMessage om = m_peer.CreateMessage(1);
 			om.Write(size);
 			om.m_messageType = NetMessageType.ExpandMTUSuccess;
-			int len = om.Encode(m_peer.m_sendBuffer, 0, 0);
-			bool connectionReset;
-			m_peer.SendPacket(len, m_remoteEndpoint, 1, out connectionReset);
+			SendLibraryPacket(om);
 
 			// m_peer.LogDebug("Received MTU expand request for " + size + " bytes");
-
-			m_statistics.PacketSent(len, 1);
 		}
 
 		private void HandleExpandMTUSuccess(double now, int size)
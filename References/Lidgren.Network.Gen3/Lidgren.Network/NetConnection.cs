@@ -1,4 +1,5 @@
 ﻿using System;
+using System.Collections.Generic;
 using System.Net;
 using System.Threading;
 using System.Diagnostics;
@@ -22,10 +23,24 @@ namespace Lidgren.Network
 		internal long m_remoteUniqueIdentifier;
 		internal NetQueue<NetTuple<NetMessageType, int>> m_queuedOutgoingAcks;
 		internal NetQueue<NetTuple<NetMessageType, int>> m_queuedIncomingAcks;
+		internal NetQueue<NetSelectiveAck> m_queuedIncomingSelectiveAcks;
 		private int m_sendBufferWritePtr;
 		private int m_sendBufferNumMessages;
+		private int m_sendBufferStart; // room left ahead of the messages for the packet cipher's header
+		internal NetPacketCipher m_packetCipher;
 		private object m_tag;
 		internal NetConnectionStatistics m_statistics;
+		internal NetCongestionControl m_congestion;
+
+		// partly received fragmented messages by group; see NetPeer.HandleReleasedFragment()
+		internal Dictionary<int, ReceivedFragmentGroup> m_receivedFragmentGroups;
+		internal int m_reassemblyBytes;
+
+		// heartbeat scheduling; see NetPeer.HeartbeatConnections()
+		internal int m_isWoken;
+		internal bool m_isDue;
+		internal bool m_isListed;
+		internal float m_scheduledDeadline = float.MaxValue;
 
 		/// <summary>
 		/// Gets or sets the application defined object containing data about the connection
@@ -51,6 +66,22 @@ namespace Lidgren.Network
 		/// </summary>
 		public NetConnectionStatistics Statistics { get { return m_statistics; } }
 
+		/// <summary>
+		/// Gets the congestion window in messages in flight over all reliable channels, or zero if congestion control is disabled
+		/// </summary>
+		public float CongestionWindow { get { return (m_congestion == null ? 0.0f : m_congestion.Window); } }
+
+		/// <summary>
+		/// Gets the estimated rate, in bytes per second, reliable messages can currently be sent at without congesting the link;
+		/// zero if congestion control is disabled or no round trip has been measured yet
+		/// </summary>
+		public float SendRateEstimate { get { return (m_congestion == null ? 0.0f : m_congestion.SendRate); } }
+
+		/// <summary>
+		/// Gets whether the packets of this connection are encrypted and authenticated; see NetPeerConfiguration.EnablePacketEncryption
+		/// </summary>
+		public bool IsPacketEncrypted { get { return m_packetCipher != null; } }
+
 		/// <summary>
 		/// Gets the remote endpoint for the connection
 		/// </summary>
@@ -86,9 +117,14 @@ namespace Lidgren.Network
 			m_receiveChannels = new NetReceiverChannelBase[NetConstants.NumTotalChannels];
 			m_queuedOutgoingAcks = new NetQueue<NetTuple<NetMessageType, int>>(4);
 			m_queuedIncomingAcks = new NetQueue<NetTuple<NetMessageType, int>>(4);
+			m_queuedIncomingSelectiveAcks = new NetQueue<NetSelectiveAck>(4);
 			m_statistics = new NetConnectionStatistics(this);
 			m_averageRoundtripTime = -1.0f;
 			m_currentMTU = m_peerConfiguration.MaximumTransmissionUnit;
+
+			// shared by all reliable channels; room for a few busy ones at once
+			if (m_peerConfiguration.m_enableCongestionControl)
+				m_congestion = new NetCongestionControl(NetConstants.DefaultWindowSize * 4);
 		}
 
 		/// <summary>
@@ -139,42 +175,42 @@ namespace Lidgren.Network
 
 			NetException.Assert(m_status != NetConnectionStatus.InitiatedConnect && m_status != NetConnectionStatus.RespondedConnect);
 
-			if ((frameCounter % 5) == 0)
+			// we're only visited when something is due, so these checks are cheap enough to make every time
+			if (now > m_timeoutDeadline)
 			{
-				if (now > m_timeoutDeadline)
-				{
-					//
-					// connection timed out
-					//
-					m_peer.LogVerbose("Connection timed out at " + now + " deadline was " + m_timeoutDeadline);
-					ExecuteDisconnect("Connection timed out", true);
-				}
+				//
+				// connection timed out
+				//
+				m_peer.LogVerbose("Connection timed out at " + now + " deadline was " + m_timeoutDeadline);
+				ExecuteDisconnect("Connection timed out", true);
+			}
 
-				// send ping?
-				if (m_status == NetConnectionStatus.Connected)
-				{
-					if (now > m_sentPingTime + m_peer.m_configuration.m_pingInterval)
-						SendPing();
+			// waits to be removed; the channels were reset, so acks still queued no longer refer to anything
+			if (m_status == NetConnectionStatus.Disconnected)
+				return;
 
-					// handle expand mtu
-					MTUExpansionHeartbeat(now);
-				}
+			// send ping?
+			if (m_status == NetConnectionStatus.Connected)
+			{
+				if (now > m_sentPingTime + m_peer.m_configuration.m_pingInterval)
+					SendPing();
 
-				if (m_disconnectRequested)
-				{
-					ExecuteDisconnect(m_disconnectMessage, true);
-					return;
-				}
+				// handle expand mtu
+				MTUExpansionHeartbeat(now);
 			}
 
-			bool connectionReset; // TODO: handle connection reset
+			if (m_disconnectRequested)
+			{
+				ExecuteDisconnect(m_disconnectMessage, true);
+				return;
+			}
 
 			//
 			// Note: at this point m_sendBufferWritePtr and m_sendBufferNumMessages may be non-null; resends may already be queued up
 			//
 
 			byte[] sendBuffer = m_peer.m_sendBuffer;
-			int mtu = m_currentMTU;
+			int mtu = m_sendBufferStart + GetPacketPayloadSize(); // how far the send buffer may be filled
 
 			if ((frameCounter % 3) == 0) // coalesce a few frames
 			{
@@ -215,14 +251,13 @@ namespace Lidgren.Network
 					if (m_queuedOutgoingAcks.Count > 0)
 					{
 						// send packet and go for another round of acks
-						NetException.Assert(m_sendBufferWritePtr > 0 && m_sendBufferNumMessages > 0);
-						m_peer.SendPacket(m_sendBufferWritePtr, m_remoteEndpoint, m_sendBufferNumMessages, out connectionReset);
-						m_statistics.PacketSent(m_sendBufferWritePtr, 1);
-						m_sendBufferWritePtr = 0;
-						m_sendBufferNumMessages = 0;
+						SendBufferedPacket();
 					}
 				}
 
+				if (m_peerConfiguration.m_enableSelectiveAcks)
+					WriteSelectiveAcks(sendBuffer, mtu);
+
 				//
 				// Parse incoming acks (may trigger resends)
 				//
@@ -235,6 +270,14 @@ namespace Lidgren.Network
 						chan = CreateSenderChannel(incAck.Item1);
 					chan.ReceiveAcknowledge(now, incAck.Item2);
 				}
+
+				NetSelectiveAck incSack;
+				while (m_queuedIncomingSelectiveAcks.TryDequeue(out incSack))
+				{
+					NetReliableSenderChannel chan = m_sendChannels[(int)incSack.Type - 1] as NetReliableSenderChannel;
+					if (chan != null)
+						chan.ReceiveSelectiveAcknowledge(now, incSack.WindowStart, incSack.EarlyReceived);
+				}
 			}
 
 			//
@@ -245,27 +288,177 @@ namespace Lidgren.Network
 				for (int i = m_sendChannels.Length - 1; i >= 0; i--)    // Reverse order so reliable messages are sent first
 				{
 					var channel = m_sendChannels[i];
-					NetException.Assert(m_sendBufferWritePtr < 1 || m_sendBufferNumMessages > 0);
+					NetException.Assert(m_sendBufferWritePtr <= m_sendBufferStart || m_sendBufferNumMessages > 0);
 					if (channel != null)
 						channel.SendQueuedMessages(now);
-					NetException.Assert(m_sendBufferWritePtr < 1 || m_sendBufferNumMessages > 0);
+					NetException.Assert(m_sendBufferWritePtr <= m_sendBufferStart || m_sendBufferNumMessages > 0);
 				}
 			}
 
 			//
 			// Put on wire data has been written to send buffer but not yet sent
 			//
-			if (m_sendBufferWritePtr > 0)
+			if (m_sendBufferNumMessages > 0)
 			{
 				m_peer.VerifyNetworkThread();
-				NetException.Assert(m_sendBufferWritePtr > 0 && m_sendBufferNumMessages > 0);
-				m_peer.SendPacket(m_sendBufferWritePtr, m_remoteEndpoint, m_sendBufferNumMessages, out connectionReset);
-				m_statistics.PacketSent(m_sendBufferWritePtr, m_sendBufferNumMessages);
-				m_sendBufferWritePtr = 0;
-				m_sendBufferNumMessages = 0;
+				SendBufferedPacket();
+			}
+		}
+
+		// puts the messages coalesced in the send buffer on the wire, sealed in place if the connection is encrypted
+		private void SendBufferedPacket()
+		{
+			NetException.Assert(m_sendBufferWritePtr > m_sendBufferStart && m_sendBufferNumMessages > 0);
+
+			int length = m_sendBufferWritePtr;
+			if (m_packetCipher != null)
+				length = m_packetCipher.Seal(m_peer.m_sendBuffer, m_sendBufferWritePtr);
+
+			bool connectionReset; // TODO: handle connection reset
+			m_peer.SendPacket(length, m_remoteEndpoint, m_sendBufferNumMessages, out connectionReset);
+			m_statistics.PacketSent(length, m_sendBufferNumMessages);
+			m_sendBufferWritePtr = m_sendBufferStart;
+			m_sendBufferNumMessages = 0;
+		}
+
+		// encodes a library message as a packet of its own at the start of the send buffer, sealed once the remote can open it; returns its length
+		internal int EncodeLibraryPacket(NetOutgoingMessage om)
+		{
+			// until the handshake is through the remote may not have a cipher of its own
+			if (m_packetCipher == null || (m_status != NetConnectionStatus.Connected && m_status != NetConnectionStatus.Disconnecting))
+				return om.Encode(m_peer.m_sendBuffer, 0, 0);
+
+			// the send buffer may hold messages waiting to be coalesced
+			if (m_sendBufferNumMessages > 0)
+				SendBufferedPacket();
+
+			int end = om.Encode(m_peer.m_sendBuffer, m_sendBufferStart, 0);
+			return m_packetCipher.Seal(m_peer.m_sendBuffer, end);
+		}
+
+		// sends a library message on its own right away
+		internal void SendLibraryPacket(NetOutgoingMessage om)
+		{
+			m_peer.VerifyNetworkThread();
+
+			int len = EncodeLibraryPacket(om);
+			bool connectionReset;
+			m_peer.SendPacket(len, m_remoteEndpoint, 1, out connectionReset);
+
+			m_statistics.PacketSent(len, 1);
+		}
+
+		// the most bytes of messages one packet can carry
+		internal int GetPacketPayloadSize()
+		{
+			return (m_packetCipher == null ? m_currentMTU : m_currentMTU - NetPacketCipher.Overhead);
+		}
+
+		// from here on every coalesced packet is sealed; called during the handshake, before anything is coalesced
+		internal void SetPacketCipher(NetPacketCipher cipher)
+		{
+			NetException.Assert(m_sendBufferNumMessages == 0);
+			m_packetCipher = cipher;
+			m_sendBufferStart = NetPacketCipher.HeaderSize;
+			m_sendBufferWritePtr = m_sendBufferStart;
+		}
+
+		// one entry per reliable channel that has received something since the last round; each repeats
+		// everything the channel holds, so a lost ack packet is made good by the next one
+		private void WriteSelectiveAcks(byte[] sendBuffer, int mtu)
+		{
+			int entries = 0;
+			foreach (NetReceiverChannelBase chan in m_receiveChannels)
+			{
+				if (chan != null && chan.m_selectiveAckPending)
+					entries++;
+			}
+			if (entries == 0)
+				return;
+
+			int len = entries * NetSelectiveAck.EncodedSize;
+			if (m_sendBufferWritePtr + NetConstants.HeaderByteSize + len > mtu)
+			{
+				// send what we have and start a fresh packet
+				SendBufferedPacket();
+			}
+
+			m_sendBufferNumMessages++;
+
+			sendBuffer[m_sendBufferWritePtr++] = (byte)NetMessageType.SelectiveAcknowledge;
+			sendBuffer[m_sendBufferWritePtr++] = 0; // no sequence number
+			sendBuffer[m_sendBufferWritePtr++] = 0; // no sequence number
+			int bits = len * 8;
+			sendBuffer[m_sendBufferWritePtr++] = (byte)bits;
+			sendBuffer[m_sendBufferWritePtr++] = (byte)(bits >> 8);
+
+			for (int i = 0; i < m_receiveChannels.Length; i++)
+			{
+				NetReceiverChannelBase chan = m_receiveChannels[i];
+				if (chan == null || !chan.m_selectiveAckPending)
+					continue;
+				chan.m_selectiveAckPending = false;
+
+				int windowStart;
+				uint earlyReceived;
+				chan.GetSelectiveAck(out windowStart, out earlyReceived);
+
+				sendBuffer[m_sendBufferWritePtr++] = (byte)(i + 1); // netmessagetype
+				sendBuffer[m_sendBufferWritePtr++] = (byte)windowStart;
+				sendBuffer[m_sendBufferWritePtr++] = (byte)(windowStart >> 8);
+				sendBuffer[m_sendBufferWritePtr++] = (byte)earlyReceived;
+				sendBuffer[m_sendBufferWritePtr++] = (byte)(earlyReceived >> 8);
+				sendBuffer[m_sendBufferWritePtr++] = (byte)(earlyReceived >> 16);
+				sendBuffer[m_sendBufferWritePtr++] = (byte)(earlyReceived >> 24);
 			}
 		}
 		
+		/// <summary>
+		/// Has the peer give this connection a heartbeat as soon as possible; any thread
+		/// </summary>
+		internal void Wake()
+		{
+			if (Interlocked.CompareExchange(ref m_isWoken, 1, 0) == 0)
+				m_peer.WakeConnection(this);
+		}
+
+		// anything a heartbeat right away could make progress on
+		internal bool HasQueuedWork()
+		{
+			if (m_queuedOutgoingAcks.Count > 0 || m_queuedIncomingAcks.Count > 0 || m_queuedIncomingSelectiveAcks.Count > 0)
+				return true; // acks are only handled every few frames
+
+			if (m_peerConfiguration.m_autoFlushSendQueue)
+			{
+				foreach (NetSenderChannelBase chan in m_sendChannels)
+				{
+					// a full window waits for acks, which wake us when they arrive
+					if (chan != null && chan.m_queuedSends.Count > 0 && chan.GetAllowedSends() > 0)
+						return true;
+				}
+			}
+			return false;
+		}
+
+		// when the next timeout, ping, mtu probe or resend falls due
+		internal float GetNextHeartbeatTime(float now)
+		{
+			float next = m_timeoutDeadline;
+
+			if (m_status == NetConnectionStatus.Connected)
+			{
+				next = Math.Min(next, m_sentPingTime + m_peerConfiguration.m_pingInterval);
+				next = Math.Min(next, GetNextMTUExpansionTime(now));
+			}
+
+			foreach (NetSenderChannelBase chan in m_sendChannels)
+			{
+				if (chan != null)
+					next = Math.Min(next, chan.GetNextResendTime());
+			}
+			return next;
+		}
+
 		// Queue an item for immediate sending on the wire
 		// This method is called from the ISenderChannels
 		internal void QueueSendMessage(NetOutgoingMessage om, int seqNr)
@@ -273,17 +466,14 @@ namespace Lidgren.Network
 			m_peer.VerifyNetworkThread();
 
 			int sz = om.GetEncodedSize();
-			if (sz > m_currentMTU)
+			int payloadSize = GetPacketPayloadSize();
+			if (sz > payloadSize)
 				m_peer.LogWarning("Message larger than MTU! Fragmentation must have failed!");
 
-			if (m_sendBufferWritePtr + sz > m_currentMTU)
+			if (m_sendBufferWritePtr + sz > m_sendBufferStart + payloadSize)
 			{
-				bool connReset; // TODO: handle connection reset
-				NetException.Assert(m_sendBufferWritePtr > 0 && m_sendBufferNumMessages > 0); // or else the message should have been fragmented earlier
-				m_peer.SendPacket(m_sendBufferWritePtr, m_remoteEndpoint, m_sendBufferNumMessages, out connReset);
-				m_statistics.PacketSent(m_sendBufferWritePtr, m_sendBufferNumMessages);
-				m_sendBufferWritePtr = 0;
-				m_sendBufferNumMessages = 0;
+				// or else the message should have been fragmented earlier
+				SendBufferedPacket();
 			}
 
 			m_sendBufferWritePtr = om.Encode(m_peer.m_sendBuffer, m_sendBufferWritePtr, seqNr);
@@ -319,10 +509,11 @@ namespace Lidgren.Network
 			if (chan == null)
 				chan = CreateSenderChannel(tp);
 
-			if (msg.GetEncodedSize() > m_currentMTU)
+			if (msg.GetEncodedSize() > GetPacketPayloadSize())
 				throw new NetException("Message too large! Fragmentation failure?");
 
 			var retval = chan.Enqueue(msg);
+			Wake();
 			if (retval == NetSendResult.Sent && m_peerConfiguration.m_autoFlushSendQueue == false)
 				retval = NetSendResult.Queued; // queued since we're not autoflushing
 			return retval;
@@ -369,7 +560,7 @@ namespace Lidgren.Network
 		}
 
 		// received a library message while Connected
-		internal void ReceivedLibraryMessage(NetMessageType tp, int ptr, int payloadLength)
+		internal void ReceivedLibraryMessage(byte[] data, NetMessageType tp, int ptr, int payloadLength)
 		{
 			m_peer.VerifyNetworkThread();
 
@@ -384,16 +575,33 @@ namespace Lidgren.Network
 				case NetMessageType.Acknowledge:
 					for (int i = 0; i < payloadLength; i+=3)
 					{
-						NetMessageType acktp = (NetMessageType)m_peer.m_receiveBuffer[ptr++]; // netmessagetype
-						int seqNr = m_peer.m_receiveBuffer[ptr++];
-						seqNr |= (m_peer.m_receiveBuffer[ptr++] << 8);
+						NetMessageType acktp = (NetMessageType)data[ptr++]; // netmessagetype
+						int seqNr = data[ptr++];
+						seqNr |= (data[ptr++] << 8);
 
 						// need to enqueue this and handle it in the netconnection heartbeat; so be able to send resends together with normal sends
 						m_queuedIncomingAcks.Enqueue(new NetTuple<NetMessageType, int>(acktp, seqNr));
 					}
 					break;
+				case NetMessageType.SelectiveAcknowledge:
+					for (int i = 0; i + NetSelectiveAck.EncodedSize <= payloadLength; i += NetSelectiveAck.EncodedSize)
+					{
+						byte[] buf = data;
+						NetMessageType sacktp = (NetMessageType)buf[ptr++];
+						int windowStart = buf[ptr++];
+						windowStart |= (buf[ptr++] << 8);
+						uint earlyReceived = (uint)(buf[ptr] | (buf[ptr + 1] << 8) | (buf[ptr + 2] << 16) | (buf[ptr + 3] << 24));
+						ptr += 4;
+
+						if (sacktp < NetMessageType.UserReliableUnordered || sacktp >= NetMessageType.Unused1)
+							continue; // not a reliable channel
+
+						// handled in the heartbeat, like plain acks
+						m_queuedIncomingSelectiveAcks.Enqueue(new NetSelectiveAck(sacktp, windowStart, earlyReceived));
+					}
+					break;
 				case NetMessageType.Ping:
-					int pingNr = m_peer.m_receiveBuffer[ptr++];
+					int pingNr = data[ptr++];
 					SendPong(pingNr);
 					break;
 				case NetMessageType.Pong:
@@ -0,0 +1,119 @@
+﻿using System;
+using System.Diagnostics;
+
+namespace Lidgren.Network
+{
+	/// <summary>
+	/// Binary min-heap of connections by the time they next need a heartbeat; network thread only
+	/// </summary>
+	/// <remarks>
+	/// Each connection remembers the deadline of its live entry. Moving a deadline earlier pushes a new
+	/// entry and orphans the old one, which is skipped when it surfaces; moving it later is left to the
+	/// heartbeat at the earlier time, which reschedules. This keeps every operation O(log n) without
+	/// having to find entries in the heap.
+	/// </remarks>
+	[DebuggerDisplay("Count={m_count}")]
+	internal sealed class NetDeadlineHeap
+	{
+		private float[] m_deadlines;
+		private NetConnection[] m_connections;
+		private int m_count;
+
+		public NetDeadlineHeap(int initialCapacity)
+		{
+			m_deadlines = new float[initialCapacity];
+			m_connections = new NetConnection[initialCapacity];
+		}
+
+		/// <summary>
+		/// Makes sure the connection gets a heartbeat no later than the deadline
+		/// </summary>
+		public void Schedule(NetConnection conn, float deadline)
+		{
+			if (deadline >= conn.m_scheduledDeadline)
+				return; // an earlier heartbeat is already due; it will reschedule
+
+			conn.m_scheduledDeadline = deadline;
+
+			if (m_count == m_deadlines.Length)
+			{
+				Array.Resize(ref m_deadlines, m_count * 2);
+				Array.Resize(ref m_connections, m_count * 2);
+			}
+
+			// sift up
+			int i = m_count++;
+			while (i > 0)
+			{
+				int parent = (i - 1) / 2;
+				if (m_deadlines[parent] <= deadline)
+					break;
+				m_deadlines[i] = m_deadlines[parent];
+				m_connections[i] = m_connections[parent];
+				i = parent;
+			}
+			m_deadlines[i] = deadline;
+			m_connections[i] = conn;
+		}
+
+		/// <summary>
+		/// Takes the next connection whose deadline has passed, if any
+		/// </summary>
+		public bool TryDequeueDue(float now, out NetConnection conn)
+		{
+			while (m_count > 0 && m_deadlines[0] <= now)
+			{
+				float deadline = m_deadlines[0];
+				conn = m_connections[0];
+				RemoveFirst();
+
+				if (conn.m_scheduledDeadline != deadline)
+					continue; // superseded by an earlier deadline
+
+				conn.m_scheduledDeadline = float.MaxValue;
+				return true;
+			}
+
+			conn = null;
+			return false;
+		}
+
+		public void Clear()
+		{
+			for (int i = 0; i < m_count; i++)
+			{
+				m_connections[i].m_scheduledDeadline = float.MaxValue;
+				m_connections[i] = null;
+			}
+			m_count = 0;
+		}
+
+		private void RemoveFirst()
+		{
+			m_count--;
+			float deadline = m_deadlines[m_count];
+			NetConnection conn = m_connections[m_count];
+			m_connections[m_count] = null;
+			if (m_count == 0)
+				return;
+
+			// sift the last entry down from the top
+			int i = 0;
+			while (true)
+			{
+				int child = i * 2 + 1;
+				if (child >= m_count)
+					break;
+				if (child + 1 < m_count && m_deadlines[child + 1] < m_deadlines[child])
+					child++;
+				if (deadline <= m_deadlines[child])
+					break;
+				m_deadlines[i] = m_deadlines[child];
+				m_connections[i] = m_connections[child];
+				i = child;
+			}
+			m_deadlines[i] = deadline;
+			m_connections[i] = conn;
+		}
+	}
+}
@@ -0,0 +1,81 @@
+﻿using System;
+
+namespace Lidgren.Network
+{
+	/// <summary>
+	/// State of one simulated link from this peer to a remote endpoint; network thread only
+	/// </summary>
+	/// <remarks>
+	/// Loss follows a Gilbert-Elliott model: the link flips between a good and a bad state, each with its own
+	/// loss rate, giving the bursts real links show. A bandwidth cap is modeled as a bottleneck which a packet
+	/// occupies for its size over the rate; packets queue behind it and are dropped from the tail when the queue
+	/// is full. Every packet takes the same number of random draws whatever happens to it, so the same seed and
+	/// the same packets give the same impairments.
+	/// </remarks>
+	internal sealed class NetImpairedLink
+	{
+		private readonly NetImpairmentTimeline m_timeline;
+		private readonly NetRandom m_random;
+		private readonly double m_start;
+
+		private bool m_inBurst;
+		private double m_busyUntil;
+
+		internal NetImpairedLink(NetImpairmentTimeline timeline, int seed, double now)
+		{
+			m_timeline = timeline;
+			m_random = new NetRandom(seed);
+			m_start = now;
+		}
+
+		/// <summary>
+		/// Works out when the copies of a packet arrive; returns how many copies there are, zero if it was lost
+		/// </summary>
+		internal int Transmit(double now, int numBytes, double[] arrivals)
+		{
+			NetImpairmentProfile profile = m_timeline.GetProfile(now - m_start);
+
+			float flip = m_random.NextSingle();
+			float lose = m_random.NextSingle();
+			float latency = m_random.NextSingle();
+			float reorder = m_random.NextSingle();
+			float duplicate = m_random.NextSingle();
+			float duplicateLatency = m_random.NextSingle();
+
+			if (m_inBurst)
+			{
+				if (flip < profile.BurstEndChance)
+					m_inBurst = false;
+			}
+			else if (flip < profile.BurstStartChance)
+			{
+				m_inBurst = true;
+			}
+
+			// through the bottleneck first; a packet lost beyond it still took its share of the bandwidth
+			double departure = now;
+			int bandwidth = profile.BandwidthBytesPerSecond;
+			if (bandwidth > 0)
+			{
+				double start = Math.Max(now, m_busyUntil);
+				if ((start - now) * bandwidth + numBytes > profile.QueueBytes)
+					return 0; // queue full; tail drop
+				m_busyUntil = start + (double)numBytes / bandwidth;
+				departure = m_busyUntil;
+			}
+
+			if (lose < (m_inBurst ? profile.BurstLoss : profile.Loss))
+				return 0;
+
+			arrivals[0] = departure + profile.MinimumLatency + latency * profile.RandomLatency;
+			if (reorder < profile.ReorderChance)
+				arrivals[0] += profile.ReorderDelay;
+
+			if (duplicate >= profile.DuplicateChance)
+				return 1;
+
+			arrivals[1] = departure + profile.MinimumLatency + duplicateLatency * profile.RandomLatency;
+			return 2;
+		}
+	}
+}
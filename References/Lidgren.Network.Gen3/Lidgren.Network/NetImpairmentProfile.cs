@@ -0,0 +1,138 @@
+﻿using System;
+
+namespace Lidgren.Network
+{
+	/// <summary>
+	/// Conditions of a simulated link at one point of a NetImpairmentTimeline; only has an effect in DEBUG builds
+	/// </summary>
+	public sealed class NetImpairmentProfile
+	{
+		private float m_loss;
+		private float m_burstLoss;
+		private float m_burstStartChance;
+		private float m_burstEndChance;
+		private float m_minimumLatency;
+		private float m_randomLatency;
+		private float m_reorderChance;
+		private float m_reorderDelay;
+		private float m_duplicateChance;
+		private int m_bandwidth;
+		private int m_queueBytes;
+
+		/// <summary>
+		/// Creates a profile of a perfect link
+		/// </summary>
+		public NetImpairmentProfile()
+		{
+			m_reorderDelay = 0.05f;
+			m_queueBytes = 64 * 1024;
+		}
+
+		/// <summary>
+		/// Gets or sets the chance of losing a packet while the link is in its good state, from 0.0f to 1.0f
+		/// </summary>
+		public float Loss
+		{
+			get { return m_loss; }
+			set { m_loss = value; }
+		}
+
+		/// <summary>
+		/// Gets or sets the chance of losing a packet while the link is in its bad (burst) state, from 0.0f to 1.0f
+		/// </summary>
+		public float BurstLoss
+		{
+			get { return m_burstLoss; }
+			set { m_burstLoss = value; }
+		}
+
+		/// <summary>
+		/// Gets or sets the chance, per packet, of the link going from its good state to its bad state
+		/// </summary>
+		public float BurstStartChance
+		{
+			get { return m_burstStartChance; }
+			set { m_burstStartChance = value; }
+		}
+
+		/// <summary>
+		/// Gets or sets the chance, per packet, of the link going from its bad state back to its good state; the mean burst is 1 / BurstEndChance packets
+		/// </summary>
+		public float BurstEndChance
+		{
+			get { return m_burstEndChance; }
+			set { m_burstEndChance = value; }
+		}
+
+		/// <summary>
+		/// Gets or sets the minimum one way latency in seconds
+		/// </summary>
+		public float MinimumLatency
+		{
+			get { return m_minimumLatency; }
+			set { m_minimumLatency = value; }
+		}
+
+		/// <summary>
+		/// Gets or sets the random one way latency in seconds added on top of the minimum
+		/// </summary>
+		public float RandomLatency
+		{
+			get { return m_randomLatency; }
+			set { m_randomLatency = value; }
+		}
+
+		/// <summary>
+		/// Gets or sets the chance of a packet being held back by ReorderDelay, letting later packets overtake it
+		/// </summary>
+		public float ReorderChance
+		{
+			get { return m_reorderChance; }
+			set { m_reorderChance = value; }
+		}
+
+		/// <summary>
+		/// Gets or sets how long a reordered packet is held back, in seconds
+		/// </summary>
+		public float ReorderDelay
+		{
+			get { return m_reorderDelay; }
+			set { m_reorderDelay = value; }
+		}
+
+		/// <summary>
+		/// Gets or sets the chance of a packet arriving twice, from 0.0f to 1.0f
+		/// </summary>
+		public float DuplicateChance
+		{
+			get { return m_duplicateChance; }
+			set { m_duplicateChance = value; }
+		}
+
+		/// <summary>
+		/// Gets or sets the capacity of the link in bytes per second; zero means unlimited
+		/// </summary>
+		public int BandwidthBytesPerSecond
+		{
+			get { return m_bandwidth; }
+			set { m_bandwidth = value; }
+		}
+
+		/// <summary>
+		/// Gets or sets how many bytes may queue up in front of a capped link before packets are dropped
+		/// </summary>
+		public int QueueBytes
+		{
+			get { return m_queueBytes; }
+			set { m_queueBytes = value; }
+		}
+
+		/// <summary>
+		/// Creates a memberwise copy of this profile
+		/// </summary>
+		public NetImpairmentProfile Clone()
+		{
+			return this.MemberwiseClone() as NetImpairmentProfile;
+		}
+	}
+}
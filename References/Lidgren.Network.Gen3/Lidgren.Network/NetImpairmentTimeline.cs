@@ -0,0 +1,55 @@
+﻿using System;
+using System.Collections.Generic;
+
+namespace Lidgren.Network
+{
+	/// <summary>
+	/// Scripted conditions of a simulated link: a profile to start with and the profiles that take over at later times
+	/// </summary>
+	public sealed class NetImpairmentTimeline
+	{
+		private readonly List<double> m_times = new List<double>();
+		private readonly List<NetImpairmentProfile> m_profiles = new List<NetImpairmentProfile>();
+
+		/// <summary>
+		/// Creates a timeline which holds the initial profile until another is added
+		/// </summary>
+		public NetImpairmentTimeline(NetImpairmentProfile initial)
+		{
+			if (initial == null)
+				throw new ArgumentNullException("initial");
+			m_times.Add(0.0);
+			m_profiles.Add(initial);
+		}
+
+		/// <summary>
+		/// Gets the number of profiles in the timeline
+		/// </summary>
+		public int Count { get { return m_profiles.Count; } }
+
+		/// <summary>
+		/// Switches to profile the given number of seconds after the link is set up; steps must be added in order
+		/// </summary>
+		public NetImpairmentTimeline Add(double atSeconds, NetImpairmentProfile profile)
+		{
+			if (profile == null)
+				throw new ArgumentNullException("profile");
+			if (atSeconds < m_times[m_times.Count - 1])
+				throw new NetException("Timeline steps must be added in order");
+			m_times.Add(atSeconds);
+			m_profiles.Add(profile);
+			return this;
+		}
+
+		/// <summary>
+		/// Gets the profile in effect the given number of seconds after the link was set up
+		/// </summary>
+		public NetImpairmentProfile GetProfile(double elapsed)
+		{
+			int i = m_times.Count - 1;
+			while (i > 0 && m_times[i] > elapsed)
+				i--;
+			return m_profiles[i];
+		}
+	}
+}
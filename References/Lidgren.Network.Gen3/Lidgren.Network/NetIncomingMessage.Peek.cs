@@ -201,12 +201,7 @@ namespace Lidgren.Network
 		{
 			NetException.Assert(m_bitLength - m_readPosition >= 64, c_readOverflowError);
 
-			ulong low = NetBitWriter.ReadUInt32(m_data, 32, m_readPosition);
-			ulong high = NetBitWriter.ReadUInt32(m_data, 32, m_readPosition + 32);
-
-			ulong retval = low + (high << 32);
-
-			return retval;
+			return NetBitWriter.ReadUInt64(m_data, 64, m_readPosition);
 		}
 
 		/// <summary>
@@ -232,17 +227,7 @@ namespace Lidgren.Network
 			NetException.Assert((numberOfBits > 0 && numberOfBits <= 64), "ReadUInt() can only read between 1 and 64 bits");
 			NetException.Assert(m_bitLength - m_readPosition >= numberOfBits, c_readOverflowError);
 
-			ulong retval;
-			if (numberOfBits <= 32)
-			{
-				retval = (ulong)NetBitWriter.ReadUInt32(m_data, numberOfBits, m_readPosition);
-			}
-			else
-			{
-				retval = NetBitWriter.ReadUInt32(m_data, 32, m_readPosition);
-				retval |= NetBitWriter.ReadUInt32(m_data, numberOfBits - 32, m_readPosition) << 32;
-			}
-			return retval;
+			return NetBitWriter.ReadUInt64(m_data, numberOfBits, m_readPosition);
 		}
 
 		/// <summary>
@@ -171,5 +171,7 @@ namespace Lidgren.Network
 		NatIntroduction = 139, // send to master server
 		ExpandMTURequest = 140,
 		ExpandMTUSuccess = 141,
+		SelectiveAcknowledge = 142, // cumulative ack plus bitmap, per reliable channel
+		Encrypted = 143, // a sealed packet; see NetPacketCipher
 	}
 }
\ No newline at end of file
@@ -37,6 +37,9 @@ namespace Lidgren.Network
 		internal int m_fragmentChunkByteSize;	  // size, in bytes, of every chunk but the last one
 		internal int m_fragmentChunkNumber;       // which number chunk this is, starting with 0
 
+		internal byte[] m_sharedEncoding;         // headers and payload encoded once for many recipients; sequence number left blank
+		internal int m_sharedEncodingLength;
+
 		internal NetOutgoingMessage()
 		{
 		}
@@ -48,6 +51,21 @@ namespace Lidgren.Network
 			m_isSent = false;
 			m_recyclingCount = 0;
 			m_fragmentGroup = 0;
+			m_sharedEncoding = null;
+			m_sharedEncodingLength = 0;
+		}
+
+		/// <summary>
+		/// Encodes headers and payload once into a buffer shared by all recipients; Encode() then only copies it and fills in the sequence number.
+		/// The buffer is immutable until the message is recycled, which happens when the last channel holding it has sent it (see m_recyclingCount)
+		/// </summary>
+		internal void EncodeShared(byte[] intoBuffer)
+		{
+			NetException.Assert(m_fragmentGroup == 0, "Fragments cannot share an encoding");
+			NetException.Assert(m_sharedEncoding == null, "Message already has a shared encoding");
+
+			m_sharedEncodingLength = Encode(intoBuffer, 0, 0);
+			m_sharedEncoding = intoBuffer;
 		}
 
 		internal int Encode(byte[] intoBuffer, int ptr, int sequenceNumber)
@@ -56,7 +74,16 @@ namespace Lidgren.Network
 			//  1 bit  - Fragment?
 			// 15 bits - Sequence number
 			// 16 bits - Payload length in bits
-			
+
+			if (m_sharedEncoding != null)
+			{
+				// only the sequence number differs between recipients
+				Buffer.BlockCopy(m_sharedEncoding, 0, intoBuffer, ptr, m_sharedEncodingLength);
+				intoBuffer[ptr + 1] = (byte)(sequenceNumber << 1);
+				intoBuffer[ptr + 2] = (byte)(sequenceNumber >> 7);
+				return ptr + m_sharedEncodingLength;
+			}
+
 			intoBuffer[ptr++] = (byte)m_messageType;
 
 			byte low = (byte)((sequenceNumber << 1) | (m_fragmentGroup == 0 ? 0 : 1));
@@ -106,6 +133,9 @@ namespace Lidgren.Network
 
 		internal int GetEncodedSize()
 		{
+			if (m_sharedEncoding != null)
+				return m_sharedEncodingLength;
+
 			int retval = NetConstants.UnfragmentedMessageHeaderSize; // regular headers
 			if (m_fragmentGroup != 0)
 				retval += NetFragmentationHelper.GetFragmentationHeaderSize(m_fragmentGroup, m_fragmentGroupTotalBits / 8, m_fragmentChunkByteSize, m_fragmentChunkNumber);
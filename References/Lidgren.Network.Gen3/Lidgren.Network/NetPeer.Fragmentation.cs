@@ -6,16 +6,32 @@ namespace Lidgren.Network
 {
 	internal class ReceivedFragmentGroup
 	{
+		public int Group;
+		public int TotalBits;
+		public int ChunkByteSize;
 		public float LastReceived;
-		public byte[] Data;
+		public byte[] Data; // from the storage pool; becomes the completed message's storage
 		public NetBitVector ReceivedChunks;
+		public int NumReceivedChunks;
+		public bool Reliable; // its fragments are acked as they arrive, so it can't be given up on quietly
 	}
 
 	public partial class NetPeer
 	{
 		private int m_lastUsedFragmentGroup;
 
-		private Dictionary<NetConnection, Dictionary<int, ReceivedFragmentGroup>> m_receivedFragmentGroups;
+		// connections holding partly received fragmented messages, and the bytes they hold together
+		private readonly List<NetConnection> m_reassemblingConnections = new List<NetConnection>();
+		private readonly List<ReceivedFragmentGroup> m_expiredFragmentGroups = new List<ReceivedFragmentGroup>();
+		private int m_reassemblyBytes;
+		private float m_nextFragmentExpiry;
+
+		private const float c_fragmentExpiryInterval = 1.0f;
+
+		internal int ReassemblyBytes
+		{
+			get { return m_reassemblyBytes; }
+		}
 
 		// on user thread
 		private void SendFragmentedMessage(NetOutgoingMessage msg, IList<NetConnection> recipients, NetDeliveryMethod method, int sequenceChannel)
@@ -73,6 +89,14 @@ namespace Lidgren.Network
 
 		private void HandleReleasedFragment(NetIncomingMessage im)
 		{
+			NetConnection conn = im.SenderConnection;
+			if (conn == null)
+			{
+				LogWarning("Dropped unconnected message fragment from " + im.SenderEndpoint);
+				Recycle(im);
+				return;
+			}
+
 			//
 			// read fragmentation header and combine fragments
 			//
@@ -87,63 +111,87 @@ namespace Lidgren.Network
 				out chunkByteSize,
 				out chunkNumber
 			);
+			int chunkBytes = im.LengthBytes - ptr;
 
-			NetException.Assert(im.LengthBytes > ptr);
+			if (group <= 0 || totalBits <= 0 || chunkByteSize <= 0 || chunkBytes <= 0 || chunkBytes > chunkByteSize)
+			{
+				LogWarning("Malformed fragment header from " + conn);
+				Recycle(im);
+				return;
+			}
+
+			NetDeliveryMethod method = NetUtility.GetDeliveryMethod(im.m_receivedMessageType);
+			bool reliable = (method == NetDeliveryMethod.ReliableOrdered || method == NetDeliveryMethod.ReliableUnordered);
+
+			if ((long)totalBits > (long)m_configuration.m_maximumReassemblyBytesPerConnection * 8)
+			{
+				LogWarning("Dropped fragment of a " + (totalBits / 8) + " byte message from " + conn + "; larger than MaximumReassemblyBytesPerConnection");
+				if (reliable)
+					LoseReliableMessage(conn, "Reliable message larger than MaximumReassemblyBytesPerConnection");
+				Recycle(im);
+				return;
+			}
 
-			NetException.Assert(group > 0);
-			NetException.Assert(totalBits > 0);
-			NetException.Assert(chunkByteSize > 0);
-			
-			int totalBytes = NetUtility.BytesToHoldBits((int)totalBits);
+			int totalBytes = NetUtility.BytesToHoldBits(totalBits);
 			int totalNumChunks = totalBytes / chunkByteSize;
 			if (totalNumChunks * chunkByteSize < totalBytes)
 				totalNumChunks++;
 
-			NetException.Assert(chunkNumber < totalNumChunks);
-
-			if (chunkNumber >= totalNumChunks)
+			int offset = chunkNumber * chunkByteSize;
+			if (chunkNumber < 0 || chunkNumber >= totalNumChunks || offset + chunkBytes > totalBytes)
 			{
 				LogWarning("Index out of bounds for chunk " + chunkNumber + " (total chunks " + totalNumChunks + ")");
+				Recycle(im);
 				return;
 			}
 
-			Dictionary<int, ReceivedFragmentGroup> groups;
-			if (!m_receivedFragmentGroups.TryGetValue(im.SenderConnection, out groups))
-			{
-				groups = new Dictionary<int, ReceivedFragmentGroup>();
-				m_receivedFragmentGroups[im.SenderConnection] = groups;
-			}
+			float now = (float)NetTime.Now;
+
+			if (conn.m_receivedFragmentGroups == null)
+				conn.m_receivedFragmentGroups = new Dictionary<int, ReceivedFragmentGroup>();
 
 			ReceivedFragmentGroup info;
-			if (!groups.TryGetValue(group, out info))
+			if (conn.m_receivedFragmentGroups.TryGetValue(group, out info) && (info.TotalBits != totalBits || info.ChunkByteSize != chunkByteSize))
 			{
-				info = new ReceivedFragmentGroup();
-				info.Data = new byte[totalBytes];
-				info.ReceivedChunks = new NetBitVector(totalNumChunks);
-				groups[group] = info;
+				// group id wrapped around onto a message that never completed
+				AbandonFragmentGroup(conn, info);
+				info = null;
 			}
 
-			info.ReceivedChunks[chunkNumber] = true;
-			info.LastReceived = (float)NetTime.Now;
+			if (info == null)
+			{
+				info = StartFragmentGroup(conn, group, totalBits, chunkByteSize, totalNumChunks, reliable, now);
+				if (info == null)
+				{
+					Recycle(im);
+					return;
+				}
+			}
 
-			// copy to data
-			int offset = (chunkNumber * chunkByteSize);
-			Buffer.BlockCopy(im.m_data, ptr, info.Data, offset, im.LengthBytes - ptr);
+			info.LastReceived = now;
+			if (!info.ReceivedChunks[chunkNumber])
+			{
+				info.ReceivedChunks[chunkNumber] = true;
+				info.NumReceivedChunks++;
 
-			int cnt = info.ReceivedChunks.Count();
-			//LogVerbose("Found fragment #" + chunkNumber + " in group " + group + " offset " + offset + " of total bits " + totalBits + " (total chunks done " + cnt + ")");
+				// copy to data
+				Buffer.BlockCopy(im.m_data, ptr, info.Data, offset, chunkBytes);
+			}
 
-			LogVerbose("Received fragment " + chunkNumber + " of " + totalNumChunks + " (" + cnt + " chunks received)");
+			LogVerbose("Received fragment " + chunkNumber + " of " + totalNumChunks + " (" + info.NumReceivedChunks + " chunks received)");
 
-			if (info.ReceivedChunks.Count() == totalNumChunks)
+			if (info.NumReceivedChunks == totalNumChunks)
 			{
-				// Done! Transform this incoming message
+				// Done! Hand the reassembly buffer over to this incoming message as is
+				RemoveFragmentGroup(conn, info);
+
+				byte[] chunkStorage = im.m_data;
 				im.m_data = info.Data;
-				im.m_bitLength = (int)totalBits;
+				im.m_bitLength = totalBits;
 				im.m_isFragment = false;
+				Recycle(chunkStorage);
 
 				LogVerbose("Fragment group #" + group + " fully received in " + totalNumChunks + " chunks (" + totalBits + " bits)");
-				groups.Remove(group);
 
 				ReleaseMessage(im);
 			}
@@ -155,5 +203,126 @@ namespace Lidgren.Network
 
 			return;
 		}
+
+		private ReceivedFragmentGroup StartFragmentGroup(NetConnection conn, int group, int totalBits, int chunkByteSize, int totalNumChunks, bool reliable, float now)
+		{
+			int totalBytes = NetUtility.BytesToHoldBits(totalBits);
+
+			// make room among the connection's own unreliable messages first; a peer can only crowd out itself
+			while (conn.m_reassemblyBytes + totalBytes > m_configuration.m_maximumReassemblyBytesPerConnection)
+			{
+				ReceivedFragmentGroup oldest = null;
+				foreach (ReceivedFragmentGroup candidate in conn.m_receivedFragmentGroups.Values)
+				{
+					if (!candidate.Reliable && (oldest == null || candidate.LastReceived < oldest.LastReceived))
+						oldest = candidate;
+				}
+				if (oldest == null)
+					break;
+
+				LogWarning("Abandoned fragment group #" + oldest.Group + " from " + conn + " to stay within MaximumReassemblyBytesPerConnection");
+				AbandonFragmentGroup(conn, oldest);
+			}
+
+			if (conn.m_reassemblyBytes + totalBytes > m_configuration.m_maximumReassemblyBytesPerConnection)
+			{
+				// what's left is reliable
+				LogWarning("Dropped fragment of a " + totalBytes + " byte message from " + conn + "; MaximumReassemblyBytesPerConnection reached");
+				m_statistics.m_fragmentGroupsDropped++;
+				if (reliable)
+					LoseReliableMessage(conn, "Reliable messages over MaximumReassemblyBytesPerConnection");
+				return null;
+			}
+
+			if (m_reassemblyBytes + totalBytes > m_configuration.m_maximumReassemblyBytes)
+			{
+				LogWarning("Dropped fragment of a " + totalBytes + " byte message from " + conn + "; MaximumReassemblyBytes reached");
+				m_statistics.m_fragmentGroupsDropped++;
+				if (reliable)
+					LoseReliableMessage(conn, "Reliable message over MaximumReassemblyBytes");
+				return null;
+			}
+
+			ReceivedFragmentGroup info = new ReceivedFragmentGroup();
+			info.Group = group;
+			info.TotalBits = totalBits;
+			info.ChunkByteSize = chunkByteSize;
+			info.LastReceived = now;
+			info.Reliable = reliable;
+			info.Data = GetStorage(totalBytes);
+			info.ReceivedChunks = new NetBitVector(totalNumChunks);
+
+			if (conn.m_receivedFragmentGroups.Count == 0)
+				m_reassemblingConnections.Add(conn);
+			conn.m_receivedFragmentGroups[group] = info;
+			conn.m_reassemblyBytes += totalBytes;
+			m_reassemblyBytes += totalBytes;
+			if (m_reassemblyBytes > m_statistics.m_reassemblyBytesPeak)
+				m_statistics.m_reassemblyBytesPeak = m_reassemblyBytes;
+
+			return info;
+		}
+
+		// forgets a group without releasing its buffer
+		private void RemoveFragmentGroup(NetConnection conn, ReceivedFragmentGroup info)
+		{
+			int totalBytes = NetUtility.BytesToHoldBits(info.TotalBits);
+			conn.m_receivedFragmentGroups.Remove(info.Group);
+			conn.m_reassemblyBytes -= totalBytes;
+			m_reassemblyBytes -= totalBytes;
+
+			if (conn.m_receivedFragmentGroups.Count == 0)
+				m_reassemblingConnections.Remove(conn);
+		}
+
+		private void AbandonFragmentGroup(NetConnection conn, ReceivedFragmentGroup info)
+		{
+			RemoveFragmentGroup(conn, info);
+			Recycle(info.Data);
+			info.Data = null;
+			m_statistics.m_fragmentGroupsAbandoned++;
+
+			if (info.Reliable)
+				LoseReliableMessage(conn, "Reliable message abandoned before all its fragments arrived");
+		}
+
+		// the sender has had acks for the fragments that did arrive and won't resend them, so the message can't be
+		// delivered any more; better to drop the connection than carry on without it
+		private void LoseReliableMessage(NetConnection conn, string reason)
+		{
+			if (conn.m_status == NetConnectionStatus.Disconnecting || conn.m_status == NetConnectionStatus.Disconnected)
+				return;
+
+			LogWarning(reason + " from " + conn + "; disconnecting");
+			conn.Disconnect(reason);
+		}
+
+		/// <summary>
+		/// Abandons partly received messages nothing has been added to for FragmentGroupTimeout seconds, and all those of disconnected connections
+		/// </summary>
+		private void ExpireFragmentGroups(float now)
+		{
+			if (m_reassemblingConnections.Count == 0 || now < m_nextFragmentExpiry)
+				return;
+			m_nextFragmentExpiry = now + c_fragmentExpiryInterval;
+
+			float cutoff = now - m_configuration.m_fragmentGroupTimeout;
+			for (int i = m_reassemblingConnections.Count - 1; i >= 0; i--)
+			{
+				NetConnection conn = m_reassemblingConnections[i];
+				bool gone = (conn.m_status == NetConnectionStatus.Disconnected);
+
+				foreach (ReceivedFragmentGroup info in conn.m_receivedFragmentGroups.Values)
+				{
+					if (gone || info.LastReceived < cutoff)
+						m_expiredFragmentGroups.Add(info);
+				}
+
+				// may take conn off the list; fine, since we're walking it backwards
+				foreach (ReceivedFragmentGroup info in m_expiredFragmentGroups)
+					AbandonFragmentGroup(conn, info);
+				m_expiredFragmentGroups.Clear();
+			}
+		}
 	}
 }
@@ -19,6 +19,7 @@ namespace Lidgren.Network
 		internal byte[] m_receiveBuffer;
 		internal NetIncomingMessage m_readHelperMessage;
 		private EndPoint m_senderRemote;
+		private NetBatchedSocketIO m_batchedIO;
 		private object m_initializeLock = new object();
 		private uint m_frameCounter;
 		private double m_lastHeartbeat;
@@ -127,6 +128,15 @@ namespace Lidgren.Network
 				m_readHelperMessage = new NetIncomingMessage(NetIncomingMessageType.Error);
 				m_readHelperMessage.m_data = m_receiveBuffer;
 
+				if (m_configuration.m_enableBatchedSocketIO)
+				{
+					m_batchedIO = NetBatchedSocketIO.TryCreate(this, m_socket);
+					if (m_batchedIO == null)
+						LogWarning("Batched socket I/O isn't available on this platform; using one call per datagram");
+					else
+						LogDebug("Using recvmmsg/sendmmsg for socket I/O");
+				}
+
 				byte[] macBytes = new byte[8];
 				NetRandom.Instance.NextBytes(macBytes);
 
@@ -208,7 +218,10 @@ namespace Lidgren.Network
 
 					// shut down connections
 					foreach (NetConnection conn in list)
+					{
 						conn.Shutdown(m_shutdownReason);
+						conn.Wake();
+					}
 				}
 			}
 
@@ -237,6 +250,11 @@ namespace Lidgren.Network
 				}
 				finally
 				{
+					if (m_batchedIO != null)
+					{
+						m_batchedIO.Dispose();
+						m_batchedIO = null;
+					}
 					m_socket = null;
 					m_status = NetPeerStatus.NotRunning;
 					LogDebug("Shutdown complete");
@@ -247,6 +265,8 @@ namespace Lidgren.Network
 				m_unsentUnconnectedMessages.Clear();
 				m_connections.Clear();
 				m_handshakes.Clear();
+				m_connectionDeadlines.Clear();
+				m_wokenConnections.Clear();
 			}
 
 			return;
@@ -261,7 +281,8 @@ namespace Lidgren.Network
 
 			double delta = dnow - m_lastHeartbeat;
 
-			int maxCHBpS = 1250 - m_connections.Count;
+			// back off with the number of connections that needed a heartbeat last time, not how many there are
+			int maxCHBpS = 1250 - m_lastDueCount;
 			if (maxCHBpS < 250)
 				maxCHBpS = 250;
 			if (delta > (1.0 / (double)maxCHBpS)) // max connection heartbeats/second max
@@ -305,24 +326,11 @@ namespace Lidgren.Network
 					m_executeFlushSendQueue = true;
 
 				// do connection heartbeats
-				lock (m_connections)
-				{
-					foreach (NetConnection conn in m_connections)
-					{
-						conn.Heartbeat(now, m_frameCounter);
-						if (conn.m_status == NetConnectionStatus.Disconnected)
-						{
-							//
-							// remove connection
-							//
-							m_connections.Remove(conn);
-							m_connectionLookup.Remove(conn.RemoteEndpoint);
-							break; // can't continue iteration here
-						}
-					}
-				}
+				HeartbeatConnections(now);
 				m_executeFlushSendQueue = false;
 
+				ExpireFragmentGroups(now);
+
 				// send unsent unconnected messages
 				NetTuple<IPEndPoint, NetOutgoingMessage> unsent;
 				while (m_unsentUnconnectedMessages.TryDequeue(out unsent))
@@ -345,9 +353,19 @@ namespace Lidgren.Network
 			if (m_socket == null)
 				return;
 
+			// anything written by the heartbeats above goes out before we wait
+			if (m_batchedIO != null)
+				m_batchedIO.Flush();
+
 			if (!m_socket.Poll(1000, SelectMode.SelectRead)) // wait up to 1 ms for data to arrive
 				return;
 
+			if (m_batchedIO != null)
+			{
+				ReceiveBatchedSocketData();
+				return;
+			}
+
 			//if (m_socket == null || m_socket.Available < 1)
 			//	return;
 
@@ -376,123 +394,182 @@ namespace Lidgren.Network
 				if (bytesReceived < NetConstants.HeaderByteSize)
 					return;
 
-				//LogVerbose("Received " + bytesReceived + " bytes");
+				ReceivedPacket(m_receiveBuffer, bytesReceived, (IPEndPoint)m_senderRemote);
+
+			} while (m_socket.Available > 0);
+		}
+
+		private void ReceiveBatchedSocketData()
+		{
+			int count;
+			do
+			{
+				count = m_batchedIO.Receive();
+				for (int i = 0; i < count; i++)
+				{
+					byte[] data;
+					IPEndPoint ipsender;
+					int bytesReceived = m_batchedIO.GetReceived(i, out data, out ipsender);
+					if (bytesReceived < 0)
+					{
+						LogWarning("Dropped truncated datagram from " + ipsender);
+						continue;
+					}
+
+					if (bytesReceived < NetConstants.HeaderByteSize)
+						continue;
+
+					// parsed straight out of the datagram's slot in the ring
+					ReceivedPacket(data, bytesReceived, ipsender);
+				}
+
+				// handshake replies and the like are sent while parsing
+				m_batchedIO.Flush();
+			} while (count == NetBatchedSocketIO.BatchSize);
+		}
+
+		private void ReceivedPacket(byte[] data, int bytesReceived, IPEndPoint ipsender)
+		{
+			//LogVerbose("Received " + bytesReceived + " bytes");
 
-				IPEndPoint ipsender = (IPEndPoint)m_senderRemote;
+			// library messages are read through the helper, so it has to look at this packet
+			m_readHelperMessage.m_data = data;
 
-				if (ipsender.Port == 1900)
+			if (ipsender.Port == 1900)
+			{
+				// UPnP response
+				try
 				{
-					// UPnP response
-					try
+					string resp = System.Text.Encoding.ASCII.GetString(data, 0, bytesReceived);
+					if (resp.Contains("upnp:rootdevice"))
 					{
-						string resp = System.Text.Encoding.ASCII.GetString(m_receiveBuffer, 0, bytesReceived);
-						if (resp.Contains("upnp:rootdevice"))
-						{
-							resp = resp.Substring(resp.ToLower().IndexOf("location:") + 9);
-							resp = resp.Substring(0, resp.IndexOf("\r")).Trim();
-							m_upnp.ExtractServiceUrl(resp);
-							return;
-						}
+						resp = resp.Substring(resp.ToLower().IndexOf("location:") + 9);
+						resp = resp.Substring(0, resp.IndexOf("\r")).Trim();
+						m_upnp.ExtractServiceUrl(resp);
+						return;
 					}
-					catch { }
 				}
+				catch { }
+			}
 
-				NetConnection sender = null;
-				m_connectionLookup.TryGetValue(ipsender, out sender);
+			NetConnection sender = null;
+			m_connectionLookup.TryGetValue(ipsender, out sender);
 
-				double receiveTime = NetTime.Now;
-				//
-				// parse packet into messages
-				//
-				int numMessages = 0;
-				int ptr = 0;
-				while ((bytesReceived - ptr) >= NetConstants.HeaderByteSize)
+			int ptr = 0;
+			int end = bytesReceived;
+			bool isSealed = (sender != null && sender.m_packetCipher != null && data[0] == (byte)NetMessageType.Encrypted);
+			if (isSealed)
+			{
+				// decrypt in place and parse the messages inside
+				if (!sender.m_packetCipher.Open(data, bytesReceived, out end))
 				{
-					// decode header
-					//  8 bits - NetMessageType
-					//  1 bit  - Fragment?
-					// 15 bits - Sequence number
-					// 16 bits - Payload length in bits
+					LogVerbose("Dropped packet failing authentication from " + ipsender);
+					return;
+				}
+				ptr = NetPacketCipher.HeaderSize;
+			}
+
+			// whatever this holds will want acks sent or resends checked
+			if (sender != null)
+				sender.Wake();
 
-					numMessages++;
+			double receiveTime = NetTime.Now;
+			//
+			// parse packet into messages
+			//
+			int numMessages = 0;
+			while ((end - ptr) >= NetConstants.HeaderByteSize)
+			{
+				// decode header
+				//  8 bits - NetMessageType
+				//  1 bit  - Fragment?
+				// 15 bits - Sequence number
+				// 16 bits - Payload length in bits
 
-					NetMessageType tp = (NetMessageType)m_receiveBuffer[ptr++];
+				numMessages++;
 
-					byte low = m_receiveBuffer[ptr++];
-					byte high = m_receiveBuffer[ptr++];
+				NetMessageType tp = (NetMessageType)data[ptr++];
 
-					bool isFragment = ((low & 1) == 1);
-					ushort sequenceNumber = (ushort)((low >> 1) | (((int)high) << 7));
+				byte low = data[ptr++];
+				byte high = data[ptr++];
 
-					ushort payloadBitLength = (ushort)(m_receiveBuffer[ptr++] | (m_receiveBuffer[ptr++] << 8));
-					int payloadByteLength = NetUtility.BytesToHoldBits(payloadBitLength);
+				bool isFragment = ((low & 1) == 1);
+				ushort sequenceNumber = (ushort)((low >> 1) | (((int)high) << 7));
 
-					if (bytesReceived - ptr < payloadByteLength)
-					{
-						LogWarning("Malformed packet; stated payload length " + payloadByteLength + ", remaining bytes " + (bytesReceived - ptr));
-						return;
-					}
+				ushort payloadBitLength = (ushort)(data[ptr++] | (data[ptr++] << 8));
+				int payloadByteLength = NetUtility.BytesToHoldBits(payloadBitLength);
 
-					try
-					{
-						NetException.Assert(tp < NetMessageType.Unused1 || tp > NetMessageType.Unused29);
+				if (end - ptr < payloadByteLength)
+				{
+					LogWarning("Malformed packet; stated payload length " + payloadByteLength + ", remaining bytes " + (end - ptr));
+					return;
+				}
 
-						if (tp >= NetMessageType.LibraryError)
-						{
-							if (sender != null)
-								sender.ReceivedLibraryMessage(tp, ptr, payloadByteLength);
-							else
-								ReceivedUnconnectedLibraryMessage(receiveTime, ipsender, tp, ptr, payloadByteLength);
-						}
+				if (!isSealed && sender != null && sender.m_packetCipher != null && !NetPacketCipher.IsAllowedUnsealed(tp))
+				{
+					// anyone could have sent this
+					ptr += payloadByteLength;
+					continue;
+				}
+
+				try
+				{
+					NetException.Assert(tp < NetMessageType.Unused1 || tp > NetMessageType.Unused29);
+
+					if (tp >= NetMessageType.LibraryError)
+					{
+						if (sender != null)
+							sender.ReceivedLibraryMessage(data, tp, ptr, payloadByteLength);
 						else
+							ReceivedUnconnectedLibraryMessage(data, receiveTime, ipsender, tp, ptr, payloadByteLength);
+					}
+					else
+					{
+						if (sender == null && !m_configuration.IsMessageTypeEnabled(NetIncomingMessageType.UnconnectedData))
+							return; // dropping unconnected message since it's not enabled
+
+						NetIncomingMessage msg = CreateIncomingMessage(NetIncomingMessageType.Data, payloadByteLength);
+						msg.m_isFragment = isFragment;
+						msg.m_receiveTime = receiveTime;
+						msg.m_sequenceNumber = sequenceNumber;
+						msg.m_receivedMessageType = tp;
+						msg.m_senderConnection = sender;
+						msg.m_senderEndpoint = ipsender;
+						msg.m_bitLength = payloadBitLength;
+						Buffer.BlockCopy(data, ptr, msg.m_data, 0, payloadByteLength);
+						if (sender != null)
 						{
-							if (sender == null && !m_configuration.IsMessageTypeEnabled(NetIncomingMessageType.UnconnectedData))
-								return; // dropping unconnected message since it's not enabled
-
-							NetIncomingMessage msg = CreateIncomingMessage(NetIncomingMessageType.Data, payloadByteLength);
-							msg.m_isFragment = isFragment;
-							msg.m_receiveTime = receiveTime;
-							msg.m_sequenceNumber = sequenceNumber;
-							msg.m_receivedMessageType = tp;
-							msg.m_senderConnection = sender;
-							msg.m_senderEndpoint = ipsender;
-							msg.m_bitLength = payloadBitLength;
-							Buffer.BlockCopy(m_receiveBuffer, ptr, msg.m_data, 0, payloadByteLength);
-							if (sender != null)
+							if (tp == NetMessageType.Unconnected)
 							{
-								if (tp == NetMessageType.Unconnected)
-								{
-									// We're connected; but we can still send unconnected messages to this peer
-									msg.m_incomingMessageType = NetIncomingMessageType.UnconnectedData;
-									ReleaseMessage(msg);
-								}
-								else
-								{
-									// connected application (non-library) message
-									sender.ReceivedMessage(msg);
-								}
+								// We're connected; but we can still send unconnected messages to this peer
+								msg.m_incomingMessageType = NetIncomingMessageType.UnconnectedData;
+								ReleaseMessage(msg);
 							}
 							else
 							{
-								// at this point we know the message type is enabled
-								// unconnected application (non-library) message
-								msg.m_incomingMessageType = NetIncomingMessageType.UnconnectedData;
-								ReleaseMessage(msg);
+								// connected application (non-library) message
+								sender.ReceivedMessage(msg);
 							}
 						}
+						else
+						{
+							// at this point we know the message type is enabled
+							// unconnected application (non-library) message
+							msg.m_incomingMessageType = NetIncomingMessageType.UnconnectedData;
+							ReleaseMessage(msg);
+						}
 					}
-					catch (Exception ex)
-					{
-						LogError("Packet parsing error: " + ex.Message + " from " + ipsender);
-					}
-					ptr += payloadByteLength;
 				}
+				catch (Exception ex)
+				{
+					LogError("Packet parsing error: " + ex.Message + " from " + ipsender);
+				}
+				ptr += payloadByteLength;
+			}
 
-				m_statistics.PacketReceived(bytesReceived, numMessages);
-				if (sender != null)
-					sender.m_statistics.PacketReceived(bytesReceived, numMessages);
-
-			} while (m_socket.Available > 0);
+			m_statistics.PacketReceived(bytesReceived, numMessages);
+			if (sender != null)
+				sender.m_statistics.PacketReceived(bytesReceived, numMessages);
 		}
 
 		/// <summary>
@@ -501,15 +578,22 @@ namespace Lidgren.Network
 		public void FlushSendQueue()
 		{
 			m_executeFlushSendQueue = true;
+
+			// connections are only visited when they have something to do, and now they all might
+			lock (m_connections)
+			{
+				foreach (NetConnection conn in m_connections)
+					conn.Wake();
+			}
 		}
 
-		internal void HandleIncomingDiscoveryRequest(double now, IPEndPoint senderEndpoint, int ptr, int payloadByteLength)
+		internal void HandleIncomingDiscoveryRequest(byte[] data, double now, IPEndPoint senderEndpoint, int ptr, int payloadByteLength)
 		{
 			if (m_configuration.IsMessageTypeEnabled(NetIncomingMessageType.DiscoveryRequest))
 			{
 				NetIncomingMessage dm = CreateIncomingMessage(NetIncomingMessageType.DiscoveryRequest, payloadByteLength);
 				if (payloadByteLength > 0)
-					Buffer.BlockCopy(m_receiveBuffer, ptr, dm.m_data, 0, payloadByteLength);
+					Buffer.BlockCopy(data, ptr, dm.m_data, 0, payloadByteLength);
 				dm.m_receiveTime = now;
 				dm.m_bitLength = payloadByteLength * 8;
 				dm.m_senderEndpoint = senderEndpoint;
@@ -517,13 +601,13 @@ namespace Lidgren.Network
 			}
 		}
 
-		internal void HandleIncomingDiscoveryResponse(double now, IPEndPoint senderEndpoint, int ptr, int payloadByteLength)
+		internal void HandleIncomingDiscoveryResponse(byte[] data, double now, IPEndPoint senderEndpoint, int ptr, int payloadByteLength)
 		{
 			if (m_configuration.IsMessageTypeEnabled(NetIncomingMessageType.DiscoveryResponse))
 			{
 				NetIncomingMessage dr = CreateIncomingMessage(NetIncomingMessageType.DiscoveryResponse, payloadByteLength);
 				if (payloadByteLength > 0)
-					Buffer.BlockCopy(m_receiveBuffer, ptr, dr.m_data, 0, payloadByteLength);
+					Buffer.BlockCopy(data, ptr, dr.m_data, 0, payloadByteLength);
 				dr.m_receiveTime = now;
 				dr.m_bitLength = payloadByteLength * 8;
 				dr.m_senderEndpoint = senderEndpoint;
@@ -531,12 +615,12 @@ namespace Lidgren.Network
 			}
 		}
 
-		private void ReceivedUnconnectedLibraryMessage(double now, IPEndPoint senderEndpoint, NetMessageType tp, int ptr, int payloadByteLength)
+		private void ReceivedUnconnectedLibraryMessage(byte[] data, double now, IPEndPoint senderEndpoint, NetMessageType tp, int ptr, int payloadByteLength)
 		{
 			NetConnection shake;
 			if (m_handshakes.TryGetValue(senderEndpoint, out shake))
 			{
-				shake.ReceivedHandshake(now, tp, ptr, payloadByteLength);
+				shake.ReceivedHandshake(data, now, tp, ptr, payloadByteLength);
 				return;
 			}
 
@@ -546,10 +630,10 @@ namespace Lidgren.Network
 			switch (tp)
 			{
 				case NetMessageType.Discovery:
-					HandleIncomingDiscoveryRequest(now, senderEndpoint, ptr, payloadByteLength);
+					HandleIncomingDiscoveryRequest(data, now, senderEndpoint, ptr, payloadByteLength);
 					return;
 				case NetMessageType.DiscoveryResponse:
-					HandleIncomingDiscoveryResponse(now, senderEndpoint, ptr, payloadByteLength);
+					HandleIncomingDiscoveryResponse(data, now, senderEndpoint, ptr, payloadByteLength);
 					return;
 				case NetMessageType.NatIntroduction:
 					HandleNatIntroduction(ptr);
@@ -582,7 +666,7 @@ namespace Lidgren.Network
 									m_connectionLookup.Add(senderEndpoint, hsconn);
 									m_handshakes.Add(senderEndpoint, hsconn);
 
-									hsconn.ReceivedHandshake(now, tp, ptr, payloadByteLength);
+									hsconn.ReceivedHandshake(data, now, tp, ptr, payloadByteLength);
 									return;
 								}
 							}
@@ -618,7 +702,7 @@ namespace Lidgren.Network
 			// Ok, start handshake!
 			NetConnection conn = new NetConnection(this, senderEndpoint);
 			m_handshakes.Add(senderEndpoint, conn);
-			conn.ReceivedHandshake(now, tp, ptr, payloadByteLength);
+			conn.ReceivedHandshake(data, now, tp, ptr, payloadByteLength);
 
 			return;
 		}
@@ -641,6 +725,8 @@ namespace Lidgren.Network
 				{
 					m_connections.Add(conn);
 					m_connectionLookup.Add(conn.m_remoteEndpoint, conn);
+					conn.m_isListed = true;
+					conn.Wake();
 				}
 			}
 		}
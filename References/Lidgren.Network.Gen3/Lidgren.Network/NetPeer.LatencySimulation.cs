@@ -31,8 +31,13 @@ namespace Lidgren.Network
 	{
 
 #if DEBUG
+		// kept in order of DelayedUntil
 		private readonly List<DelayedPacket> m_delayedPackets = new List<DelayedPacket>();
 
+		// simulated links by remote endpoint; set from any thread, used on the network thread
+		private readonly Dictionary<IPEndPoint, NetImpairedLink> m_impairedLinks = new Dictionary<IPEndPoint, NetImpairedLink>();
+		private readonly double[] m_impairedArrivals = new double[2];
+
 		private class DelayedPacket
 		{
 			public byte[] Data;
@@ -40,10 +45,75 @@ namespace Lidgren.Network
 			public IPEndPoint Target;
 		}
 
+		/// <summary>
+		/// Simulates the conditions of timeline on everything sent to target, in place of NetPeerConfiguration.SimulatedImpairment; null goes back to the configured conditions.
+		/// Random draws come from seed, so the same packets see the same impairments from run to run
+		/// </summary>
+		public void SetSimulatedImpairment(IPEndPoint target, NetImpairmentTimeline timeline, int seed)
+		{
+			lock (m_impairedLinks)
+			{
+				if (timeline == null)
+					m_impairedLinks.Remove(target);
+				else
+					m_impairedLinks[target] = new NetImpairedLink(timeline, seed, NetTime.Now);
+			}
+		}
+
+		private NetImpairedLink GetImpairedLink(IPEndPoint target)
+		{
+			lock (m_impairedLinks)
+			{
+				NetImpairedLink link;
+				if (m_impairedLinks.TryGetValue(target, out link))
+					return link;
+
+				NetImpairmentTimeline timeline = m_configuration.m_impairment;
+				if (timeline == null)
+					return null;
+
+				// links nobody set up explicitly follow the configuration from the first packet on
+				link = new NetImpairedLink(timeline, m_configuration.m_impairmentSeed ^ target.GetHashCode(), NetTime.Now);
+				m_impairedLinks[target] = link;
+				return link;
+			}
+		}
+
+		private void QueueDelayedPacket(byte[] data, int numBytes, IPEndPoint target, double delayedUntil)
+		{
+			DelayedPacket p = new DelayedPacket();
+			p.Target = target;
+			p.Data = new byte[numBytes];
+			Buffer.BlockCopy(data, 0, p.Data, 0, numBytes);
+			p.DelayedUntil = delayedUntil;
+
+			// after any packet due at the same time, so those keep their order
+			int index = m_delayedPackets.Count;
+			while (index > 0 && m_delayedPackets[index - 1].DelayedUntil > delayedUntil)
+				index--;
+			m_delayedPackets.Insert(index, p);
+		}
+
 		internal void SendPacket(int numBytes, IPEndPoint target, int numMessages, out bool connectionReset)
 		{
 			connectionReset = false;
 
+			NetImpairedLink link = GetImpairedLink(target);
+			if (link != null)
+			{
+				int copies = link.Transmit(NetTime.Now, numBytes, m_impairedArrivals);
+				if (copies == 0)
+				{
+					LogVerbose("Sending packet " + numBytes + " bytes - SIMULATED LOST!");
+					return;
+				}
+
+				m_statistics.PacketSent(numBytes, numMessages);
+				for (int i = 0; i < copies; i++)
+					QueueDelayedPacket(m_sendBuffer, numBytes, target, m_impairedArrivals[i]);
+				return;
+			}
+
 			// simulate loss
 			float loss = m_configuration.m_loss;
 			if (loss > 0.0f)
@@ -79,13 +149,7 @@ namespace Lidgren.Network
 				delay = m_configuration.m_minimumOneWayLatency + (NetRandom.Instance.NextSingle() * m_configuration.m_randomOneWayLatency);
 
 				// Enqueue delayed packet
-				DelayedPacket p = new DelayedPacket();
-				p.Target = target;
-				p.Data = new byte[numBytes];
-				Buffer.BlockCopy(m_sendBuffer, 0, p.Data, 0, numBytes);
-				p.DelayedUntil = NetTime.Now + delay;
-
-				m_delayedPackets.Add(p);
+				QueueDelayedPacket(m_sendBuffer, numBytes, target, NetTime.Now + delay);
 			}
 
 			// LogVerbose("Sending packet " + numBytes + " bytes - delayed " + NetTime.ToReadable(delay));
@@ -100,21 +164,25 @@ namespace Lidgren.Network
 
 			bool connectionReset;
 
-		RestartDelaySending:
-			foreach (DelayedPacket p in m_delayedPackets)
+			int sent = 0;
+			while (sent < m_delayedPackets.Count && now > m_delayedPackets[sent].DelayedUntil)
 			{
-				if (now > p.DelayedUntil)
-				{
-					ActuallySendPacket(p.Data, p.Data.Length, p.Target, out connectionReset);
-					m_delayedPackets.Remove(p);
-					goto RestartDelaySending;
-				}
+				DelayedPacket p = m_delayedPackets[sent++];
+				ActuallySendPacket(p.Data, p.Data.Length, p.Target, out connectionReset);
 			}
+			if (sent > 0)
+				m_delayedPackets.RemoveRange(0, sent);
 		}
 
 		internal bool ActuallySendPacket(byte[] data, int numBytes, IPEndPoint target, out bool connectionReset)
 		{
 			connectionReset = false;
+			if (m_batchedIO != null && m_batchedIO.CanSend(target, numBytes))
+			{
+				connectionReset = m_batchedIO.Send(data, numBytes, target);
+				return !connectionReset;
+			}
+
 			try
 			{
 				// TODO: refactor this check outta here
@@ -234,6 +302,12 @@ namespace Lidgren.Network
 			m_statistics.PacketSent(numBytes, numMessages);
 #endif
 			connectionReset = false;
+			if (m_batchedIO != null && m_batchedIO.CanSend(target, numBytes))
+			{
+				connectionReset = m_batchedIO.Send(m_sendBuffer, numBytes, target);
+				return;
+			}
+
 			try
 			{
 				// TODO: refactor this check outta here
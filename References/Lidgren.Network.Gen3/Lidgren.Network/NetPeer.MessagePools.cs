@@ -6,19 +6,25 @@ namespace Lidgren.Network
 {
 	public partial class NetPeer
 	{
-		private List<byte[]> m_storagePool; // sorted smallest to largest
-		private NetQueue<NetOutgoingMessage> m_outgoingMessagesPool;
-		private NetQueue<NetIncomingMessage> m_incomingMessagesPool;
+		private NetStoragePool m_storagePool;
+		private NetRingQueue<NetOutgoingMessage> m_outgoingMessagesPool;
+		private NetRingQueue<NetIncomingMessage> m_incomingMessagesPool;
 
-		internal int m_storagePoolBytes;
+		// messages beyond this many are left to the garbage collector
+		private const int c_messagePoolCapacity = 1024;
+
+		internal int StoragePoolBytes
+		{
+			get { return (m_storagePool == null ? 0 : m_storagePool.BytesInPool); }
+		}
 
 		private void InitializePools()
 		{
 			if (m_configuration.UseMessageRecycling)
 			{
-				m_storagePool = new List<byte[]>(16);
-				m_outgoingMessagesPool = new NetQueue<NetOutgoingMessage>(4);
-				m_incomingMessagesPool = new NetQueue<NetIncomingMessage>(4);
+				m_storagePool = new NetStoragePool(m_statistics, m_configuration.m_maximumTransmissionUnit, m_configuration.m_storagePoolMaxBytes);
+				m_outgoingMessagesPool = new NetRingQueue<NetOutgoingMessage>(c_messagePoolCapacity);
+				m_incomingMessagesPool = new NetRingQueue<NetIncomingMessage>(c_messagePoolCapacity);
 			}
 			else
 			{
@@ -33,21 +39,7 @@ namespace Lidgren.Network
 			if (m_storagePool == null)
 				return new byte[minimumCapacity];
 
-			lock (m_storagePool)
-			{
-				for (int i = 0; i < m_storagePool.Count; i++)
-				{
-					byte[] retval = m_storagePool[i];
-					if (retval != null && retval.Length >= minimumCapacity)
-					{
-						m_storagePool[i] = null;
-						m_storagePoolBytes -= retval.Length;
-						return retval;
-					}
-				}
-			}
-			m_statistics.m_bytesAllocated += minimumCapacity;
-			return new byte[minimumCapacity];
+			return m_storagePool.Get(minimumCapacity);
 		}
 
 		internal void Recycle(byte[] storage)
@@ -55,20 +47,7 @@ namespace Lidgren.Network
 			if (m_storagePool == null)
 				return;
 
-			lock (m_storagePool)
-			{
-				m_storagePoolBytes += storage.Length;
-				int cnt = m_storagePool.Count;
-				for (int i = 0; i < cnt; i++)
-				{
-					if (m_storagePool[i] == null)
-					{
-						m_storagePool[i] = storage;
-						return;
-					}
-				}
-				m_storagePool.Add(storage);
-			}
+			m_storagePool.Return(storage);
 		}
 
 		/// <summary>
@@ -144,7 +123,7 @@ namespace Lidgren.Network
 			msg.m_data = null;
 			Recycle(storage);
 			msg.Reset();
-			m_incomingMessagesPool.Enqueue(msg);
+			m_incomingMessagesPool.TryEnqueue(msg);
 		}
 
 		/// <summary>
@@ -155,33 +134,14 @@ namespace Lidgren.Network
 			if (m_incomingMessagesPool == null)
 				return;
 
-			// first recycle the storage of each message
-			if (m_storagePool != null)
+			foreach (var msg in toRecycle)
 			{
-				lock (m_storagePool)
-				{
-					foreach (var msg in toRecycle)
-					{
-						var storage = msg.m_data;
-						msg.m_data = null;
-						m_storagePoolBytes += storage.Length;
-						int cnt = m_storagePool.Count;
-						for (int i = 0; i < cnt; i++)
-						{
-							if (m_storagePool[i] == null)
-							{
-								m_storagePool[i] = storage;
-								return;
-							}
-						}
-						msg.Reset();
-						m_storagePool.Add(storage);
-					}
-				}
+				byte[] storage = msg.m_data;
+				msg.m_data = null;
+				Recycle(storage);
+				msg.Reset();
+				m_incomingMessagesPool.TryEnqueue(msg);
 			}
-
-			// then recycle the message objects
-			m_incomingMessagesPool.Enqueue(toRecycle);
 		}
 
 		internal void Recycle(NetOutgoingMessage msg)
@@ -200,9 +160,12 @@ namespace Lidgren.Network
 			// TODO: find a way to recycle large message after all fragments has been acknowledged; or? possibly better just to garbage collect them
 			if (msg.m_fragmentGroup == 0)
 				Recycle(storage);
+
+			if (msg.m_sharedEncoding != null)
+				Recycle(msg.m_sharedEncoding);
 	
 			msg.Reset();
-			m_outgoingMessagesPool.Enqueue(msg);
+			m_outgoingMessagesPool.TryEnqueue(msg);
 		}
 
 		/// <summary>
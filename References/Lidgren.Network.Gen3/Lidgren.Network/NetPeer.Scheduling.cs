@@ -0,0 +1,79 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Threading;
+
+namespace Lidgren.Network
+{
+	public partial class NetPeer
+	{
+		// connections with something to do now; any thread may wake one
+		private readonly NetQueue<NetConnection> m_wokenConnections = new NetQueue<NetConnection>(16);
+
+		// connections waiting for a timeout, ping, resend or mtu probe to come due
+		private readonly NetDeadlineHeap m_connectionDeadlines = new NetDeadlineHeap(64);
+
+		// reused every heartbeat
+		private readonly List<NetConnection> m_dueConnections = new List<NetConnection>();
+		private int m_lastDueCount;
+
+		internal void WakeConnection(NetConnection conn)
+		{
+			m_wokenConnections.Enqueue(conn);
+		}
+
+		/// <summary>
+		/// Heartbeats only the connections that have been woken or whose next deadline has passed;
+		/// idle connections cost nothing until their ping or timeout comes around
+		/// </summary>
+		private void HeartbeatConnections(float now)
+		{
+			VerifyNetworkThread();
+
+			NetConnection conn;
+			while (m_connectionDeadlines.TryDequeueDue(now, out conn))
+				AddDueConnection(conn);
+			while (m_wokenConnections.TryDequeue(out conn))
+			{
+				// wakes from here on need to be seen next heartbeat
+				Interlocked.Exchange(ref conn.m_isWoken, 0);
+				AddDueConnection(conn);
+			}
+
+			lock (m_connections)
+			{
+				foreach (NetConnection due in m_dueConnections)
+				{
+					due.m_isDue = false;
+					if (!due.m_isListed)
+						continue; // removed since it was scheduled
+
+					due.Heartbeat(now, m_frameCounter);
+					if (due.m_status == NetConnectionStatus.Disconnected)
+					{
+						//
+						// remove connection
+						//
+						m_connections.Remove(due);
+						m_connectionLookup.Remove(due.RemoteEndpoint);
+						due.m_isListed = false;
+						continue;
+					}
+
+					if (due.HasQueuedWork())
+						due.Wake();
+					m_connectionDeadlines.Schedule(due, due.GetNextHeartbeatTime(now));
+				}
+			}
+			m_lastDueCount = m_dueConnections.Count;
+			m_dueConnections.Clear();
+		}
+
+		private void AddDueConnection(NetConnection conn)
+		{
+			if (conn.m_isDue)
+				return;
+			conn.m_isDue = true;
+			m_dueConnections.Add(conn);
+		}
+	}
+}
@@ -47,7 +47,7 @@ namespace Lidgren.Network
 			msg.m_isSent = true;
 
 			int len = NetConstants.UnfragmentedMessageHeaderSize + msg.LengthBytes; // headers + length, faster than calling msg.GetEncodedSize
-			if (len <= recipient.m_currentMTU)
+			if (len <= recipient.GetPacketPayloadSize())
 			{
 				Interlocked.Increment(ref msg.m_recyclingCount);
 				return recipient.EnqueueMessage(msg, method, sequenceChannel);
@@ -69,7 +69,7 @@ namespace Lidgren.Network
 			int mtu = int.MaxValue;
 			foreach (NetConnection conn in recipients)
 			{
-				int cmtu = conn.m_currentMTU;
+				int cmtu = conn.GetPacketPayloadSize();
 				if (cmtu < mtu)
 					mtu = cmtu;
 			}
@@ -103,17 +103,24 @@ namespace Lidgren.Network
 			int len = msg.GetEncodedSize();
 			if (len <= mtu)
 			{
+				if (recipients.Count > 1 && m_configuration.m_useSharedBroadcastEncoding &&
+					(method == NetDeliveryMethod.Unreliable || method == NetDeliveryMethod.UnreliableSequenced))
+				{
+					// encode once for everyone; each connection only adds its own sequence number
+					msg.m_messageType = (NetMessageType)((int)method + sequenceChannel);
+					msg.EncodeShared(GetStorage(len));
+				}
+
 				Interlocked.Add(ref msg.m_recyclingCount, recipients.Count);
 				foreach (NetConnection conn in recipients)
 				{
-					if (conn == null)
+					NetSendResult res = (conn == null ? NetSendResult.FailedNotConnected : conn.EnqueueMessage(msg, method, sequenceChannel));
+					if (res != NetSendResult.Queued && res != NetSendResult.Sent)
 					{
-						Interlocked.Decrement(ref msg.m_recyclingCount);
-						continue;
+						// last reference may be ours if everyone else has already sent it
+						if (Interlocked.Decrement(ref msg.m_recyclingCount) == 0)
+							Recycle(msg);
 					}
-					NetSendResult res = conn.EnqueueMessage(msg, method, sequenceChannel);
-					if (res != NetSendResult.Queued && res != NetSendResult.Sent)
-						Interlocked.Decrement(ref msg.m_recyclingCount);
 				}
 			}
 			else
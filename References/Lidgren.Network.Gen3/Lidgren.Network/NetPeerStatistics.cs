@@ -45,6 +45,14 @@ namespace Lidgren.Network
 
 		internal long m_bytesAllocated;
 
+		internal int m_storagePoolHits;
+		internal int m_storagePoolMisses;
+		internal int m_storagePoolDiscards;
+
+		internal int m_fragmentGroupsAbandoned;
+		internal int m_fragmentGroupsDropped;
+		internal int m_reassemblyBytesPeak;
+
 		internal NetPeerStatistics(NetPeer peer)
 		{
 			m_peer = peer;
@@ -63,6 +71,14 @@ namespace Lidgren.Network
 			m_receivedBytes = 0;
 
 			m_bytesAllocated = 0;
+
+			m_storagePoolHits = 0;
+			m_storagePoolMisses = 0;
+			m_storagePoolDiscards = 0;
+
+			m_fragmentGroupsAbandoned = 0;
+			m_fragmentGroupsDropped = 0;
+			m_reassemblyBytesPeak = 0;
 		}
 
 		/// <summary>
@@ -103,7 +119,42 @@ namespace Lidgren.Network
 		/// <summary>
 		/// Gets the number of bytes in the recycled pool
 		/// </summary>
-		public int BytesInRecyclePool { get { return m_peer.m_storagePoolBytes; } }
+		public int BytesInRecyclePool { get { return m_peer.StoragePoolBytes; } }
+
+		/// <summary>
+		/// Gets the number of times message storage was taken from the recycled pool
+		/// </summary>
+		public int StoragePoolHits { get { return m_storagePoolHits; } }
+
+		/// <summary>
+		/// Gets the number of times message storage had to be allocated because the recycled pool had none of the right size
+		/// </summary>
+		public int StoragePoolMisses { get { return m_storagePoolMisses; } }
+
+		/// <summary>
+		/// Gets the number of recycled arrays left to the garbage collector because the pool was full
+		/// </summary>
+		public int StoragePoolDiscards { get { return m_storagePoolDiscards; } }
+
+		/// <summary>
+		/// Gets the number of bytes currently held by partly received fragmented messages
+		/// </summary>
+		public int ReassemblyBytes { get { return m_peer.ReassemblyBytes; } }
+
+		/// <summary>
+		/// Gets the most bytes held by partly received fragmented messages at any one time
+		/// </summary>
+		public int ReassemblyBytesPeak { get { return m_reassemblyBytesPeak; } }
+
+		/// <summary>
+		/// Gets the number of partly received fragmented messages given up on; expired, crowded out or their connection gone
+		/// </summary>
+		public int FragmentGroupsAbandoned { get { return m_fragmentGroupsAbandoned; } }
+
+		/// <summary>
+		/// Gets the number of fragmented messages not started because MaximumReassemblyBytes was reached
+		/// </summary>
+		public int FragmentGroupsDropped { get { return m_fragmentGroupsDropped; } }
 
 #if USE_RELEASE_STATISTICS
 		internal void PacketSent(int numBytes, int numMessages)
@@ -154,7 +205,8 @@ namespace Lidgren.Network
 			bdr.AppendLine("Received (n/a) bytes in (n/a) messages in (n/a) packets");
 #endif
 			bdr.AppendLine("Storage allocated " + m_bytesAllocated + " bytes");
-			bdr.AppendLine("Recycled pool " + m_peer.m_storagePoolBytes + " bytes");
+			bdr.AppendLine("Recycled pool " + m_peer.StoragePoolBytes + " bytes (" + m_storagePoolHits + " hits, " + m_storagePoolMisses + " misses, " + m_storagePoolDiscards + " discarded)");
+			bdr.AppendLine("Reassembling " + m_peer.ReassemblyBytes + " bytes, peak " + m_reassemblyBytesPeak + " (" + m_fragmentGroupsAbandoned + " groups abandoned, " + m_fragmentGroupsDropped + " dropped)");
 			return bdr.ToString();
 		}
 	}
@@ -7,6 +7,9 @@ namespace Lidgren.Network
 		internal NetPeer m_peer;
 		internal NetConnection m_connection;
 
+		// something arrived since the last selective ack went out
+		internal bool m_selectiveAckPending;
+
 		public NetReceiverChannelBase(NetConnection connection)
 		{
 			m_connection = connection;
@@ -14,5 +17,15 @@ namespace Lidgren.Network
 		}
 
 		internal abstract void ReceiveMessage(NetIncomingMessage msg);
+
+		/// <summary>
+		/// Reports the next sequence number expected and which of the following ones have arrived early; false if the channel doesn't ack
+		/// </summary>
+		internal virtual bool GetSelectiveAck(out int windowStart, out uint earlyReceived)
+		{
+			windowStart = 0;
+			earlyReceived = 0;
+			return false;
+		}
 	}
 }
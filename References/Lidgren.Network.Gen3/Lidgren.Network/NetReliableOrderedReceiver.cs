@@ -23,12 +23,25 @@ namespace Lidgren.Network
 			m_windowStart = (m_windowStart + 1) % NetConstants.NumSequenceNumbers;
 		}
 
+		internal override bool GetSelectiveAck(out int windowStart, out uint earlyReceived)
+		{
+			windowStart = m_windowStart;
+			earlyReceived = 0;
+			for (int i = 0; i < NetSelectiveAck.NumBits && i + 1 < m_windowSize; i++)
+			{
+				if (m_earlyReceived[(m_windowStart + 1 + i) % m_windowSize])
+					earlyReceived |= (1u << i);
+			}
+			return true;
+		}
+
 		internal override void ReceiveMessage(NetIncomingMessage message)
 		{
 			int relate = NetUtility.RelativeSequenceNumber(message.m_sequenceNumber, m_windowStart);
 
 			// ack no matter what
 			m_connection.QueueAck(message.m_receivedMessageType, message.m_sequenceNumber);
+			m_selectiveAckPending = true;
 
 			if (relate == 0)
 			{
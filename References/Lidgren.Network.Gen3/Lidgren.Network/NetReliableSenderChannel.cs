@@ -8,6 +8,9 @@ namespace Lidgren.Network
 	/// </summary>
 	internal sealed class NetReliableSenderChannel : NetSenderChannelBase
 	{
+		// later messages acked before a first send is taken as lost without waiting out the reorder allowance, like TCP's duplicate acks
+		private const int c_fastRetransmitAcks = 2;
+
 		private NetConnection m_connection;
 		private int m_windowStart;
 		private int m_windowSize;
@@ -17,6 +20,7 @@ namespace Lidgren.Network
 		internal NetStoredReliableMessage[] m_storedMessages;
 
 		internal float m_resendDelay;
+		private float m_nextResendTime;
 
 		internal override int WindowSize { get { return m_windowSize; } }
 
@@ -30,15 +34,37 @@ namespace Lidgren.Network
 			m_storedMessages = new NetStoredReliableMessage[m_windowSize];
 			m_queuedSends = new NetQueue<NetOutgoingMessage>(8);
 			m_resendDelay = m_connection.GetResendDelay();
+			m_nextResendTime = float.MaxValue;
 		}
 
 		internal override int GetAllowedSends()
 		{
 			int retval = m_windowSize - ((m_sendStart + NetConstants.NumSequenceNumbers) - m_windowStart) % NetConstants.NumSequenceNumbers;
 			NetException.Assert(retval >= 0 && retval <= m_windowSize);
+
+			NetCongestionControl congestion = m_connection.m_congestion;
+			if (congestion != null)
+				retval = Math.Min(retval, congestion.GetAllowedSends());
 			return retval;
 		}
 
+		// with congestion control, each timeout doubles the wait before the next resend of that message
+		private float GetResendDelay(int numSent)
+		{
+			if (m_connection.m_congestion == null || numSent <= 1)
+				return m_resendDelay;
+			return m_resendDelay * (float)(1 << Math.Min(numSent - 1, 4));
+		}
+
+		// how long an overtaken message gets before it is taken as lost; a round trip plus a quarter for reordering
+		private float GetFastRetransmitDelay()
+		{
+			float rtt = m_connection.AverageRoundtripTime;
+			if (rtt <= 0.0f)
+				return m_resendDelay * 0.5f; // not measured yet
+			return rtt * 1.25f;
+		}
+
 		internal override void Reset()
 		{
 			m_receivedAcks.Clear();
@@ -47,6 +73,13 @@ namespace Lidgren.Network
 			m_queuedSends.Clear();
 			m_windowStart = 0;
 			m_sendStart = 0;
+			m_nextResendTime = float.MaxValue;
+		}
+
+		internal override float GetNextResendTime()
+		{
+			// may be early if acks have arrived since; that only costs an extra heartbeat
+			return m_nextResendTime;
 		}
 
 		internal override NetSendResult Enqueue(NetOutgoingMessage message)
@@ -64,37 +97,71 @@ namespace Lidgren.Network
 		internal override void SendQueuedMessages(float now)
 		{
 			//
-			// resends
+			// resends; walk back from the newest message so we know whether anything sent later has been acked
 			//
-			for (int i = 0; i < m_storedMessages.Length; i++)
+			bool fastRetransmit = m_connection.m_peerConfiguration.m_enableSelectiveAcks;
+			float lossDelay = GetFastRetransmitDelay();
+			float newestAckedSend = -1.0f;
+			int ackedAfter = 0;
+			float nextResend = float.MaxValue;
+
+			int outstanding = NetUtility.RelativeSequenceNumber(m_sendStart, m_windowStart);
+			for (int i = outstanding - 1; i >= 0; i--)
 			{
-				NetOutgoingMessage om = m_storedMessages[i].Message;
+				int seqNr = (m_windowStart + i) % NetConstants.NumSequenceNumbers;
+				int slot = seqNr % m_windowSize;
+				NetOutgoingMessage om = m_storedMessages[slot].Message;
 				if (om == null)
 					continue;
 
-				float t = m_storedMessages[i].LastSent;
-				if (t > 0 && (now - t) > m_resendDelay)
+				float t = m_storedMessages[slot].LastSent;
+				if (m_receivedAcks[seqNr])
 				{
-					// deduce sequence number
-					int startSlot = m_windowStart % m_windowSize;
-					int seqNr = m_windowStart;
-					while (startSlot != i)
-					{
-						startSlot--;
-						if (startSlot < 0)
-							startSlot = m_windowSize - 1;
-						seqNr--;
-					}
+					// arrived; only waiting for the window start
+					if (t > newestAckedSend)
+						newestAckedSend = t;
+					ackedAfter++;
+					continue;
+				}
+
+				// overtaken by a later message that has been acked; lost unless merely reordered. Everything
+				// after a message sent only once was sent after it, so enough of them arriving settles it
+				bool overtaken = fastRetransmit && newestAckedSend >= t;
+				bool settled = (m_storedMessages[slot].NumSent == 1 && ackedAfter >= c_fastRetransmitAcks);
+				if (overtaken && (settled || (now - t) >= lossDelay))
+				{
+					//m_connection.m_peer.LogVerbose("Fast retransmit of #" + seqNr + " " + om.ToString());
+					m_connection.m_statistics.MessageResent(MessageResendReason.HoleInSequence);
+					if (m_connection.m_congestion != null)
+						m_connection.m_congestion.MessageLost(now, false);
+
+					m_connection.QueueSendMessage(om, seqNr);
 
+					m_storedMessages[slot].LastSent = now;
+					m_storedMessages[slot].NumSent++;
+					overtaken = false;
+				}
+				else if (t > 0 && (now - t) > GetResendDelay(m_storedMessages[slot].NumSent))
+				{
 					//m_connection.m_peer.LogVerbose("Resending due to delay #" + seqNr + " " + om.ToString());
 					m_connection.m_statistics.MessageResent(MessageResendReason.Delay);
+					if (m_connection.m_congestion != null)
+						m_connection.m_congestion.MessageLost(now, true);
 
 					m_connection.QueueSendMessage(om, seqNr);
 
-					m_storedMessages[i].LastSent = now;
-					m_storedMessages[i].NumSent++;
+					m_storedMessages[slot].LastSent = now;
+					m_storedMessages[slot].NumSent++;
+					overtaken = false;
 				}
+
+				float due = m_storedMessages[slot].LastSent + GetResendDelay(m_storedMessages[slot].NumSent);
+				if (overtaken)
+					due = Math.Min(due, t + lossDelay);
+				if (due < nextResend)
+					nextResend = due;
 			}
+			m_nextResendTime = nextResend;
 
 			int num = GetAllowedSends();
 			if (num < 1)
@@ -125,9 +192,26 @@ namespace Lidgren.Network
 			m_storedMessages[storeIndex].Message = message;
 			m_storedMessages[storeIndex].LastSent = now;
 
+			if (m_connection.m_congestion != null)
+				m_connection.m_congestion.MessageSent(message.GetEncodedSize());
+
+			if (now + m_resendDelay < m_nextResendTime)
+				m_nextResendTime = now + m_resendDelay;
+
 			return;
 		}
 
+		// tells congestion control about the first ack of a message; the window catching up with it later doesn't count again
+		private void CountAcknowledged(float now, int storeIndex)
+		{
+			if (m_connection.m_congestion == null)
+				return;
+
+			// only a message sent once gives an unambiguous round trip
+			float roundtrip = (m_storedMessages[storeIndex].NumSent == 1 ? now - m_storedMessages[storeIndex].LastSent : -1.0f);
+			m_connection.m_congestion.MessageAcknowledged(roundtrip);
+		}
+
 		private void DestoreMessage(int storeIndex)
 		{
 			NetOutgoingMessage storedMessage = m_storedMessages[storeIndex].Message;
@@ -138,8 +222,7 @@ namespace Lidgren.Network
 			if (storedMessage != null)
 			{
 #endif
-			Interlocked.Decrement(ref storedMessage.m_recyclingCount);
-			if (storedMessage.m_recyclingCount <= 0)
+			if (Interlocked.Decrement(ref storedMessage.m_recyclingCount) <= 0)
 				m_connection.m_peer.Recycle(storedMessage);
 
 #if !DEBUG
@@ -168,8 +251,11 @@ namespace Lidgren.Network
 				// ack arrived right on time
 				NetException.Assert(seqNr == m_windowStart);
 
+				int slot = m_windowStart % m_windowSize;
+				CountAcknowledged(now, slot);
+
 				m_receivedAcks[m_windowStart] = false;
-				DestoreMessage(m_windowStart % m_windowSize);
+				DestoreMessage(slot);
 				m_windowStart = (m_windowStart + 1) % NetConstants.NumSequenceNumbers;
 
 				// advance window if we already have early acks
@@ -177,7 +263,7 @@ namespace Lidgren.Network
 				{
 					//m_connection.m_peer.LogDebug("Using early ack for #" + m_windowStart + "...");
 					m_receivedAcks[m_windowStart] = false;
-					DestoreMessage(m_windowStart % m_windowSize);
+					DestoreMessage(m_windowStart % m_windowSize); // acked some time ago, and counted then
 
 					NetException.Assert(m_storedMessages[m_windowStart % m_windowSize].Message == null); // should already be destored
 					m_windowStart = (m_windowStart + 1) % NetConstants.NumSequenceNumbers;
@@ -207,6 +293,9 @@ namespace Lidgren.Network
 				else
 				{
 					m_receivedAcks[seqNr] = true;
+
+					// it has left the network even though the window can't move past it yet
+					CountAcknowledged(now, seqNr % m_windowSize);
 				}
 			}
 			else if (sendRelate > 0)
@@ -216,6 +305,9 @@ namespace Lidgren.Network
 				return;
 			}
 
+			if (m_connection.m_peerConfiguration.m_enableSelectiveAcks)
+				return; // the gap is resent by SendQueuedMessages once the reorder allowance has passed
+
 			// Ok, lets resend all missing acks
 			int rnr = seqNr;
 			do
@@ -247,6 +339,8 @@ namespace Lidgren.Network
 							m_storedMessages[slot].LastSent = now;
 							m_storedMessages[slot].NumSent++;
 							m_connection.m_statistics.MessageResent(MessageResendReason.HoleInSequence);
+							if (m_connection.m_congestion != null)
+								m_connection.m_congestion.MessageLost(now, false);
 							m_connection.QueueSendMessage(rmsg, rnr);
 						}
 					}
@@ -254,5 +348,24 @@ namespace Lidgren.Network
 
 			} while (rnr != m_windowStart);
 		}
+
+		// remoteWindowStart is the next sequence number the remote expects; bit n of earlyReceived is set if remoteWindowStart + 1 + n has arrived
+		internal void ReceiveSelectiveAcknowledge(float now, int remoteWindowStart, uint earlyReceived)
+		{
+			// everything below the remote window start has arrived, even if its plain ack was lost
+			while (m_windowStart != m_sendStart && NetUtility.RelativeSequenceNumber(remoteWindowStart, m_windowStart) > 0)
+				ReceiveAcknowledge(now, m_windowStart);
+
+			for (int i = 0; earlyReceived != 0; i++, earlyReceived >>= 1)
+			{
+				if ((earlyReceived & 1) == 0)
+					continue;
+
+				int seqNr = (remoteWindowStart + 1 + i) % NetConstants.NumSequenceNumbers;
+				if (NetUtility.RelativeSequenceNumber(seqNr, m_sendStart) >= 0)
+					break; // not sent; stale or bogus
+				ReceiveAcknowledge(now, seqNr);
+			}
+		}
 	}
 }
@@ -18,6 +18,14 @@ namespace Lidgren.Network
 			m_windowStart = (m_windowStart + 1) % NetConstants.NumSequenceNumbers;
 		}
 
+		// anything older than the window start is dropped on arrival, so the sender may stop resending it
+		internal override bool GetSelectiveAck(out int windowStart, out uint earlyReceived)
+		{
+			windowStart = m_windowStart;
+			earlyReceived = 0;
+			return true;
+		}
+
 		internal override void ReceiveMessage(NetIncomingMessage message)
 		{
 			int nr = message.m_sequenceNumber;
@@ -26,6 +34,7 @@ namespace Lidgren.Network
 
 			// ack no matter what
 			m_connection.QueueAck(message.m_receivedMessageType, nr);
+			m_selectiveAckPending = true;
 
 			if (relate == 0)
 			{
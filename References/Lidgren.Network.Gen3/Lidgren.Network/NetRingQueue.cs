@@ -0,0 +1,171 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading;
+
+namespace Lidgren.Network
+{
+	/// <summary>
+	/// Lock free bounded queue; any number of threads may enqueue and dequeue at the same time
+	/// </summary>
+	/// <remarks>
+	/// Each slot carries a sequence number saying whether it is free for the producer at that position
+	/// or holds an item for the consumer at that position, so producers and consumers only ever
+	/// contend on a single interlocked compare-exchange. TryEnqueue fails rather than grows when full.
+	/// </remarks>
+	[DebuggerDisplay("Count={Count} Capacity={Capacity}")]
+	public sealed class NetRingQueue<T>
+	{
+		private readonly T[] m_items;
+		private readonly int[] m_sequences;
+		private readonly int m_mask;
+
+		// positions only ever increase; they wrap around int, which the sequence arithmetic allows for
+		private int m_enqueuePosition;
+		private int m_dequeuePosition;
+
+		/// <summary>
+		/// Gets the number of items in the queue; only a snapshot while other threads are using it
+		/// </summary>
+		public int Count
+		{
+			get
+			{
+				int count = Thread.VolatileRead(ref m_enqueuePosition) - Thread.VolatileRead(ref m_dequeuePosition);
+				if (count < 0)
+					return 0;
+				return (count > m_items.Length ? m_items.Length : count);
+			}
+		}
+
+		/// <summary>
+		/// Gets the capacity of the queue
+		/// </summary>
+		public int Capacity { get { return m_items.Length; } }
+
+		/// <summary>
+		/// Returns true if nothing is in the queue and no enqueue is in progress
+		/// </summary>
+		public bool IsEmpty
+		{
+			get { return Thread.VolatileRead(ref m_enqueuePosition) == Thread.VolatileRead(ref m_dequeuePosition); }
+		}
+
+		/// <summary>
+		/// NetRingQueue constructor
+		/// </summary>
+		/// <param name="capacity">capacity, rounded up to the next power of two</param>
+		public NetRingQueue(int capacity)
+		{
+			if (capacity < 2)
+				capacity = 2;
+
+			int size = 2;
+			while (size < capacity)
+				size <<= 1;
+
+			m_items = new T[size];
+			m_sequences = new int[size];
+			m_mask = size - 1;
+
+			for (int i = 0; i < size; i++)
+				m_sequences[i] = i;
+		}
+
+		/// <summary>
+		/// Adds an item last/tail of the queue; returns false if the queue is full
+		/// </summary>
+		public bool TryEnqueue(T item)
+		{
+			int position = Thread.VolatileRead(ref m_enqueuePosition);
+			while (true)
+			{
+				int slot = position & m_mask;
+				int difference = Thread.VolatileRead(ref m_sequences[slot]) - position;
+
+				if (difference == 0)
+				{
+					int current = Interlocked.CompareExchange(ref m_enqueuePosition, position + 1, position);
+					if (current == position)
+					{
+						m_items[slot] = item;
+						Thread.VolatileWrite(ref m_sequences[slot], position + 1);
+						return true;
+					}
+					position = current;
+				}
+				else if (difference < 0)
+				{
+					// the consumer a whole lap behind hasn't freed this slot yet
+					return false;
+				}
+				else
+				{
+					position = Thread.VolatileRead(ref m_enqueuePosition);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Gets an item from the head of the queue, or returns false if there is none ready
+		/// </summary>
+		public bool TryDequeue(out T item)
+		{
+			int position = Thread.VolatileRead(ref m_dequeuePosition);
+			while (true)
+			{
+				int slot = position & m_mask;
+				int difference = Thread.VolatileRead(ref m_sequences[slot]) - (position + 1);
+
+				if (difference == 0)
+				{
+					int current = Interlocked.CompareExchange(ref m_dequeuePosition, position + 1, position);
+					if (current == position)
+					{
+						item = m_items[slot];
+						m_items[slot] = default(T);
+						Thread.VolatileWrite(ref m_sequences[slot], position + m_items.Length);
+						return true;
+					}
+					position = current;
+				}
+				else if (difference < 0)
+				{
+					// empty, or the producer of this slot is still writing it
+					item = default(T);
+					return false;
+				}
+				else
+				{
+					position = Thread.VolatileRead(ref m_dequeuePosition);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Determines whether an item is in the queue; only reliable while no other thread is using it
+		/// </summary>
+		public bool Contains(T item)
+		{
+			EqualityComparer<T> comparer = EqualityComparer<T>.Default;
+
+			int end = Thread.VolatileRead(ref m_enqueuePosition);
+			for (int position = Thread.VolatileRead(ref m_dequeuePosition); position != end; position++)
+			{
+				int slot = position & m_mask;
+				if (Thread.VolatileRead(ref m_sequences[slot]) == position + 1 && comparer.Equals(m_items[slot], item))
+					return true;
+			}
+			return false;
+		}
+
+		/// <summary>
+		/// Removes all items that can be dequeued
+		/// </summary>
+		public void Clear()
+		{
+			T item;
+			while (TryDequeue(out item)) ;
+		}
+	}
+}
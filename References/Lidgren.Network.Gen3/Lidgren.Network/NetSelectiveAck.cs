@@ -0,0 +1,31 @@
+﻿using System;
+
+namespace Lidgren.Network
+{
+	/// <summary>
+	/// One reliable channel's entry in a SelectiveAcknowledge message
+	/// </summary>
+	internal struct NetSelectiveAck
+	{
+		// bits of bitmap sent per channel; the sequence numbers right after the cumulative ack
+		internal const int NumBits = 32;
+
+		// bytes per entry on the wire: message type, cumulative ack, bitmap
+		internal const int EncodedSize = 1 + 2 + 4;
+
+		public NetMessageType Type;
+
+		// next sequence number the receiver expects; everything before it has arrived
+		public int WindowStart;
+
+		// bit n set means WindowStart + 1 + n has arrived
+		public uint EarlyReceived;
+
+		public NetSelectiveAck(NetMessageType type, int windowStart, uint earlyReceived)
+		{
+			Type = type;
+			WindowStart = windowStart;
+			EarlyReceived = earlyReceived;
+		}
+	}
+}
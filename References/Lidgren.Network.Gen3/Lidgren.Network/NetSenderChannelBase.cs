@@ -15,5 +15,8 @@ namespace Lidgren.Network
 		internal abstract void SendQueuedMessages(float now);
 		internal abstract void Reset();
 		internal abstract void ReceiveAcknowledge(float now, int sequenceNumber);
+
+		// when SendQueuedMessages() next needs calling for a resend, or float.MaxValue
+		internal abstract float GetNextResendTime();
 	}
 }
@@ -0,0 +1,156 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Threading;
+
+namespace Lidgren.Network
+{
+	/// <summary>
+	/// Pool of message storage arrays, bucketed by power of two size classes up to the MTU plus one class for anything larger
+	/// </summary>
+	/// <remarks>
+	/// Every class is a lock free <see cref="NetRingQueue{T}"/>, only the rarely used large class takes a lock.
+	/// There are no per thread caches; a thread serving several peers would keep swapping them out. An array is pooled
+	/// in the largest class it can serve, so a request never gets an array more than twice its size
+	/// (except from the large class). Arrays recycled beyond the byte cap are left to the garbage collector.
+	/// </remarks>
+	internal sealed class NetStoragePool
+	{
+		private const int c_minimumClassBits = 4; // 16 bytes
+		private const int c_ringCapacity = 256;
+		private const int c_largeCapacity = 32;
+
+		private readonly NetPeerStatistics m_statistics;
+		private readonly int m_maxBytes;
+		private readonly int m_classCount;
+		private readonly int m_largestClassSize;
+		private readonly NetRingQueue<byte[]>[] m_classes;
+		private readonly List<byte[]> m_large;
+
+		private int m_bytesInPool;
+
+		/// <summary>
+		/// Gets the number of bytes held by the pool
+		/// </summary>
+		public int BytesInPool { get { return m_bytesInPool; } }
+
+		public NetStoragePool(NetPeerStatistics statistics, int maximumTransmissionUnit, int maxBytes)
+		{
+			m_statistics = statistics;
+			m_maxBytes = maxBytes;
+
+			m_classCount = 1;
+			while ((1 << (c_minimumClassBits + m_classCount - 1)) < maximumTransmissionUnit)
+				m_classCount++;
+			m_largestClassSize = 1 << (c_minimumClassBits + m_classCount - 1);
+
+			m_classes = new NetRingQueue<byte[]>[m_classCount];
+			for (int i = 0; i < m_classCount; i++)
+				m_classes[i] = new NetRingQueue<byte[]>(c_ringCapacity);
+
+			m_large = new List<byte[]>(c_largeCapacity);
+		}
+
+		/// <summary>
+		/// Gets an array of at least minimumCapacity bytes
+		/// </summary>
+		public byte[] Get(int minimumCapacity)
+		{
+			if (minimumCapacity > m_largestClassSize)
+				return GetLarge(minimumCapacity);
+
+			// smallest class whose arrays are all large enough
+			int sizeClass = 0;
+			while ((1 << (c_minimumClassBits + sizeClass)) < minimumCapacity)
+				sizeClass++;
+
+			byte[] retval;
+			if (!m_classes[sizeClass].TryDequeue(out retval))
+				return Allocate(1 << (c_minimumClassBits + sizeClass));
+
+			Interlocked.Add(ref m_bytesInPool, -retval.Length);
+			Interlocked.Increment(ref m_statistics.m_storagePoolHits);
+			return retval;
+		}
+
+		/// <summary>
+		/// Returns an array to the pool
+		/// </summary>
+		public void Return(byte[] storage)
+		{
+			if (storage == null || storage.Length < (1 << c_minimumClassBits))
+				return;
+
+			if (m_bytesInPool + storage.Length > m_maxBytes)
+			{
+				Interlocked.Increment(ref m_statistics.m_storagePoolDiscards);
+				return;
+			}
+
+			if (storage.Length > m_largestClassSize)
+			{
+				ReturnLarge(storage);
+				return;
+			}
+
+			// largest class this array can serve
+			int sizeClass = m_classCount - 1;
+			while ((1 << (c_minimumClassBits + sizeClass)) > storage.Length)
+				sizeClass--;
+
+			Interlocked.Add(ref m_bytesInPool, storage.Length);
+
+			if (!m_classes[sizeClass].TryEnqueue(storage))
+			{
+				Interlocked.Add(ref m_bytesInPool, -storage.Length);
+				Interlocked.Increment(ref m_statistics.m_storagePoolDiscards);
+			}
+		}
+
+		private byte[] GetLarge(int minimumCapacity)
+		{
+			lock (m_large)
+			{
+				// smallest that fits
+				int best = -1;
+				for (int i = 0; i < m_large.Count; i++)
+				{
+					if (m_large[i].Length >= minimumCapacity && (best == -1 || m_large[i].Length < m_large[best].Length))
+						best = i;
+				}
+
+				if (best != -1)
+				{
+					byte[] retval = m_large[best];
+					m_large[best] = m_large[m_large.Count - 1];
+					m_large.RemoveAt(m_large.Count - 1);
+
+					Interlocked.Add(ref m_bytesInPool, -retval.Length);
+					Interlocked.Increment(ref m_statistics.m_storagePoolHits);
+					return retval;
+				}
+			}
+			return Allocate(minimumCapacity);
+		}
+
+		private void ReturnLarge(byte[] storage)
+		{
+			lock (m_large)
+			{
+				if (m_large.Count < c_largeCapacity)
+				{
+					m_large.Add(storage);
+					Interlocked.Add(ref m_bytesInPool, storage.Length);
+					return;
+				}
+			}
+			Interlocked.Increment(ref m_statistics.m_storagePoolDiscards);
+		}
+
+		private byte[] Allocate(int size)
+		{
+			Interlocked.Increment(ref m_statistics.m_storagePoolMisses);
+			Interlocked.Add(ref m_statistics.m_bytesAllocated, size);
+			return new byte[size];
+		}
+	}
+}
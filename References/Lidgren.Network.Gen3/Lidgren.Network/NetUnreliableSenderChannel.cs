@@ -42,6 +42,11 @@ namespace Lidgren.Network
 			m_sendStart = 0;
 		}
 
+		internal override float GetNextResendTime()
+		{
+			return float.MaxValue; // never resends
+		}
+
 		internal override NetSendResult Enqueue(NetOutgoingMessage message)
 		{
 			int queueLen = m_queuedSends.Count + 1;
@@ -79,8 +84,7 @@ namespace Lidgren.Network
 
 			m_connection.QueueSendMessage(message, seqNr);
 
-			Interlocked.Decrement(ref message.m_recyclingCount);
-			if (message.m_recyclingCount <= 0)
+			if (Interlocked.Decrement(ref message.m_recyclingCount) <= 0)
 				m_connection.m_peer.Recycle(message);
 
 			return;
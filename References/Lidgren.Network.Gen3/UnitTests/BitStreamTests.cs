@@ -0,0 +1,251 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using Lidgren.Network;
+
+namespace UnitTests
+{
+	/// <summary>
+	/// Fuzzed round trips of unaligned bit streams, checked byte for byte against the original per-byte bit writer, and unaligned throughput
+	/// </summary>
+	public static class BitStreamTests
+	{
+		private const int c_rounds = 500;
+		private const int c_values = 1000000;
+
+		private enum Op
+		{
+			Bool,
+			Byte,
+			UInt32,
+			UInt64,
+			Bytes
+		}
+
+		private struct Written
+		{
+			public Op Op;
+			public int Bits;
+			public ulong Value;
+			public byte[] Bytes;
+		}
+
+		public static void Run(NetPeer peer)
+		{
+			Random random = new Random(1234);
+			List<Written> written = new List<Written>();
+
+			for (int round = 0; round < c_rounds; round++)
+			{
+				NetOutgoingMessage msg = peer.CreateMessage();
+				byte[] reference = new byte[1024];
+				int referenceBits = 0;
+				written.Clear();
+
+				int count = random.Next(1, 60);
+				for (int i = 0; i < count; i++)
+				{
+					Written w = new Written();
+					w.Op = (Op)random.Next(5);
+					switch (w.Op)
+					{
+						case Op.Bool:
+							w.Bits = 1;
+							w.Value = (ulong)random.Next(2);
+							msg.Write(w.Value != 0);
+							break;
+						case Op.Byte:
+							w.Bits = random.Next(1, 9);
+							w.Value = (ulong)random.Next(256) & Mask(w.Bits);
+							msg.Write((byte)w.Value, w.Bits);
+							break;
+						case Op.UInt32:
+							w.Bits = random.Next(1, 33);
+							w.Value = NextUInt64(random) & Mask(w.Bits);
+							msg.Write((uint)w.Value, w.Bits);
+							break;
+						case Op.UInt64:
+							w.Bits = random.Next(1, 65);
+							w.Value = NextUInt64(random) & Mask(w.Bits);
+							msg.Write(w.Value, w.Bits);
+							break;
+						case Op.Bytes:
+							w.Bytes = new byte[random.Next(0, 24)];
+							random.NextBytes(w.Bytes);
+							w.Bits = w.Bytes.Length * 8;
+							msg.Write(w.Bytes);
+							break;
+					}
+
+					if (w.Op == Op.Bytes)
+					{
+						foreach (byte b in w.Bytes)
+							referenceBits = ReferenceWrite(b, 8, reference, referenceBits);
+					}
+					else
+					{
+						referenceBits = ReferenceWrite(w.Value, w.Bits, reference, referenceBits);
+					}
+					written.Add(w);
+				}
+
+				if (msg.LengthBits != referenceBits)
+					throw new NetException("Bit stream length " + msg.LengthBits + " differs from reference " + referenceBits);
+
+				byte[] data = msg.PeekDataBuffer();
+				for (int i = 0; i < msg.LengthBytes; i++)
+					if (data[i] != reference[i])
+						throw new NetException("Bit stream byte " + i + " is " + data[i] + ", reference " + reference[i] + " (round " + round + ")");
+
+				NetIncomingMessage inc = Program.CreateIncomingMessage(data, msg.LengthBits);
+				foreach (Written w in written)
+				{
+					switch (w.Op)
+					{
+						case Op.Bool:
+							Check(inc.ReadBoolean() ? 1UL : 0UL, w, round);
+							break;
+						case Op.Byte:
+							Check(inc.ReadByte(w.Bits), w, round);
+							break;
+						case Op.UInt32:
+							Check(inc.ReadUInt32(w.Bits), w, round);
+							break;
+						case Op.UInt64:
+							Check(inc.ReadUInt64(w.Bits), w, round);
+							break;
+						case Op.Bytes:
+							byte[] readBytes = inc.ReadBytes(w.Bytes.Length);
+							for (int i = 0; i < readBytes.Length; i++)
+								if (readBytes[i] != w.Bytes[i])
+									throw new NetException("Unaligned ReadBytes mismatch at " + i + " (round " + round + ")");
+							break;
+					}
+				}
+			}
+
+			Console.WriteLine("Bit stream tests OK");
+
+			// throughput at an odd width, so nearly every value straddles bytes
+			const int bits = 11;
+			byte[] buffer = new byte[(c_values * bits + 7) / 8 + 8];
+
+			Stopwatch watch = Stopwatch.StartNew();
+			for (int i = 0, offset = 0; i < c_values; i++, offset += bits)
+				NetBitWriter.WriteUInt32((uint)i, bits, buffer, offset);
+			double write = watch.Elapsed.TotalSeconds;
+
+			watch = Stopwatch.StartNew();
+			uint sum = 0;
+			for (int i = 0, offset = 0; i < c_values; i++, offset += bits)
+				sum += NetBitWriter.ReadUInt32(buffer, bits, offset);
+			double read = watch.Elapsed.TotalSeconds;
+
+			watch = Stopwatch.StartNew();
+			for (int i = 0, offset = 0; i < c_values; i++, offset += bits)
+				ReferenceWrite((ulong)i, bits, buffer, offset);
+			double referenceWrite = watch.Elapsed.TotalSeconds;
+
+			watch = Stopwatch.StartNew();
+			uint referenceSum = 0;
+			for (int i = 0, offset = 0; i < c_values; i++, offset += bits)
+				referenceSum += (uint)ReferenceRead(buffer, bits, offset);
+			double referenceRead = watch.Elapsed.TotalSeconds;
+
+			if (sum != referenceSum)
+				throw new NetException("Unaligned reads disagree with the reference reader");
+
+			Console.WriteLine("Unaligned " + bits + " bit values: write " + MBits(bits, write) + " Mbit/s (per-byte " + MBits(bits, referenceWrite) +
+				"), read " + MBits(bits, read) + " Mbit/s (per-byte " + MBits(bits, referenceRead) + ")");
+		}
+
+		private static void Check(ulong read, Written w, int round)
+		{
+			if (read != w.Value)
+				throw new NetException(w.Op + " of " + w.Bits + " bits read back as " + read + ", wrote " + w.Value + " (round " + round + ")");
+		}
+
+		private static ulong Mask(int bits)
+		{
+			return ulong.MaxValue >> (64 - bits);
+		}
+
+		private static ulong NextUInt64(Random random)
+		{
+			return ((ulong)(uint)random.Next() << 33) ^ ((ulong)(uint)random.Next() << 16) ^ (ulong)(uint)random.Next();
+		}
+
+		private static int MBits(int bits, double seconds)
+		{
+			return (int)(c_values * (double)bits / seconds / 1000000.0);
+		}
+
+		//
+		// The original writer, a byte at a time, as the reference for the wire format
+		//
+
+		private static int ReferenceWrite(ulong source, int numberOfBits, byte[] destination, int destBitOffset)
+		{
+			int end = destBitOffset + numberOfBits;
+			while (numberOfBits > 0)
+			{
+				int chunk = (numberOfBits < 8 ? numberOfBits : 8);
+				ReferenceWriteByte((byte)source, chunk, destination, destBitOffset);
+				source >>= 8;
+				destBitOffset += chunk;
+				numberOfBits -= chunk;
+			}
+			return end;
+		}
+
+		private static void ReferenceWriteByte(byte source, int numberOfBits, byte[] destination, int destBitOffset)
+		{
+			byte isrc = (byte)((uint)source & ((~(uint)0) >> (8 - numberOfBits)));
+
+			int bytePtr = destBitOffset >> 3;
+			int localBitLen = (destBitOffset % 8);
+			if (localBitLen == 0)
+			{
+				destination[bytePtr] = isrc;
+				return;
+			}
+
+			destination[bytePtr] = (byte)((uint)(destination[bytePtr] & (255 >> (8 - localBitLen))) | (uint)(isrc << localBitLen));
+
+			if (localBitLen + numberOfBits > 8)
+				destination[bytePtr + 1] = (byte)((uint)(destination[bytePtr + 1] & (255 << localBitLen)) | (uint)(isrc >> (8 - localBitLen)));
+		}
+
+		private static ulong ReferenceRead(byte[] fromBuffer, int numberOfBits, int readBitOffset)
+		{
+			ulong result = 0;
+			int shift = 0;
+			while (numberOfBits > 0)
+			{
+				int chunk = (numberOfBits < 8 ? numberOfBits : 8);
+				result |= (ulong)ReferenceReadByte(fromBuffer, chunk, readBitOffset) << shift;
+				shift += chunk;
+				readBitOffset += chunk;
+				numberOfBits -= chunk;
+			}
+			return result;
+		}
+
+		private static byte ReferenceReadByte(byte[] fromBuffer, int numberOfBits, int readBitOffset)
+		{
+			int bytePtr = readBitOffset >> 3;
+			int startReadAtIndex = readBitOffset - (bytePtr * 8);
+
+			if (startReadAtIndex == 0 && numberOfBits == 8)
+				return fromBuffer[bytePtr];
+
+			byte returnValue = (byte)(fromBuffer[bytePtr] >> startReadAtIndex);
+			int numberOfBitsInSecondByte = numberOfBits - (8 - startReadAtIndex);
+			if (numberOfBitsInSecondByte < 1)
+				return (byte)(returnValue & (255 >> (8 - numberOfBits)));
+
+			byte second = (byte)(fromBuffer[bytePtr + 1] & (255 >> (8 - numberOfBitsInSecondByte)));
+			return (byte)(returnValue | (byte)(second << (numberOfBits - numberOfBitsInSecondByte)));
+		}
+	}
+}
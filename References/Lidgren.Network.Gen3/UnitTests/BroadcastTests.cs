@@ -0,0 +1,153 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading;
+using Lidgren.Network;
+
+namespace UnitTests
+{
+	/// <summary>
+	/// Unreliable broadcast from one server to many clients over loopback
+	/// </summary>
+	public static class BroadcastTests
+	{
+		private const int c_recipients = 100;
+		private const int c_payloadSize = 64;
+
+		public static void Run()
+		{
+			NetPeerConfiguration config = new NetPeerConfiguration("broadcasttests");
+			config.MaximumConnections = c_recipients;
+			NetServer server = new NetServer(config);
+			server.Start();
+
+			List<NetClient> clients = new List<NetClient>(c_recipients);
+			for (int i = 0; i < c_recipients; i++)
+			{
+				NetClient client = new NetClient(new NetPeerConfiguration("broadcasttests"));
+				client.Start();
+				client.Connect("127.0.0.1", server.Port);
+				clients.Add(client);
+			}
+
+			Stopwatch waited = Stopwatch.StartNew();
+			while (server.ConnectionsCount < c_recipients)
+			{
+				if (waited.Elapsed.TotalSeconds > 20)
+					throw new NetException("Only " + server.ConnectionsCount + " of " + c_recipients + " clients connected");
+				Drain(server);
+				Thread.Sleep(10);
+			}
+			foreach (NetClient client in clients)
+				Drain(client);
+
+			// every recipient must decode what was sent, whichever way it was encoded
+			VerifyDelivery(server, clients, true);
+			VerifyDelivery(server, clients, false);
+
+			Console.WriteLine("Broadcast tests OK");
+
+#if DEBUG
+			// warm up both paths before timing them
+			TimeBroadcasts(server, clients, true, 4, 32);
+			TimeBroadcasts(server, clients, false, 4, 32);
+
+			double perRecipient = TimeBroadcasts(server, clients, false, 50, 32);
+			double shared = TimeBroadcasts(server, clients, true, 50, 32);
+
+			Console.WriteLine("Broadcast to " + c_recipients + " recipients: per recipient encoding " + (perRecipient * 1000000.0).ToString("F1") +
+				" us, shared encoding " + (shared * 1000000.0).ToString("F1") + " us per message (" + (perRecipient / shared).ToString("F2") + "x)");
+#else
+			Console.WriteLine("Broadcast timing counts sent messages with the statistics of a DEBUG build; skipped");
+#endif
+
+			foreach (NetClient client in clients)
+				client.Shutdown("bye");
+			server.Shutdown("bye");
+		}
+
+		private static NetOutgoingMessage CreateBroadcast(NetPeer peer, int marker)
+		{
+			NetOutgoingMessage om = peer.CreateMessage(4 + c_payloadSize);
+			om.Write(marker);
+			for (int i = 0; i < c_payloadSize; i++)
+				om.Write((byte)(marker + i));
+			return om;
+		}
+
+		private static void VerifyDelivery(NetServer server, List<NetClient> clients, bool shared)
+		{
+			server.Configuration.UseSharedBroadcastEncoding = shared;
+
+			int marker = (shared ? 0x5ADE : 0x0E4C);
+			server.SendToAll(CreateBroadcast(server, marker), NetDeliveryMethod.Unreliable);
+
+			foreach (NetClient client in clients)
+			{
+				Stopwatch waited = Stopwatch.StartNew();
+				bool received = false;
+				while (!received)
+				{
+					if (waited.Elapsed.TotalSeconds > 5)
+						throw new NetException("Broadcast never arrived (shared encoding " + shared + ")");
+
+					NetIncomingMessage inc = client.ReadMessage();
+					if (inc == null)
+					{
+						Thread.Sleep(1);
+						continue;
+					}
+
+					if (inc.MessageType == NetIncomingMessageType.Data)
+					{
+						if (inc.ReadInt32() != marker || inc.LengthBytes != 4 + c_payloadSize)
+							throw new NetException("Broadcast corrupt (shared encoding " + shared + ")");
+						for (int i = 0; i < c_payloadSize; i++)
+							if (inc.ReadByte() != (byte)(marker + i))
+								throw new NetException("Broadcast payload corrupt (shared encoding " + shared + ")");
+						received = true;
+					}
+					client.Recycle(inc);
+				}
+			}
+		}
+
+#if DEBUG
+		/// <summary>
+		/// Returns seconds per broadcast, from the first SendToAll until the server has put every copy on the wire
+		/// </summary>
+		private static double TimeBroadcasts(NetServer server, List<NetClient> clients, bool shared, int bursts, int burstSize)
+		{
+			server.Configuration.UseSharedBroadcastEncoding = shared;
+
+			// bursts stay well inside the unreliable window so nothing is dropped
+			int broadcasts = 0;
+			Stopwatch watch = Stopwatch.StartNew();
+			for (int b = 0; b < bursts; b++)
+			{
+				int target = server.Statistics.SentMessages + burstSize * c_recipients;
+				for (int i = 0; i < burstSize; i++)
+					server.SendToAll(CreateBroadcast(server, broadcasts++), NetDeliveryMethod.Unreliable);
+
+				Stopwatch waited = Stopwatch.StartNew();
+				while (server.Statistics.SentMessages < target && waited.Elapsed.TotalSeconds < 2)
+					Thread.Sleep(0);
+			}
+			double elapsed = watch.Elapsed.TotalSeconds;
+
+			Drain(server);
+			foreach (NetClient client in clients)
+				Drain(client);
+
+			return elapsed / broadcasts;
+		}
+#endif
+
+		private static void Drain(NetPeer peer)
+		{
+			NetIncomingMessage inc;
+			while ((inc = peer.ReadMessage()) != null)
+				peer.Recycle(inc);
+		}
+	}
+}
@@ -0,0 +1,126 @@
+﻿using System;
+using System.Diagnostics;
+using System.Threading;
+using Lidgren.Network;
+
+namespace UnitTests
+{
+	/// <summary>
+	/// Reliable ordered transfer over a simulated lossy, laggy loopback link, with and without congestion control
+	/// </summary>
+	public static class CongestionTests
+	{
+		private const int c_messages = 400;
+		private const float c_loss = 0.05f;
+		private const float c_latency = 0.05f;
+
+		public static void Run()
+		{
+#if DEBUG
+			Transfer without = RunTransfer(false);
+			Transfer with = RunTransfer(true);
+
+			if (with.Window < 2.0f || with.Window > 256.0f)
+				throw new NetException("Congestion window out of bounds: " + with.Window);
+			if (with.SendRate <= 0.0f)
+				throw new NetException("No send rate estimate with congestion control enabled");
+			if (without.Window != 0.0f || without.SendRate != 0.0f)
+				throw new NetException("Congestion figures reported with congestion control disabled");
+
+			Console.WriteLine("Congestion tests OK");
+			Console.WriteLine("Reliable transfer at " + (c_loss * 100.0f) + "% loss, " + (c_latency * 1000.0f) + " ms: without congestion control " +
+				without.Resent + " resends in " + without.Seconds.ToString("F2") + " s; with " + with.Resent + " resends in " + with.Seconds.ToString("F2") +
+				" s, window " + with.Window.ToString("F1") + ", estimated rate " + (int)with.SendRate + " bytes/s");
+#else
+			Console.WriteLine("Congestion tests need the latency simulation of a DEBUG build; skipped");
+#endif
+		}
+
+#if DEBUG
+		private struct Transfer
+		{
+			public double Seconds;
+			public int Resent;
+			public float Window;
+			public float SendRate;
+		}
+
+		private static NetPeerConfiguration CreateConfig(bool congestionControl)
+		{
+			NetPeerConfiguration config = new NetPeerConfiguration("congestiontests");
+			config.EnableCongestionControl = congestionControl;
+			config.SimulatedLoss = c_loss;
+			config.SimulatedMinimumLatency = c_latency;
+			config.SimulatedRandomLatency = c_latency * 0.4f;
+			return config;
+		}
+
+		private static Transfer RunTransfer(bool congestionControl)
+		{
+			NetServer server = new NetServer(CreateConfig(congestionControl));
+			server.Start();
+
+			NetClient client = new NetClient(CreateConfig(congestionControl));
+			client.Start();
+			client.Connect("127.0.0.1", server.Port);
+
+			Stopwatch waited = Stopwatch.StartNew();
+			while (client.ConnectionStatus != NetConnectionStatus.Connected)
+			{
+				if (waited.Elapsed.TotalSeconds > 20)
+					throw new NetException("Client never connected over the simulated link");
+				Drain(server, null);
+				Drain(client, null);
+				Thread.Sleep(10);
+			}
+
+			byte[] padding = new byte[100];
+			Stopwatch watch = Stopwatch.StartNew();
+			for (int i = 0; i < c_messages; i++)
+			{
+				NetOutgoingMessage om = client.CreateMessage(4 + padding.Length);
+				om.Write(i);
+				om.Write(padding);
+				client.SendMessage(om, NetDeliveryMethod.ReliableOrdered);
+			}
+
+			// everything must arrive, in order, whatever the controller does to the pace
+			int[] next = new int[1];
+			while (next[0] < c_messages)
+			{
+				if (watch.Elapsed.TotalSeconds > 60)
+					throw new NetException("Only " + next[0] + " of " + c_messages + " reliable messages arrived (congestion control " + congestionControl + ")");
+				Drain(server, next);
+				Drain(client, null);
+				Thread.Sleep(1);
+			}
+
+			Transfer result = new Transfer();
+			result.Seconds = watch.Elapsed.TotalSeconds;
+			result.Resent = client.ServerConnection.Statistics.ResentMessages;
+			result.Window = client.ServerConnection.CongestionWindow;
+			result.SendRate = client.ServerConnection.SendRateEstimate;
+
+			client.Shutdown("bye");
+			server.Shutdown("bye");
+			return result;
+		}
+
+		private static void Drain(NetPeer peer, int[] next)
+		{
+			NetIncomingMessage inc;
+			while ((inc = peer.ReadMessage()) != null)
+			{
+				if (inc.MessageType == NetIncomingMessageType.Data && next != null)
+				{
+					int nr = inc.ReadInt32();
+					if (nr != next[0])
+						throw new NetException("Reliable ordered message " + nr + " arrived when expecting " + next[0]);
+					next[0]++;
+				}
+				peer.Recycle(inc);
+			}
+		}
+#endif
+	}
+}
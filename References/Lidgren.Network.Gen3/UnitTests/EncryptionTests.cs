@@ -4,6 +4,8 @@ using System.Text;
 using Lidgren.Network;
 using System.Security;
 using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading;
 
 namespace UnitTests
 {
@@ -93,6 +95,171 @@ namespace UnitTests
 			}
 
 			Console.WriteLine("Message encryption OK");
+
+			ChaCha20Poly1305Vector();
+			PacketEncryption();
+			PacketThroughput(peer);
+		}
+
+		// RFC 8439 section 2.8.2
+		private static void ChaCha20Poly1305Vector()
+		{
+			byte[] key = new byte[32];
+			for (int i = 0; i < key.Length; i++)
+				key[i] = (byte)(0x80 + i);
+			byte[] aad = NetUtility.ToByteArray("50515253c0c1c2c3c4c5c6c7");
+			byte[] plain = Encoding.ASCII.GetBytes("Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.");
+
+			byte[] buffer = new byte[aad.Length + plain.Length + NetChaCha20Poly1305.TagSize];
+			Buffer.BlockCopy(aad, 0, buffer, 0, aad.Length);
+			Buffer.BlockCopy(plain, 0, buffer, aad.Length, plain.Length);
+
+			NetChaCha20Poly1305 aead = new NetChaCha20Poly1305(key);
+			aead.Seal(7, 0x4746454443424140UL, buffer, 0, aad.Length, aad.Length, plain.Length);
+
+			byte[] tag = NetUtility.ToByteArray("1ae10b594f09e26a7e902ecbd0600691");
+			byte[] start = NetUtility.ToByteArray("d31a8d34648e60db");
+			for (int i = 0; i < tag.Length; i++)
+				if (buffer[aad.Length + plain.Length + i] != tag[i])
+					throw new NetException("ChaCha20-Poly1305 tag does not match the RFC 8439 test vector");
+			for (int i = 0; i < start.Length; i++)
+				if (buffer[aad.Length + i] != start[i])
+					throw new NetException("ChaCha20-Poly1305 ciphertext does not match the RFC 8439 test vector");
+
+			buffer[aad.Length + 3] ^= 1;
+			if (aead.Open(7, 0x4746454443424140UL, buffer, 0, aad.Length, aad.Length, plain.Length))
+				throw new NetException("ChaCha20-Poly1305 opened a tampered message");
+			buffer[aad.Length + 3] ^= 1;
+			if (!aead.Open(7, 0x4746454443424140UL, buffer, 0, aad.Length, aad.Length, plain.Length))
+				throw new NetException("ChaCha20-Poly1305 failed to open");
+			for (int i = 0; i < plain.Length; i++)
+				if (buffer[aad.Length + i] != plain[i])
+					throw new NetException("ChaCha20-Poly1305 round trip failed");
+
+			Console.WriteLine("ChaCha20-Poly1305 verified");
+		}
+
+		// a connection with packet encryption, both ways
+		private static void PacketEncryption()
+		{
+			NetPeerConfiguration config = new NetPeerConfiguration("encryptiontests");
+			config.EnablePacketEncryption = true;
+			config.PacketEncryptionSecret = "TopSecret";
+			config.PingInterval = 0.1f; // pings and pongs are sealed as well
+
+			NetServer server = new NetServer(config.Clone());
+			server.Start();
+			NetClient client = new NetClient(config.Clone());
+			client.Start();
+			client.Connect("127.0.0.1", server.Port);
+
+			Stopwatch waited = Stopwatch.StartNew();
+			int echoed = 0;
+			bool sent = false;
+			while (echoed < 10)
+			{
+				if (waited.Elapsed.TotalSeconds > 10)
+					throw new NetException("Encrypted connection only echoed " + echoed + " messages");
+
+				if (!sent && client.ConnectionStatus == NetConnectionStatus.Connected)
+				{
+					if (!client.ServerConnection.IsPacketEncrypted)
+						throw new NetException("Connection is not encrypted");
+					for (int i = 0; i < 10; i++)
+					{
+						NetOutgoingMessage om = client.CreateMessage();
+						om.Write("secret " + i);
+						client.SendMessage(om, NetDeliveryMethod.ReliableOrdered);
+					}
+					sent = true;
+				}
+
+				NetIncomingMessage inc;
+				while ((inc = server.ReadMessage()) != null)
+				{
+					if (inc.MessageType == NetIncomingMessageType.Data)
+					{
+						NetOutgoingMessage echo = server.CreateMessage();
+						echo.Write(inc.ReadString());
+						server.SendMessage(echo, inc.SenderConnection, NetDeliveryMethod.ReliableOrdered);
+					}
+					server.Recycle(inc);
+				}
+				while ((inc = client.ReadMessage()) != null)
+				{
+					if (inc.MessageType == NetIncomingMessageType.Data)
+					{
+						if (inc.ReadString() != "secret " + echoed)
+							throw new NetException("Encrypted echo out of order or corrupt");
+						echoed++;
+					}
+					client.Recycle(inc);
+				}
+				Thread.Sleep(1);
+			}
+
+			// only the handshake may arrive unsealed, so the goodbye has to be sealed to get through
+			client.Disconnect("bye");
+			waited = Stopwatch.StartNew();
+			while (server.ConnectionsCount > 0)
+			{
+				if (waited.Elapsed.TotalSeconds > 5)
+					throw new NetException("Disconnect over an encrypted connection never arrived");
+
+				NetIncomingMessage inc;
+				while ((inc = server.ReadMessage()) != null)
+					server.Recycle(inc);
+				Thread.Sleep(1);
+			}
+
+			client.Shutdown("bye");
+			server.Shutdown("bye");
+
+			Console.WriteLine("Packet encryption verified");
+		}
+
+		// sealing and opening a full packet, against XTEA encrypting and decrypting a message of the same size
+		private static void PacketThroughput(NetPeer peer)
+		{
+			const int packets = 20000;
+			const int size = 1408;
+
+			byte[] key = new byte[NetChaCha20Poly1305.KeySize];
+			NetRandom.Instance.NextBytes(key);
+			NetChaCha20Poly1305 aead = new NetChaCha20Poly1305(key);
+
+			int payload = size - NetPacketOverhead;
+			byte[] buffer = new byte[size];
+			NetRandom.Instance.NextBytes(buffer);
+
+			Stopwatch watch = Stopwatch.StartNew();
+			for (int i = 0; i < packets; i++)
+			{
+				aead.Seal(0, (ulong)i, buffer, 0, 13, 13, payload);
+				if (!aead.Open(0, (ulong)i, buffer, 0, 13, 13, payload))
+					throw new NetException("Sealed packet did not open");
+			}
+			double chacha = watch.Elapsed.TotalSeconds;
+
+			NetXtea xtea = new NetXtea("TopSecret");
+			byte[] data = new byte[size - 4 - 8]; // room for the length XTEA appends and its padding
+			watch = Stopwatch.StartNew();
+			for (int i = 0; i < packets; i++)
+			{
+				NetOutgoingMessage om = peer.CreateMessage(size);
+				om.Write(data);
+				om.Encrypt(xtea);
+				NetIncomingMessage im = Program.CreateIncomingMessage(om.PeekDataBuffer(), om.LengthBits);
+				im.Decrypt(xtea);
+			}
+			double xteaSeconds = watch.Elapsed.TotalSeconds;
+
+			Console.WriteLine("Encrypt and decrypt " + size + " byte packets: ChaCha20-Poly1305 in place " + (int)(packets / chacha) + " packets/s (" +
+				(int)(packets * (double)size / chacha / 1000000.0) + " MB/s), XTEA " + (int)(packets / xteaSeconds) + " packets/s (" +
+				(int)(packets * (double)size / xteaSeconds / 1000000.0) + " MB/s)");
 		}
+
+		// header, packet counter and tag
+		private const int NetPacketOverhead = 13 + NetChaCha20Poly1305.TagSize;
 	}
 }
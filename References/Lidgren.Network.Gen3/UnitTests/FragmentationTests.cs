@@ -0,0 +1,209 @@
+﻿using System;
+using System.Diagnostics;
+using System.Threading;
+using Lidgren.Network;
+
+namespace UnitTests
+{
+	/// <summary>
+	/// Fragmented messages over loopback: large reliable messages must arrive intact out of pooled storage, and
+	/// a flood of messages that never complete must stay within the reassembly limits and expire
+	/// </summary>
+	public static class FragmentationTests
+	{
+		private const int c_messageBytes = 64 * 1024;
+		private const int c_reliableMessages = 40;
+		private const int c_perConnectionLimit = 256 * 1024;
+		private const int c_globalLimit = 384 * 1024;
+
+		public static void Run()
+		{
+			NetServer server = new NetServer(CreateConfig());
+			server.Start();
+
+			NetClient client = Connect(server);
+
+			// large reliable messages; each must be delivered complete and in order
+			for (int i = 0; i < c_reliableMessages; i++)
+				client.SendMessage(CreatePayload(client, i), NetDeliveryMethod.ReliableOrdered);
+
+			int[] next = new int[1];
+			Stopwatch watch = Stopwatch.StartNew();
+			while (next[0] < c_reliableMessages)
+			{
+				if (watch.Elapsed.TotalSeconds > 30)
+					throw new NetException("Only " + next[0] + " of " + c_reliableMessages + " fragmented messages arrived");
+				Drain(server, next);
+				Drain(client, null);
+				Thread.Sleep(1);
+			}
+
+			if (server.Statistics.ReassemblyBytes != 0)
+				throw new NetException("Reassembly memory still held after every message completed: " + server.Statistics.ReassemblyBytes);
+
+			// the peer tracks the peak itself; reassembling a message takes microseconds, too quick to catch from out here
+			int peak = server.Statistics.ReassemblyBytesPeak;
+			if (peak < c_messageBytes)
+				throw new NetException("Reassembly memory peaked at " + peak + " bytes, less than one message of " + c_messageBytes);
+			if (peak > c_perConnectionLimit)
+				throw new NetException("Reassembly memory peaked at " + peak + " bytes, over the per connection limit of " + c_perConnectionLimit);
+
+			// recycled messages hand their reassembly buffers to the next ones; one at a time, since how many the burst
+			// above holds at once depends on how far the reading thread falls behind
+			long allocatedBefore = server.Statistics.StorageBytesAllocated;
+			for (int i = c_reliableMessages; i < c_reliableMessages * 2; i++)
+			{
+				client.SendMessage(CreatePayload(client, i), NetDeliveryMethod.ReliableOrdered);
+				while (next[0] <= i)
+				{
+					if (watch.Elapsed.TotalSeconds > 60)
+						throw new NetException("Only " + next[0] + " of " + (c_reliableMessages * 2) + " fragmented messages arrived");
+					Drain(server, next);
+					Drain(client, null);
+					Thread.Sleep(1);
+				}
+			}
+
+			long allocated = server.Statistics.StorageBytesAllocated - allocatedBefore;
+			if (allocated >= c_messageBytes)
+				throw new NetException("Reassembly allocated " + allocated + " bytes for " + c_reliableMessages + " messages received one by one; buffers are not being reused");
+
+			Console.WriteLine("Fragmentation tests OK");
+			Console.WriteLine("Reassembled " + (c_reliableMessages * 2) + " x " + c_messageBytes + " bytes, " + allocated + " bytes allocated once buffers were pooled, peak held " + peak);
+
+#if DEBUG
+			Flood(server, client);
+#else
+			Console.WriteLine("Fragment flood test needs the loss simulation of a DEBUG build; skipped");
+#endif
+
+			// a reliable message that can't be reassembled is lost for good, which has to take the connection with it
+			NetOutgoingMessage oversized = client.CreateMessage(c_perConnectionLimit + 1);
+			oversized.Write(new byte[c_perConnectionLimit + 1]);
+			client.SendMessage(oversized, NetDeliveryMethod.ReliableOrdered);
+
+			watch = Stopwatch.StartNew();
+			while (client.ConnectionStatus != NetConnectionStatus.Disconnected)
+			{
+				if (watch.Elapsed.TotalSeconds > 10)
+					throw new NetException("Reliable message over MaximumReassemblyBytesPerConnection didn't disconnect");
+				Drain(server, null);
+				Drain(client, null);
+				Thread.Sleep(10);
+			}
+			Console.WriteLine("Unreassemblable reliable message disconnected");
+
+			client.Shutdown("bye");
+			server.Shutdown("bye");
+		}
+
+#if DEBUG
+		// two lossy clients pour unreliable fragmented messages at the server; nearly none complete
+		private static void Flood(NetServer server, NetClient first)
+		{
+			NetClient second = Connect(server);
+			first.Configuration.SimulatedLoss = 0.3f;
+			second.Configuration.SimulatedLoss = 0.3f;
+
+			for (int i = 0; i < 100; i++)
+			{
+				first.SendMessage(CreatePayload(first, i), NetDeliveryMethod.Unreliable);
+				second.SendMessage(CreatePayload(second, i), NetDeliveryMethod.Unreliable);
+			}
+
+			Stopwatch watch = Stopwatch.StartNew();
+			while (watch.Elapsed.TotalSeconds < 3.0)
+			{
+				Drain(server, null);
+				Drain(first, null);
+				Drain(second, null);
+				Thread.Sleep(1);
+			}
+
+			int peak = server.Statistics.ReassemblyBytesPeak;
+			if (peak > c_globalLimit)
+				throw new NetException("Reassembly memory peaked at " + peak + " bytes under a fragment flood, over the limit of " + c_globalLimit);
+
+			if (server.Statistics.FragmentGroupsAbandoned + server.Statistics.FragmentGroupsDropped == 0)
+				throw new NetException("Fragment flood never reached the reassembly limits");
+
+			// incomplete groups go stale and are abandoned
+			while (server.Statistics.ReassemblyBytes != 0)
+			{
+				if (watch.Elapsed.TotalSeconds > 10)
+					throw new NetException("Stale fragment groups never expired; " + server.Statistics.ReassemblyBytes + " bytes still held");
+				Drain(server, null);
+				Thread.Sleep(10);
+			}
+
+			Console.WriteLine("Fragment flood peaked at " + peak + " bytes held; " + server.Statistics.FragmentGroupsAbandoned + " groups abandoned, " +
+				server.Statistics.FragmentGroupsDropped + " dropped");
+
+			second.Shutdown("bye");
+		}
+#endif
+
+		private static NetPeerConfiguration CreateConfig()
+		{
+			NetPeerConfiguration config = new NetPeerConfiguration("fragmentationtests");
+			config.MaximumReassemblyBytesPerConnection = c_perConnectionLimit;
+			config.MaximumReassemblyBytes = c_globalLimit;
+			config.FragmentGroupTimeout = 1.0f;
+			return config;
+		}
+
+		private static NetClient Connect(NetServer server)
+		{
+			NetPeerConfiguration config = CreateConfig();
+			config.ResendHandshakeInterval = 0.5f;
+
+			NetClient client = new NetClient(config);
+			client.Start();
+			client.Connect("127.0.0.1", server.Port);
+
+			Stopwatch waited = Stopwatch.StartNew();
+			while (client.ConnectionStatus != NetConnectionStatus.Connected)
+			{
+				if (waited.Elapsed.TotalSeconds > 20)
+					throw new NetException("Client never connected");
+				Drain(server, null);
+				Drain(client, null);
+				Thread.Sleep(10);
+			}
+			return client;
+		}
+
+		private static NetOutgoingMessage CreatePayload(NetPeer peer, int nr)
+		{
+			NetOutgoingMessage om = peer.CreateMessage(c_messageBytes);
+			om.Write(nr);
+			for (int i = 4; i < c_messageBytes; i++)
+				om.Write((byte)(nr + i));
+			return om;
+		}
+
+		private static void Drain(NetPeer peer, int[] next)
+		{
+			NetIncomingMessage inc;
+			while ((inc = peer.ReadMessage()) != null)
+			{
+				if (inc.MessageType == NetIncomingMessageType.Data && next != null)
+				{
+					if (inc.LengthBytes != c_messageBytes)
+						throw new NetException("Fragmented message reassembled to " + inc.LengthBytes + " bytes, expected " + c_messageBytes);
+
+					int nr = inc.ReadInt32();
+					if (nr != next[0])
+						throw new NetException("Fragmented message " + nr + " arrived when expecting " + next[0]);
+					for (int i = 4; i < c_messageBytes; i++)
+					{
+						if (inc.ReadByte() != (byte)(nr + i))
+							throw new NetException("Fragmented message " + nr + " corrupt at byte " + i);
+					}
+					next[0]++;
+				}
+				peer.Recycle(inc);
+			}
+		}
+	}
+}
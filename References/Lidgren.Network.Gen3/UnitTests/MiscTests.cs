@@ -18,6 +18,14 @@ namespace UnitTests
 			if (config.IsMessageTypeEnabled(NetIncomingMessageType.UnconnectedData) == true)
 				throw new NetException("setting enabled message types failed");
 
+			// storage comes in power of two size classes
+			int requests = peer.Statistics.StoragePoolMisses + peer.Statistics.StoragePoolHits;
+			NetOutgoingMessage om = peer.CreateMessage(100);
+			if (om.PeekDataBuffer().Length != 128)
+				throw new NetException("storage not rounded up to its size class");
+			if (peer.Statistics.StoragePoolMisses + peer.Statistics.StoragePoolHits != requests + 1)
+				throw new NetException("storage pool statistics not updated");
+
 			Console.WriteLine("Misc tests OK");
 			
 			Console.WriteLine("Hex test: " + NetUtility.ToHexString(new byte[]{0xDE,0xAD,0xBE,0xEF}));
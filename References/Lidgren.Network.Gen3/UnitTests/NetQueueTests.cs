@@ -1,5 +1,6 @@
 ﻿using System;
 using System.Collections.Generic;
+using System.Threading;
 using Lidgren.Network;
 
 namespace UnitTests
@@ -80,6 +81,116 @@ namespace UnitTests
 				throw new Exception("NetQueue.ToArray failure");
 
 			Console.WriteLine("NetQueue tests OK");
+
+			RingQueueTests();
+			RingQueueStressTest(4, 4, 200000);
+
+			Console.WriteLine("Lock free queue stress tests OK");
+		}
+
+		private static void RingQueueTests()
+		{
+			NetRingQueue<int> ring = new NetRingQueue<int>(3);
+			if (ring.Capacity != 4)
+				throw new Exception("NetRingQueue capacity not rounded up to power of two");
+
+			int a;
+			if (ring.TryDequeue(out a) || !ring.IsEmpty)
+				throw new Exception("NetRingQueue not empty");
+
+			// go around a few times to cover wrapping
+			for (int lap = 0; lap < 3; lap++)
+			{
+				for (int i = 0; i < 4; i++)
+					if (!ring.TryEnqueue(i))
+						throw new Exception("NetRingQueue.TryEnqueue failed");
+
+				if (ring.TryEnqueue(4))
+					throw new Exception("NetRingQueue.TryEnqueue succeeded when full");
+				if (ring.Count != 4 || !ring.Contains(2) || ring.Contains(4))
+					throw new Exception("NetRingQueue Count/Contains failure");
+
+				for (int i = 0; i < 4; i++)
+					if (!ring.TryDequeue(out a) || a != i)
+						throw new Exception("NetRingQueue.TryDequeue failure");
+
+				if (ring.TryDequeue(out a) || ring.Count != 0)
+					throw new Exception("NetRingQueue not empty");
+			}
 		}
+
+		/// <summary>
+		/// Many producers and consumers hammering one ring; every item must come out exactly once
+		/// </summary>
+		private static void RingQueueStressTest(int producers, int consumers, int itemsPerProducer)
+		{
+			NetRingQueue<int> ring = new NetRingQueue<int>(64);
+			int[] seen = new int[producers * itemsPerProducer];
+			int consumed = 0;
+			int total = seen.Length;
+
+			List<ThreadStart> threads = new List<ThreadStart>();
+			for (int p = 0; p < producers; p++)
+			{
+				int first = p * itemsPerProducer;
+				threads.Add(() =>
+				{
+					for (int i = 0; i < itemsPerProducer; i++)
+						while (!ring.TryEnqueue(first + i))
+							Thread.Yield();
+				});
+			}
+			for (int c = 0; c < consumers; c++)
+			{
+				threads.Add(() =>
+				{
+					int item;
+					while (Thread.VolatileRead(ref consumed) < total)
+					{
+						if (ring.TryDequeue(out item))
+						{
+							Interlocked.Increment(ref seen[item]);
+							Interlocked.Increment(ref consumed);
+						}
+						else
+						{
+							Thread.Yield();
+						}
+					}
+				});
+			}
+
+			RunAll(threads);
+
+			for (int i = 0; i < seen.Length; i++)
+				if (seen[i] != 1)
+					throw new Exception("NetRingQueue stress failure; item " + i + " seen " + seen[i] + " times");
+		}
+
+		private static void RunAll(List<ThreadStart> bodies)
+		{
+			// an exception on another thread would take the process down, so carry it back here
+			Exception failure = null;
+			List<Thread> threads = new List<Thread>();
+
+			foreach (ThreadStart body in bodies)
+			{
+				ThreadStart run = body;
+				threads.Add(new Thread(() =>
+				{
+					try { run(); }
+					catch (Exception ex) { failure = ex; }
+				}));
+			}
+
+			foreach (Thread thread in threads)
+				thread.Start();
+			foreach (Thread thread in threads)
+				thread.Join();
+
+			if (failure != null)
+				throw failure;
+		}
+
 	}
 }
@@ -19,6 +19,8 @@ namespace UnitTests
 
 			ReadWriteTests.Run(peer);
 
+			BitStreamTests.Run(peer);
+
 			NetQueueTests.Run();
 
 			MiscTests.Run(peer);
@@ -27,6 +29,16 @@ namespace UnitTests
 
 			EncryptionTests.Run(peer);
 
+			BroadcastTests.Run();
+
+			SocketTests.Run();
+
+			CongestionTests.Run();
+
+			SelectiveAckTests.Run();
+
+			FragmentationTests.Run();
+
 			var om = peer.CreateMessage();
 			peer.SendUnconnectedMessage(om, new IPEndPoint(IPAddress.Loopback, 14242));
 			try
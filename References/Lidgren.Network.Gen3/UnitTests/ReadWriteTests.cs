@@ -141,6 +141,28 @@ namespace UnitTests
 			for (int i = 0; i < tmparr.Length; i++)
 				if (tmparr[i] != result[i])
 					throw new Exception("readbytes fail");
+
+			// test unaligned WriteBytes/ReadBytes and wide values
+			msg = peer.CreateMessage();
+			msg.Write(true);
+			msg.Write(tmparr);
+			msg.Write((ulong)0x0123456789abcdefUL, 61);
+			msg.Write(-5000000000L);
+			msg.Write((ulong)0xfedcba9876543210UL, 40);
+
+			inc = Program.CreateIncomingMessage(msg.PeekDataBuffer(), msg.LengthBits);
+			if (inc.ReadBoolean() != true)
+				throw new Exception("unaligned readbytes fail");
+			result = inc.ReadBytes(tmparr.Length);
+			for (int i = 0; i < tmparr.Length; i++)
+				if (tmparr[i] != result[i])
+					throw new Exception("unaligned readbytes fail");
+			if (inc.PeekUInt64(61) != 0x0123456789abcdefUL || inc.ReadUInt64(61) != 0x0123456789abcdefUL)
+				throw new Exception("unaligned 61 bit read fail");
+			if (inc.ReadInt64() != -5000000000L)
+				throw new Exception("unaligned 64 bit read fail");
+			if (inc.ReadUInt64(40) != 0x9876543210UL)
+				throw new Exception("unaligned 40 bit read fail");
 		}
 	}
 
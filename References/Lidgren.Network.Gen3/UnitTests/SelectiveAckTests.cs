@@ -0,0 +1,125 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading;
+using Lidgren.Network;
+
+namespace UnitTests
+{
+	/// <summary>
+	/// Delivery latency of a paced reliable ordered stream over a simulated lossy link, with and without selective acks
+	/// </summary>
+	public static class SelectiveAckTests
+	{
+		private const int c_messages = 1000;
+		private const double c_interval = 0.005;
+		private const float c_loss = 0.02f;
+		private const float c_latency = 0.03f;
+
+		public static void Run()
+		{
+#if DEBUG
+			double[] without = RunStream(false);
+			double[] with = RunStream(true);
+
+			Console.WriteLine("Selective ack tests OK");
+			Console.WriteLine("Reliable ordered delivery at " + (c_loss * 100.0f) + "% loss, " + (c_latency * 1000.0f) + " ms: without selective acks p50 " +
+				Format(Percentile(without, 0.5)) + " p99 " + Format(Percentile(without, 0.99)) + "; selective acks p50 " +
+				Format(Percentile(with, 0.5)) + " p99 " + Format(Percentile(with, 0.99)));
+#else
+			Console.WriteLine("Selective ack tests need the latency simulation of a DEBUG build; skipped");
+#endif
+		}
+
+#if DEBUG
+		private static NetPeerConfiguration CreateConfig(bool selectiveAcks)
+		{
+			NetPeerConfiguration config = new NetPeerConfiguration("selectiveacktests");
+			config.EnableSelectiveAcks = selectiveAcks;
+			config.SimulatedLoss = c_loss;
+			config.SimulatedMinimumLatency = c_latency;
+			config.SimulatedRandomLatency = c_latency * 0.3f;
+			return config;
+		}
+
+		// returns the delivery latency of each message, in seconds, sorted
+		private static double[] RunStream(bool selectiveAcks)
+		{
+			NetServer server = new NetServer(CreateConfig(selectiveAcks));
+			server.Start();
+
+			NetClient client = new NetClient(CreateConfig(selectiveAcks));
+			client.Start();
+			client.Connect("127.0.0.1", server.Port);
+
+			Stopwatch waited = Stopwatch.StartNew();
+			while (client.ConnectionStatus != NetConnectionStatus.Connected)
+			{
+				if (waited.Elapsed.TotalSeconds > 20)
+					throw new NetException("Client never connected over the simulated link");
+				Drain(server, null);
+				Drain(client, null);
+				Thread.Sleep(10);
+			}
+
+			// both ends share NetTime, so the send time travels in the message
+			byte[] padding = new byte[64];
+			List<double> latencies = new List<double>(c_messages);
+			Stopwatch watch = Stopwatch.StartNew();
+			int sent = 0;
+			while (latencies.Count < c_messages)
+			{
+				if (watch.Elapsed.TotalSeconds > 60)
+					throw new NetException("Only " + latencies.Count + " of " + c_messages + " reliable messages arrived (selective acks " + selectiveAcks + ")");
+
+				while (sent < c_messages && watch.Elapsed.TotalSeconds >= sent * c_interval)
+				{
+					NetOutgoingMessage om = client.CreateMessage(12 + padding.Length);
+					om.Write(sent++);
+					om.Write(NetTime.Now);
+					om.Write(padding);
+					client.SendMessage(om, NetDeliveryMethod.ReliableOrdered);
+				}
+
+				Drain(server, latencies);
+				Drain(client, null);
+				Thread.Sleep(1);
+			}
+
+			client.Shutdown("bye");
+			server.Shutdown("bye");
+
+			double[] retval = latencies.ToArray();
+			Array.Sort(retval);
+			return retval;
+		}
+
+		private static void Drain(NetPeer peer, List<double> latencies)
+		{
+			NetIncomingMessage inc;
+			while ((inc = peer.ReadMessage()) != null)
+			{
+				if (inc.MessageType == NetIncomingMessageType.Data && latencies != null)
+				{
+					int nr = inc.ReadInt32();
+					if (nr != latencies.Count)
+						throw new NetException("Reliable ordered message " + nr + " arrived when expecting " + latencies.Count);
+					latencies.Add(NetTime.Now - inc.ReadDouble());
+				}
+				peer.Recycle(inc);
+			}
+		}
+
+		private static double Percentile(double[] sorted, double p)
+		{
+			int index = (int)Math.Ceiling(p * sorted.Length) - 1;
+			return sorted[Math.Max(0, Math.Min(sorted.Length - 1, index))];
+		}
+
+		private static string Format(double seconds)
+		{
+			return (seconds * 1000.0).ToString("F1") + " ms";
+		}
+#endif
+	}
+}
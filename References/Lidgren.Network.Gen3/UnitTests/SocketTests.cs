@@ -0,0 +1,138 @@
+﻿using System;
+using System.Diagnostics;
+using System.Net;
+using System.Threading;
+using Lidgren.Network;
+
+namespace UnitTests
+{
+	/// <summary>
+	/// Raw datagram throughput over loopback, with and without batched socket I/O
+	/// </summary>
+	public static class SocketTests
+	{
+		private const int c_packets = 200000;
+
+		// packets in flight; enough to keep both network threads busy without overrunning the receive buffer
+		private const int c_window = 2048;
+
+		public static void Run()
+		{
+			OversizedBatchedSend();
+
+			double single = PacketsPerSecond(false);
+			double batched = PacketsPerSecond(true);
+
+			Console.WriteLine("Loopback datagrams: one call per datagram " + (int)single + " packets/s, batched (recvmmsg/sendmmsg where available) " +
+				(int)batched + " packets/s (" + (batched / single).ToString("F2") + "x)");
+		}
+
+		/// <summary>
+		/// A packet too large for a batched send slot has to go out unbatched rather than fail on the network thread
+		/// </summary>
+		private static void OversizedBatchedSend()
+		{
+			NetPeerConfiguration config = new NetPeerConfiguration("sockettests");
+			config.EnableMessageType(NetIncomingMessageType.UnconnectedData);
+			NetPeer receiver = new NetPeer(config);
+			receiver.Start();
+
+			NetPeerConfiguration senderConfig = new NetPeerConfiguration("sockettests");
+			senderConfig.EnableBatchedSocketIO = true;
+			senderConfig.MaximumTransmissionUnit = 8191;
+			NetPeer sender = new NetPeer(senderConfig);
+			sender.Start();
+
+			NetOutgoingMessage om = sender.CreateMessage(8190);
+			om.Write(new byte[8190]);
+			sender.SendUnconnectedMessage(om, new IPEndPoint(IPAddress.Loopback, receiver.Port));
+
+			int length = -1;
+			Stopwatch watch = Stopwatch.StartNew();
+			while (length < 0 && watch.Elapsed.TotalSeconds < 2)
+			{
+				NetIncomingMessage inc = receiver.ReadMessage();
+				if (inc == null)
+				{
+					Thread.Sleep(1);
+					continue;
+				}
+				if (inc.MessageType == NetIncomingMessageType.UnconnectedData)
+					length = inc.LengthBytes;
+				receiver.Recycle(inc);
+			}
+
+			sender.Shutdown("bye");
+			receiver.Shutdown("bye");
+
+			if (length != 8190)
+				throw new NetException("Oversized packet from a batched sender didn't arrive");
+		}
+
+		private static double PacketsPerSecond(bool batched)
+		{
+			NetPeerConfiguration config = new NetPeerConfiguration("sockettests");
+			config.EnableBatchedSocketIO = batched;
+			config.EnableMessageType(NetIncomingMessageType.UnconnectedData);
+			config.ReceiveBufferSize = 1024 * 1024;
+			NetPeer receiver = new NetPeer(config);
+			receiver.Start();
+
+			NetPeerConfiguration senderConfig = new NetPeerConfiguration("sockettests");
+			senderConfig.EnableBatchedSocketIO = batched;
+			NetPeer sender = new NetPeer(senderConfig);
+			sender.Start();
+
+			IPEndPoint target = new IPEndPoint(IPAddress.Loopback, receiver.Port);
+
+			int sent = 0;
+			int received = 0;
+			double lastReceived = 0;
+			Stopwatch watch = Stopwatch.StartNew();
+			Stopwatch idle = Stopwatch.StartNew();
+
+			// anything lost stalls the window; give up after a second without progress
+			while (received < c_packets && idle.Elapsed.TotalSeconds < 1)
+			{
+				while (sent < c_packets && sent - received < c_window)
+				{
+					NetOutgoingMessage om = sender.CreateMessage(4);
+					om.Write(sent++);
+					sender.SendUnconnectedMessage(om, target);
+				}
+
+				bool any = false;
+				NetIncomingMessage inc;
+				while ((inc = receiver.ReadMessage()) != null)
+				{
+					if (inc.MessageType == NetIncomingMessageType.UnconnectedData)
+					{
+						received++;
+						any = true;
+					}
+					receiver.Recycle(inc);
+				}
+
+				if (any)
+				{
+					lastReceived = watch.Elapsed.TotalSeconds;
+					idle.Restart();
+				}
+				else
+				{
+					Thread.Sleep(0);
+				}
+			}
+
+			if (received < sent)
+				Console.WriteLine("Lost " + (sent - received) + " of " + sent + " loopback datagrams (batched " + batched + ")");
+			if (received == 0)
+				throw new NetException("No datagrams arrived over loopback (batched " + batched + ")");
+
+			sender.Shutdown("bye");
+			receiver.Shutdown("bye");
+
+			return received / lastReceived;
+		}
+	}
+}